@@ -15,7 +15,43 @@ document.addEventListener("DOMContentLoaded", function() {
 
 
     const websocket = new WebSocket("ws://localhost:9000/ws")
+    websocket.binaryType = "arraybuffer";
+
+    // fMP4 fallback, fed over the same websocket when WebRTC does not connect
+    let mse = null;
+    const startFmp4 = () => {
+        if (mse || !window.MediaSource) {
+            return;
+        }
+        console.log("WebRTC unavailable, falling back to fMP4");
+        mse = {source: new MediaSource(), buffer: null, pending: [], appended: 0};
+        videoElement.srcObject = null;
+        videoElement.src = URL.createObjectURL(mse.source);
+        mse.source.addEventListener("sourceopen", () => websocket.send(JSON.stringify({action: "fmp4"})));
+    };
+    const appendFmp4 = () => {
+        if (!mse.buffer || mse.buffer.updating || mse.pending.length == 0) {
+            return;
+        }
+        mse.buffer.appendBuffer(mse.pending.shift());
+    };
+    setTimeout(() => {
+        if (!videoElement.srcObject) {
+            startFmp4();
+        }
+    }, 5000);
+    peerconnection.onconnectionstatechange = () => {
+        if (peerconnection.connectionState == "failed") {
+            startFmp4();
+        }
+    };
+
     websocket.onmessage = (message)=> {
+        if (message.data instanceof ArrayBuffer) {
+            mse.pending.push(message.data);
+            appendFmp4();
+            return;
+        }
         const messageObj = JSON.parse(message.data);
             console.log(messageObj.action)
         if ("action" in messageObj){
@@ -33,6 +69,28 @@ document.addEventListener("DOMContentLoaded", function() {
                 });
             }else if (messageObj.action == "ice"){
                 peerconnection.addIceCandidate(new RTCIceCandidate(messageObj.params));
+            }else if (messageObj.action == "fmp4"){
+                // Init segment follows, with its MSE type
+                if (!mse.buffer) {
+                    mse.buffer = mse.source.addSourceBuffer(messageObj.params.mime);
+                    mse.buffer.mode = "segments";
+                    mse.buffer.addEventListener("updateend", () => {
+                        mse.appended++;
+                        websocket.send(JSON.stringify({action: "fmp4-ack", params: {appended: mse.appended}}));
+                        // Stay on the live edge
+                        const buffered = mse.buffer.buffered;
+                        if (buffered.length > 0 && buffered.end(buffered.length - 1) - videoElement.currentTime > 1) {
+                            videoElement.currentTime = buffered.end(buffered.length - 1) - 0.2;
+                        }
+                        appendFmp4();
+                    });
+                }
+                videoElement.play();
+            }else if (messageObj.action == "fmp4-evicted"){
+                // Too far behind, resubscribe from the next GOP
+                mse.pending = [];
+                mse.appended = 0;
+                websocket.send(JSON.stringify({action: "fmp4"}));
             }
         }else {
             console.log("Wrong message format");
@@ -51,6 +109,10 @@ document.addEventListener("DOMContentLoaded", function() {
 
     websocket.onopen = () => {
         console.log("send create stream");
-        websocket.send('{"action": "play"}');
+        // Codecs this browser decodes, the preview transcodes when needed
+        const codecs = RTCRtpReceiver.getCapabilities("video").codecs
+            .map((codec) => codec.mimeType.split("/")[1])
+            .filter((name, index, names) => names.indexOf(name) === index);
+        websocket.send(JSON.stringify({action: "play", params: {codecs: codecs}}));
     }
 });
\ No newline at end of file
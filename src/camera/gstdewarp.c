@@ -0,0 +1,436 @@
+#include "gstdewarp.h"
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <common/gstworkpool.h>
+
+#include "gstremap.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_dewarp_debug);
+#define GST_CAT_DEFAULT gst_dewarp_debug
+
+#define gst_dewarp_parent_class parent_class
+
+/* tools/cameragl/dewarp/undistort.py */
+#define DEFAULT_FX 1006.47899
+#define DEFAULT_FY 998.616258
+#define DEFAULT_CX 1012.63906
+#define DEFAULT_CY 538.428063
+#define DEFAULT_K1 -0.04836358
+#define DEFAULT_K2 0.0476189
+#define DEFAULT_K3 -0.136679
+#define DEFAULT_K4 0.08632943
+#define DEFAULT_CALIBRATION_WIDTH 1920
+#define DEFAULT_CALIBRATION_HEIGHT 1080
+#define DEFAULT_SCALE 1.0
+
+/* output rows per job, and columns per tile within them, so the source
+ * read by a tile stays in cache */
+#define BAND_ROWS 32
+#define TILE_WIDTH 128
+
+#define DEWARP_CAPS GST_VIDEO_CAPS_MAKE ("{ I420, NV12, BGRA, RGBA, BGRx, RGBx }")
+
+/* properties */
+enum
+{
+  PROP_0,
+  PROP_FX,
+  PROP_FY,
+  PROP_CX,
+  PROP_CY,
+  PROP_K1,
+  PROP_K2,
+  PROP_K3,
+  PROP_K4,
+  PROP_CALIBRATION_WIDTH,
+  PROP_CALIBRATION_HEIGHT,
+  PROP_SCALE,
+  PROP_CALIBRATION_FILE,
+  PROP_STATS,
+};
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (DEWARP_CAPS));
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (DEWARP_CAPS));
+
+/* Undistorts fisheye frames with the calibration of the camera. The
+ * source position of every output sample is computed once per calibration
+ * and caps in a fixed point table, each frame is then sampled from it in
+ * bands of tiles spread on the shared work pool. */
+struct _GstDewarp
+{
+  GstVideoFilter parent_instance;
+
+  /* under the object lock */
+  GstFisheyeCalibration calibration;
+  gdouble scale;
+  gchar *calibration_file;
+  gboolean dirty;
+  guint64 frames;
+  GstClockTime frame_time;
+  GstClockTime table_time;
+
+  /* from the streaming thread, chroma planes share their table */
+  GstRemapTable *tables[GST_VIDEO_MAX_PLANES];
+  guint8 fill[GST_VIDEO_MAX_PLANES][4];
+  gint channels[GST_VIDEO_MAX_PLANES];
+  gint band_rows[GST_VIDEO_MAX_PLANES];
+  guint n_planes;
+  guint n_bands;
+};
+
+typedef struct
+{
+  GstDewarp *self;
+  GstVideoFrame *in;
+  GstVideoFrame *out;
+} GstDewarpFrame;
+
+G_DEFINE_TYPE(GstDewarp, gst_dewarp, GST_TYPE_VIDEO_FILTER);
+
+
+static void gst_dewarp_clear_tables(GstDewarp *self)
+{
+  for (guint p = 0; p < GST_VIDEO_MAX_PLANES; p++){
+    if (self->tables[p] && (p == 0 || self->tables[p] != self->tables[p - 1]))
+      gst_remap_table_free(self->tables[p]);
+  }
+  memset(self->tables, 0, sizeof(self->tables));
+}
+
+static void gst_dewarp_build_tables(GstDewarp *self, GstVideoInfo *info)
+{
+  const GstVideoFormatInfo *finfo = info->finfo;
+  GstFisheyeCalibration calibration;
+  gdouble scale;
+  gint64 started = g_get_monotonic_time();
+
+  GST_OBJECT_LOCK(self);
+  gst_fisheye_calibration_scale(&self->calibration, GST_VIDEO_INFO_WIDTH(info), GST_VIDEO_INFO_HEIGHT(info), &calibration);
+  scale = self->scale;
+  self->dirty = FALSE;
+  GST_OBJECT_UNLOCK(self);
+
+  gst_dewarp_clear_tables(self);
+  self->n_planes = GST_VIDEO_INFO_N_PLANES(info);
+
+  for (guint p = 0; p < self->n_planes; p++){
+    /* first component of the plane, its chroma shares the sampling */
+    guint comp = p == 0 ? 0 : p;
+    gint w_sub, h_sub;
+
+    if (GST_VIDEO_FORMAT_INFO_N_PLANES(finfo) == 2)
+      comp = p == 0 ? 0 : 1;
+    w_sub = GST_VIDEO_FORMAT_INFO_W_SUB(finfo, comp);
+    h_sub = GST_VIDEO_FORMAT_INFO_H_SUB(finfo, comp);
+
+    self->channels[p] = GST_VIDEO_INFO_COMP_PSTRIDE(info, comp);
+    self->band_rows[p] = BAND_ROWS >> h_sub;
+    if (GST_VIDEO_FORMAT_INFO_IS_YUV(finfo))
+      memset(self->fill[p], p == 0 ? 16 : 128, sizeof(self->fill[p]));
+    else
+      memcpy(self->fill[p], (guint8[]) {0, 0, 0, 255}, sizeof(self->fill[p]));
+
+    if (p > 1 && self->channels[p] == self->channels[p - 1] && self->band_rows[p] == self->band_rows[p - 1])
+      self->tables[p] = self->tables[p - 1];
+    else
+      self->tables[p] = gst_remap_table_new_undistort(&calibration, scale,
+          GST_VIDEO_INFO_COMP_WIDTH(info, comp), GST_VIDEO_INFO_COMP_HEIGHT(info, comp), 1 << w_sub, 1 << h_sub);
+  }
+  self->n_bands = (GST_VIDEO_INFO_HEIGHT(info) + BAND_ROWS - 1) / BAND_ROWS;
+
+  GST_OBJECT_LOCK(self);
+  self->table_time = (g_get_monotonic_time() - started) * GST_USECOND;
+  GST_OBJECT_UNLOCK(self);
+
+  GST_DEBUG_OBJECT(self, "Remap tables of %dx%d built in %" GST_TIME_FORMAT,
+      GST_VIDEO_INFO_WIDTH(info), GST_VIDEO_INFO_HEIGHT(info), GST_TIME_ARGS(self->table_time));
+}
+
+static void gst_dewarp_band_func(gpointer data, guint band)
+{
+  GstDewarpFrame *frame = data;
+  GstDewarp *self = frame->self;
+
+  for (guint p = 0; p < self->n_planes; p++){
+    GstRemapTable *table = self->tables[p];
+    gint rows = self->band_rows[p];
+
+    for (gint x = 0; x < table->width; x += TILE_WIDTH){
+      gst_remap_table_apply(table,
+          GST_VIDEO_FRAME_PLANE_DATA(frame->in, p), GST_VIDEO_FRAME_PLANE_STRIDE(frame->in, p),
+          GST_VIDEO_FRAME_PLANE_DATA(frame->out, p), GST_VIDEO_FRAME_PLANE_STRIDE(frame->out, p),
+          self->channels[p], self->fill[p], x, band * rows, TILE_WIDTH, rows);
+    }
+  }
+}
+
+static GstFlowReturn gst_dewarp_transform_frame(GstVideoFilter *filter, GstVideoFrame *in, GstVideoFrame *out)
+{
+  GstDewarp *self = GST_DEWARP(filter);
+  GstDewarpFrame frame = { self, in, out };
+  gint64 started = g_get_monotonic_time();
+  GstClockTime elapsed;
+  gboolean dirty;
+
+  GST_OBJECT_LOCK(self);
+  dirty = self->dirty;
+  GST_OBJECT_UNLOCK(self);
+
+  /* the calibration changed while playing */
+  if (dirty)
+    gst_dewarp_build_tables(self, &filter->in_info);
+
+  gst_work_pool_parallel(gst_work_pool_get_default(), self->n_bands, gst_dewarp_band_func, &frame);
+
+  elapsed = (g_get_monotonic_time() - started) * GST_USECOND;
+  GST_OBJECT_LOCK(self);
+  self->frames++;
+  self->frame_time = self->frame_time == 0 ? elapsed : (self->frame_time * 15 + elapsed) / 16;
+  GST_OBJECT_UNLOCK(self);
+
+  return GST_FLOW_OK;
+}
+
+static gboolean gst_dewarp_set_info(GstVideoFilter *filter, GstCaps *incaps, GstVideoInfo *in_info,
+                                    GstCaps *outcaps, GstVideoInfo *out_info)
+{
+  gst_dewarp_build_tables(GST_DEWARP(filter), in_info);
+  return TRUE;
+}
+
+static GstStructure *gst_dewarp_get_stats(GstDewarp *self)
+{
+  GstStructure *stats;
+
+  GST_OBJECT_LOCK(self);
+  stats = gst_structure_new("dewarp-stats",
+      "frames", G_TYPE_UINT64, self->frames,
+      "frame-time", G_TYPE_UINT64, self->frame_time,
+      "table-time", G_TYPE_UINT64, self->table_time,
+      NULL);
+  GST_OBJECT_UNLOCK(self);
+
+  return stats;
+}
+
+static void gst_dewarp_init(GstDewarp *self)
+{
+  self->calibration.fx = DEFAULT_FX;
+  self->calibration.fy = DEFAULT_FY;
+  self->calibration.cx = DEFAULT_CX;
+  self->calibration.cy = DEFAULT_CY;
+  self->calibration.k[0] = DEFAULT_K1;
+  self->calibration.k[1] = DEFAULT_K2;
+  self->calibration.k[2] = DEFAULT_K3;
+  self->calibration.k[3] = DEFAULT_K4;
+  self->calibration.width = DEFAULT_CALIBRATION_WIDTH;
+  self->calibration.height = DEFAULT_CALIBRATION_HEIGHT;
+  self->scale = DEFAULT_SCALE;
+}
+
+static void gst_dewarp_set_property(GObject *object,
+                                    guint prop_id,
+                                    const GValue *value,
+                                    GParamSpec *pspec){
+    GstDewarp *self = GST_DEWARP(object);
+    GError *error = NULL;
+
+    GST_OBJECT_LOCK(self);
+    switch (prop_id) {
+        case PROP_FX:
+            self->calibration.fx = g_value_get_double(value);
+            break;
+        case PROP_FY:
+            self->calibration.fy = g_value_get_double(value);
+            break;
+        case PROP_CX:
+            self->calibration.cx = g_value_get_double(value);
+            break;
+        case PROP_CY:
+            self->calibration.cy = g_value_get_double(value);
+            break;
+        case PROP_K1:
+        case PROP_K2:
+        case PROP_K3:
+        case PROP_K4:
+            self->calibration.k[prop_id - PROP_K1] = g_value_get_double(value);
+            break;
+        case PROP_CALIBRATION_WIDTH:
+            self->calibration.width = g_value_get_int(value);
+            break;
+        case PROP_CALIBRATION_HEIGHT:
+            self->calibration.height = g_value_get_int(value);
+            break;
+        case PROP_SCALE:
+            self->scale = g_value_get_double(value);
+            break;
+        case PROP_CALIBRATION_FILE:
+            g_free(self->calibration_file);
+            self->calibration_file = g_value_dup_string(value);
+            if (self->calibration_file && !gst_fisheye_calibration_load(&self->calibration,
+                    &self->scale, self->calibration_file, &error)){
+                GST_WARNING_OBJECT(self, "Cannot load the calibration from %s: %s",
+                    self->calibration_file, error->message);
+                g_clear_error(&error);
+            }
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+    self->dirty = TRUE;
+    GST_OBJECT_UNLOCK(self);
+}
+
+static void gst_dewarp_get_property(GObject *object,
+                                    guint prop_id,
+                                    GValue *value,
+                                    GParamSpec *pspec){
+
+    GstDewarp *self = GST_DEWARP(object);
+
+    if (prop_id == PROP_STATS){
+        g_value_take_boxed(value, gst_dewarp_get_stats(self));
+        return;
+    }
+
+    GST_OBJECT_LOCK(self);
+    switch (prop_id) {
+        case PROP_FX:
+            g_value_set_double(value, self->calibration.fx);
+            break;
+        case PROP_FY:
+            g_value_set_double(value, self->calibration.fy);
+            break;
+        case PROP_CX:
+            g_value_set_double(value, self->calibration.cx);
+            break;
+        case PROP_CY:
+            g_value_set_double(value, self->calibration.cy);
+            break;
+        case PROP_K1:
+        case PROP_K2:
+        case PROP_K3:
+        case PROP_K4:
+            g_value_set_double(value, self->calibration.k[prop_id - PROP_K1]);
+            break;
+        case PROP_CALIBRATION_WIDTH:
+            g_value_set_int(value, self->calibration.width);
+            break;
+        case PROP_CALIBRATION_HEIGHT:
+            g_value_set_int(value, self->calibration.height);
+            break;
+        case PROP_SCALE:
+            g_value_set_double(value, self->scale);
+            break;
+        case PROP_CALIBRATION_FILE:
+            g_value_set_string(value, self->calibration_file);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+    GST_OBJECT_UNLOCK(self);
+}
+
+static void gst_dewarp_finalize(GObject *object)
+{
+  GstDewarp *self = GST_DEWARP(object);
+
+  gst_dewarp_clear_tables(self);
+  g_free(self->calibration_file);
+
+  G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
+static void gst_dewarp_install_double(GObjectClass *object_class, guint prop_id, const gchar *name,
+                                      const gchar *nick, const gchar *blurb, gdouble min, gdouble max, gdouble def)
+{
+  g_object_class_install_property(object_class, prop_id,
+      g_param_spec_double(name, nick, blurb, min, max, def,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_CONTROLLABLE));
+}
+
+static void gst_dewarp_class_init(GstDewarpClass *klass)
+{
+  GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+  GstVideoFilterClass *filter_class = GST_VIDEO_FILTER_CLASS(klass);
+
+  GObjectClass *object_class = G_OBJECT_CLASS(klass);
+  object_class->set_property = gst_dewarp_set_property;
+  object_class->get_property = gst_dewarp_get_property;
+  object_class->finalize = gst_dewarp_finalize;
+
+  filter_class->set_info = gst_dewarp_set_info;
+  filter_class->transform_frame = gst_dewarp_transform_frame;
+
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&src_template));
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&sink_template));
+
+  gst_dewarp_install_double(object_class, PROP_FX, "fx", "Fx",
+      "Focal length along x, in pixels of the calibration", 1, G_MAXDOUBLE, DEFAULT_FX);
+  gst_dewarp_install_double(object_class, PROP_FY, "fy", "Fy",
+      "Focal length along y, in pixels of the calibration", 1, G_MAXDOUBLE, DEFAULT_FY);
+  gst_dewarp_install_double(object_class, PROP_CX, "cx", "Cx",
+      "Optical center column, in pixels of the calibration", -G_MAXDOUBLE, G_MAXDOUBLE, DEFAULT_CX);
+  gst_dewarp_install_double(object_class, PROP_CY, "cy", "Cy",
+      "Optical center row, in pixels of the calibration", -G_MAXDOUBLE, G_MAXDOUBLE, DEFAULT_CY);
+  gst_dewarp_install_double(object_class, PROP_K1, "k1", "K1",
+      "First fisheye distortion coefficient", -G_MAXDOUBLE, G_MAXDOUBLE, DEFAULT_K1);
+  gst_dewarp_install_double(object_class, PROP_K2, "k2", "K2",
+      "Second fisheye distortion coefficient", -G_MAXDOUBLE, G_MAXDOUBLE, DEFAULT_K2);
+  gst_dewarp_install_double(object_class, PROP_K3, "k3", "K3",
+      "Third fisheye distortion coefficient", -G_MAXDOUBLE, G_MAXDOUBLE, DEFAULT_K3);
+  gst_dewarp_install_double(object_class, PROP_K4, "k4", "K4",
+      "Fourth fisheye distortion coefficient", -G_MAXDOUBLE, G_MAXDOUBLE, DEFAULT_K4);
+  gst_dewarp_install_double(object_class, PROP_SCALE, "scale", "Scale",
+      "Focal length of the undistorted view relative to the camera's, below 1 keeps more of the field of view",
+      0.01, 100, DEFAULT_SCALE);
+
+  g_object_class_install_property(object_class, PROP_CALIBRATION_WIDTH,
+      g_param_spec_int("calibration-width", "Calibration width",
+          "Frame width the camera matrix was calibrated at, scaled to the stream",
+          1, G_MAXINT, DEFAULT_CALIBRATION_WIDTH,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(object_class, PROP_CALIBRATION_HEIGHT,
+      g_param_spec_int("calibration-height", "Calibration height",
+          "Frame height the camera matrix was calibrated at, scaled to the stream",
+          1, G_MAXINT, DEFAULT_CALIBRATION_HEIGHT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(object_class, PROP_CALIBRATION_FILE,
+      g_param_spec_string("calibration-file", "Calibration file",
+          "Key file written by calibration.py, overriding the calibration properties",
+          NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(object_class, PROP_STATS,
+      g_param_spec_boxed("stats", "Statistics",
+          "Frames dewarped, average time per frame and time to build the remap tables",
+          GST_TYPE_STRUCTURE,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  GST_DEBUG_CATEGORY_INIT (gst_dewarp_debug, "dewarp", 0,
+      "Dewarp Debug");
+
+  gst_element_class_set_static_metadata(element_class,
+                                        "Dewarp",
+                                        "Filter/Effect/Video",
+                                        "Undistorts fisheye frames with the camera calibration",
+                                        "Ludovic Bouguerra <ludovic.bouguerra@stream.studio>");
+}
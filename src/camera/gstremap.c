@@ -0,0 +1,390 @@
+#include "gstremap.h"
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <string.h>
+
+#define CALIBRATION_GROUP "calibration"
+
+/* one clone per instruction set, the loader resolves them once */
+#if defined(__x86_64__) && defined(__has_attribute)
+#if __has_attribute(target_clones)
+#define KERNEL __attribute__((target_clones("avx2", "default")))
+#endif
+#endif
+#ifndef KERNEL
+#define KERNEL
+#endif
+
+/**
+ * gst_fisheye_calibration_scale:
+ * @calibration: a calibration
+ * @width: frame width
+ * @height: frame height
+ * @scaled: (out): @calibration for frames of @width x @height
+ */
+void
+gst_fisheye_calibration_scale (const GstFisheyeCalibration * calibration,
+    gint width, gint height, GstFisheyeCalibration * scaled)
+{
+  gdouble sx = (gdouble) width / calibration->width;
+  gdouble sy = (gdouble) height / calibration->height;
+
+  *scaled = *calibration;
+  scaled->fx *= sx;
+  scaled->cx *= sx;
+  scaled->fy *= sy;
+  scaled->cy *= sy;
+  scaled->width = width;
+  scaled->height = height;
+}
+
+/**
+ * gst_fisheye_calibration_load:
+ * @calibration: calibration to update
+ * @scale: (out) (optional): focal length scale of the undistorted view,
+ *   left unchanged when the file has none
+ * @location: key file written by calibration.py
+ * @error: return location for a #GError
+ *
+ * Reads the camera matrix K and the distortion D, and the frame size when
+ * present. @calibration is left unchanged on error.
+ */
+gboolean
+gst_fisheye_calibration_load (GstFisheyeCalibration * calibration,
+    gdouble * scale, const gchar * location, GError ** error)
+{
+  GKeyFile *file = g_key_file_new ();
+  gdouble *k = NULL, *d = NULL;
+  gsize n_k = 0, n_d = 0;
+  gboolean ret = FALSE;
+
+  if (!g_key_file_load_from_file (file, location, G_KEY_FILE_NONE, error))
+    goto done;
+
+  k = g_key_file_get_double_list (file, CALIBRATION_GROUP, "K", &n_k, error);
+  if (k == NULL)
+    goto done;
+  d = g_key_file_get_double_list (file, CALIBRATION_GROUP, "D", &n_d, error);
+  if (d == NULL)
+    goto done;
+  if (n_k != 9 || n_d != 4) {
+    g_set_error (error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+        "K needs 9 values and D 4, got %" G_GSIZE_FORMAT " and %"
+        G_GSIZE_FORMAT, n_k, n_d);
+    goto done;
+  }
+
+  calibration->fx = k[0];
+  calibration->cx = k[2];
+  calibration->fy = k[4];
+  calibration->cy = k[5];
+  for (guint i = 0; i < 4; i++)
+    calibration->k[i] = d[i];
+  if (g_key_file_has_key (file, CALIBRATION_GROUP, "width", NULL))
+    calibration->width = MAX (1, g_key_file_get_integer (file,
+            CALIBRATION_GROUP, "width", NULL));
+  if (g_key_file_has_key (file, CALIBRATION_GROUP, "height", NULL))
+    calibration->height = MAX (1, g_key_file_get_integer (file,
+            CALIBRATION_GROUP, "height", NULL));
+  if (scale && g_key_file_has_key (file, CALIBRATION_GROUP, "scale", NULL))
+    *scale = g_key_file_get_double (file, CALIBRATION_GROUP, "scale", NULL);
+  ret = TRUE;
+
+done:
+  g_free (k);
+  g_free (d);
+  g_key_file_free (file);
+  return ret;
+}
+
+/**
+ * gst_fisheye_calibration_project:
+ * @calibration: a calibration
+ * @x: ray, right of the camera
+ * @y: ray, below the camera
+ * @z: ray, along the optical axis
+ * @u: (out): column where the ray is seen
+ * @v: (out): row where the ray is seen
+ */
+void
+gst_fisheye_calibration_project (const GstFisheyeCalibration * calibration,
+    gdouble x, gdouble y, gdouble z, gdouble * u, gdouble * v)
+{
+  const gdouble *k = calibration->k;
+  gdouble r = sqrt (x * x + y * y);
+  gdouble theta, theta2, distorted;
+
+  if (r < 1e-12) {
+    *u = calibration->cx;
+    *v = calibration->cy;
+    return;
+  }
+
+  theta = atan2 (r, z);
+  theta2 = theta * theta;
+  distorted = theta * (1 + theta2 * (k[0] + theta2 * (k[1] + theta2 * (k[2] +
+                  theta2 * k[3]))));
+
+  *u = calibration->fx * distorted * x / r + calibration->cx;
+  *v = calibration->fy * distorted * y / r + calibration->cy;
+}
+
+GstRemapTable *
+gst_remap_table_new (gint width, gint height)
+{
+  GstRemapTable *table = g_new0 (GstRemapTable, 1);
+
+  table->width = width;
+  table->height = height;
+  table->points = g_new0 (GstRemapPoint, (gsize) width * height);
+
+  return table;
+}
+
+/**
+ * gst_remap_table_set:
+ * @table: a table
+ * @x: output column
+ * @y: output row
+ * @u: source column
+ * @v: source row
+ * @src_width: source plane width
+ * @src_height: source plane height
+ *
+ * Points outside the source are filled.
+ */
+void
+gst_remap_table_set (GstRemapTable * table, gint x, gint y, gdouble u,
+    gdouble v, gint src_width, gint src_height)
+{
+  GstRemapPoint *point = &table->points[(gsize) y * table->width + x];
+  gint left, top;
+
+  if (!(u >= 0 && v >= 0 && u <= src_width - 1 && v <= src_height - 1)
+      || src_width < 2 || src_height < 2 || src_width > G_MAXINT16
+      || src_height > G_MAXINT16) {
+    point->x = -1;
+    point->y = -1;
+    point->fx = point->fy = 0;
+    return;
+  }
+
+  /* the right and bottom samples are always there */
+  left = MIN ((gint) u, src_width - 2);
+  top = MIN ((gint) v, src_height - 2);
+  point->x = left;
+  point->y = top;
+  point->fx = MIN (lround ((u - left) * 256), 255);
+  point->fy = MIN (lround ((v - top) * 256), 255);
+}
+
+/**
+ * gst_remap_table_new_undistort:
+ * @calibration: calibration scaled to the frames
+ * @scale: focal length of the undistorted view, relative to the camera's,
+ *   below 1 keeps more of the field of view
+ * @width: plane width
+ * @height: plane height
+ * @subsampling_x: horizontal subsampling of the plane
+ * @subsampling_y: vertical subsampling of the plane
+ *
+ * Returns: (transfer full): the table of a plane of the undistorted frame,
+ *   as cv2.fisheye.initUndistortRectifyMap() with the focal length scaled
+ */
+GstRemapTable *
+gst_remap_table_new_undistort (const GstFisheyeCalibration * calibration,
+    gdouble scale, gint width, gint height, gint subsampling_x,
+    gint subsampling_y)
+{
+  GstRemapTable *table = gst_remap_table_new (width, height);
+  gdouble fx = calibration->fx * scale, fy = calibration->fy * scale;
+
+  for (gint y = 0; y < height; y++) {
+    /* plane sample centers in frame pixels */
+    gdouble ry = ((y + 0.5) * subsampling_y - 0.5 - calibration->cy) / fy;
+
+    for (gint x = 0; x < width; x++) {
+      gdouble rx = ((x + 0.5) * subsampling_x - 0.5 - calibration->cx) / fx;
+      gdouble u, v;
+
+      gst_fisheye_calibration_project (calibration, rx, ry, 1, &u, &v);
+      gst_remap_table_set (table, x, y, (u + 0.5) / subsampling_x - 0.5,
+          (v + 0.5) / subsampling_y - 0.5, width, height);
+    }
+  }
+
+  return table;
+}
+
+void
+gst_remap_table_free (GstRemapTable * table)
+{
+  if (table == NULL)
+    return;
+
+  g_free (table->points);
+  g_free (table);
+}
+
+/* Bilinear sampling of one row, the channel count a constant once
+ * inlined so the inner loop unrolls */
+static inline void
+gst_remap_row (const GstRemapPoint * points, gint n, const guint8 * src,
+    gint stride, guint8 * dst, gint channels, const guint8 * fill)
+{
+  for (gint i = 0; i < n; i++) {
+    const GstRemapPoint *point = &points[i];
+    const guint8 *s;
+    guint fx = point->fx, fy = point->fy;
+
+    if (point->x < 0) {
+      memcpy (dst + i * channels, fill, channels);
+      continue;
+    }
+
+    s = src + point->y * stride + point->x * channels;
+    for (gint c = 0; c < channels; c++) {
+      guint top = s[c] * (256 - fx) + s[c + channels] * fx;
+      guint bottom = s[stride + c] * (256 - fx) + s[stride + c + channels] * fx;
+
+      dst[i * channels + c] = (top * (256 - fy) + bottom * fy + 32768) >> 16;
+    }
+  }
+}
+
+/* @dst is the output of the top left point */
+KERNEL static void
+gst_remap_rows (const GstRemapTable * table, const guint8 * src,
+    gint src_stride, guint8 * dst, gint dst_stride, gint channels,
+    const guint8 * fill, gint x, gint y, gint width, gint height)
+{
+  for (gint row = y; row < y + height; row++) {
+    const GstRemapPoint *points = table->points + (gsize) row * table->width + x;
+    guint8 *out = dst + (gsize) (row - y) * dst_stride;
+
+    switch (channels) {
+      case 1:
+        gst_remap_row (points, width, src, src_stride, out, 1, fill);
+        break;
+      case 2:
+        gst_remap_row (points, width, src, src_stride, out, 2, fill);
+        break;
+      case 4:
+        gst_remap_row (points, width, src, src_stride, out, 4, fill);
+        break;
+      default:
+        gst_remap_row (points, width, src, src_stride, out, channels, fill);
+        break;
+    }
+  }
+}
+
+/**
+ * gst_remap_table_apply_row:
+ * @table: a table
+ * @src: source plane
+ * @src_stride: source plane stride
+ * @dst: output samples of the @width points from @x
+ * @channels: interleaved samples per pixel
+ * @fill: @channels samples for the points outside the source
+ * @x: left of the output area
+ * @y: output row
+ * @width: width of the output area
+ *
+ * Samples part of a row into a separate buffer, to be blended.
+ */
+void
+gst_remap_table_apply_row (const GstRemapTable * table, const guint8 * src,
+    gint src_stride, guint8 * dst, gint channels, const guint8 * fill, gint x,
+    gint y, gint width)
+{
+  width = MIN (width, table->width - x);
+  if (width <= 0 || y < 0 || y >= table->height)
+    return;
+
+  gst_remap_rows (table, src, src_stride, dst, 0, channels, fill, x, y,
+      width, 1);
+}
+
+/**
+ * gst_remap_table_apply:
+ * @table: a table
+ * @src: source plane
+ * @src_stride: source plane stride
+ * @dst: output plane
+ * @dst_stride: output plane stride
+ * @channels: interleaved samples per pixel
+ * @fill: @channels samples for the points outside the source
+ * @x: left of the output area
+ * @y: top of the output area
+ * @width: width of the output area
+ * @height: height of the output area
+ *
+ * Samples an area of the output plane. Areas are independent, to be split
+ * in tiles small enough for the source they read to stay in cache.
+ */
+void
+gst_remap_table_apply (const GstRemapTable * table, const guint8 * src,
+    gint src_stride, guint8 * dst, gint dst_stride, gint channels,
+    const guint8 * fill, gint x, gint y, gint width, gint height)
+{
+  width = MIN (width, table->width - x);
+  height = MIN (height, table->height - y);
+  if (width <= 0 || height <= 0)
+    return;
+
+  gst_remap_rows (table, src, src_stride,
+      dst + (gsize) y * dst_stride + (gsize) x * channels, dst_stride,
+      channels, fill, x, y, width, height);
+}
+
+static inline void
+gst_remap_blend_row (const guint8 * a, const guint8 * b,
+    const guint8 * weight, guint8 * dst, gint width, gint channels)
+{
+  for (gint i = 0; i < width; i++) {
+    /* out of 256, so a full weight takes b as is */
+    guint w = weight[i] + (weight[i] >> 7);
+
+    for (gint c = 0; c < channels; c++) {
+      gint n = i * channels + c;
+
+      dst[n] = (a[n] * (256 - w) + b[n] * w + 128) >> 8;
+    }
+  }
+}
+
+/**
+ * gst_remap_blend:
+ * @a: first source row
+ * @b: second source row
+ * @weight: weight of @b for each pixel, out of 255
+ * @dst: output row
+ * @width: pixels in the row
+ * @channels: interleaved samples per pixel
+ *
+ * Cross-fades two rows, as along the seam of a stitch.
+ */
+KERNEL void
+gst_remap_blend (const guint8 * a, const guint8 * b, const guint8 * weight,
+    guint8 * dst, gint width, gint channels)
+{
+  switch (channels) {
+    case 1:
+      gst_remap_blend_row (a, b, weight, dst, width, 1);
+      break;
+    case 2:
+      gst_remap_blend_row (a, b, weight, dst, width, 2);
+      break;
+    case 4:
+      gst_remap_blend_row (a, b, weight, dst, width, 4);
+      break;
+    default:
+      gst_remap_blend_row (a, b, weight, dst, width, channels);
+      break;
+  }
+}
@@ -0,0 +1,90 @@
+#ifndef __GST_REMAP_H__
+#define __GST_REMAP_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/**
+ * GstFisheyeCalibration:
+ *
+ * Fisheye camera model of OpenCV's cv2.fisheye, as computed by
+ * tools/cameragl/dewarp/calibration.py: camera matrix @fx, @fy, @cx, @cy
+ * and distortion @k, for frames of @width x @height.
+ */
+typedef struct
+{
+  gdouble fx;
+  gdouble fy;
+  gdouble cx;
+  gdouble cy;
+  gdouble k[4];
+  gint width;
+  gint height;
+} GstFisheyeCalibration;
+
+/* the sample camera of tools/cameragl/dewarp/undistort.py */
+#define GST_FISHEYE_CALIBRATION_INIT { 1006.47899, 998.616258, 1012.63906, \
+    538.428063, { -0.04836358, 0.0476189, -0.136679, 0.08632943 }, 1920, 1080 }
+
+/**
+ * GstRemapPoint:
+ * @x: left source sample, -1 when the point falls outside the source
+ * @y: top source sample
+ * @fx: weight of the right samples, out of 256
+ * @fy: weight of the bottom samples, out of 256
+ */
+typedef struct
+{
+  gint16 x;
+  gint16 y;
+  guint8 fx;
+  guint8 fy;
+} GstRemapPoint;
+
+/**
+ * GstRemapTable:
+ *
+ * Source position of each sample of an output plane, bilinear in fixed
+ * point, computed once and applied to every frame.
+ */
+typedef struct
+{
+  gint width;
+  gint height;
+  GstRemapPoint *points;
+} GstRemapTable;
+
+void gst_fisheye_calibration_scale (const GstFisheyeCalibration * calibration,
+    gint width, gint height, GstFisheyeCalibration * scaled);
+
+gboolean gst_fisheye_calibration_load (GstFisheyeCalibration * calibration,
+    gdouble * scale, const gchar * location, GError ** error);
+
+void gst_fisheye_calibration_project (const GstFisheyeCalibration * calibration,
+    gdouble x, gdouble y, gdouble z, gdouble * u, gdouble * v);
+
+GstRemapTable *gst_remap_table_new (gint width, gint height);
+
+void gst_remap_table_set (GstRemapTable * table, gint x, gint y,
+    gdouble u, gdouble v, gint src_width, gint src_height);
+
+GstRemapTable *gst_remap_table_new_undistort (const GstFisheyeCalibration * calibration,
+    gdouble scale, gint width, gint height, gint subsampling_x, gint subsampling_y);
+
+void gst_remap_table_apply_row (const GstRemapTable * table,
+    const guint8 * src, gint src_stride, guint8 * dst, gint channels,
+    const guint8 * fill, gint x, gint y, gint width);
+
+void gst_remap_table_free (GstRemapTable * table);
+
+void gst_remap_table_apply (const GstRemapTable * table, const guint8 * src,
+    gint src_stride, guint8 * dst, gint dst_stride, gint channels,
+    const guint8 * fill, gint x, gint y, gint width, gint height);
+
+void gst_remap_blend (const guint8 * a, const guint8 * b, const guint8 * weight,
+    guint8 * dst, gint width, gint channels);
+
+G_END_DECLS
+
+#endif
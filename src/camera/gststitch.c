@@ -0,0 +1,801 @@
+#include "gststitch.h"
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <string.h>
+
+#include <common/gstworkpool.h>
+
+#include "gstremap.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_stitch_debug);
+#define GST_CAT_DEFAULT gst_stitch_debug
+
+#define gst_stitch_parent_class parent_class
+
+#define N_CAMERAS 2
+
+#define DEFAULT_WIDTH 3840
+#define DEFAULT_HEIGHT 1080
+#define DEFAULT_FIELD_OF_VIEW 200.0
+#define DEFAULT_BLEND_WIDTH 10.0
+#define DEFAULT_YAW 45.0
+#define DEFAULT_PITCH 0.0
+#define DEFAULT_CAMERA_FIELD_OF_VIEW 180.0
+
+/* output rows per job and columns per tile, as in dewarp */
+#define BAND_ROWS 32
+#define TILE_WIDTH 128
+
+#define STITCH_CAPS GST_VIDEO_CAPS_MAKE ("{ I420, NV12, BGRA, RGBA, BGRx, RGBx }")
+
+/* element properties */
+enum
+{
+  PROP_0,
+  PROP_FIELD_OF_VIEW,
+  PROP_BLEND_WIDTH,
+  PROP_STATS,
+};
+
+/* pad properties */
+enum
+{
+  PROP_PAD_0,
+  PROP_PAD_YAW,
+  PROP_PAD_PITCH,
+  PROP_PAD_FIELD_OF_VIEW,
+  PROP_PAD_CALIBRATION_FILE,
+};
+
+/* what a tile of the panorama is made of */
+enum
+{
+  TILE_FIRST,
+  TILE_SECOND,
+  TILE_BLEND,
+};
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink_%u",
+    GST_PAD_SINK,
+    GST_PAD_REQUEST,
+    GST_STATIC_CAPS (STITCH_CAPS));
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (STITCH_CAPS));
+
+/* One fisheye camera, converted to the output format by the parent pad */
+struct _GstStitchPad
+{
+  GstVideoAggregatorConvertPad parent_instance;
+
+  /* under the object lock */
+  GstFisheyeCalibration calibration;
+  gchar *calibration_file;
+  gdouble yaw;
+  gdouble pitch;
+  gdouble field_of_view;
+  gboolean dirty;
+};
+
+G_DEFINE_TYPE(GstStitchPad, gst_stitch_pad, GST_TYPE_VIDEO_AGGREGATOR_CONVERT_PAD);
+
+typedef struct
+{
+  gint channels;
+  gint band_rows;
+  gint tile_width;
+  gint n_columns;
+  guint8 fill[4];
+  GstRemapTable *tables[N_CAMERAS];
+  /* weight of the second camera for each sample */
+  guint8 *weights;
+  /* TILE_* of each tile, band by band */
+  guint8 *tiles;
+} GstStitchPlane;
+
+/* Stitches two fisheye cameras into a cylindrical panorama. Each camera has
+ * a table from the panorama to its frames, built on caps or geometry
+ * changes along with the weights of the seam. Frames are paired by the
+ * aggregator on their running time, then the panorama is sampled in bands
+ * on the shared work pool, each tile from one camera or blended across
+ * the seam. */
+struct _GstStitch
+{
+  GstVideoAggregator parent_instance;
+
+  /* under the object lock */
+  gdouble field_of_view;
+  gdouble blend_width;
+  gboolean dirty;
+  guint64 frames;
+  guint64 missing;
+  GstClockTime frame_time;
+  GstClockTime max_frame_time;
+  GstClockTime skew;
+  GstClockTime table_time;
+
+  /* from the aggregating thread */
+  GstStitchPlane planes[GST_VIDEO_MAX_PLANES];
+  guint n_planes;
+  guint n_bands;
+  GstVideoInfo out_info;
+  gint in_width[N_CAMERAS];
+  gint in_height[N_CAMERAS];
+};
+
+typedef struct
+{
+  GstStitch *self;
+  GstVideoFrame *in[N_CAMERAS];
+  GstVideoFrame *out;
+} GstStitchFrame;
+
+G_DEFINE_TYPE(GstStitch, gst_stitch, GST_TYPE_VIDEO_AGGREGATOR);
+
+
+static void gst_stitch_clear_planes(GstStitch *self)
+{
+  for (guint p = 0; p < GST_VIDEO_MAX_PLANES; p++){
+    GstStitchPlane *plane = &self->planes[p];
+
+    for (guint i = 0; i < N_CAMERAS; i++)
+      gst_remap_table_free(plane->tables[i]);
+    g_free(plane->weights);
+    g_free(plane->tiles);
+    memset(plane, 0, sizeof(GstStitchPlane));
+  }
+  self->n_planes = 0;
+}
+
+/* Table of one camera for a plane of the panorama, the longitude of each
+ * column given in @lon */
+static GstRemapTable *gst_stitch_build_table(const GstFisheyeCalibration *calibration, gdouble yaw,
+                                             gdouble pitch, gdouble field_of_view, const gdouble *lon,
+                                             gdouble focal, gint center_y, gint width, gint height,
+                                             gint sub_x, gint sub_y, gint src_width, gint src_height)
+{
+  GstRemapTable *table = gst_remap_table_new(width, height);
+  gdouble max_theta = field_of_view / 2;
+  gdouble cos_yaw = cos(yaw), sin_yaw = sin(yaw);
+  gdouble cos_pitch = cos(pitch), sin_pitch = sin(pitch);
+
+  for (gint y = 0; y < height; y++){
+    gdouble h = ((y + 0.5) * sub_y - center_y) / focal;
+
+    for (gint x = 0; x < width; x++){
+      /* panorama ray, rotated into the camera */
+      gdouble rx = sin(lon[x]), rz = cos(lon[x]);
+      gdouble cx = cos_yaw * rx - sin_yaw * rz;
+      gdouble cz = sin_yaw * rx + cos_yaw * rz;
+      gdouble cy = cos_pitch * h + sin_pitch * cz;
+      gdouble u = -1, v = -1;
+
+      cz = cos_pitch * cz - sin_pitch * h;
+      if (atan2(sqrt(cx * cx + cy * cy), cz) <= max_theta){
+        gst_fisheye_calibration_project(calibration, cx, cy, cz, &u, &v);
+        u = (u + 0.5) / sub_x - 0.5;
+        v = (v + 0.5) / sub_y - 0.5;
+      }
+      gst_remap_table_set(table, x, y, u, v, src_width, src_height);
+    }
+  }
+
+  return table;
+}
+
+static void gst_stitch_build_tables(GstStitch *self, GstStitchPad *pads[N_CAMERAS])
+{
+  GstVideoInfo *info = &GST_VIDEO_AGGREGATOR(self)->info;
+  const GstVideoFormatInfo *finfo = info->finfo;
+  GstFisheyeCalibration calibrations[N_CAMERAS];
+  gdouble yaw[N_CAMERAS], pitch[N_CAMERAS], fov[N_CAMERAS];
+  gdouble field_of_view, blend_width, focal, seam, direction;
+  gint64 started = g_get_monotonic_time();
+
+  GST_OBJECT_LOCK(self);
+  field_of_view = self->field_of_view * G_PI / 180;
+  blend_width = self->blend_width * G_PI / 180;
+  self->dirty = FALSE;
+  GST_OBJECT_UNLOCK(self);
+
+  for (guint i = 0; i < N_CAMERAS; i++){
+    GstVideoInfo *in_info = &GST_VIDEO_AGGREGATOR_PAD(pads[i])->info;
+
+    GST_OBJECT_LOCK(pads[i]);
+    gst_fisheye_calibration_scale(&pads[i]->calibration, GST_VIDEO_INFO_WIDTH(in_info),
+        GST_VIDEO_INFO_HEIGHT(in_info), &calibrations[i]);
+    yaw[i] = pads[i]->yaw * G_PI / 180;
+    pitch[i] = pads[i]->pitch * G_PI / 180;
+    fov[i] = pads[i]->field_of_view * G_PI / 180;
+    pads[i]->dirty = FALSE;
+    GST_OBJECT_UNLOCK(pads[i]);
+
+    self->in_width[i] = GST_VIDEO_INFO_WIDTH(in_info);
+    self->in_height[i] = GST_VIDEO_INFO_HEIGHT(in_info);
+  }
+
+  gst_stitch_clear_planes(self);
+  self->out_info = *info;
+  self->n_planes = GST_VIDEO_INFO_N_PLANES(info);
+  self->n_bands = (GST_VIDEO_INFO_HEIGHT(info) + BAND_ROWS - 1) / BAND_ROWS;
+
+  /* pixels per radian, the same along both axes of the cylinder */
+  focal = GST_VIDEO_INFO_WIDTH(info) / field_of_view;
+  seam = (yaw[0] + yaw[1]) / 2;
+  direction = yaw[1] >= yaw[0] ? 1 : -1;
+
+  for (guint p = 0; p < self->n_planes; p++){
+    GstStitchPlane *plane = &self->planes[p];
+    guint comp = GST_VIDEO_FORMAT_INFO_N_PLANES(finfo) == 2 && p > 0 ? 1 : p;
+    gint sub_x = 1 << GST_VIDEO_FORMAT_INFO_W_SUB(finfo, comp);
+    gint sub_y = 1 << GST_VIDEO_FORMAT_INFO_H_SUB(finfo, comp);
+    gint width = GST_VIDEO_INFO_COMP_WIDTH(info, comp);
+    gint height = GST_VIDEO_INFO_COMP_HEIGHT(info, comp);
+    gdouble *lon = g_new(gdouble, width);
+
+    plane->channels = GST_VIDEO_INFO_COMP_PSTRIDE(info, comp);
+    plane->band_rows = BAND_ROWS / sub_y;
+    plane->tile_width = TILE_WIDTH / sub_x;
+    plane->n_columns = (width + plane->tile_width - 1) / plane->tile_width;
+    if (GST_VIDEO_FORMAT_INFO_IS_YUV(finfo))
+      memset(plane->fill, p == 0 ? 16 : 128, sizeof(plane->fill));
+    else
+      memcpy(plane->fill, (guint8[]) {0, 0, 0, 255}, sizeof(plane->fill));
+
+    for (gint x = 0; x < width; x++)
+      lon[x] = ((x + 0.5) * sub_x - GST_VIDEO_INFO_WIDTH(info) / 2.0) / focal;
+
+    /* the cameras are converted to the output format, at their size */
+    for (guint i = 0; i < N_CAMERAS; i++){
+      plane->tables[i] = gst_stitch_build_table(&calibrations[i], yaw[i], pitch[i], fov[i], lon, focal,
+          GST_VIDEO_INFO_HEIGHT(info) / 2, width, height, sub_x, sub_y,
+          GST_VIDEO_SUB_SCALE(GST_VIDEO_FORMAT_INFO_W_SUB(finfo, comp), self->in_width[i]),
+          GST_VIDEO_SUB_SCALE(GST_VIDEO_FORMAT_INFO_H_SUB(finfo, comp), self->in_height[i]));
+    }
+
+    /* feathered across the seam where both cameras see, otherwise
+     * whichever does */
+    plane->weights = g_new(guint8, (gsize) width * height);
+    for (gint y = 0; y < height; y++){
+      for (gint x = 0; x < width; x++){
+        gsize n = (gsize) y * width + x;
+        gboolean first = plane->tables[0]->points[n].x >= 0;
+        gboolean second = plane->tables[1]->points[n].x >= 0;
+        gdouble w = second ? 1 : 0;
+
+        if (first && second)
+          w = CLAMP(direction * (lon[x] - seam) / blend_width + 0.5, 0, 1);
+        plane->weights[n] = lround(w * 255);
+      }
+    }
+
+    plane->tiles = g_new(guint8, (gsize) self->n_bands * plane->n_columns);
+    for (guint band = 0; band < self->n_bands; band++){
+      for (gint column = 0; column < plane->n_columns; column++){
+        gint x0 = column * plane->tile_width, y0 = band * plane->band_rows;
+        gint x1 = MIN(x0 + plane->tile_width, width), y1 = MIN(y0 + plane->band_rows, height);
+        gboolean any_first = FALSE, any_second = FALSE;
+
+        for (gint y = y0; y < y1; y++){
+          for (gint x = x0; x < x1; x++){
+            guint8 w = plane->weights[(gsize) y * width + x];
+
+            any_first |= w < 255;
+            any_second |= w > 0;
+          }
+        }
+        plane->tiles[band * plane->n_columns + column] =
+            any_first && any_second ? TILE_BLEND : any_second ? TILE_SECOND : TILE_FIRST;
+      }
+    }
+
+    g_free(lon);
+  }
+
+  GST_OBJECT_LOCK(self);
+  self->table_time = (g_get_monotonic_time() - started) * GST_USECOND;
+  GST_OBJECT_UNLOCK(self);
+
+  GST_DEBUG_OBJECT(self, "Stitch tables of %dx%d built in %" GST_TIME_FORMAT,
+      GST_VIDEO_INFO_WIDTH(info), GST_VIDEO_INFO_HEIGHT(info), GST_TIME_ARGS(self->table_time));
+}
+
+static void gst_stitch_band_func(gpointer data, guint band)
+{
+  GstStitchFrame *frame = data;
+  GstStitch *self = frame->self;
+
+  for (guint p = 0; p < self->n_planes; p++){
+    GstStitchPlane *plane = &self->planes[p];
+    gint width = plane->tables[0]->width;
+    gint y0 = band * plane->band_rows;
+    gint y1 = MIN(y0 + plane->band_rows, plane->tables[0]->height);
+    guint8 *dst = GST_VIDEO_FRAME_PLANE_DATA(frame->out, p);
+    gint dst_stride = GST_VIDEO_FRAME_PLANE_STRIDE(frame->out, p);
+    const guint8 *src[N_CAMERAS] = { NULL, NULL };
+    gint src_stride[N_CAMERAS] = { 0, 0 };
+
+    for (guint i = 0; i < N_CAMERAS; i++){
+      if (frame->in[i]){
+        src[i] = GST_VIDEO_FRAME_PLANE_DATA(frame->in[i], p);
+        src_stride[i] = GST_VIDEO_FRAME_PLANE_STRIDE(frame->in[i], p);
+      }
+    }
+
+    for (gint column = 0; column < plane->n_columns; column++){
+      gint x = column * plane->tile_width;
+      guint tile = plane->tiles[band * plane->n_columns + column];
+
+      /* a missing camera leaves the other on its own */
+      if (src[0] == NULL)
+        tile = TILE_SECOND;
+      else if (src[1] == NULL)
+        tile = TILE_FIRST;
+
+      if (tile != TILE_BLEND){
+        gst_remap_table_apply(plane->tables[tile], src[tile], src_stride[tile], dst, dst_stride,
+            plane->channels, plane->fill, x, y0, plane->tile_width, y1 - y0);
+        continue;
+      }
+
+      for (gint y = y0; y < y1; y++){
+        guint8 second[TILE_WIDTH * 4];
+        guint8 *out = dst + (gsize) y * dst_stride + (gsize) x * plane->channels;
+        gint n = MIN(plane->tile_width, width - x);
+
+        gst_remap_table_apply(plane->tables[0], src[0], src_stride[0], dst, dst_stride,
+            plane->channels, plane->fill, x, y, n, 1);
+        gst_remap_table_apply_row(plane->tables[1], src[1], src_stride[1], second,
+            plane->channels, plane->fill, x, y, n);
+        gst_remap_blend(out, second, plane->weights + (gsize) y * width + x, out, n, plane->channels);
+      }
+    }
+  }
+}
+
+static void gst_stitch_fill_frame(GstStitch *self, GstVideoFrame *out)
+{
+  for (guint p = 0; p < self->n_planes; p++){
+    GstStitchPlane *plane = &self->planes[p];
+    guint8 *dst = GST_VIDEO_FRAME_PLANE_DATA(out, p);
+    gint stride = GST_VIDEO_FRAME_PLANE_STRIDE(out, p);
+
+    for (gint y = 0; y < plane->tables[0]->height; y++)
+      for (gint x = 0; x < plane->tables[0]->width; x++)
+        memcpy(dst + (gsize) y * stride + (gsize) x * plane->channels, plane->fill, plane->channels);
+  }
+}
+
+/* Running time of the frame a pad is about to be stitched with */
+static GstClockTime gst_stitch_pad_running_time(GstVideoAggregatorPad *pad)
+{
+  GstBuffer *buffer = gst_video_aggregator_pad_get_current_buffer(pad);
+  GstSegment *segment = &GST_AGGREGATOR_PAD(pad)->segment;
+
+  if (buffer == NULL || !GST_BUFFER_PTS_IS_VALID(buffer))
+    return GST_CLOCK_TIME_NONE;
+
+  return gst_segment_to_running_time(segment, GST_FORMAT_TIME, GST_BUFFER_PTS(buffer));
+}
+
+static gboolean gst_stitch_needs_tables(GstStitch *self, GstStitchPad *pads[N_CAMERAS])
+{
+  GstVideoInfo *info = &GST_VIDEO_AGGREGATOR(self)->info;
+  gboolean dirty;
+
+  GST_OBJECT_LOCK(self);
+  dirty = self->dirty;
+  GST_OBJECT_UNLOCK(self);
+
+  if (dirty || self->n_planes == 0 || !gst_video_info_is_equal(info, &self->out_info))
+    return TRUE;
+
+  for (guint i = 0; i < N_CAMERAS; i++){
+    GstVideoInfo *in_info = &GST_VIDEO_AGGREGATOR_PAD(pads[i])->info;
+
+    GST_OBJECT_LOCK(pads[i]);
+    dirty = pads[i]->dirty;
+    GST_OBJECT_UNLOCK(pads[i]);
+
+    if (dirty || GST_VIDEO_INFO_WIDTH(in_info) != self->in_width[i]
+        || GST_VIDEO_INFO_HEIGHT(in_info) != self->in_height[i])
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+static GstFlowReturn gst_stitch_aggregate_frames(GstVideoAggregator *vagg, GstBuffer *outbuf)
+{
+  GstStitch *self = GST_STITCH(vagg);
+  GstStitchPad *pads[N_CAMERAS] = { NULL, NULL };
+  GstStitchFrame frame = { self, { NULL, NULL }, NULL };
+  GstClockTime running_time[N_CAMERAS];
+  GstVideoFrame out;
+  GstClockTime elapsed, skew = GST_CLOCK_TIME_NONE;
+  gint64 started = g_get_monotonic_time();
+  guint n_pads = 0;
+
+  GST_OBJECT_LOCK(vagg);
+  for (GList *l = GST_ELEMENT(vagg)->sinkpads; l && n_pads < N_CAMERAS; l = l->next){
+    GstVideoAggregatorPad *pad = l->data;
+
+    pads[n_pads] = gst_object_ref(pad);
+    frame.in[n_pads] = gst_video_aggregator_pad_get_prepared_frame(pad);
+    running_time[n_pads] = gst_stitch_pad_running_time(pad);
+    n_pads++;
+  }
+  GST_OBJECT_UNLOCK(vagg);
+
+  if (n_pads < N_CAMERAS){
+    GST_ELEMENT_ERROR(self, CORE, NEGOTIATION, ("Stitching needs %d cameras", N_CAMERAS),
+        ("Only %u sink pads were requested", n_pads));
+    for (guint i = 0; i < n_pads; i++)
+      gst_object_unref(pads[i]);
+    return GST_FLOW_NOT_NEGOTIATED;
+  }
+
+  if (!gst_video_frame_map(&out, &vagg->info, outbuf, GST_MAP_WRITE)){
+    for (guint i = 0; i < N_CAMERAS; i++)
+      gst_object_unref(pads[i]);
+    return GST_FLOW_ERROR;
+  }
+  frame.out = &out;
+
+  if (gst_stitch_needs_tables(self, pads))
+    gst_stitch_build_tables(self, pads);
+
+  if (frame.in[0] == NULL && frame.in[1] == NULL)
+    gst_stitch_fill_frame(self, &out);
+  else
+    gst_work_pool_parallel(gst_work_pool_get_default(), self->n_bands, gst_stitch_band_func, &frame);
+
+  gst_video_frame_unmap(&out);
+
+  if (GST_CLOCK_TIME_IS_VALID(running_time[0]) && GST_CLOCK_TIME_IS_VALID(running_time[1]))
+    skew = GST_CLOCK_DIFF(running_time[0], running_time[1]) < 0 ?
+        running_time[0] - running_time[1] : running_time[1] - running_time[0];
+
+  elapsed = (g_get_monotonic_time() - started) * GST_USECOND;
+  GST_OBJECT_LOCK(self);
+  self->frames++;
+  if (frame.in[0] == NULL || frame.in[1] == NULL)
+    self->missing++;
+  self->frame_time = self->frame_time == 0 ? elapsed : (self->frame_time * 15 + elapsed) / 16;
+  self->max_frame_time = MAX(self->max_frame_time, elapsed);
+  if (GST_CLOCK_TIME_IS_VALID(skew))
+    self->skew = (self->skew * 15 + skew) / 16;
+  GST_OBJECT_UNLOCK(self);
+
+  for (guint i = 0; i < N_CAMERAS; i++)
+    gst_object_unref(pads[i]);
+
+  return GST_FLOW_OK;
+}
+
+static GstCaps *gst_stitch_fixate_src_caps(GstAggregator *agg, GstCaps *caps)
+{
+  GstStructure *s;
+  gint best_fps_n = 0, best_fps_d = 1;
+
+  /* as fast as the fastest camera */
+  GST_OBJECT_LOCK(agg);
+  for (GList *l = GST_ELEMENT(agg)->sinkpads; l; l = l->next){
+    GstVideoAggregatorPad *pad = l->data;
+    gint fps_n = GST_VIDEO_INFO_FPS_N(&pad->info), fps_d = GST_VIDEO_INFO_FPS_D(&pad->info);
+
+    if (fps_n > 0 && fps_d > 0 && (best_fps_n == 0 || gst_util_fraction_compare(fps_n, fps_d, best_fps_n, best_fps_d) > 0)){
+      best_fps_n = fps_n;
+      best_fps_d = fps_d;
+    }
+  }
+  GST_OBJECT_UNLOCK(agg);
+
+  if (best_fps_n == 0){
+    best_fps_n = 30;
+    best_fps_d = 1;
+  }
+
+  caps = gst_caps_truncate(gst_caps_make_writable(caps));
+  s = gst_caps_get_structure(caps, 0);
+  gst_structure_fixate_field_nearest_int(s, "width", DEFAULT_WIDTH);
+  gst_structure_fixate_field_nearest_int(s, "height", DEFAULT_HEIGHT);
+  gst_structure_fixate_field_nearest_fraction(s, "framerate", best_fps_n, best_fps_d);
+  if (gst_structure_has_field(s, "pixel-aspect-ratio"))
+    gst_structure_fixate_field_nearest_fraction(s, "pixel-aspect-ratio", 1, 1);
+
+  return gst_caps_fixate(caps);
+}
+
+static GstPad *gst_stitch_request_new_pad(GstElement *element, GstPadTemplate *templ,
+                                          const gchar *name, const GstCaps *caps)
+{
+  GstPad *pad;
+
+  GST_OBJECT_LOCK(element);
+  if (element->numsinkpads >= N_CAMERAS){
+    GST_OBJECT_UNLOCK(element);
+    GST_WARNING_OBJECT(element, "Only %d cameras can be stitched", N_CAMERAS);
+    return NULL;
+  }
+  GST_OBJECT_UNLOCK(element);
+
+  pad = GST_ELEMENT_CLASS(parent_class)->request_new_pad(element, templ, name, caps);
+  if (pad == NULL)
+    return NULL;
+
+  /* the second camera looks right of the first by default */
+  GST_OBJECT_LOCK(element);
+  GST_STITCH_PAD(pad)->yaw = element->numsinkpads > 1 ? DEFAULT_YAW : -DEFAULT_YAW;
+  GST_OBJECT_UNLOCK(element);
+
+  return pad;
+}
+
+static void gst_stitch_release_pad(GstElement *element, GstPad *pad)
+{
+  GstStitch *self = GST_STITCH(element);
+
+  GST_OBJECT_LOCK(self);
+  self->dirty = TRUE;
+  GST_OBJECT_UNLOCK(self);
+
+  GST_ELEMENT_CLASS(parent_class)->release_pad(element, pad);
+}
+
+static gboolean gst_stitch_stop(GstAggregator *agg)
+{
+  GstStitch *self = GST_STITCH(agg);
+
+  gst_stitch_clear_planes(self);
+
+  return GST_AGGREGATOR_CLASS(parent_class)->stop(agg);
+}
+
+static GstStructure *gst_stitch_get_stats(GstStitch *self)
+{
+  GstStructure *stats;
+
+  GST_OBJECT_LOCK(self);
+  stats = gst_structure_new("stitch-stats",
+      "frames", G_TYPE_UINT64, self->frames,
+      "missing", G_TYPE_UINT64, self->missing,
+      "frame-time", G_TYPE_UINT64, self->frame_time,
+      "max-frame-time", G_TYPE_UINT64, self->max_frame_time,
+      "skew", G_TYPE_UINT64, self->skew,
+      "table-time", G_TYPE_UINT64, self->table_time,
+      NULL);
+  GST_OBJECT_UNLOCK(self);
+
+  return stats;
+}
+
+static void gst_stitch_init(GstStitch *self)
+{
+  self->field_of_view = DEFAULT_FIELD_OF_VIEW;
+  self->blend_width = DEFAULT_BLEND_WIDTH;
+  gst_video_info_init(&self->out_info);
+}
+
+static void gst_stitch_set_property(GObject *object,
+                                    guint prop_id,
+                                    const GValue *value,
+                                    GParamSpec *pspec){
+    GstStitch *self = GST_STITCH(object);
+
+    GST_OBJECT_LOCK(self);
+    switch (prop_id) {
+        case PROP_FIELD_OF_VIEW:
+            self->field_of_view = g_value_get_double(value);
+            break;
+        case PROP_BLEND_WIDTH:
+            self->blend_width = g_value_get_double(value);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+    self->dirty = TRUE;
+    GST_OBJECT_UNLOCK(self);
+}
+
+static void gst_stitch_get_property(GObject *object,
+                                    guint prop_id,
+                                    GValue *value,
+                                    GParamSpec *pspec){
+
+    GstStitch *self = GST_STITCH(object);
+
+    if (prop_id == PROP_STATS){
+        g_value_take_boxed(value, gst_stitch_get_stats(self));
+        return;
+    }
+
+    GST_OBJECT_LOCK(self);
+    switch (prop_id) {
+        case PROP_FIELD_OF_VIEW:
+            g_value_set_double(value, self->field_of_view);
+            break;
+        case PROP_BLEND_WIDTH:
+            g_value_set_double(value, self->blend_width);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+    GST_OBJECT_UNLOCK(self);
+}
+
+static void gst_stitch_finalize(GObject *object)
+{
+  gst_stitch_clear_planes(GST_STITCH(object));
+
+  G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
+static void gst_stitch_class_init(GstStitchClass *klass)
+{
+  GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+  GstAggregatorClass *aggregator_class = GST_AGGREGATOR_CLASS(klass);
+  GstVideoAggregatorClass *videoaggregator_class = GST_VIDEO_AGGREGATOR_CLASS(klass);
+
+  GObjectClass *object_class = G_OBJECT_CLASS(klass);
+  object_class->set_property = gst_stitch_set_property;
+  object_class->get_property = gst_stitch_get_property;
+  object_class->finalize = gst_stitch_finalize;
+
+  element_class->request_new_pad = gst_stitch_request_new_pad;
+  element_class->release_pad = gst_stitch_release_pad;
+  aggregator_class->fixate_src_caps = gst_stitch_fixate_src_caps;
+  aggregator_class->stop = gst_stitch_stop;
+  videoaggregator_class->aggregate_frames = gst_stitch_aggregate_frames;
+
+  gst_element_class_add_static_pad_template_with_gtype(element_class,
+      &src_template, GST_TYPE_AGGREGATOR_PAD);
+  gst_element_class_add_static_pad_template_with_gtype(element_class,
+      &sink_template, GST_TYPE_STITCH_PAD);
+
+  g_object_class_install_property(object_class, PROP_FIELD_OF_VIEW,
+      g_param_spec_double("field-of-view", "Field of view",
+          "Horizontal field of view of the panorama, in degrees",
+          1, 360, DEFAULT_FIELD_OF_VIEW,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property(object_class, PROP_BLEND_WIDTH,
+      g_param_spec_double("blend-width", "Blend width",
+          "Width of the cross-fade between the cameras around the seam, in degrees",
+          0.1, 180, DEFAULT_BLEND_WIDTH,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property(object_class, PROP_STATS,
+      g_param_spec_boxed("stats", "Statistics",
+          "Panoramas produced and with a camera missing, average and worst time to stitch one, "
+          "average running time difference of the paired frames and time to build the tables",
+          GST_TYPE_STRUCTURE,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  GST_DEBUG_CATEGORY_INIT (gst_stitch_debug, "stitch", 0,
+      "Stitch Debug");
+
+  gst_element_class_set_static_metadata(element_class,
+                                        "Stitch",
+                                        "Filter/Editor/Video/Compositor",
+                                        "Stitches two fisheye cameras into a cylindrical panorama",
+                                        "Ludovic Bouguerra <ludovic.bouguerra@stream.studio>");
+}
+
+
+static void gst_stitch_pad_set_property(GObject *object,
+                                        guint prop_id,
+                                        const GValue *value,
+                                        GParamSpec *pspec){
+    GstStitchPad *pad = GST_STITCH_PAD(object);
+    GError *error = NULL;
+
+    GST_OBJECT_LOCK(pad);
+    switch (prop_id) {
+        case PROP_PAD_YAW:
+            pad->yaw = g_value_get_double(value);
+            break;
+        case PROP_PAD_PITCH:
+            pad->pitch = g_value_get_double(value);
+            break;
+        case PROP_PAD_FIELD_OF_VIEW:
+            pad->field_of_view = g_value_get_double(value);
+            break;
+        case PROP_PAD_CALIBRATION_FILE:
+            g_free(pad->calibration_file);
+            pad->calibration_file = g_value_dup_string(value);
+            if (pad->calibration_file && !gst_fisheye_calibration_load(&pad->calibration,
+                    NULL, pad->calibration_file, &error)){
+                GST_WARNING_OBJECT(pad, "Cannot load the calibration from %s: %s",
+                    pad->calibration_file, error->message);
+                g_clear_error(&error);
+            }
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+    pad->dirty = TRUE;
+    GST_OBJECT_UNLOCK(pad);
+}
+
+static void gst_stitch_pad_get_property(GObject *object,
+                                        guint prop_id,
+                                        GValue *value,
+                                        GParamSpec *pspec){
+    GstStitchPad *pad = GST_STITCH_PAD(object);
+
+    GST_OBJECT_LOCK(pad);
+    switch (prop_id) {
+        case PROP_PAD_YAW:
+            g_value_set_double(value, pad->yaw);
+            break;
+        case PROP_PAD_PITCH:
+            g_value_set_double(value, pad->pitch);
+            break;
+        case PROP_PAD_FIELD_OF_VIEW:
+            g_value_set_double(value, pad->field_of_view);
+            break;
+        case PROP_PAD_CALIBRATION_FILE:
+            g_value_set_string(value, pad->calibration_file);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+    GST_OBJECT_UNLOCK(pad);
+}
+
+static void gst_stitch_pad_finalize(GObject *object)
+{
+  g_free(GST_STITCH_PAD(object)->calibration_file);
+
+  G_OBJECT_CLASS(gst_stitch_pad_parent_class)->finalize(object);
+}
+
+static void gst_stitch_pad_init(GstStitchPad *pad)
+{
+  pad->calibration = (GstFisheyeCalibration) GST_FISHEYE_CALIBRATION_INIT;
+  pad->pitch = DEFAULT_PITCH;
+  pad->field_of_view = DEFAULT_CAMERA_FIELD_OF_VIEW;
+}
+
+static void gst_stitch_pad_class_init(GstStitchPadClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS(klass);
+  object_class->set_property = gst_stitch_pad_set_property;
+  object_class->get_property = gst_stitch_pad_get_property;
+  object_class->finalize = gst_stitch_pad_finalize;
+
+  g_object_class_install_property(object_class, PROP_PAD_YAW,
+      g_param_spec_double("yaw", "Yaw",
+          "Direction the camera looks at, in degrees right of the panorama center",
+          -180, 180, 0,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property(object_class, PROP_PAD_PITCH,
+      g_param_spec_double("pitch", "Pitch",
+          "Direction the camera looks at, in degrees above the horizon",
+          -90, 90, DEFAULT_PITCH,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property(object_class, PROP_PAD_FIELD_OF_VIEW,
+      g_param_spec_double("field-of-view", "Field of view",
+          "Widest angle the lens sees, in degrees",
+          1, 360, DEFAULT_CAMERA_FIELD_OF_VIEW,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property(object_class, PROP_PAD_CALIBRATION_FILE,
+      g_param_spec_string("calibration-file", "Calibration file",
+          "Key file written by calibration.py, the sample camera otherwise",
+          NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+}
@@ -0,0 +1,26 @@
+#ifndef __GST_STITCH_H__
+#define __GST_STITCH_H__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <gst/video/gstvideoaggregator.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_STITCH_PAD gst_stitch_pad_get_type ()
+G_DECLARE_FINAL_TYPE (GstStitchPad, gst_stitch_pad, GST, STITCH_PAD, GstVideoAggregatorConvertPad)
+
+struct GstStitchPadClass {
+  GstVideoAggregatorConvertPadClass parent_class;
+};
+
+#define GST_TYPE_STITCH gst_stitch_get_type ()
+G_DECLARE_FINAL_TYPE (GstStitch, gst_stitch, GST, STITCH, GstVideoAggregator)
+
+struct GstStitchClass {
+  GstVideoAggregatorClass parent_class;
+};
+
+G_END_DECLS
+
+#endif
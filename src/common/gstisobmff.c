@@ -0,0 +1,290 @@
+#include "gstisobmff.h"
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#define FOURCC_trak GST_MAKE_FOURCC('t','r','a','k')
+#define FOURCC_tkhd GST_MAKE_FOURCC('t','k','h','d')
+#define FOURCC_mdia GST_MAKE_FOURCC('m','d','i','a')
+#define FOURCC_mdhd GST_MAKE_FOURCC('m','d','h','d')
+#define FOURCC_hdlr GST_MAKE_FOURCC('h','d','l','r')
+#define FOURCC_minf GST_MAKE_FOURCC('m','i','n','f')
+#define FOURCC_stbl GST_MAKE_FOURCC('s','t','b','l')
+#define FOURCC_stsd GST_MAKE_FOURCC('s','t','s','d')
+#define FOURCC_avcC GST_MAKE_FOURCC('a','v','c','C')
+#define FOURCC_avc1 GST_MAKE_FOURCC('a','v','c','1')
+#define FOURCC_avc3 GST_MAKE_FOURCC('a','v','c','3')
+#define FOURCC_mp4a GST_MAKE_FOURCC('m','p','4','a')
+#define FOURCC_Opus GST_MAKE_FOURCC('O','p','u','s')
+#define FOURCC_mvex GST_MAKE_FOURCC('m','v','e','x')
+#define FOURCC_trex GST_MAKE_FOURCC('t','r','e','x')
+#define FOURCC_traf GST_MAKE_FOURCC('t','r','a','f')
+#define FOURCC_tfhd GST_MAKE_FOURCC('t','f','h','d')
+#define FOURCC_tfdt GST_MAKE_FOURCC('t','f','d','t')
+#define FOURCC_trun GST_MAKE_FOURCC('t','r','u','n')
+#define FOURCC_vide GST_MAKE_FOURCC('v','i','d','e')
+
+#define SAMPLE_FLAG_NON_SYNC 0x00010000
+
+/**
+ * gst_isobmff_box_next:
+ * @data: (inout): start of the next box, advanced past it
+ * @size: (inout): bytes left from @data
+ * @type: (out): fourcc of the box
+ * @payload: (out): content of the box, after its header
+ * @payload_size: (out): size of @payload
+ *
+ * Returns: FALSE when no complete box is left.
+ */
+gboolean
+gst_isobmff_box_next (const guint8 ** data, gsize * size, guint32 * type,
+    const guint8 ** payload, gsize * payload_size)
+{
+  guint64 box_size;
+  gsize header = 8;
+
+  if (*size < 8)
+    return FALSE;
+
+  box_size = GST_READ_UINT32_BE (*data);
+  *type = GST_READ_UINT32_LE (*data + 4);
+  if (box_size == 1) {
+    if (*size < 16)
+      return FALSE;
+    box_size = GST_READ_UINT64_BE (*data + 8);
+    header = 16;
+  } else if (box_size == 0) {
+    box_size = *size;
+  }
+  if (box_size < header || box_size > *size)
+    return FALSE;
+
+  *payload = *data + header;
+  *payload_size = box_size - header;
+  *data += box_size;
+  *size -= box_size;
+  return TRUE;
+}
+
+gboolean
+gst_isobmff_box_find (const guint8 * data, gsize size, guint32 wanted,
+    const guint8 ** payload, gsize * payload_size)
+{
+  guint32 type;
+
+  while (gst_isobmff_box_next (&data, &size, &type, payload, payload_size)) {
+    if (type == wanted)
+      return TRUE;
+  }
+  return FALSE;
+}
+
+/* RFC 6381 name of the first sample entry */
+static gchar *
+gst_isobmff_sample_entry_codec (const guint8 * stbl, gsize stbl_size)
+{
+  const guint8 *stsd, *entry, *avcc;
+  gsize stsd_size, entry_size, avcc_size;
+  guint32 type;
+
+  if (!gst_isobmff_box_find (stbl, stbl_size, FOURCC_stsd, &stsd, &stsd_size)
+      || stsd_size < 8)
+    return NULL;
+  stsd += 8;
+  stsd_size -= 8;
+  if (!gst_isobmff_box_next (&stsd, &stsd_size, &type, &entry, &entry_size))
+    return NULL;
+
+  switch (type) {
+    case FOURCC_avc1:
+    case FOURCC_avc3:
+      /* the avcC box follows the 78 bytes of the visual sample entry */
+      if (entry_size > 78 && gst_isobmff_box_find (entry + 78, entry_size - 78,
+              FOURCC_avcC, &avcc, &avcc_size) && avcc_size >= 4)
+        return g_strdup_printf ("%" GST_FOURCC_FORMAT ".%02x%02x%02x",
+            GST_FOURCC_ARGS (type), avcc[1], avcc[2], avcc[3]);
+      return g_strdup_printf ("%" GST_FOURCC_FORMAT, GST_FOURCC_ARGS (type));
+    case FOURCC_mp4a:
+      return g_strdup ("mp4a.40.2");
+    case FOURCC_Opus:
+      return g_strdup ("opus");
+    default:
+      return g_strdup_printf ("%" GST_FOURCC_FORMAT, GST_FOURCC_ARGS (type));
+  }
+}
+
+/**
+ * gst_isobmff_parse_moov:
+ * @moov: content of a moov box
+ * @moov_size: size of @moov
+ * @track: (out): the main track
+ *
+ * Returns: (transfer full): the codecs of the tracks, comma separated as
+ *   in an HLS CODECS attribute or an MSE type.
+ */
+gchar *
+gst_isobmff_parse_moov (const guint8 * moov, gsize moov_size,
+    GstIsobmffTrack * track)
+{
+  const guint8 *data = moov, *payload, *box, *mdia, *stbl;
+  gsize size = moov_size, payload_size, box_size, mdia_size, stbl_size;
+  GPtrArray *codecs = g_ptr_array_new_with_free_func (g_free);
+  guint32 type;
+  gchar *joined;
+
+  memset (track, 0, sizeof (GstIsobmffTrack));
+
+  while (gst_isobmff_box_next (&data, &size, &type, &payload, &payload_size)) {
+    guint32 track_id = 0, timescale = 0;
+    gboolean video = FALSE;
+    gchar *codec;
+
+    if (type != FOURCC_trak)
+      continue;
+
+    if (gst_isobmff_box_find (payload, payload_size, FOURCC_tkhd, &box,
+            &box_size) && box_size >= 24)
+      track_id = GST_READ_UINT32_BE (box + (box[0] == 1 ? 20 : 12));
+    if (!gst_isobmff_box_find (payload, payload_size, FOURCC_mdia, &mdia,
+            &mdia_size))
+      continue;
+    if (gst_isobmff_box_find (mdia, mdia_size, FOURCC_mdhd, &box, &box_size)
+        && box_size >= 24)
+      timescale = GST_READ_UINT32_BE (box + (box[0] == 1 ? 20 : 12));
+    if (gst_isobmff_box_find (mdia, mdia_size, FOURCC_hdlr, &box, &box_size)
+        && box_size >= 12)
+      video = GST_READ_UINT32_LE (box + 8) == FOURCC_vide;
+    if (gst_isobmff_box_find (mdia, mdia_size, FOURCC_minf, &box, &box_size)
+        && gst_isobmff_box_find (box, box_size, FOURCC_stbl, &stbl, &stbl_size)
+        && (codec = gst_isobmff_sample_entry_codec (stbl, stbl_size)))
+      g_ptr_array_add (codecs, codec);
+
+    if (track->track_id == 0 || (video && !track->video)) {
+      track->track_id = track_id;
+      track->timescale = timescale;
+      track->video = video;
+    }
+  }
+
+  if (track->track_id != 0 && gst_isobmff_box_find (moov, moov_size,
+          FOURCC_mvex, &payload, &payload_size)) {
+    data = payload;
+    size = payload_size;
+    while (gst_isobmff_box_next (&data, &size, &type, &box, &box_size)) {
+      if (type == FOURCC_trex && box_size >= 24
+          && GST_READ_UINT32_BE (box + 4) == track->track_id) {
+        track->default_duration = GST_READ_UINT32_BE (box + 12);
+        track->default_flags = GST_READ_UINT32_BE (box + 20);
+      }
+    }
+  }
+
+  g_ptr_array_add (codecs, NULL);
+  joined = g_strjoinv (",", (gchar **) codecs->pdata);
+  g_ptr_array_unref (codecs);
+
+  return joined;
+}
+
+/**
+ * gst_isobmff_parse_moof:
+ * @moof: content of a moof box
+ * @moof_size: size of @moof
+ * @track: the main track, from gst_isobmff_parse_moov()
+ * @key: (out) (optional): TRUE if the first sample of the track is a sync
+ *   sample, always TRUE for audio
+ * @decode_time: (out) (optional): decode time of the first sample, in the
+ *   track timescale
+ * @duration: (out) (optional): duration of the samples, in the track
+ *   timescale
+ *
+ * Returns: FALSE if the fragment has no sample of @track.
+ */
+gboolean
+gst_isobmff_parse_moof (const guint8 * moof, gsize moof_size,
+    const GstIsobmffTrack * track, gboolean * key, guint64 * decode_time,
+    guint64 * duration)
+{
+  const guint8 *data = moof, *traf, *box;
+  gsize size = moof_size, traf_size, box_size;
+  guint32 type;
+
+  while (gst_isobmff_box_next (&data, &size, &type, &traf, &traf_size)) {
+    guint32 flags, default_duration = track->default_duration;
+    guint32 default_flags = track->default_flags, first_flags;
+    const guint8 *runs = traf;
+    gsize runs_size = traf_size, offset = 8;
+    gboolean first = TRUE;
+    guint64 total = 0;
+
+    if (type != FOURCC_traf)
+      continue;
+    if (!gst_isobmff_box_find (traf, traf_size, FOURCC_tfhd, &box, &box_size)
+        || box_size < 8 || GST_READ_UINT32_BE (box + 4) != track->track_id)
+      continue;
+
+    flags = GST_READ_UINT32_BE (box) & 0xffffff;
+    offset += (flags & 0x01) ? 8 : 0;
+    offset += (flags & 0x02) ? 4 : 0;
+    if ((flags & 0x08) && box_size >= offset + 4)
+      default_duration = GST_READ_UINT32_BE (box + offset);
+    offset += (flags & 0x08) ? 4 : 0;
+    offset += (flags & 0x10) ? 4 : 0;
+    if ((flags & 0x20) && box_size >= offset + 4)
+      default_flags = GST_READ_UINT32_BE (box + offset);
+    first_flags = default_flags;
+
+    if (decode_time) {
+      *decode_time = 0;
+      if (gst_isobmff_box_find (traf, traf_size, FOURCC_tfdt, &box, &box_size)
+          && box_size >= 8)
+        *decode_time = box[0] == 1 && box_size >= 12 ?
+            GST_READ_UINT64_BE (box + 4) : GST_READ_UINT32_BE (box + 4);
+    }
+
+    while (gst_isobmff_box_next (&runs, &runs_size, &type, &box, &box_size)) {
+      guint32 count, entry_size;
+
+      if (type != FOURCC_trun || box_size < 8)
+        continue;
+
+      flags = GST_READ_UINT32_BE (box) & 0xffffff;
+      count = GST_READ_UINT32_BE (box + 4);
+      offset = 8 + ((flags & 0x01) ? 4 : 0);
+      if (flags & 0x04) {
+        if (first && box_size >= offset + 4)
+          first_flags = GST_READ_UINT32_BE (box + offset);
+        offset += 4;
+      } else if ((flags & 0x400) && first && count > 0) {
+        gsize flags_offset = offset + ((flags & 0x100) ? 4 : 0) +
+            ((flags & 0x200) ? 4 : 0);
+
+        if (box_size >= flags_offset + 4)
+          first_flags = GST_READ_UINT32_BE (box + flags_offset);
+      }
+      first = first && count == 0;
+
+      entry_size = ((flags & 0x100) ? 4 : 0) + ((flags & 0x200) ? 4 : 0) +
+          ((flags & 0x400) ? 4 : 0) + ((flags & 0x800) ? 4 : 0);
+      if (!(flags & 0x100)) {
+        total += (guint64) count * default_duration;
+        continue;
+      }
+      for (guint32 i = 0; i < count && box_size >= offset + 4; i++) {
+        total += GST_READ_UINT32_BE (box + offset);
+        offset += entry_size;
+      }
+    }
+
+    if (key)
+      *key = !track->video || !(first_flags & SAMPLE_FLAG_NON_SYNC);
+    if (duration)
+      *duration = total;
+    return TRUE;
+  }
+
+  return FALSE;
+}
@@ -0,0 +1,46 @@
+#ifndef __GST_ISOBMFF_H__
+#define __GST_ISOBMFF_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define GST_ISOBMFF_FOURCC_ftyp GST_MAKE_FOURCC('f','t','y','p')
+#define GST_ISOBMFF_FOURCC_moov GST_MAKE_FOURCC('m','o','o','v')
+#define GST_ISOBMFF_FOURCC_moof GST_MAKE_FOURCC('m','o','o','f')
+#define GST_ISOBMFF_FOURCC_mdat GST_MAKE_FOURCC('m','d','a','t')
+
+/**
+ * GstIsobmffTrack:
+ * @track_id: track the fragments are timed and keyed on, 0 if unknown
+ * @timescale: units per second of the track
+ * @default_duration: sample duration from the trex box
+ * @default_flags: sample flags from the trex box
+ * @video: TRUE if the track is a video track
+ *
+ * Main track of a fragmented MP4: the video one if any, else the first.
+ */
+typedef struct {
+  guint32 track_id;
+  guint32 timescale;
+  guint32 default_duration;
+  guint32 default_flags;
+  gboolean video;
+} GstIsobmffTrack;
+
+gboolean gst_isobmff_box_next (const guint8 ** data, gsize * size,
+    guint32 * type, const guint8 ** payload, gsize * payload_size);
+
+gboolean gst_isobmff_box_find (const guint8 * data, gsize size, guint32 type,
+    const guint8 ** payload, gsize * payload_size);
+
+gchar *gst_isobmff_parse_moov (const guint8 * moov, gsize moov_size,
+    GstIsobmffTrack * track);
+
+gboolean gst_isobmff_parse_moof (const guint8 * moof, gsize moof_size,
+    const GstIsobmffTrack * track, gboolean * key, guint64 * decode_time,
+    guint64 * duration);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,229 @@
+#include "gstrecordindex.h"
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <glib/gstdio.h>
+
+struct _GstRecordIndex
+{
+  const guint8 *data;
+  gsize size;
+  guint n_entries;
+};
+
+struct _GstRecordIndexWriter
+{
+  gint fd;
+};
+
+static gboolean
+gst_record_index_write_all (gint fd, const guint8 * data, gsize size)
+{
+  while (size > 0) {
+    ssize_t written = write (fd, data, size);
+
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      return FALSE;
+    }
+    data += written;
+    size -= written;
+  }
+  return TRUE;
+}
+
+/**
+ * gst_record_index_open:
+ * @path: index file
+ * @error: return location for an error
+ *
+ * Maps the index, the entries written after this call are not seen.
+ *
+ * Returns: (transfer full) (nullable): the index, to close with
+ *   gst_record_index_close().
+ */
+GstRecordIndex *
+gst_record_index_open (const gchar * path, GError ** error)
+{
+  GstRecordIndex *index;
+  struct stat st;
+  gpointer data;
+  gint fd;
+
+  fd = g_open (path, O_RDONLY | O_CLOEXEC, 0);
+  if (fd < 0) {
+    g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+        "Cannot open %s: %s", path, g_strerror (errno));
+    return NULL;
+  }
+  if (fstat (fd, &st) < 0 || st.st_size < GST_RECORD_INDEX_HEADER_SIZE) {
+    g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+        "%s is not a record index", path);
+    close (fd);
+    return NULL;
+  }
+
+  data = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close (fd);
+  if (data == MAP_FAILED) {
+    g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+        "Cannot map %s: %s", path, g_strerror (errno));
+    return NULL;
+  }
+
+  if (memcmp (data, GST_RECORD_INDEX_MAGIC, 8) != 0
+      || GST_READ_UINT32_LE ((guint8 *) data + 8) != GST_RECORD_INDEX_VERSION
+      || GST_READ_UINT32_LE ((guint8 *) data + 12) !=
+      GST_RECORD_INDEX_ENTRY_SIZE) {
+    g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+        "%s is not a version %d record index", path, GST_RECORD_INDEX_VERSION);
+    munmap (data, st.st_size);
+    return NULL;
+  }
+
+  index = g_new0 (GstRecordIndex, 1);
+  index->data = data;
+  index->size = st.st_size;
+  index->n_entries = (st.st_size - GST_RECORD_INDEX_HEADER_SIZE) /
+      GST_RECORD_INDEX_ENTRY_SIZE;
+
+  return index;
+}
+
+void
+gst_record_index_close (GstRecordIndex * index)
+{
+  if (index == NULL)
+    return;
+
+  munmap ((gpointer) index->data, index->size);
+  g_free (index);
+}
+
+guint
+gst_record_index_get_n_entries (GstRecordIndex * index)
+{
+  return index->n_entries;
+}
+
+gboolean
+gst_record_index_get_entry (GstRecordIndex * index, guint i,
+    GstRecordIndexEntry * entry)
+{
+  const guint8 *data;
+
+  if (i >= index->n_entries)
+    return FALSE;
+
+  data = index->data + GST_RECORD_INDEX_HEADER_SIZE +
+      (gsize) i * GST_RECORD_INDEX_ENTRY_SIZE;
+  entry->pts = GST_READ_UINT64_LE (data);
+  entry->offset = GST_READ_UINT64_LE (data + 8);
+  entry->size = GST_READ_UINT32_LE (data + 16);
+  entry->flags = GST_READ_UINT32_LE (data + 20);
+  return TRUE;
+}
+
+/**
+ * gst_record_index_lookup:
+ * @index: the index
+ * @pts: time to seek to
+ *
+ * Returns: the last keyframe at or before @pts, the first one if @pts is
+ *   before it, -1 if the index is empty.
+ */
+gint
+gst_record_index_lookup (GstRecordIndex * index, GstClockTime pts)
+{
+  guint low = 0, high = index->n_entries;
+
+  if (index->n_entries == 0)
+    return -1;
+
+  /* keyframes are indexed in recording order, so by increasing pts */
+  while (high - low > 1) {
+    guint middle = low + (high - low) / 2;
+    const guint8 *data = index->data + GST_RECORD_INDEX_HEADER_SIZE +
+        (gsize) middle * GST_RECORD_INDEX_ENTRY_SIZE;
+
+    if (GST_READ_UINT64_LE (data) <= pts)
+      low = middle;
+    else
+      high = middle;
+  }
+
+  return low;
+}
+
+/**
+ * gst_record_index_writer_new:
+ * @path: index file, replaced
+ * @error: return location for an error
+ *
+ * Returns: (transfer full) (nullable): the writer, to free with
+ *   gst_record_index_writer_free().
+ */
+GstRecordIndexWriter *
+gst_record_index_writer_new (const gchar * path, GError ** error)
+{
+  GstRecordIndexWriter *writer;
+  guint8 header[GST_RECORD_INDEX_HEADER_SIZE];
+  gint fd;
+
+  fd = g_open (path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+        "Cannot open %s: %s", path, g_strerror (errno));
+    return NULL;
+  }
+
+  memcpy (header, GST_RECORD_INDEX_MAGIC, 8);
+  GST_WRITE_UINT32_LE (header + 8, GST_RECORD_INDEX_VERSION);
+  GST_WRITE_UINT32_LE (header + 12, GST_RECORD_INDEX_ENTRY_SIZE);
+  if (!gst_record_index_write_all (fd, header, sizeof (header))) {
+    g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+        "Cannot write %s: %s", path, g_strerror (errno));
+    close (fd);
+    return NULL;
+  }
+
+  writer = g_new0 (GstRecordIndexWriter, 1);
+  writer->fd = fd;
+
+  return writer;
+}
+
+/* One write per entry, a crash loses at most the last keyframe */
+gboolean
+gst_record_index_writer_append (GstRecordIndexWriter * writer,
+    const GstRecordIndexEntry * entry)
+{
+  guint8 data[GST_RECORD_INDEX_ENTRY_SIZE];
+
+  GST_WRITE_UINT64_LE (data, entry->pts);
+  GST_WRITE_UINT64_LE (data + 8, entry->offset);
+  GST_WRITE_UINT32_LE (data + 16, entry->size);
+  GST_WRITE_UINT32_LE (data + 20, entry->flags);
+
+  return gst_record_index_write_all (writer->fd, data, sizeof (data));
+}
+
+void
+gst_record_index_writer_free (GstRecordIndexWriter * writer)
+{
+  if (writer == NULL)
+    return;
+
+  close (writer->fd);
+  g_free (writer);
+}
@@ -0,0 +1,62 @@
+#ifndef __GST_RECORD_INDEX_H__
+#define __GST_RECORD_INDEX_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Sidecar keyframe index of a recording, written next to it as
+ * <recording>.idx while it is recorded.
+ *
+ * The file is a 16 bytes header, "GSTRIDX1" then the version and the entry
+ * size as little endian 32-bit integers, followed by one entry per video
+ * keyframe in recording order:
+ *
+ *   guint64 pts      presentation time in nanoseconds
+ *   guint64 offset   byte offset of the keyframe sample in the recording
+ *   guint32 size     size of the sample
+ *   guint32 flags    reserved, 0
+ *
+ * all little endian. Entries are only appended, a reader mapping the file
+ * while it grows ignores a partial last entry.
+ */
+
+#define GST_RECORD_INDEX_MAGIC "GSTRIDX1"
+#define GST_RECORD_INDEX_VERSION 1
+#define GST_RECORD_INDEX_HEADER_SIZE 16
+#define GST_RECORD_INDEX_ENTRY_SIZE 24
+#define GST_RECORD_INDEX_SUFFIX ".idx"
+
+typedef struct {
+  GstClockTime pts;
+  guint64 offset;
+  guint32 size;
+  guint32 flags;
+} GstRecordIndexEntry;
+
+typedef struct _GstRecordIndex GstRecordIndex;
+typedef struct _GstRecordIndexWriter GstRecordIndexWriter;
+
+GstRecordIndex *gst_record_index_open (const gchar * path, GError ** error);
+
+void gst_record_index_close (GstRecordIndex * index);
+
+guint gst_record_index_get_n_entries (GstRecordIndex * index);
+
+gboolean gst_record_index_get_entry (GstRecordIndex * index, guint i,
+    GstRecordIndexEntry * entry);
+
+gint gst_record_index_lookup (GstRecordIndex * index, GstClockTime pts);
+
+GstRecordIndexWriter *gst_record_index_writer_new (const gchar * path,
+    GError ** error);
+
+gboolean gst_record_index_writer_append (GstRecordIndexWriter * writer,
+    const GstRecordIndexEntry * entry);
+
+void gst_record_index_writer_free (GstRecordIndexWriter * writer);
+
+G_END_DECLS
+
+#endif
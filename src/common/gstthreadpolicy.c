@@ -0,0 +1,356 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "gstthreadpolicy.h"
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+GST_DEBUG_CATEGORY_STATIC (gst_thread_policy_debug);
+#define GST_CAT_DEFAULT gst_thread_policy_debug
+
+#define MAX_CPUS 1024
+
+struct _GstThreadPolicy
+{
+  gchar *branch_class;
+  gchar *description;
+
+  gboolean has_cpus;
+  guint8 cpus[MAX_CPUS / 8];
+
+  gboolean has_nice;
+  gint nice;
+
+  gboolean has_rr;
+  gint rr_priority;
+
+  gboolean shared_pool;
+};
+
+static void ensure_debug_category(void)
+{
+  static gsize initialized = 0;
+
+  if (g_once_init_enter(&initialized)){
+    GST_DEBUG_CATEGORY_INIT (gst_thread_policy_debug, "threadpolicy", 0,
+        "Streaming thread placement");
+    g_once_init_leave(&initialized, 1);
+  }
+}
+
+static gboolean parse_cpus(GstThreadPolicy *policy, const gchar *value)
+{
+  gchar **ranges = g_strsplit(value, ",", -1);
+  gboolean ret = TRUE;
+
+  for (guint i = 0; ranges[i] != NULL && ret; i++){
+    gchar **bounds = g_strsplit(ranges[i], "-", 2);
+    guint64 first = 0, last = 0;
+
+    ret = g_ascii_string_to_unsigned(g_strstrip(bounds[0]), 10, 0, MAX_CPUS - 1, &first, NULL);
+    if (ret && bounds[1] != NULL){
+      ret = g_ascii_string_to_unsigned(g_strstrip(bounds[1]), 10, first, MAX_CPUS - 1, &last, NULL);
+    } else {
+      last = first;
+    }
+
+    for (guint64 cpu = first; ret && cpu <= last; cpu++){
+      policy->cpus[cpu / 8] |= 1 << (cpu % 8);
+    }
+    g_strfreev(bounds);
+  }
+
+  g_strfreev(ranges);
+  policy->has_cpus = ret;
+  return ret;
+}
+
+/**
+ * gst_thread_policy_new_from_string:
+ * @branch_class: name reported with the effective placement
+ * @description: ';' separated list of cpus=<list>, nice=<n>, rr=<priority>
+ *   and pool=shared|default
+ *
+ * Returns: a new policy, or NULL if @description is empty or invalid
+ */
+GstThreadPolicy *gst_thread_policy_new_from_string(const gchar *branch_class, const gchar *description)
+{
+  ensure_debug_category();
+
+  if (description == NULL || *description == '\0')
+    return NULL;
+
+  GstThreadPolicy *policy = g_new0(GstThreadPolicy, 1);
+  policy->branch_class = g_strdup(branch_class);
+  policy->description = g_strdup(description);
+
+  gchar **fields = g_strsplit(description, ";", -1);
+  gboolean ret = TRUE;
+
+  for (guint i = 0; fields[i] != NULL && ret; i++){
+    gchar **kv = g_strsplit(fields[i], "=", 2);
+    const gchar *key = g_strstrip(kv[0]);
+    const gchar *value = kv[1] ? g_strstrip(kv[1]) : NULL;
+    gint64 number = 0;
+
+    if (*key == '\0'){
+      /* trailing separator */
+    } else if (value == NULL){
+      ret = FALSE;
+    } else if (g_strcmp0(key, "cpus") == 0){
+      ret = parse_cpus(policy, value);
+    } else if (g_strcmp0(key, "nice") == 0){
+      ret = g_ascii_string_to_signed(value, 10, -20, 19, &number, NULL);
+      policy->has_nice = ret;
+      policy->nice = number;
+    } else if (g_strcmp0(key, "rr") == 0){
+      ret = g_ascii_string_to_signed(value, 10, 1, 99, &number, NULL);
+      policy->has_rr = ret;
+      policy->rr_priority = number;
+    } else if (g_strcmp0(key, "pool") == 0){
+      ret = g_strcmp0(value, "shared") == 0 || g_strcmp0(value, "default") == 0;
+      policy->shared_pool = g_strcmp0(value, "shared") == 0;
+    } else {
+      ret = FALSE;
+    }
+
+    if (!ret){
+      GST_WARNING("Invalid %s thread policy field '%s'", branch_class, fields[i]);
+    }
+    g_strfreev(kv);
+  }
+  g_strfreev(fields);
+
+  if (!ret){
+    gst_thread_policy_free(policy);
+    return NULL;
+  }
+
+  GST_INFO("%s thread policy: %s", branch_class, description);
+  return policy;
+}
+
+void gst_thread_policy_free(GstThreadPolicy *policy)
+{
+  if (policy == NULL)
+    return;
+
+  g_free(policy->branch_class);
+  g_free(policy->description);
+  g_free(policy);
+}
+
+const gchar *gst_thread_policy_get_description(GstThreadPolicy *policy)
+{
+  return policy ? policy->description : NULL;
+}
+
+/**
+ * gst_thread_policy_get_shared_pool:
+ *
+ * Returns: (transfer none): the process-wide pool the streaming tasks of a
+ *   policy with pool=shared run on
+ */
+GstTaskPool *gst_thread_policy_get_shared_pool(void)
+{
+  static gsize initialized = 0;
+  static GstTaskPool *pool = NULL;
+
+  if (g_once_init_enter(&initialized)){
+    GError *error = NULL;
+
+    ensure_debug_category();
+    pool = gst_task_pool_new();
+    gst_task_pool_prepare(pool, &error);
+    if (error != NULL){
+      GST_ERROR("Failed to prepare shared task pool: %s", error->message);
+      g_error_free(error);
+    }
+    GST_OBJECT_FLAG_SET(pool, GST_OBJECT_FLAG_MAY_BE_LEAKED);
+    g_once_init_leave(&initialized, 1);
+  }
+
+  return pool;
+}
+
+#ifdef __linux__
+static gchar *format_cpu_set(cpu_set_t *set)
+{
+  GString *cpus = g_string_new(NULL);
+  gint first = -1;
+
+  for (gint cpu = 0; cpu <= CPU_SETSIZE; cpu++){
+    gboolean in_set = cpu < CPU_SETSIZE && CPU_ISSET(cpu, set);
+
+    if (in_set && first < 0){
+      first = cpu;
+    } else if (!in_set && first >= 0){
+      if (cpus->len > 0)
+        g_string_append_c(cpus, ',');
+      if (cpu - 1 == first)
+        g_string_append_printf(cpus, "%d", first);
+      else
+        g_string_append_printf(cpus, "%d-%d", first, cpu - 1);
+      first = -1;
+    }
+  }
+
+  return g_string_free(cpus, FALSE);
+}
+
+static const gchar *scheduler_name(gint policy)
+{
+  switch (policy){
+    case SCHED_RR:
+      return "rr";
+    case SCHED_FIFO:
+      return "fifo";
+    case SCHED_BATCH:
+      return "batch";
+    case SCHED_IDLE:
+      return "idle";
+    default:
+      return "other";
+  }
+}
+#endif
+
+/* Runs in the thread entering the task, the placement only affects it */
+static void gst_thread_policy_apply(GstThreadPolicy *policy, GstElement *reporter,
+    GstElement *owner, GstTask *task)
+{
+  const gchar *thread_name = task ? GST_OBJECT_NAME(task) : owner ? GST_OBJECT_NAME(owner) : "unknown";
+  GString *errors = g_string_new(NULL);
+  GstStructure *placement;
+
+#ifdef __linux__
+  pid_t tid = syscall(SYS_gettid);
+  gint err;
+
+  if (policy->has_cpus){
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (gint cpu = 0; cpu < MAX_CPUS && cpu < CPU_SETSIZE; cpu++){
+      if (policy->cpus[cpu / 8] & (1 << (cpu % 8)))
+        CPU_SET(cpu, &set);
+    }
+
+    err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (err != 0)
+      g_string_append_printf(errors, "affinity: %s; ", g_strerror(err));
+  }
+
+  if (policy->has_rr){
+    struct sched_param param = { .sched_priority = policy->rr_priority };
+    err = pthread_setschedparam(pthread_self(), SCHED_RR, &param);
+    if (err != 0)
+      g_string_append_printf(errors, "rr: %s; ", g_strerror(err));
+  }
+
+  if (policy->has_nice && setpriority(PRIO_PROCESS, tid, policy->nice) != 0){
+    g_string_append_printf(errors, "nice: %s; ", g_strerror(errno));
+  }
+
+  /* report what the kernel actually granted */
+  cpu_set_t effective;
+  CPU_ZERO(&effective);
+  pthread_getaffinity_np(pthread_self(), sizeof(effective), &effective);
+  gchar *cpus = format_cpu_set(&effective);
+
+  gint sched_policy = SCHED_OTHER;
+  struct sched_param sched_param = { 0 };
+  pthread_getschedparam(pthread_self(), &sched_policy, &sched_param);
+
+  errno = 0;
+  gint nice = getpriority(PRIO_PROCESS, tid);
+
+  placement = gst_structure_new("thread-placement",
+      "class", G_TYPE_STRING, policy->branch_class,
+      "thread", G_TYPE_STRING, thread_name,
+      "tid", G_TYPE_INT, (gint) tid,
+      "cpus", G_TYPE_STRING, cpus,
+      "scheduler", G_TYPE_STRING, scheduler_name(sched_policy),
+      "priority", G_TYPE_INT, sched_param.sched_priority,
+      "nice", G_TYPE_INT, nice,
+      NULL);
+  g_free(cpus);
+#else
+  g_string_append(errors, "thread placement is not supported on this platform");
+  placement = gst_structure_new("thread-placement",
+      "class", G_TYPE_STRING, policy->branch_class,
+      "thread", G_TYPE_STRING, thread_name,
+      NULL);
+#endif
+
+  gst_structure_set(placement,
+      "pool", G_TYPE_STRING, policy->shared_pool ? "shared" : "default",
+      "applied", G_TYPE_BOOLEAN, errors->len == 0,
+      "error", G_TYPE_STRING, errors->len ? errors->str : NULL,
+      NULL);
+
+  if (errors->len){
+    GST_WARNING_OBJECT(reporter, "Could not fully place %s thread %s: %s",
+        policy->branch_class, thread_name, errors->str);
+  }
+  GST_INFO_OBJECT(reporter, "Placed %" GST_PTR_FORMAT, placement);
+
+  gst_element_post_message(reporter, gst_message_new_element(GST_OBJECT(reporter), placement));
+  g_string_free(errors, TRUE);
+}
+
+/**
+ * gst_thread_policy_handle_message:
+ * @policy: (nullable): the policy to apply
+ * @reporter: element posting the effective placement
+ * @message: a message seen by the bin of @reporter
+ *
+ * Moves tasks to the shared pool when they are created and places the
+ * streaming thread when it enters the task. Must be called from a bus sync
+ * handler or GstBin::handle_message so it runs in the posting thread.
+ *
+ * Returns: TRUE if @message was a stream-status message handled by @policy
+ */
+gboolean gst_thread_policy_handle_message(GstThreadPolicy *policy, GstElement *reporter, GstMessage *message)
+{
+  GstStreamStatusType type;
+  GstElement *owner = NULL;
+  GstTask *task = NULL;
+
+  if (policy == NULL || GST_MESSAGE_TYPE(message) != GST_MESSAGE_STREAM_STATUS)
+    return FALSE;
+
+  gst_message_parse_stream_status(message, &type, &owner);
+
+  const GValue *object = gst_message_get_stream_status_object(message);
+  if (object != NULL && G_VALUE_HOLDS(object, GST_TYPE_TASK))
+    task = GST_TASK(g_value_get_object(object));
+
+  switch (type){
+    case GST_STREAM_STATUS_TYPE_CREATE:
+      if (policy->shared_pool && task != NULL){
+        gst_task_set_pool(task, gst_thread_policy_get_shared_pool());
+      }
+      break;
+    case GST_STREAM_STATUS_TYPE_ENTER:
+      gst_thread_policy_apply(policy, reporter, owner, task);
+      break;
+    default:
+      break;
+  }
+
+  return TRUE;
+}
@@ -0,0 +1,31 @@
+#ifndef __GST_THREAD_POLICY_H__
+#define __GST_THREAD_POLICY_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/**
+ * GstThreadPolicy:
+ *
+ * Placement of the streaming threads of one branch class (encoder, preview,
+ * publish...). Parsed from a description such as
+ * "cpus=0-3,6;nice=5;pool=shared" or "cpus=2;rr=10".
+ */
+typedef struct _GstThreadPolicy GstThreadPolicy;
+
+GstThreadPolicy *gst_thread_policy_new_from_string (const gchar * branch_class,
+    const gchar * description);
+
+void gst_thread_policy_free (GstThreadPolicy * policy);
+
+const gchar *gst_thread_policy_get_description (GstThreadPolicy * policy);
+
+gboolean gst_thread_policy_handle_message (GstThreadPolicy * policy,
+    GstElement * reporter, GstMessage * message);
+
+GstTaskPool *gst_thread_policy_get_shared_pool (void);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,325 @@
+#include "gstworkpool.h"
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+GST_DEBUG_CATEGORY_STATIC (gst_work_pool_debug);
+#define GST_CAT_DEFAULT gst_work_pool_debug
+
+typedef struct
+{
+  GstWorkPoolFunc func;
+  gpointer data;
+} GstWorkPoolJob;
+
+typedef struct
+{
+  GstWorkPool *pool;
+  guint index;
+  GThread *thread;
+
+  GMutex lock;
+  GQueue jobs;
+
+  guint64 executed;
+  guint64 steals;
+} GstWorkPoolWorker;
+
+struct _GstWorkPool
+{
+  guint n_workers;
+  GstWorkPoolWorker *workers;
+
+  /* total number of queued jobs, sleeping workers wait for it to grow */
+  gint pending;
+  guint next;
+
+  GMutex lock;
+  GCond cond;
+  guint sleeping;
+};
+
+/* Items of one gst_work_pool_parallel() call, held by each job queued for
+ * it. Jobs running late find no item left and only touch the counter. */
+typedef struct
+{
+  GstWorkPoolItemFunc func;
+  gpointer data;
+  guint n_items;
+  gint next;
+  gint done;
+
+  GMutex lock;
+  GCond cond;
+} GstWorkPoolParallel;
+
+static GPrivate current_worker;
+
+static gboolean gst_work_pool_take(GstWorkPool *pool, GstWorkPoolWorker *self,
+    GstWorkPoolJob **job, gboolean *stolen)
+{
+  /* own jobs first, oldest first so a branch keeps its order */
+  g_mutex_lock(&self->lock);
+  *job = g_queue_pop_head(&self->jobs);
+  g_mutex_unlock(&self->lock);
+
+  if (*job != NULL){
+    *stolen = FALSE;
+    return TRUE;
+  }
+
+  /* steal the newest job of the next busy worker */
+  for (guint i = 1; i < pool->n_workers; i++){
+    GstWorkPoolWorker *victim = &pool->workers[(self->index + i) % pool->n_workers];
+
+    g_mutex_lock(&victim->lock);
+    *job = g_queue_pop_tail(&victim->jobs);
+    g_mutex_unlock(&victim->lock);
+
+    if (*job != NULL){
+      *stolen = TRUE;
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+static gpointer gst_work_pool_worker_func(gpointer data)
+{
+  GstWorkPoolWorker *self = data;
+  GstWorkPool *pool = self->pool;
+
+  g_private_set(&current_worker, self);
+
+  for (;;){
+    GstWorkPoolJob *job;
+    gboolean stolen;
+
+    if (!gst_work_pool_take(pool, self, &job, &stolen)){
+      g_mutex_lock(&pool->lock);
+      while (g_atomic_int_get(&pool->pending) <= 0){
+        pool->sleeping++;
+        g_cond_wait(&pool->cond, &pool->lock);
+        pool->sleeping--;
+      }
+      g_mutex_unlock(&pool->lock);
+      continue;
+    }
+
+    g_atomic_int_add(&pool->pending, -1);
+
+    job->func(job->data, stolen);
+    g_slice_free(GstWorkPoolJob, job);
+
+    /* only read for stats, a torn 64 bit read is harmless */
+    self->executed++;
+    if (stolen)
+      self->steals++;
+  }
+
+  return NULL;
+}
+
+/**
+ * gst_work_pool_get_default:
+ *
+ * Returns: (transfer none): the process-wide pool, started on first use
+ *   with one worker per core. Workers live until the process exits.
+ */
+GstWorkPool *gst_work_pool_get_default(void)
+{
+  static gsize initialized = 0;
+  static GstWorkPool *pool = NULL;
+
+  if (g_once_init_enter(&initialized)){
+    GST_DEBUG_CATEGORY_INIT (gst_work_pool_debug, "workpool", 0,
+        "Shared work-stealing pool");
+
+    pool = g_new0(GstWorkPool, 1);
+    pool->n_workers = MAX(1, g_get_num_processors());
+    pool->workers = g_new0(GstWorkPoolWorker, pool->n_workers);
+    g_mutex_init(&pool->lock);
+    g_cond_init(&pool->cond);
+
+    for (guint i = 0; i < pool->n_workers; i++){
+      GstWorkPoolWorker *worker = &pool->workers[i];
+      gchar *name = g_strdup_printf("workpool-%u", i);
+
+      worker->pool = pool;
+      worker->index = i;
+      g_mutex_init(&worker->lock);
+      g_queue_init(&worker->jobs);
+      worker->thread = g_thread_new(name, gst_work_pool_worker_func, worker);
+      g_free(name);
+    }
+
+    GST_INFO("Started shared work pool with %u threads", pool->n_workers);
+    g_once_init_leave(&initialized, 1);
+  }
+
+  return pool;
+}
+
+/**
+ * gst_work_pool_push:
+ * @pool: a #GstWorkPool
+ * @func: the job
+ * @data: user data for @func
+ *
+ * Queues @func on the calling worker when called from a job, on the next
+ * worker in turn otherwise.
+ */
+void gst_work_pool_push(GstWorkPool *pool, GstWorkPoolFunc func, gpointer data)
+{
+  GstWorkPoolWorker *worker = g_private_get(&current_worker);
+  GstWorkPoolJob *job = g_slice_new(GstWorkPoolJob);
+
+  job->func = func;
+  job->data = data;
+
+  if (worker == NULL || worker->pool != pool){
+    guint next = (guint) g_atomic_int_add((gint *) &pool->next, 1);
+    worker = &pool->workers[next % pool->n_workers];
+  }
+
+  g_mutex_lock(&worker->lock);
+  g_queue_push_tail(&worker->jobs, job);
+  g_mutex_unlock(&worker->lock);
+
+  g_atomic_int_inc(&pool->pending);
+
+  g_mutex_lock(&pool->lock);
+  if (pool->sleeping > 0)
+    g_cond_signal(&pool->cond);
+  g_mutex_unlock(&pool->lock);
+}
+
+static void gst_work_pool_parallel_run(GstWorkPoolParallel *parallel)
+{
+  gint index;
+
+  while ((index = g_atomic_int_add(&parallel->next, 1)) < (gint) parallel->n_items){
+    parallel->func(parallel->data, index);
+
+    if (g_atomic_int_add(&parallel->done, 1) + 1 == (gint) parallel->n_items){
+      g_mutex_lock(&parallel->lock);
+      g_cond_signal(&parallel->cond);
+      g_mutex_unlock(&parallel->lock);
+    }
+  }
+}
+
+static void gst_work_pool_parallel_clear(gpointer data)
+{
+  GstWorkPoolParallel *parallel = data;
+
+  g_mutex_clear(&parallel->lock);
+  g_cond_clear(&parallel->cond);
+}
+
+static void gst_work_pool_parallel_func(gpointer data, gboolean stolen)
+{
+  gst_work_pool_parallel_run(data);
+  g_atomic_rc_box_release_full(data, gst_work_pool_parallel_clear);
+}
+
+/**
+ * gst_work_pool_parallel:
+ * @pool: a #GstWorkPool
+ * @n_items: number of items
+ * @func: called once per item, from any thread
+ * @data: user data for @func
+ *
+ * Runs @func on items 0 to @n_items - 1 on the workers and the calling
+ * thread, and returns once all of them are done. The caller takes items
+ * itself while the workers are busy, so it can be called from a job.
+ */
+void gst_work_pool_parallel(GstWorkPool *pool, guint n_items, GstWorkPoolItemFunc func, gpointer data)
+{
+  GstWorkPoolParallel *parallel;
+  guint helpers = MIN(n_items, pool->n_workers + 1) - 1;
+
+  if (helpers == 0){
+    for (guint i = 0; i < n_items; i++)
+      func(data, i);
+    return;
+  }
+
+  parallel = g_atomic_rc_box_new0(GstWorkPoolParallel);
+  parallel->func = func;
+  parallel->data = data;
+  parallel->n_items = n_items;
+  g_mutex_init(&parallel->lock);
+  g_cond_init(&parallel->cond);
+
+  for (guint i = 0; i < helpers; i++)
+    gst_work_pool_push(pool, gst_work_pool_parallel_func, g_atomic_rc_box_acquire(parallel));
+
+  gst_work_pool_parallel_run(parallel);
+
+  g_mutex_lock(&parallel->lock);
+  while (g_atomic_int_get(&parallel->done) < (gint) n_items)
+    g_cond_wait(&parallel->cond, &parallel->lock);
+  g_mutex_unlock(&parallel->lock);
+
+  g_atomic_rc_box_release_full(parallel, gst_work_pool_parallel_clear);
+}
+
+guint gst_work_pool_get_n_threads(GstWorkPool *pool)
+{
+  return pool->n_workers;
+}
+
+/**
+ * gst_work_pool_get_stats:
+ * @pool: a #GstWorkPool
+ *
+ * Returns: (transfer full): a "work-pool-stats" structure with the number of
+ *   threads, the queued jobs, and per worker arrays of queue depth, executed
+ *   jobs and steals
+ */
+GstStructure *gst_work_pool_get_stats(GstWorkPool *pool)
+{
+  GValue depths = G_VALUE_INIT, executed = G_VALUE_INIT, steals = G_VALUE_INIT;
+  guint64 total_executed = 0, total_steals = 0;
+
+  gst_value_array_init(&depths, pool->n_workers);
+  gst_value_array_init(&executed, pool->n_workers);
+  gst_value_array_init(&steals, pool->n_workers);
+
+  for (guint i = 0; i < pool->n_workers; i++){
+    GstWorkPoolWorker *worker = &pool->workers[i];
+    GValue v = G_VALUE_INIT;
+
+    g_mutex_lock(&worker->lock);
+    g_value_init(&v, G_TYPE_UINT);
+    g_value_set_uint(&v, worker->jobs.length);
+    g_mutex_unlock(&worker->lock);
+    gst_value_array_append_and_take_value(&depths, &v);
+
+    g_value_init(&v, G_TYPE_UINT64);
+    g_value_set_uint64(&v, worker->executed);
+    gst_value_array_append_and_take_value(&executed, &v);
+    total_executed += worker->executed;
+
+    g_value_init(&v, G_TYPE_UINT64);
+    g_value_set_uint64(&v, worker->steals);
+    gst_value_array_append_and_take_value(&steals, &v);
+    total_steals += worker->steals;
+  }
+
+  GstStructure *stats = gst_structure_new("work-pool-stats",
+      "threads", G_TYPE_UINT, pool->n_workers,
+      "queued", G_TYPE_INT, g_atomic_int_get(&pool->pending),
+      "executed", G_TYPE_UINT64, total_executed,
+      "steals", G_TYPE_UINT64, total_steals,
+      NULL);
+
+  gst_structure_take_value(stats, "worker-depth", &depths);
+  gst_structure_take_value(stats, "worker-executed", &executed);
+  gst_structure_take_value(stats, "worker-steals", &steals);
+
+  return stats;
+}
@@ -0,0 +1,47 @@
+#ifndef __GST_WORK_POOL_H__
+#define __GST_WORK_POOL_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/**
+ * GstWorkPool:
+ *
+ * Process-wide work-stealing executor. One worker per core, each with its
+ * own deque; idle workers steal from the others. Jobs must run to
+ * completion quickly and reschedule themselves instead of looping, so many
+ * engines can share a bounded number of threads.
+ */
+typedef struct _GstWorkPool GstWorkPool;
+
+/**
+ * GstWorkPoolFunc:
+ * @data: user data given to gst_work_pool_push()
+ * @stolen: TRUE if the job ran on a worker other than the one it was
+ *   queued on
+ */
+typedef void (*GstWorkPoolFunc) (gpointer data, gboolean stolen);
+
+/**
+ * GstWorkPoolItemFunc:
+ * @data: user data given to gst_work_pool_parallel()
+ * @index: the item to process
+ */
+typedef void (*GstWorkPoolItemFunc) (gpointer data, guint index);
+
+GstWorkPool *gst_work_pool_get_default (void);
+
+void gst_work_pool_push (GstWorkPool * pool, GstWorkPoolFunc func,
+    gpointer data);
+
+void gst_work_pool_parallel (GstWorkPool * pool, guint n_items,
+    GstWorkPoolItemFunc func, gpointer data);
+
+guint gst_work_pool_get_n_threads (GstWorkPool * pool);
+
+GstStructure *gst_work_pool_get_stats (GstWorkPool * pool);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,729 @@
+#include "gstaudiofrontend.h"
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <time.h>
+
+#include <gst/audio/audio.h>
+#include <gst/base/gstflowcombiner.h>
+
+GST_DEBUG_CATEGORY_STATIC (gst_audio_frontend_debug);
+#define GST_CAT_DEFAULT gst_audio_frontend_debug
+
+#define gst_audio_frontend_parent_class parent_class
+
+#define DEFAULT_QUALITY 8
+
+/* buffers kept by the pool of a stage, the queues in front of the encoders
+ * hold a few */
+#define POOL_MIN_BUFFERS 4
+
+#define AUDIO_FRONTEND_CAPS \
+    "audio/x-raw, " \
+    "format = (string) " GST_AUDIO_FORMATS_ALL ", " \
+    "rate = " GST_AUDIO_RATE_RANGE ", " \
+    "channels = " GST_AUDIO_CHANNELS_RANGE ", " \
+    "layout = (string) { interleaved, non-interleaved }"
+
+/* properties */
+enum
+{
+  PROP_0,
+  PROP_QUALITY,
+  PROP_STATS,
+};
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (AUDIO_FRONTEND_CAPS));
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src_%u",
+    GST_PAD_SRC,
+    GST_PAD_REQUEST,
+    GST_STATIC_CAPS (AUDIO_FRONTEND_CAPS));
+
+/* One conversion of the input, shared by the outputs negotiating the same
+ * format, rate and channels */
+typedef struct
+{
+  GstAudioInfo info;
+  GstAudioConverter *converter;
+  GstBufferPool *pool;
+  gsize pool_size;
+
+  /* timestamps count the samples out since the last discontinuity */
+  GstClockTime start;
+  guint64 samples;
+  gboolean discont;
+  GstBuffer *out;
+
+  /* under the object lock */
+  guint n_outputs;
+  guint64 buffers;
+  GstClockTime cpu_time;
+} GstAudioFrontendStage;
+
+typedef struct
+{
+  GstPad *pad;
+  GstAudioFrontendStage *stage;
+} GstAudioFrontendOutput;
+
+/* The audio of the engine converted once for all the encoders: each request
+ * pad negotiates the format and rate its encoder takes, and the outputs
+ * asking for the same one share a single pass of conversion and
+ * resampling, written in buffers of a pool of its own. */
+struct _GstAudioFrontend
+{
+  GstElement parent_instance;
+
+  GstPad *sinkpad;
+
+  /* under the object lock */
+  gint quality;
+  guint next_pad;
+  guint64 buffers;
+  GPtrArray *stages;
+
+  gint reconfigure;
+
+  /* from the streaming thread */
+  GstAudioInfo in_info;
+  GArray *outputs;
+  GstFlowCombiner *flow_combiner;
+};
+
+G_DEFINE_TYPE(GstAudioFrontend, gst_audio_frontend, GST_TYPE_ELEMENT);
+
+/* CPU time of the calling thread, the conversion runs in the streaming
+ * thread of the source */
+static GstClockTime gst_audio_frontend_cpu_time(void)
+{
+  struct timespec ts;
+
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+    return 0;
+
+  return GST_TIMESPEC_TO_TIME(ts);
+}
+
+static void gst_audio_frontend_stage_free(gpointer data)
+{
+  GstAudioFrontendStage *stage = data;
+
+  gst_buffer_replace(&stage->out, NULL);
+  if (stage->pool){
+    gst_buffer_pool_set_active(stage->pool, FALSE);
+    gst_object_unref(stage->pool);
+  }
+  if (stage->converter)
+    gst_audio_converter_free(stage->converter);
+  g_free(stage);
+}
+
+static GstAudioFrontendStage *gst_audio_frontend_stage_new(GstAudioFrontend *self, const GstAudioInfo *info, gint quality)
+{
+  GstAudioFrontendStage *stage = g_new0(GstAudioFrontendStage, 1);
+  GstStructure *config = gst_structure_new_empty("GstAudioConverter.config");
+
+  gst_structure_set(config,
+      GST_AUDIO_CONVERTER_OPT_RESAMPLER_METHOD, GST_TYPE_AUDIO_RESAMPLER_METHOD, GST_AUDIO_RESAMPLER_METHOD_KAISER,
+      NULL);
+  gst_audio_resampler_options_set_quality(GST_AUDIO_RESAMPLER_METHOD_KAISER, quality,
+      GST_AUDIO_INFO_RATE(&self->in_info), GST_AUDIO_INFO_RATE(info), config);
+
+  stage->info = *info;
+  stage->start = GST_CLOCK_TIME_NONE;
+  stage->converter = gst_audio_converter_new(GST_AUDIO_CONVERTER_FLAG_NONE, &self->in_info, &stage->info, config);
+  if (stage->converter == NULL){
+    gst_audio_frontend_stage_free(stage);
+    return NULL;
+  }
+
+  GST_DEBUG_OBJECT(self, "New stage to %s at %d Hz, %d channels%s",
+      GST_AUDIO_INFO_NAME(info), GST_AUDIO_INFO_RATE(info), GST_AUDIO_INFO_CHANNELS(info),
+      gst_audio_converter_is_passthrough(stage->converter) ? ", passthrough" : "");
+
+  return stage;
+}
+
+/* A pool in use cannot be configured again, a larger one replaces it and
+ * the buffers still downstream go back to the old one */
+static gboolean gst_audio_frontend_stage_grow_pool(GstAudioFrontendStage *stage, gsize size)
+{
+  GstBufferPool *pool = gst_buffer_pool_new();
+  GstStructure *config = gst_buffer_pool_get_config(pool);
+  GstCaps *caps = gst_audio_info_to_caps(&stage->info);
+
+  /* room for the rounding of the resampler */
+  size += size / 4;
+  gst_buffer_pool_config_set_params(config, caps, size, POOL_MIN_BUFFERS, 0);
+  gst_caps_unref(caps);
+  if (!gst_buffer_pool_set_config(pool, config) || !gst_buffer_pool_set_active(pool, TRUE)){
+    gst_object_unref(pool);
+    return FALSE;
+  }
+
+  if (stage->pool){
+    gst_buffer_pool_set_active(stage->pool, FALSE);
+    gst_object_unref(stage->pool);
+  }
+  stage->pool = pool;
+  stage->pool_size = size;
+  return TRUE;
+}
+
+static void gst_audio_frontend_stage_reset(GstAudioFrontendStage *stage)
+{
+  gst_audio_converter_reset(stage->converter);
+  stage->start = GST_CLOCK_TIME_NONE;
+  stage->samples = 0;
+}
+
+static GstFlowReturn gst_audio_frontend_stage_process(GstAudioFrontend *self, GstAudioFrontendStage *stage,
+                                                      GstAudioBuffer *in, GstBuffer *inbuf)
+{
+  GstClockTime started = gst_audio_frontend_cpu_time();
+  GstAudioBuffer out;
+  GstBuffer *outbuf;
+  GstFlowReturn ret;
+  gsize out_frames, size;
+  gboolean converted;
+
+  if (GST_BUFFER_IS_DISCONT(inbuf) || !GST_CLOCK_TIME_IS_VALID(stage->start)){
+    if (GST_BUFFER_IS_DISCONT(inbuf))
+      gst_audio_converter_reset(stage->converter);
+    stage->start = GST_BUFFER_PTS(inbuf);
+    stage->samples = 0;
+    stage->discont = TRUE;
+  }
+
+  /* the input already is what the encoder takes */
+  if (gst_audio_converter_is_passthrough(stage->converter)){
+    stage->out = gst_buffer_ref(inbuf);
+    stage->samples += in->n_samples;
+    stage->discont = FALSE;
+    out_frames = in->n_samples;
+    goto done;
+  }
+
+  /* nothing out while the resampler fills up */
+  out_frames = gst_audio_converter_get_out_frames(stage->converter, in->n_samples);
+  if (out_frames == 0)
+    goto done;
+
+  size = out_frames * GST_AUDIO_INFO_BPF(&stage->info);
+  if (size > stage->pool_size && !gst_audio_frontend_stage_grow_pool(stage, size)){
+    GST_ELEMENT_ERROR(self, RESOURCE, FAILED, ("Failed to configure the buffer pool"), (NULL));
+    return GST_FLOW_ERROR;
+  }
+  ret = gst_buffer_pool_acquire_buffer(stage->pool, &outbuf, NULL);
+  if (ret != GST_FLOW_OK)
+    return ret;
+
+  gst_buffer_set_size(outbuf, size);
+  if (GST_AUDIO_INFO_LAYOUT(&stage->info) == GST_AUDIO_LAYOUT_NON_INTERLEAVED)
+    gst_buffer_add_audio_meta(outbuf, &stage->info, out_frames, NULL);
+  if (!gst_audio_buffer_map(&out, &stage->info, outbuf, GST_MAP_WRITE)){
+    gst_buffer_unref(outbuf);
+    return GST_FLOW_ERROR;
+  }
+  converted = gst_audio_converter_samples(stage->converter, GST_AUDIO_CONVERTER_FLAG_NONE,
+      in->planes, in->n_samples, out.planes, out_frames);
+  gst_audio_buffer_unmap(&out);
+  if (!converted){
+    gst_buffer_unref(outbuf);
+    GST_ELEMENT_ERROR(self, STREAM, FORMAT, ("Failed to convert the audio"), (NULL));
+    return GST_FLOW_ERROR;
+  }
+
+  if (GST_CLOCK_TIME_IS_VALID(stage->start)){
+    gint rate = GST_AUDIO_INFO_RATE(&stage->info);
+    GstClockTime end = stage->start + gst_util_uint64_scale_int(stage->samples + out_frames, GST_SECOND, rate);
+
+    GST_BUFFER_PTS(outbuf) = stage->start + gst_util_uint64_scale_int(stage->samples, GST_SECOND, rate);
+    GST_BUFFER_DURATION(outbuf) = end - GST_BUFFER_PTS(outbuf);
+  }
+  if (stage->discont)
+    GST_BUFFER_FLAG_SET(outbuf, GST_BUFFER_FLAG_DISCONT);
+  stage->discont = FALSE;
+  stage->samples += out_frames;
+  stage->out = outbuf;
+
+done:
+  GST_OBJECT_LOCK(self);
+  if (out_frames > 0)
+    stage->buffers++;
+  stage->cpu_time += gst_audio_frontend_cpu_time() - started;
+  GST_OBJECT_UNLOCK(self);
+
+  return GST_FLOW_OK;
+}
+
+static gboolean forward_sticky_event(GstPad *pad, GstEvent **event, gpointer user_data)
+{
+  GstPad *srcpad = GST_PAD(user_data);
+
+  /* each output has caps of its own */
+  if (GST_EVENT_TYPE(*event) != GST_EVENT_EOS && GST_EVENT_TYPE(*event) != GST_EVENT_CAPS){
+    gst_pad_store_sticky_event(srcpad, *event);
+  }
+
+  return TRUE;
+}
+
+/* The format of the input the encoder takes, at the rate closest to it */
+static GstCaps *gst_audio_frontend_fixate(GstAudioFrontend *self, GstPad *pad)
+{
+  GstCaps *templ = gst_pad_get_pad_template_caps(pad);
+  GstCaps *caps = gst_pad_peer_query_caps(pad, templ);
+  GstCaps *same, *preferred;
+  GstStructure *s;
+
+  gst_caps_unref(templ);
+  if (gst_caps_is_empty(caps)){
+    gst_caps_unref(caps);
+    return NULL;
+  }
+
+  /* encoders list mono first, the channels are kept when they can be */
+  same = gst_caps_new_simple("audio/x-raw", "channels", G_TYPE_INT, GST_AUDIO_INFO_CHANNELS(&self->in_info), NULL);
+  preferred = gst_caps_intersect_full(caps, same, GST_CAPS_INTERSECT_FIRST);
+  gst_caps_unref(same);
+  if (gst_caps_is_empty(preferred)){
+    gst_caps_unref(preferred);
+  } else {
+    gst_caps_unref(caps);
+    caps = preferred;
+  }
+
+  caps = gst_caps_truncate(gst_caps_make_writable(caps));
+  s = gst_caps_get_structure(caps, 0);
+  gst_structure_fixate_field_nearest_int(s, "rate", GST_AUDIO_INFO_RATE(&self->in_info));
+  gst_structure_fixate_field_nearest_int(s, "channels", GST_AUDIO_INFO_CHANNELS(&self->in_info));
+  gst_structure_fixate_field_string(s, "format", GST_AUDIO_INFO_NAME(&self->in_info));
+  gst_structure_fixate_field_string(s, "layout",
+      GST_AUDIO_INFO_LAYOUT(&self->in_info) == GST_AUDIO_LAYOUT_INTERLEAVED ? "interleaved" : "non-interleaved");
+
+  return gst_caps_fixate(caps);
+}
+
+/* Outputs to the stages of their caps. Stages kept from before keep the
+ * state of their resampler, so adding an output does not glitch the
+ * others. */
+static gboolean gst_audio_frontend_negotiate(GstAudioFrontend *self)
+{
+  GArray *outputs = g_array_new(FALSE, TRUE, sizeof(GstAudioFrontendOutput));
+  GPtrArray *stages = g_ptr_array_new_with_free_func(gst_audio_frontend_stage_free);
+  GPtrArray *old_stages;
+  gboolean ret = TRUE;
+  gint quality;
+
+  GST_OBJECT_LOCK(self);
+  quality = self->quality;
+  old_stages = self->stages;
+  for (GList *l = GST_ELEMENT(self)->srcpads; l; l = l->next){
+    GstAudioFrontendOutput output = { gst_object_ref(l->data), NULL };
+
+    g_array_append_val(outputs, output);
+  }
+  GST_OBJECT_UNLOCK(self);
+
+  gst_flow_combiner_clear(self->flow_combiner);
+  for (guint i = 0; i < outputs->len && ret; i++){
+    GstAudioFrontendOutput *output = &g_array_index(outputs, GstAudioFrontendOutput, i);
+    GstAudioFrontendStage *stage = NULL;
+    GstAudioInfo info;
+    GstCaps *caps;
+
+    /* stream-start and segment go out ahead of the caps pushed below */
+    gst_pad_sticky_events_foreach(self->sinkpad, forward_sticky_event, output->pad);
+    gst_flow_combiner_add_pad(self->flow_combiner, output->pad);
+
+    caps = gst_audio_frontend_fixate(self, output->pad);
+    if (caps == NULL || !gst_audio_info_from_caps(&info, caps)){
+      GST_WARNING_OBJECT(self, "No format for %s", GST_PAD_NAME(output->pad));
+      if (caps)
+        gst_caps_unref(caps);
+      ret = FALSE;
+      break;
+    }
+
+    for (guint j = 0; j < stages->len && !stage; j++)
+      if (gst_audio_info_is_equal(&((GstAudioFrontendStage *) g_ptr_array_index(stages, j))->info, &info))
+        stage = g_ptr_array_index(stages, j);
+    for (guint j = 0; j < old_stages->len && !stage; j++){
+      if (gst_audio_info_is_equal(&((GstAudioFrontendStage *) g_ptr_array_index(old_stages, j))->info, &info)){
+        GST_OBJECT_LOCK(self);
+        stage = g_ptr_array_steal_index_fast(old_stages, j);
+        GST_OBJECT_UNLOCK(self);
+        stage->n_outputs = 0;
+        g_ptr_array_add(stages, stage);
+      }
+    }
+    if (!stage){
+      stage = gst_audio_frontend_stage_new(self, &info, quality);
+      if (stage)
+        g_ptr_array_add(stages, stage);
+    }
+    if (!stage){
+      GST_WARNING_OBJECT(self, "No conversion for %" GST_PTR_FORMAT, caps);
+      gst_caps_unref(caps);
+      ret = FALSE;
+      break;
+    }
+
+    stage->n_outputs++;
+    output->stage = stage;
+
+    GstCaps *current = gst_pad_get_current_caps(output->pad);
+    if (current == NULL || !gst_caps_is_equal(current, caps))
+      gst_pad_push_event(output->pad, gst_event_new_caps(caps));
+    if (current)
+      gst_caps_unref(current);
+    gst_caps_unref(caps);
+  }
+
+  GST_OBJECT_LOCK(self);
+  self->stages = stages;
+  GST_OBJECT_UNLOCK(self);
+  g_ptr_array_unref(old_stages);
+
+  for (guint i = 0; i < self->outputs->len; i++)
+    gst_object_unref(g_array_index(self->outputs, GstAudioFrontendOutput, i).pad);
+  g_array_unref(self->outputs);
+  self->outputs = outputs;
+
+  return ret;
+}
+
+static GstFlowReturn gst_audio_frontend_chain(GstPad *pad, GstObject *parent, GstBuffer *buffer)
+{
+  GstAudioFrontend *self = GST_AUDIO_FRONTEND(parent);
+  gboolean reconfigure = g_atomic_int_compare_and_exchange(&self->reconfigure, TRUE, FALSE);
+  GstFlowReturn ret = GST_FLOW_OK;
+  GstAudioBuffer in;
+
+  if (GST_AUDIO_INFO_FORMAT(&self->in_info) == GST_AUDIO_FORMAT_UNKNOWN){
+    gst_buffer_unref(buffer);
+    return GST_FLOW_NOT_NEGOTIATED;
+  }
+
+  for (guint i = 0; i < self->outputs->len; i++)
+    if (gst_pad_check_reconfigure(g_array_index(self->outputs, GstAudioFrontendOutput, i).pad))
+      reconfigure = TRUE;
+  if (reconfigure && !gst_audio_frontend_negotiate(self)){
+    g_atomic_int_set(&self->reconfigure, TRUE);
+    gst_buffer_unref(buffer);
+    return GST_FLOW_NOT_NEGOTIATED;
+  }
+
+  if (!gst_audio_buffer_map(&in, &self->in_info, buffer, GST_MAP_READ)){
+    gst_buffer_unref(buffer);
+    GST_ELEMENT_ERROR(self, STREAM, FORMAT, ("Failed to map the audio"), (NULL));
+    return GST_FLOW_ERROR;
+  }
+  for (guint i = 0; i < self->stages->len && ret == GST_FLOW_OK; i++)
+    ret = gst_audio_frontend_stage_process(self, g_ptr_array_index(self->stages, i), &in, buffer);
+  gst_audio_buffer_unmap(&in);
+
+  /* the outputs of a stage all get the same buffer */
+  for (guint i = 0; i < self->outputs->len && ret == GST_FLOW_OK; i++){
+    GstAudioFrontendOutput *output = &g_array_index(self->outputs, GstAudioFrontendOutput, i);
+    GstFlowReturn pad_ret;
+
+    if (output->stage == NULL || output->stage->out == NULL)
+      continue;
+    pad_ret = gst_pad_push(output->pad, gst_buffer_ref(output->stage->out));
+    /* released since the outputs were negotiated */
+    if (pad_ret == GST_FLOW_FLUSHING && GST_OBJECT_PARENT(output->pad) != GST_OBJECT(self))
+      pad_ret = GST_FLOW_NOT_LINKED;
+    ret = gst_flow_combiner_update_pad_flow(self->flow_combiner, output->pad, pad_ret);
+  }
+  for (guint i = 0; i < self->stages->len; i++)
+    gst_buffer_replace(&((GstAudioFrontendStage *) g_ptr_array_index(self->stages, i))->out, NULL);
+
+  GST_OBJECT_LOCK(self);
+  self->buffers++;
+  GST_OBJECT_UNLOCK(self);
+
+  gst_buffer_unref(buffer);
+  return ret;
+}
+
+static gboolean gst_audio_frontend_sink_event(GstPad *pad, GstObject *parent, GstEvent *event)
+{
+  GstAudioFrontend *self = GST_AUDIO_FRONTEND(parent);
+
+  switch (GST_EVENT_TYPE(event)){
+    case GST_EVENT_CAPS: {
+      GstCaps *caps;
+      GstAudioInfo info;
+
+      gst_event_parse_caps(event, &caps);
+      if (!gst_audio_info_from_caps(&info, caps)){
+        gst_event_unref(event);
+        return FALSE;
+      }
+      /* the outputs negotiate with the next buffer */
+      if (!gst_audio_info_is_equal(&info, &self->in_info)){
+        self->in_info = info;
+        GST_OBJECT_LOCK(self);
+        g_ptr_array_set_size(self->stages, 0);
+        GST_OBJECT_UNLOCK(self);
+        g_atomic_int_set(&self->reconfigure, TRUE);
+      }
+      gst_event_unref(event);
+      return TRUE;
+    }
+    case GST_EVENT_FLUSH_STOP:
+      for (guint i = 0; i < self->stages->len; i++)
+        gst_audio_frontend_stage_reset(g_ptr_array_index(self->stages, i));
+      gst_flow_combiner_reset(self->flow_combiner);
+      break;
+    default:
+      /* replayed to the outputs once they have their caps */
+      if (GST_EVENT_IS_STICKY(event) && GST_EVENT_TYPE(event) != GST_EVENT_EOS &&
+          g_atomic_int_get(&self->reconfigure)){
+        gst_event_unref(event);
+        return TRUE;
+      }
+      break;
+  }
+
+  return gst_pad_event_default(pad, parent, event);
+}
+
+/* Any raw audio is converted, upstream is not bound by the encoders */
+static gboolean gst_audio_frontend_query(GstPad *pad, GstObject *parent, GstQuery *query)
+{
+  switch (GST_QUERY_TYPE(query)){
+    case GST_QUERY_CAPS: {
+      GstCaps *filter, *caps = gst_pad_get_pad_template_caps(pad);
+
+      gst_query_parse_caps(query, &filter);
+      if (filter){
+        GstCaps *intersection = gst_caps_intersect_full(filter, caps, GST_CAPS_INTERSECT_FIRST);
+
+        gst_caps_unref(caps);
+        caps = intersection;
+      }
+      gst_query_set_caps_result(query, caps);
+      gst_caps_unref(caps);
+      return TRUE;
+    }
+    case GST_QUERY_ALLOCATION:
+      /* the outputs come from the pools of the stages */
+      return FALSE;
+    default:
+      return gst_pad_query_default(pad, parent, query);
+  }
+}
+
+static GstPad *gst_audio_frontend_request_new_pad(GstElement *element, GstPadTemplate *templ,
+                                                  const gchar *name, const GstCaps *caps)
+{
+  GstAudioFrontend *self = GST_AUDIO_FRONTEND(element);
+  gchar *pad_name;
+  GstPad *pad;
+
+  GST_OBJECT_LOCK(self);
+  pad_name = name ? g_strdup(name) : g_strdup_printf("src_%u", self->next_pad++);
+  GST_OBJECT_UNLOCK(self);
+
+  pad = gst_pad_new_from_template(templ, pad_name);
+  g_free(pad_name);
+  gst_pad_set_query_function(pad, gst_audio_frontend_query);
+  gst_pad_set_active(pad, TRUE);
+  if (!gst_element_add_pad(element, pad)){
+    gst_object_unref(pad);
+    return NULL;
+  }
+  g_atomic_int_set(&self->reconfigure, TRUE);
+
+  return pad;
+}
+
+static void gst_audio_frontend_release_pad(GstElement *element, GstPad *pad)
+{
+  GstAudioFrontend *self = GST_AUDIO_FRONTEND(element);
+
+  g_atomic_int_set(&self->reconfigure, TRUE);
+  gst_pad_set_active(pad, FALSE);
+  gst_element_remove_pad(element, pad);
+}
+
+static void gst_audio_frontend_clear(GstAudioFrontend *self)
+{
+  GST_OBJECT_LOCK(self);
+  g_ptr_array_set_size(self->stages, 0);
+  GST_OBJECT_UNLOCK(self);
+
+  for (guint i = 0; i < self->outputs->len; i++)
+    gst_object_unref(g_array_index(self->outputs, GstAudioFrontendOutput, i).pad);
+  g_array_set_size(self->outputs, 0);
+  gst_flow_combiner_clear(self->flow_combiner);
+  gst_audio_info_init(&self->in_info);
+}
+
+static GstStateChangeReturn gst_audio_frontend_change_state(GstElement *element, GstStateChange transition)
+{
+  GstAudioFrontend *self = GST_AUDIO_FRONTEND(element);
+  GstStateChangeReturn ret;
+
+  if (transition == GST_STATE_CHANGE_READY_TO_PAUSED){
+    GST_OBJECT_LOCK(self);
+    self->buffers = 0;
+    GST_OBJECT_UNLOCK(self);
+    g_atomic_int_set(&self->reconfigure, TRUE);
+  }
+
+  ret = GST_ELEMENT_CLASS(parent_class)->change_state(element, transition);
+
+  if (transition == GST_STATE_CHANGE_PAUSED_TO_READY)
+    gst_audio_frontend_clear(self);
+
+  return ret;
+}
+
+static GstStructure *gst_audio_frontend_get_stats(GstAudioFrontend *self)
+{
+  GstStructure *stats;
+  GValue stages = G_VALUE_INIT;
+
+  g_value_init(&stages, GST_TYPE_ARRAY);
+
+  GST_OBJECT_LOCK(self);
+  for (guint i = 0; i < self->stages->len; i++){
+    GstAudioFrontendStage *stage = g_ptr_array_index(self->stages, i);
+    GValue value = G_VALUE_INIT;
+
+    g_value_init(&value, GST_TYPE_STRUCTURE);
+    g_value_take_boxed(&value, gst_structure_new("stage",
+        "format", G_TYPE_STRING, GST_AUDIO_INFO_NAME(&stage->info),
+        "rate", G_TYPE_INT, GST_AUDIO_INFO_RATE(&stage->info),
+        "channels", G_TYPE_INT, GST_AUDIO_INFO_CHANNELS(&stage->info),
+        "outputs", G_TYPE_UINT, stage->n_outputs,
+        "passthrough", G_TYPE_BOOLEAN, gst_audio_converter_is_passthrough(stage->converter),
+        "buffers", G_TYPE_UINT64, stage->buffers,
+        "cpu-time", G_TYPE_UINT64, stage->cpu_time,
+        NULL));
+    gst_value_array_append_and_take_value(&stages, &value);
+  }
+  stats = gst_structure_new("audiofrontend-stats",
+      "buffers", G_TYPE_UINT64, self->buffers,
+      NULL);
+  GST_OBJECT_UNLOCK(self);
+
+  gst_structure_take_value(stats, "stages", &stages);
+  return stats;
+}
+
+static void gst_audio_frontend_init(GstAudioFrontend *self)
+{
+  self->sinkpad = gst_pad_new_from_static_template(&sink_template, "sink");
+  gst_pad_set_chain_function(self->sinkpad, gst_audio_frontend_chain);
+  gst_pad_set_event_function(self->sinkpad, gst_audio_frontend_sink_event);
+  gst_pad_set_query_function(self->sinkpad, gst_audio_frontend_query);
+  gst_element_add_pad(GST_ELEMENT(self), self->sinkpad);
+
+  self->quality = DEFAULT_QUALITY;
+  self->stages = g_ptr_array_new_with_free_func(gst_audio_frontend_stage_free);
+  self->outputs = g_array_new(FALSE, TRUE, sizeof(GstAudioFrontendOutput));
+  self->flow_combiner = gst_flow_combiner_new();
+  gst_audio_info_init(&self->in_info);
+}
+
+static void gst_audio_frontend_set_property(GObject *object,
+                                            guint prop_id,
+                                            const GValue *value,
+                                            GParamSpec *pspec){
+    GstAudioFrontend *self = GST_AUDIO_FRONTEND(object);
+
+    GST_OBJECT_LOCK(self);
+    switch (prop_id) {
+        case PROP_QUALITY:
+            self->quality = g_value_get_int(value);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+    GST_OBJECT_UNLOCK(self);
+}
+
+static void gst_audio_frontend_get_property(GObject *object,
+                                            guint prop_id,
+                                            GValue *value,
+                                            GParamSpec *pspec){
+
+    GstAudioFrontend *self = GST_AUDIO_FRONTEND(object);
+
+    if (prop_id == PROP_STATS){
+        g_value_take_boxed(value, gst_audio_frontend_get_stats(self));
+        return;
+    }
+
+    GST_OBJECT_LOCK(self);
+    switch (prop_id) {
+        case PROP_QUALITY:
+            g_value_set_int(value, self->quality);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+    GST_OBJECT_UNLOCK(self);
+}
+
+static void gst_audio_frontend_finalize(GObject *object)
+{
+  GstAudioFrontend *self = GST_AUDIO_FRONTEND(object);
+
+  gst_audio_frontend_clear(self);
+  g_ptr_array_unref(self->stages);
+  g_array_unref(self->outputs);
+  gst_flow_combiner_free(self->flow_combiner);
+
+  G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
+static void gst_audio_frontend_class_init(GstAudioFrontendClass *klass)
+{
+  GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+  GObjectClass *object_class = G_OBJECT_CLASS(klass);
+
+  object_class->set_property = gst_audio_frontend_set_property;
+  object_class->get_property = gst_audio_frontend_get_property;
+  object_class->finalize = gst_audio_frontend_finalize;
+  element_class->change_state = gst_audio_frontend_change_state;
+  element_class->request_new_pad = gst_audio_frontend_request_new_pad;
+  element_class->release_pad = gst_audio_frontend_release_pad;
+
+  gst_element_class_add_static_pad_template(element_class, &sink_template);
+  gst_element_class_add_static_pad_template(element_class, &src_template);
+
+  g_object_class_install_property(object_class, PROP_QUALITY,
+      g_param_spec_int("quality", "Quality",
+          "Resample quality with 0 being the lowest and 10 being the best",
+          GST_AUDIO_RESAMPLER_QUALITY_MIN, GST_AUDIO_RESAMPLER_QUALITY_MAX, DEFAULT_QUALITY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property(object_class, PROP_STATS,
+      g_param_spec_boxed("stats", "Statistics",
+          "Buffers in and, per conversion, its format, the outputs sharing it, buffers out and CPU time spent",
+          GST_TYPE_STRUCTURE,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  GST_DEBUG_CATEGORY_INIT (gst_audio_frontend_debug, "audiofrontend", 0,
+      "Audio Frontend Debug");
+
+  gst_element_class_set_static_metadata(element_class,
+                                        "Audio Frontend",
+                                        "Filter/Converter/Audio",
+                                        "Converts and resamples audio once per format its outputs negotiate",
+                                        "Ludovic Bouguerra <ludovic.bouguerra@stream.studio>");
+}
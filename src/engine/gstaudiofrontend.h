@@ -0,0 +1,17 @@
+#ifndef __GST_AUDIO_FRONTEND_H__
+#define __GST_AUDIO_FRONTEND_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_AUDIO_FRONTEND gst_audio_frontend_get_type ()
+G_DECLARE_FINAL_TYPE (GstAudioFrontend, gst_audio_frontend, GST, AUDIO_FRONTEND, GstElement)
+
+struct GstAudioFrontendClass {
+  GstElementClass parent_class;
+};
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,651 @@
+#include "gstconvertscale.h"
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <common/gstworkpool.h>
+
+#include "gstconvertscalekernels.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_convert_scale_debug);
+#define GST_CAT_DEFAULT gst_convert_scale_debug
+
+#define gst_convert_scale_parent_class parent_class
+
+#define DEFAULT_N_THREADS 0
+
+/* a slice below that costs more to hand over than to convert */
+#define MIN_SLICE_ROWS 32
+
+#define CONVERT_SCALE_CAPS \
+    "video/x-raw, " \
+    "format = (string) { I420, NV12, YUY2, BGRA }, " \
+    "width = (int) [ 2, MAX ], " \
+    "height = (int) [ 2, MAX ], " \
+    "framerate = (fraction) [ 0/1, MAX ]"
+
+/* properties */
+enum
+{
+  PROP_0,
+  PROP_N_THREADS,
+  PROP_STATS,
+};
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (CONVERT_SCALE_CAPS));
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (CONVERT_SCALE_CAPS));
+
+typedef enum
+{
+  AXIS_COPY,
+  AXIS_HALVE,
+  AXIS_AREA,
+  AXIS_BILINEAR,
+} GstConvertScaleMode;
+
+/* Mapping of the output samples on one axis of a plane. Horizontal axes
+ * keep their per-sample tables, vertical ones are computed per row. */
+typedef struct
+{
+  GstConvertScaleMode mode;
+  gint src;
+  gint dst;
+
+  /* bilinear left sample or area start */
+  gint *index;
+  guint16 *frac;
+  guint16 *count;
+  guint32 *recip;
+} GstConvertScaleAxis;
+
+/* Converts NV12, YUY2, BGRA and I420 to I420 and scales it in one pass.
+ * Each output row is made from the source rows it needs, unpacked and
+ * filtered in row buffers, so no intermediate frame is written. Output
+ * rows are split in slices converted on the shared work pool, the calling
+ * thread converting slices too while it waits. */
+struct _GstConvertScale
+{
+  GstVideoFilter parent_instance;
+
+  guint n_threads;
+
+  GstConvertScaleAxis hluma;
+  GstConvertScaleAxis vluma;
+  GstConvertScaleAxis hchroma;
+  GstConvertScaleAxis vchroma;
+  guint n_slices;
+
+  /* under the object lock */
+  guint64 frames;
+  guint64 slices;
+  GstClockTime frame_time;
+};
+
+/* Rows of one slice */
+typedef struct
+{
+  GstConvertScale *self;
+  GstVideoFrame *in;
+  GstVideoFrame *out;
+
+  guint8 *y[2];
+  guint8 *u[2];
+  guint8 *v[2];
+  guint8 *yline;
+  guint8 *uline;
+  guint8 *vline;
+  guint16 *acc;
+} GstConvertScaleRows;
+
+typedef struct
+{
+  GstConvertScale *self;
+  GstVideoFrame *in;
+  GstVideoFrame *out;
+} GstConvertScaleFrame;
+
+G_DEFINE_TYPE(GstConvertScale, gst_convert_scale, GST_TYPE_VIDEO_FILTER);
+
+
+static void gst_convert_scale_axis_clear(GstConvertScaleAxis *axis)
+{
+  g_clear_pointer(&axis->index, g_free);
+  g_clear_pointer(&axis->frac, g_free);
+  g_clear_pointer(&axis->count, g_free);
+  g_clear_pointer(&axis->recip, g_free);
+}
+
+/* Source samples averaged into output sample @i, at least one */
+static void gst_convert_scale_axis_area(GstConvertScaleAxis *axis, gint i, gint *start, guint *count)
+{
+  gint end = (gint64) (i + 1) * axis->src / axis->dst;
+
+  *start = (gint64) i * axis->src / axis->dst;
+  *count = MAX(end - *start, 1);
+}
+
+/* Source samples interpolated for output sample @i, centers aligned */
+static void gst_convert_scale_axis_bilinear(GstConvertScaleAxis *axis, gint i, gint *index, guint *frac)
+{
+  gint64 position = (((gint64) (2 * i + 1) * axis->src - axis->dst) * 256) / (2 * axis->dst);
+
+  position = MAX(position, 0);
+  *index = position >> 8;
+  *frac = position & 255;
+  if (*index >= axis->src - 1){
+    *index = axis->src - 2;
+    *frac = 256;
+  }
+}
+
+static void gst_convert_scale_axis_setup(GstConvertScaleAxis *axis, gint src, gint dst, gboolean horizontal)
+{
+  gst_convert_scale_axis_clear(axis);
+  axis->src = src;
+  axis->dst = dst;
+
+  if (src == dst)
+    axis->mode = AXIS_COPY;
+  else if (src == 2 * dst)
+    axis->mode = AXIS_HALVE;
+  else if (src >= 2 * dst || src == 1)
+    axis->mode = AXIS_AREA;
+  else
+    axis->mode = AXIS_BILINEAR;
+
+  if (!horizontal)
+    return;
+
+  if (axis->mode == AXIS_AREA){
+    axis->index = g_new(gint, dst);
+    axis->count = g_new(guint16, dst);
+    axis->recip = g_new(guint32, dst);
+    for (gint i = 0; i < dst; i++){
+      guint count;
+
+      gst_convert_scale_axis_area(axis, i, &axis->index[i], &count);
+      axis->count[i] = count;
+      axis->recip[i] = GST_CONVERT_SCALE_RECIP(count);
+    }
+  } else if (axis->mode == AXIS_BILINEAR){
+    axis->index = g_new(gint, dst);
+    axis->frac = g_new(guint16, dst);
+    for (gint i = 0; i < dst; i++){
+      guint frac;
+
+      gst_convert_scale_axis_bilinear(axis, i, &axis->index[i], &frac);
+      axis->frac[i] = frac;
+    }
+  }
+}
+
+static void gst_convert_scale_horizontal(GstConvertScaleAxis *axis, const guint8 *src, guint8 *dst)
+{
+  switch (axis->mode){
+    case AXIS_COPY:
+      memcpy(dst, src, axis->dst);
+      break;
+    case AXIS_HALVE:
+      gst_convert_scale_halve(src, dst, axis->dst);
+      break;
+    case AXIS_AREA:
+      gst_convert_scale_area(src, dst, axis->index, axis->count, axis->recip, axis->dst);
+      break;
+    case AXIS_BILINEAR:
+      gst_convert_scale_bilinear(src, dst, axis->index, axis->frac, axis->dst);
+      break;
+  }
+}
+
+/* Source luma row @row, in the frame or unpacked in @slot */
+static const guint8 *gst_convert_scale_fetch_y(GstConvertScaleRows *rows, gint row, guint slot)
+{
+  GstVideoFrame *in = rows->in;
+  const guint8 *src = (const guint8 *) GST_VIDEO_FRAME_PLANE_DATA(in, 0) + row * GST_VIDEO_FRAME_PLANE_STRIDE(in, 0);
+  gint width = GST_VIDEO_FRAME_WIDTH(in);
+
+  switch (GST_VIDEO_FRAME_FORMAT(in)){
+    case GST_VIDEO_FORMAT_YUY2:
+      gst_convert_scale_yuy2_y(src, rows->y[slot], width);
+      return rows->y[slot];
+    case GST_VIDEO_FORMAT_BGRA:
+      gst_convert_scale_bgra_y(src, rows->y[slot], width);
+      return rows->y[slot];
+    default:
+      return src;
+  }
+}
+
+/* Source chroma row @row of both planes */
+static void gst_convert_scale_fetch_uv(GstConvertScaleRows *rows, gint row, guint slot, const guint8 **u, const guint8 **v)
+{
+  GstVideoFrame *in = rows->in;
+  const guint8 *src;
+  gint width = GST_VIDEO_FRAME_WIDTH(in);
+
+  switch (GST_VIDEO_FRAME_FORMAT(in)){
+    case GST_VIDEO_FORMAT_NV12:
+      src = (const guint8 *) GST_VIDEO_FRAME_PLANE_DATA(in, 1) + row * GST_VIDEO_FRAME_PLANE_STRIDE(in, 1);
+      gst_convert_scale_nv12_uv(src, rows->u[slot], rows->v[slot], rows->self->hchroma.src);
+      break;
+    case GST_VIDEO_FORMAT_YUY2:
+      src = (const guint8 *) GST_VIDEO_FRAME_PLANE_DATA(in, 0) + row * GST_VIDEO_FRAME_PLANE_STRIDE(in, 0);
+      gst_convert_scale_yuy2_uv(src, rows->u[slot], rows->v[slot], width);
+      break;
+    case GST_VIDEO_FORMAT_BGRA: {
+      gint stride = GST_VIDEO_FRAME_PLANE_STRIDE(in, 0);
+      gint last = GST_VIDEO_FRAME_HEIGHT(in) - 1;
+
+      src = GST_VIDEO_FRAME_PLANE_DATA(in, 0);
+      gst_convert_scale_bgra_uv(src + 2 * row * stride, src + MIN(2 * row + 1, last) * stride,
+          rows->u[slot], rows->v[slot], width);
+      break;
+    }
+    default:
+      *u = (const guint8 *) GST_VIDEO_FRAME_PLANE_DATA(in, 1) + row * GST_VIDEO_FRAME_PLANE_STRIDE(in, 1);
+      *v = (const guint8 *) GST_VIDEO_FRAME_PLANE_DATA(in, 2) + row * GST_VIDEO_FRAME_PLANE_STRIDE(in, 2);
+      return;
+  }
+
+  *u = rows->u[slot];
+  *v = rows->v[slot];
+}
+
+/* Source width row of output luma row @i */
+static const guint8 *gst_convert_scale_vertical_y(GstConvertScaleRows *rows, gint i)
+{
+  GstConvertScaleAxis *axis = &rows->self->vluma;
+  gint width = rows->self->hluma.src;
+  const guint8 *a, *b;
+  gint start;
+  guint count, frac;
+
+  switch (axis->mode){
+    case AXIS_COPY:
+      return gst_convert_scale_fetch_y(rows, i, 0);
+    case AXIS_HALVE:
+      a = gst_convert_scale_fetch_y(rows, 2 * i, 0);
+      b = gst_convert_scale_fetch_y(rows, 2 * i + 1, 1);
+      gst_convert_scale_blend(a, b, rows->yline, width, 128);
+      return rows->yline;
+    case AXIS_AREA:
+      gst_convert_scale_axis_area(axis, i, &start, &count);
+      if (count == 1)
+        return gst_convert_scale_fetch_y(rows, start, 0);
+      memset(rows->acc, 0, width * sizeof(guint16));
+      for (gint row = start; row < start + (gint) count; row++)
+        gst_convert_scale_accumulate(gst_convert_scale_fetch_y(rows, row, 0), rows->acc, width);
+      gst_convert_scale_average(rows->acc, rows->yline, width, GST_CONVERT_SCALE_RECIP(count));
+      return rows->yline;
+    case AXIS_BILINEAR:
+      gst_convert_scale_axis_bilinear(axis, i, &start, &frac);
+      if (frac == 0)
+        return gst_convert_scale_fetch_y(rows, start, 0);
+      if (frac == 256)
+        return gst_convert_scale_fetch_y(rows, start + 1, 0);
+      a = gst_convert_scale_fetch_y(rows, start, 0);
+      b = gst_convert_scale_fetch_y(rows, start + 1, 1);
+      gst_convert_scale_blend(a, b, rows->yline, width, frac);
+      return rows->yline;
+  }
+
+  g_assert_not_reached();
+  return NULL;
+}
+
+/* Source width rows of output chroma row @i */
+static void gst_convert_scale_vertical_uv(GstConvertScaleRows *rows, gint i, const guint8 **u, const guint8 **v)
+{
+  GstConvertScaleAxis *axis = &rows->self->vchroma;
+  gint width = rows->self->hchroma.src;
+  const guint8 *u0, *v0, *u1, *v1;
+  gint start;
+  guint count, frac;
+
+  switch (axis->mode){
+    case AXIS_COPY:
+      gst_convert_scale_fetch_uv(rows, i, 0, u, v);
+      return;
+    case AXIS_HALVE:
+      start = 2 * i;
+      frac = 128;
+      break;
+    case AXIS_AREA:
+      gst_convert_scale_axis_area(axis, i, &start, &count);
+      if (count == 1){
+        gst_convert_scale_fetch_uv(rows, start, 0, u, v);
+        return;
+      }
+      memset(rows->acc, 0, 2 * width * sizeof(guint16));
+      for (gint row = start; row < start + (gint) count; row++){
+        gst_convert_scale_fetch_uv(rows, row, 0, &u0, &v0);
+        gst_convert_scale_accumulate(u0, rows->acc, width);
+        gst_convert_scale_accumulate(v0, rows->acc + width, width);
+      }
+      gst_convert_scale_average(rows->acc, rows->uline, width, GST_CONVERT_SCALE_RECIP(count));
+      gst_convert_scale_average(rows->acc + width, rows->vline, width, GST_CONVERT_SCALE_RECIP(count));
+      *u = rows->uline;
+      *v = rows->vline;
+      return;
+    case AXIS_BILINEAR:
+      gst_convert_scale_axis_bilinear(axis, i, &start, &frac);
+      if (frac == 0 || frac == 256){
+        gst_convert_scale_fetch_uv(rows, frac ? start + 1 : start, 0, u, v);
+        return;
+      }
+      break;
+  }
+
+  gst_convert_scale_fetch_uv(rows, start, 0, &u0, &v0);
+  gst_convert_scale_fetch_uv(rows, start + 1, 1, &u1, &v1);
+  gst_convert_scale_blend(u0, u1, rows->uline, width, frac);
+  gst_convert_scale_blend(v0, v1, rows->vline, width, frac);
+  *u = rows->uline;
+  *v = rows->vline;
+}
+
+/* Output chroma rows [@first, @last) and the luma rows over them */
+static void gst_convert_scale_slice(GstConvertScale *self, GstVideoFrame *in, GstVideoFrame *out, gint first, gint last)
+{
+  GstConvertScaleRows rows = { self, in, out };
+  gint width = self->hluma.src, cwidth = self->hchroma.src;
+  gint height = GST_VIDEO_FRAME_HEIGHT(out);
+  gsize acc_size = MAX(width, 2 * cwidth) * sizeof(guint16);
+  guint8 *memory, *p;
+
+  memory = p = g_malloc(acc_size + 3 * width + 6 * cwidth);
+  /* luma row, or both chroma rows */
+  rows.acc = (guint16 *) p; p += acc_size;
+  rows.y[0] = p; p += width;
+  rows.y[1] = p; p += width;
+  rows.yline = p; p += width;
+  rows.u[0] = p; p += cwidth;
+  rows.u[1] = p; p += cwidth;
+  rows.v[0] = p; p += cwidth;
+  rows.v[1] = p; p += cwidth;
+  rows.uline = p; p += cwidth;
+  rows.vline = p;
+
+  for (gint i = 2 * first; i < MIN(2 * last, height); i++){
+    guint8 *dst = (guint8 *) GST_VIDEO_FRAME_PLANE_DATA(out, 0) + i * GST_VIDEO_FRAME_PLANE_STRIDE(out, 0);
+
+    gst_convert_scale_horizontal(&self->hluma, gst_convert_scale_vertical_y(&rows, i), dst);
+  }
+
+  for (gint i = first; i < last; i++){
+    guint8 *udst = (guint8 *) GST_VIDEO_FRAME_PLANE_DATA(out, 1) + i * GST_VIDEO_FRAME_PLANE_STRIDE(out, 1);
+    guint8 *vdst = (guint8 *) GST_VIDEO_FRAME_PLANE_DATA(out, 2) + i * GST_VIDEO_FRAME_PLANE_STRIDE(out, 2);
+    const guint8 *u, *v;
+
+    gst_convert_scale_vertical_uv(&rows, i, &u, &v);
+    gst_convert_scale_horizontal(&self->hchroma, u, udst);
+    gst_convert_scale_horizontal(&self->hchroma, v, vdst);
+  }
+
+  g_free(memory);
+}
+
+static void gst_convert_scale_slice_func(gpointer data, guint slice)
+{
+  GstConvertScaleFrame *frame = data;
+  GstConvertScale *self = frame->self;
+  gint rows = self->vchroma.dst;
+
+  gst_convert_scale_slice(self, frame->in, frame->out,
+      (gint64) slice * rows / self->n_slices, (gint64) (slice + 1) * rows / self->n_slices);
+}
+
+static GstFlowReturn gst_convert_scale_transform_frame(GstVideoFilter *filter, GstVideoFrame *in, GstVideoFrame *out)
+{
+  GstConvertScale *self = GST_CONVERT_SCALE(filter);
+  GstConvertScaleFrame frame = { self, in, out };
+  gint64 started = g_get_monotonic_time();
+  GstClockTime elapsed;
+
+  gst_work_pool_parallel(gst_work_pool_get_default(), self->n_slices, gst_convert_scale_slice_func, &frame);
+
+  elapsed = (g_get_monotonic_time() - started) * GST_USECOND;
+  GST_OBJECT_LOCK(self);
+  self->frames++;
+  self->slices += self->n_slices;
+  self->frame_time = self->frame_time == 0 ? elapsed : (self->frame_time * 15 + elapsed) / 16;
+  GST_OBJECT_UNLOCK(self);
+
+  return GST_FLOW_OK;
+}
+
+static gboolean gst_convert_scale_set_info(GstVideoFilter *filter, GstCaps *incaps, GstVideoInfo *in_info,
+                                           GstCaps *outcaps, GstVideoInfo *out_info)
+{
+  GstConvertScale *self = GST_CONVERT_SCALE(filter);
+  gint width = GST_VIDEO_INFO_WIDTH(in_info), height = GST_VIDEO_INFO_HEIGHT(in_info);
+  gint out_width = GST_VIDEO_INFO_WIDTH(out_info), out_height = GST_VIDEO_INFO_HEIGHT(out_info);
+  guint n_slices = self->n_threads;
+
+  /* passthrough */
+  if (gst_caps_is_equal(incaps, outcaps))
+    return TRUE;
+
+  if (GST_VIDEO_INFO_FORMAT(out_info) != GST_VIDEO_FORMAT_I420){
+    GST_ERROR_OBJECT(self, "Only converts to I420, not %s", GST_VIDEO_INFO_NAME(out_info));
+    return FALSE;
+  }
+
+  gst_convert_scale_axis_setup(&self->hluma, width, out_width, TRUE);
+  gst_convert_scale_axis_setup(&self->vluma, height, out_height, FALSE);
+  gst_convert_scale_axis_setup(&self->hchroma, (width + 1) / 2, (out_width + 1) / 2, TRUE);
+  /* 4:2:2 chroma is halved vertically on the way */
+  gst_convert_scale_axis_setup(&self->vchroma,
+      GST_VIDEO_INFO_FORMAT(in_info) == GST_VIDEO_FORMAT_YUY2 ? height : (height + 1) / 2,
+      (out_height + 1) / 2, FALSE);
+
+  if (n_slices == 0)
+    n_slices = gst_work_pool_get_n_threads(gst_work_pool_get_default()) + 1;
+  self->n_slices = CLAMP(self->vchroma.dst / MIN_SLICE_ROWS, 1, n_slices);
+
+  GST_DEBUG_OBJECT(self, "%s %dx%d to I420 %dx%d in %u slices", GST_VIDEO_INFO_NAME(in_info),
+      width, height, out_width, out_height, self->n_slices);
+
+  return TRUE;
+}
+
+static GstCaps *gst_convert_scale_transform_caps(GstBaseTransform *trans, GstPadDirection direction,
+                                                 GstCaps *caps, GstCaps *filter)
+{
+  GstStructure *i420 = gst_structure_new("video/x-raw", "format", G_TYPE_STRING, "I420", NULL);
+  GstCaps *ret, *converted = gst_caps_new_empty();
+  GValue formats = G_VALUE_INIT;
+
+  g_value_init(&formats, GST_TYPE_LIST);
+  for (const gchar **format = (const gchar *[]) {"I420", "NV12", "YUY2", "BGRA", NULL}; *format; format++){
+    GValue value = G_VALUE_INIT;
+
+    g_value_init(&value, G_TYPE_STRING);
+    g_value_set_static_string(&value, *format);
+    gst_value_list_append_and_take_value(&formats, &value);
+  }
+
+  for (guint i = 0; i < gst_caps_get_size(caps); i++){
+    GstStructure *structure = gst_caps_get_structure(caps, i);
+    GstCapsFeatures *features = gst_caps_get_features(caps, i);
+
+    /* only I420 comes out of a conversion */
+    if (direction == GST_PAD_SRC && !gst_structure_can_intersect(structure, i420))
+      continue;
+    if (!gst_caps_features_is_any(features) &&
+        !gst_caps_features_is_equal(features, GST_CAPS_FEATURES_MEMORY_SYSTEM_MEMORY))
+      continue;
+
+    structure = gst_structure_copy(structure);
+    gst_structure_remove_fields(structure, "format", "colorimetry", "chroma-site", "pixel-aspect-ratio", NULL);
+    gst_structure_set(structure,
+        "width", GST_TYPE_INT_RANGE, 2, G_MAXINT,
+        "height", GST_TYPE_INT_RANGE, 2, G_MAXINT, NULL);
+    if (direction == GST_PAD_SINK)
+      gst_structure_set(structure, "format", G_TYPE_STRING, "I420", NULL);
+    else
+      gst_structure_set_value(structure, "format", &formats);
+    gst_caps_append_structure(converted, structure);
+  }
+
+  /* passthrough first */
+  ret = gst_caps_merge(gst_caps_copy(caps), converted);
+
+  g_value_unset(&formats);
+  gst_structure_free(i420);
+
+  if (filter){
+    GstCaps *intersection = gst_caps_intersect_full(filter, ret, GST_CAPS_INTERSECT_FIRST);
+
+    gst_caps_unref(ret);
+    ret = intersection;
+  }
+
+  GST_DEBUG_OBJECT(trans, "%" GST_PTR_FORMAT " to %" GST_PTR_FORMAT, caps, ret);
+
+  return ret;
+}
+
+/* Same size as the input unless downstream asks for another, keeping the
+ * aspect ratio when it only sets one side */
+static GstCaps *gst_convert_scale_fixate_caps(GstBaseTransform *trans, GstPadDirection direction,
+                                              GstCaps *caps, GstCaps *othercaps)
+{
+  GstStructure *in = gst_caps_get_structure(caps, 0), *out;
+  gint width = 0, height = 0, out_width, out_height;
+
+  othercaps = gst_caps_make_writable(gst_caps_truncate(othercaps));
+  out = gst_caps_get_structure(othercaps, 0);
+
+  if (gst_structure_get_int(in, "width", &width) && gst_structure_get_int(in, "height", &height)){
+    if (gst_structure_get_int(out, "width", &out_width))
+      gst_structure_fixate_field_nearest_int(out, "height", gst_util_uint64_scale_int(height, out_width, width));
+    else if (gst_structure_get_int(out, "height", &out_height))
+      gst_structure_fixate_field_nearest_int(out, "width", gst_util_uint64_scale_int(width, out_height, height));
+    gst_structure_fixate_field_nearest_int(out, "width", width);
+    gst_structure_fixate_field_nearest_int(out, "height", height);
+  }
+
+  return gst_caps_fixate(othercaps);
+}
+
+static GstStructure *gst_convert_scale_get_stats(GstConvertScale *self)
+{
+  GstStructure *stats;
+
+  GST_OBJECT_LOCK(self);
+  stats = gst_structure_new("convertscale-stats",
+      "frames", G_TYPE_UINT64, self->frames,
+      "slices", G_TYPE_UINT64, self->slices,
+      "frame-time", G_TYPE_UINT64, self->frame_time,
+      NULL);
+  GST_OBJECT_UNLOCK(self);
+
+  return stats;
+}
+
+static void gst_convert_scale_init(GstConvertScale *self)
+{
+  self->n_threads = DEFAULT_N_THREADS;
+  self->n_slices = 1;
+}
+
+static void gst_convert_scale_set_property(GObject *object,
+                                           guint prop_id,
+                                           const GValue *value,
+                                           GParamSpec *pspec)
+{
+  GstConvertScale *self = GST_CONVERT_SCALE(object);
+
+  switch (prop_id) {
+    case PROP_N_THREADS:
+      self->n_threads = g_value_get_uint(value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+      break;
+  }
+}
+
+static void gst_convert_scale_get_property(GObject *object,
+                                           guint prop_id,
+                                           GValue *value,
+                                           GParamSpec *pspec)
+{
+  GstConvertScale *self = GST_CONVERT_SCALE(object);
+
+  switch (prop_id) {
+    case PROP_N_THREADS:
+      g_value_set_uint(value, self->n_threads);
+      break;
+    case PROP_STATS:
+      g_value_take_boxed(value, gst_convert_scale_get_stats(self));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+      break;
+  }
+}
+
+static void gst_convert_scale_finalize(GObject *object)
+{
+  GstConvertScale *self = GST_CONVERT_SCALE(object);
+
+  gst_convert_scale_axis_clear(&self->hluma);
+  gst_convert_scale_axis_clear(&self->hchroma);
+
+  G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
+static void gst_convert_scale_class_init(GstConvertScaleClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS(klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+  GstBaseTransformClass *transform_class = GST_BASE_TRANSFORM_CLASS(klass);
+  GstVideoFilterClass *filter_class = GST_VIDEO_FILTER_CLASS(klass);
+
+  object_class->set_property = gst_convert_scale_set_property;
+  object_class->get_property = gst_convert_scale_get_property;
+  object_class->finalize = gst_convert_scale_finalize;
+
+  transform_class->transform_caps = gst_convert_scale_transform_caps;
+  transform_class->fixate_caps = gst_convert_scale_fixate_caps;
+  transform_class->passthrough_on_same_caps = TRUE;
+
+  filter_class->set_info = gst_convert_scale_set_info;
+  filter_class->transform_frame = gst_convert_scale_transform_frame;
+
+  gst_element_class_add_static_pad_template(element_class, &sink_template);
+  gst_element_class_add_static_pad_template(element_class, &src_template);
+
+  g_object_class_install_property(object_class, PROP_N_THREADS,
+      g_param_spec_uint("n-threads", "Threads",
+          "Slices each frame is split in, 0 for one per work pool thread and one for the streaming thread",
+          0, G_MAXUINT, DEFAULT_N_THREADS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property(object_class, PROP_STATS,
+      g_param_spec_boxed("stats", "Statistics",
+          "Frames converted, slices run and average time per frame",
+          GST_TYPE_STRUCTURE,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  GST_DEBUG_CATEGORY_INIT (gst_convert_scale_debug, "convertscale", 0,
+      "Convert Scale Debug");
+
+  gst_element_class_set_static_metadata(element_class,
+                                        "Convert Scale",
+                                        "Filter/Converter/Video/Scaler",
+                                        "Converts NV12, YUY2 and BGRA to I420 and scales it in a single pass",
+                                        "Ludovic Bouguerra <ludovic.bouguerra@stream.studio>");
+}
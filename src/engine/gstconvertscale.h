@@ -0,0 +1,18 @@
+#ifndef __GST_CONVERT_SCALE_H__
+#define __GST_CONVERT_SCALE_H__
+
+#include <gst/gst.h>
+#include <gst/video/gstvideofilter.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_CONVERT_SCALE gst_convert_scale_get_type ()
+G_DECLARE_FINAL_TYPE (GstConvertScale, gst_convert_scale, GST, CONVERT_SCALE, GstVideoFilter)
+
+struct GstConvertScaleClass {
+  GstVideoFilterClass parent_class;
+};
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,146 @@
+#include "gstconvertscalekernels.h"
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+/* one clone per instruction set, the loader resolves them once */
+#if defined(__x86_64__) && defined(__has_attribute)
+#if __has_attribute(target_clones)
+#define KERNEL __attribute__((target_clones("avx2", "default")))
+#endif
+#endif
+#ifndef KERNEL
+#define KERNEL
+#endif
+
+/* BT.601 limited range, 8 bits of precision */
+#define RGB_Y(r, g, b) (((66 * (r) + 129 * (g) + 25 * (b) + 128) >> 8) + 16)
+
+KERNEL void
+gst_convert_scale_nv12_uv (const guint8 * uv, guint8 * u, guint8 * v, gint n)
+{
+  for (gint i = 0; i < n; i++) {
+    u[i] = uv[2 * i];
+    v[i] = uv[2 * i + 1];
+  }
+}
+
+KERNEL void
+gst_convert_scale_yuy2_y (const guint8 * src, guint8 * y, gint width)
+{
+  for (gint i = 0; i < width; i++)
+    y[i] = src[2 * i];
+}
+
+KERNEL void
+gst_convert_scale_yuy2_uv (const guint8 * src, guint8 * u, guint8 * v,
+    gint width)
+{
+  gint n = (width + 1) / 2;
+
+  for (gint i = 0; i < n; i++) {
+    u[i] = src[4 * i + 1];
+    v[i] = src[4 * i + 3];
+  }
+}
+
+KERNEL void
+gst_convert_scale_bgra_y (const guint8 * src, guint8 * y, gint width)
+{
+  for (gint i = 0; i < width; i++) {
+    gint b = src[4 * i], g = src[4 * i + 1], r = src[4 * i + 2];
+
+    y[i] = RGB_Y (r, g, b);
+  }
+}
+
+/* chroma of each 2x2 block, from the sums of its 4 pixels */
+static inline void
+gst_convert_scale_rgb4_uv (gint r, gint g, gint b, guint8 * u, guint8 * v)
+{
+  *u = ((-38 * r - 74 * g + 112 * b + 512) >> 10) + 128;
+  *v = ((112 * r - 94 * g - 18 * b + 512) >> 10) + 128;
+}
+
+KERNEL void
+gst_convert_scale_bgra_uv (const guint8 * src0, const guint8 * src1,
+    guint8 * u, guint8 * v, gint width)
+{
+  gint n = width / 2;
+
+  for (gint i = 0; i < n; i++) {
+    const guint8 *a = src0 + 8 * i, *c = src1 + 8 * i;
+    gint b = a[0] + a[4] + c[0] + c[4];
+    gint g = a[1] + a[5] + c[1] + c[5];
+    gint r = a[2] + a[6] + c[2] + c[6];
+
+    gst_convert_scale_rgb4_uv (r, g, b, &u[i], &v[i]);
+  }
+
+  /* the last column stands for its missing neighbour */
+  if (width & 1) {
+    const guint8 *a = src0 + 8 * n, *c = src1 + 8 * n;
+
+    gst_convert_scale_rgb4_uv (2 * (a[2] + c[2]), 2 * (a[1] + c[1]),
+        2 * (a[0] + c[0]), &u[n], &v[n]);
+  }
+}
+
+KERNEL void
+gst_convert_scale_blend (const guint8 * a, const guint8 * b, guint8 * dst,
+    gint n, guint frac)
+{
+  guint16 fb = frac, fa = 256 - frac;
+
+  for (gint i = 0; i < n; i++)
+    dst[i] = (guint16) (a[i] * fa + b[i] * fb + 128) >> 8;
+}
+
+KERNEL void
+gst_convert_scale_accumulate (const guint8 * src, guint16 * acc, gint n)
+{
+  for (gint i = 0; i < n; i++)
+    acc[i] += src[i];
+}
+
+KERNEL void
+gst_convert_scale_average (const guint16 * acc, guint8 * dst, gint n,
+    guint32 recip)
+{
+  for (gint i = 0; i < n; i++)
+    dst[i] = (acc[i] * recip + 32768) >> 16;
+}
+
+KERNEL void
+gst_convert_scale_halve (const guint8 * src, guint8 * dst, gint n)
+{
+  for (gint i = 0; i < n; i++)
+    dst[i] = (src[2 * i] + src[2 * i + 1] + 1) >> 1;
+}
+
+KERNEL void
+gst_convert_scale_bilinear (const guint8 * src, guint8 * dst,
+    const gint * index, const guint16 * frac, gint n)
+{
+  for (gint i = 0; i < n; i++) {
+    const guint8 *s = src + index[i];
+    guint f = frac[i];
+
+    dst[i] = (s[0] * (256 - f) + s[1] * f + 128) >> 8;
+  }
+}
+
+KERNEL void
+gst_convert_scale_area (const guint8 * src, guint8 * dst, const gint * start,
+    const guint16 * count, const guint32 * recip, gint n)
+{
+  for (gint i = 0; i < n; i++) {
+    const guint8 *s = src + start[i];
+    guint32 sum = 0;
+
+    for (guint j = 0; j < count[i]; j++)
+      sum += s[j];
+    dst[i] = (sum * recip[i] + 32768) >> 16;
+  }
+}
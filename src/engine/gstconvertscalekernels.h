@@ -0,0 +1,51 @@
+#ifndef __GST_CONVERT_SCALE_KERNELS_H__
+#define __GST_CONVERT_SCALE_KERNELS_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Row kernels of convertscale, plain loops over 8-bit samples built for
+ * the compiler to vectorize: with AVX2 next to the baseline on x86-64,
+ * picked at load time, and NEON on aarch64 where it is always there.
+ */
+
+/* unpacking to planar rows, chroma rows are (width + 1) / 2 wide */
+void gst_convert_scale_nv12_uv (const guint8 * uv, guint8 * u, guint8 * v,
+    gint n);
+
+void gst_convert_scale_yuy2_y (const guint8 * src, guint8 * y, gint width);
+
+void gst_convert_scale_yuy2_uv (const guint8 * src, guint8 * u, guint8 * v,
+    gint width);
+
+void gst_convert_scale_bgra_y (const guint8 * src, guint8 * y, gint width);
+
+void gst_convert_scale_bgra_uv (const guint8 * src0, const guint8 * src1,
+    guint8 * u, guint8 * v, gint width);
+
+/* vertical, @frac of @b out of 256 */
+void gst_convert_scale_blend (const guint8 * a, const guint8 * b,
+    guint8 * dst, gint n, guint frac);
+
+void gst_convert_scale_accumulate (const guint8 * src, guint16 * acc, gint n);
+
+void gst_convert_scale_average (const guint16 * acc, guint8 * dst, gint n,
+    guint32 recip);
+
+/* horizontal */
+void gst_convert_scale_halve (const guint8 * src, guint8 * dst, gint n);
+
+void gst_convert_scale_bilinear (const guint8 * src, guint8 * dst,
+    const gint * index, const guint16 * frac, gint n);
+
+void gst_convert_scale_area (const guint8 * src, guint8 * dst,
+    const gint * start, const guint16 * count, const guint32 * recip, gint n);
+
+/* 65536 / @count, to average @count samples with a multiply */
+#define GST_CONVERT_SCALE_RECIP(count) (65536 / (count))
+
+G_END_DECLS
+
+#endif
@@ -4,6 +4,9 @@
 
 #include <gst/gst.h>
 #include <engine/gstenginebin.h>
+#include <engine/gstconvertscale.h>
+#include <engine/gstscenemixer.h>
+#include <engine/gstaudiofrontend.h>
 
 gboolean engine_plugin_init(GstPlugin *plugin)
 {
@@ -11,6 +14,18 @@ gboolean engine_plugin_init(GstPlugin *plugin)
                               GST_RANK_NONE,
                               GST_TYPE_ENGINE_BIN);     
 
+    gst_element_register(plugin, "convertscale",
+                              GST_RANK_NONE,
+                              GST_TYPE_CONVERT_SCALE);
+
+    gst_element_register(plugin, "scenemixer",
+                              GST_RANK_NONE,
+                              GST_TYPE_SCENE_MIXER);
+
+    gst_element_register(plugin, "audiofrontend",
+                              GST_RANK_NONE,
+                              GST_TYPE_AUDIO_FRONTEND);
+
     return TRUE;
 }
 
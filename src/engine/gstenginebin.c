@@ -4,8 +4,14 @@
 #include <config.h>
 #endif
 
+#include <string.h>
+
 #include <gst/gstinfo.h>
 
+#include <common/gstthreadpolicy.h>
+
+#define DEFAULT_VIDEO_PROFILE "constrained-baseline"
+
 /* properties */
 enum
 {
@@ -13,6 +19,13 @@ enum
   PROP_VIDEO_ENCODER,
   PROP_AUDIO_ENCODER,
   PROP_USE_TEST_SOURCES,
+  PROP_ENCODER_THREAD_POLICY,
+  PROP_PREVIEW_THREAD_POLICY,
+  PROP_PUBLISH_THREAD_POLICY,
+  PROP_SHARED_POOL,
+  PROP_ENGINE_ID,
+  PROP_VIDEO_PROFILE,
+  PROP_STATS,
   PROP_LAST
 };
 
@@ -22,6 +35,10 @@ enum
   SIGNAL_STOP_RECORD,
   SIGNAL_START_STREAM,
   SIGNAL_STOP_STREAM,
+  SIGNAL_PUSH_VIDEO_SAMPLE,
+  SIGNAL_PUSH_AUDIO_SAMPLE,
+  SIGNAL_END_OF_STREAM,
+  SIGNAL_SET_SCENE,
   LAST_SIGNAL
 };
 
@@ -29,24 +46,40 @@ static guint gst_engine_bin_signals[LAST_SIGNAL] = {0};
 
 #define gst_engine_bin_parent_class parent_class
 
+/* frames queued in the ingest, the oldest is dropped past that */
+#define INGEST_MAX_BUFFERS 3
+#define INGEST_LEAKY_DOWNSTREAM 2
+
 struct _GstEngineBin
 {
   GstBin parent_instance;
   GstElement *asource;
   GstElement *vsource;
 
-  GstElement* atee;
+  /* external sources, pushed by the application or linked to the request pads */
+  GstElement *vingest;
+  GstElement *aingest;
+  GstPad *video_pad;
+  GstPad *audio_pad;
+
+  /* converts and resamples the audio once per format the encoders take */
+  GstElement *afrontend;
 
+  /* the main video on its first pad, overlays on the others */
+  GstElement *vmixer;
+  GstPad *vmixer_pad;
+  GstElement *vconvert;
+  GstElement *vscale;
   GstElement *vencoder;
   gchar *video_encoder_name;
   GstElement *video_encoder;
+  GstElement *vencfilter;
+  gchar *video_profile;
 
   GstElement *aacqueue;
-  GstElement *aacconvert;
   GstElement *aacencoder;
 
   GstElement *opusqueue;
-  GstElement *opusconvert;
   GstElement *opusencoder;
   gchar *audio_encoder_name;
   GstElement *audio_encoder;
@@ -60,40 +93,148 @@ struct _GstEngineBin
   GstElement *publish;
 
   gboolean use_test_sources;
+
+  GstThreadPolicy *encoder_thread_policy;
+
+  /* under the object lock */
+  guint64 frames;
+  guint64 fd_frames;
+  guint64 copies;
+  /* number of the last main frame into the mixer, also set on its first
+   * memory, and of the last one the encoder took without a copy */
+  guint ingest_seq;
+  guint encoder_seq;
 };
 
 G_DEFINE_TYPE(GstEngineBin, gst_engine_bin, GST_TYPE_BIN);
 
+/* Memory the encoder can map without a copy whatever process filled it */
+static gboolean gst_engine_bin_is_fd_memory(GstMemory *memory)
+{
+  return gst_memory_is_type(memory, "dmabuf") || gst_memory_is_type(memory, "fd");
+}
+
+static GQuark ingest_seq_quark;
 
-static void gst_engine_bin_init(GstEngineBin *self)
+static GstPadProbeReturn gst_engine_bin_ingest_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
 {
-  GstBin *bin = GST_BIN(self);
-  GST_INFO("Initializing GstEngineBin");
+  GstEngineBin *self = GST_ENGINE_BIN(user_data);
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+  GstMemory *memory = gst_buffer_n_memory(buffer) > 0 ? gst_buffer_peek_memory(buffer, 0) : NULL;
+
+  GST_OBJECT_LOCK(self);
+  self->frames++;
+  if (memory && gst_engine_bin_is_fd_memory(memory))
+    self->fd_frames++;
+  /* tagged rather than compared by address: a freed frame's memory can be
+   * reallocated at the same place, and a pooled one keeps an older number */
+  if (++self->ingest_seq == 0)
+    self->ingest_seq = 1;
+  if (memory)
+    gst_mini_object_set_qdata(GST_MINI_OBJECT(memory), ingest_seq_quark,
+        GUINT_TO_POINTER(self->ingest_seq), NULL);
+  GST_OBJECT_UNLOCK(self);
+
+  return GST_PAD_PROBE_OK;
+}
 
-  self->use_test_sources = TRUE;
-  self->video_encoder_name = g_strdup("x264enc");
-  self->audio_encoder_name = g_strdup("avenc_aac");
+/* A frame reaching the encoder in other memory than it came in was copied,
+ * by the mixer composing it, the converter or a pool of their own. The
+ * mixer outputs from its own thread, so the next frame may be tagged
+ * already: any tag newer than the last one taken is the ingest memory,
+ * the same one is a repeated frame, an older one a stale pooled memory */
+static GstPadProbeReturn gst_engine_bin_encoder_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+  GstEngineBin *self = GST_ENGINE_BIN(user_data);
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+  GstMemory *memory = gst_buffer_n_memory(buffer) > 0 ? gst_buffer_peek_memory(buffer, 0) : NULL;
+  guint seq = memory ? GPOINTER_TO_UINT(gst_mini_object_get_qdata(GST_MINI_OBJECT(memory), ingest_seq_quark)) : 0;
+
+  GST_OBJECT_LOCK(self);
+  if (seq != 0 && (gint) (seq - self->encoder_seq) >= 0)
+    self->encoder_seq = seq;
+  else
+    self->copies++;
+  GST_OBJECT_UNLOCK(self);
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* Test sources, or an ingest for the streams not linked to a request pad */
+static gboolean gst_engine_bin_add_sources(GstEngineBin *self)
+{
+  GstBin *bin = GST_BIN(self);
 
   if (self->use_test_sources) {
+    if (self->vsource)
+      return TRUE;
     GST_INFO("Using test sources for video and audio");
     self->vsource = gst_element_factory_make("videotestsrc", "vsource");
     self->asource = gst_element_factory_make("audiotestsrc", "asource");
     if (!self->vsource || !self->asource) {
       GST_ERROR("Failed to create test sources");
-      return;
+      return FALSE;
     }
     g_object_set(self->asource, "is-live", TRUE, NULL);
     g_object_set(self->vsource, "is-live", TRUE, NULL);
-  } else {
-    GST_INFO("Expecting external video and audio sources");
+    gst_bin_add_many(bin, self->vsource, self->asource, NULL);
+    if (!gst_element_link_pads(self->vsource, NULL, self->vmixer, GST_PAD_NAME(self->vmixer_pad)) ||
+        !gst_element_link(self->asource, self->afrontend)) {
+      GST_ERROR("Failed to link test sources to encoders");
+      return FALSE;
+    }
+    return TRUE;
+  }
+
+  GST_INFO("Expecting external video and audio sources");
+  if (!self->video_pad && !self->vingest) {
+    self->vingest = gst_element_factory_make("appsrc", "vingest");
+    if (!self->vingest) {
+      GST_ERROR("Failed to create video ingest");
+      return FALSE;
+    }
+    // Caps come with each sample, buffers are pushed as they are
+    g_object_set(self->vingest, "is-live", TRUE, "format", GST_FORMAT_TIME,
+        "max-buffers", (guint64) INGEST_MAX_BUFFERS, "leaky-type", INGEST_LEAKY_DOWNSTREAM, NULL);
+    gst_bin_add(bin, self->vingest);
+    if (!gst_element_link_pads(self->vingest, NULL, self->vmixer, GST_PAD_NAME(self->vmixer_pad))) {
+      GST_ERROR("Failed to link video ingest");
+      return FALSE;
+    }
+  }
+  if (!self->audio_pad && !self->aingest) {
+    self->aingest = gst_element_factory_make("appsrc", "aingest");
+    if (!self->aingest) {
+      GST_ERROR("Failed to create audio ingest");
+      return FALSE;
+    }
+    g_object_set(self->aingest, "is-live", TRUE, "format", GST_FORMAT_TIME,
+        "max-buffers", (guint64) INGEST_MAX_BUFFERS, "leaky-type", INGEST_LEAKY_DOWNSTREAM, NULL);
+    gst_bin_add(bin, self->aingest);
+    if (!gst_element_link(self->aingest, self->afrontend)) {
+      GST_ERROR("Failed to link audio ingest");
+      return FALSE;
+    }
   }
+  return TRUE;
+}
 
-  self->atee = gst_element_factory_make("tee", "atee");
-  if (!self->atee) {
-    GST_ERROR("Failed to create audio tee");
+
+static void gst_engine_bin_init(GstEngineBin *self)
+{
+  GstBin *bin = GST_BIN(self);
+  GST_INFO("Initializing GstEngineBin");
+
+  self->use_test_sources = TRUE;
+  self->video_encoder_name = g_strdup("x264enc");
+  self->audio_encoder_name = g_strdup("avenc_aac");
+
+  self->afrontend = gst_element_factory_make("audiofrontend", "afrontend");
+  if (!self->afrontend) {
+    GST_ERROR("Failed to create audio front-end");
     return;
   }
-  GST_DEBUG("Created audio tee element");
+  GST_DEBUG("Created audio front-end element");
 
   self->video_encoder = gst_element_factory_make(self->video_encoder_name, "vencoder");
   if (!self->video_encoder) {
@@ -101,12 +242,41 @@ static void gst_engine_bin_init(GstEngineBin *self)
     return;
   }
   GST_INFO("Created video encoder: %s", self->video_encoder_name);
+
+  // The mixer passes the main video through until overlays are placed on it
+  self->vmixer = gst_element_factory_make("scenemixer", "vmixer");
+  if (!self->vmixer) {
+    GST_ERROR("Failed to create video mixer");
+    return;
+  }
+
+  // Both passthrough unless the input format is one the encoder cannot take,
+  // the common ones are converted by convertscale, the others by videoconvert
+  self->vconvert = gst_element_factory_make("videoconvert", "vconvert");
+  self->vscale = gst_element_factory_make("convertscale", "vscale");
+  if (!self->vconvert || !self->vscale) {
+    GST_ERROR("Failed to create video converter");
+    return;
+  }
   
   if (g_strcmp0(self->video_encoder_name, "x264enc") == 0) {
     g_object_set(self->video_encoder, "bitrate", 1000, "tune", 0x00004, "key-int-max", 60, NULL);
     GST_DEBUG("Configured x264enc with bitrate=1000, tune=zerolatency, key-int-max=60");
   }
 
+  // Constrained baseline by default, the profile every browser decodes.
+  // Clearing "video-profile" lets the encoder pick, the preview then sends
+  // viewers through a transcode branch
+  self->vencfilter = gst_element_factory_make("capsfilter", "vencfilter");
+  if (!self->vencfilter) {
+    GST_ERROR("Failed to create video encoder caps filter");
+    return;
+  }
+  self->video_profile = g_strdup(DEFAULT_VIDEO_PROFILE);
+  GstCaps *venccaps = gst_caps_new_simple("video/x-h264", "profile", G_TYPE_STRING, self->video_profile, NULL);
+  g_object_set(self->vencfilter, "caps", venccaps, NULL);
+  gst_caps_unref(venccaps);
+
   self->venctee = gst_element_factory_make("tee", "venctee");
   if (!self->venctee) {
     GST_ERROR("Failed to create video tee");
@@ -123,18 +293,16 @@ static void gst_engine_bin_init(GstEngineBin *self)
   GST_DEBUG("Created preview and publish queues");
 
   self->aacqueue = gst_element_factory_make("queue", "aacqueue");
-  self->aacconvert = gst_element_factory_make("audioconvert", "aacconvert");
   self->audio_encoder = gst_element_factory_make(self->audio_encoder_name, "aacencoder");
-  if (!self->aacqueue || !self->aacconvert || !self->audio_encoder) {
+  if (!self->aacqueue || !self->audio_encoder) {
     GST_ERROR("Failed to create audio encoder pipeline");
     return;
   }
   GST_INFO("Created audio encoder: %s", self->audio_encoder_name);
 
   self->opusqueue = gst_element_factory_make("queue", "queueopus");
-  self->opusconvert = gst_element_factory_make("audioconvert", "opusconvert");
   self->opusencoder = gst_element_factory_make("opusenc", "opusenc");
-  if (!self->opusqueue || !self->opusconvert || !self->opusencoder) {
+  if (!self->opusqueue || !self->opusencoder) {
     GST_ERROR("Failed to create Opus encoder pipeline");
     return;
   }
@@ -148,45 +316,26 @@ static void gst_engine_bin_init(GstEngineBin *self)
   }
   GST_DEBUG("Created publish and preview elements");
 
-  // Add elements to bin
-  if (self->use_test_sources) {
-    gst_bin_add_many(bin, 
-      self->vsource, self->asource,
-      self->atee, self->video_encoder, self->venctee,
-      self->aacqueue, self->aacconvert, self->audio_encoder,
-      self->opusqueue, self->opusconvert, self->opusencoder,
-      self->publish, self->qvpreview, self->qvpublishtee, self->preview,
-      NULL);
-  } else {
-    gst_bin_add_many(bin,
-      self->atee, self->video_encoder, self->venctee,
-      self->aacqueue, self->aacconvert, self->audio_encoder,
-      self->opusqueue, self->opusconvert, self->opusencoder,
-      self->publish, self->qvpreview, self->qvpublishtee, self->preview,
-      NULL);
-  }
+  // Add elements to bin, the sources are added when going to READY
+  gst_bin_add_many(bin,
+    self->afrontend, self->vmixer, self->vconvert, self->vscale, self->video_encoder, self->vencfilter, self->venctee,
+    self->aacqueue, self->audio_encoder,
+    self->opusqueue, self->opusencoder,
+    self->publish, self->qvpreview, self->qvpublishtee, self->preview,
+    NULL);
   GST_DEBUG("Added all elements to bin");
 
-  if (self->use_test_sources) {
-    if (!gst_element_link(self->vsource, self->video_encoder) ||
-        !gst_element_link(self->asource, self->atee)) {
-      GST_ERROR("Failed to link test sources to encoders");
-      return;
-    }
-    GST_DEBUG("Linked test sources to encoders");
+  if (!gst_element_link_many(self->vmixer, self->vconvert, self->vscale, self->video_encoder, self->vencfilter, self->venctee, NULL)) {
+    GST_ERROR("Failed to link video encoder to tee");
+    return;
   }
+  GST_DEBUG("Linked video encoder to tee");
 
-  GstCaps *caps = gst_caps_new_simple ("video/x-h264",
-      "profile", G_TYPE_STRING,  "constrained-baseline",
-      NULL);
-
-  if (!gst_element_link_filtered(self->video_encoder, self->venctee, caps)) {
-    GST_ERROR("Failed to link video encoder to tee with H264 caps");
-    gst_caps_unref(caps);
+  self->vmixer_pad = gst_element_request_pad_simple(self->vmixer, "sink_%u");
+  if (!self->vmixer_pad) {
+    GST_ERROR("Failed to request the main video mixer pad");
     return;
   }
-  gst_caps_unref(caps);
-  GST_DEBUG("Linked video encoder to tee with H264 caps");
   
   if (!gst_element_link(self->venctee, self->qvpreview) ||
       !gst_element_link(self->venctee, self->qvpublishtee)) {
@@ -195,8 +344,10 @@ static void gst_engine_bin_init(GstEngineBin *self)
   }
   GST_DEBUG("Linked video tee to preview and publish paths");
 
-  if (!gst_element_link_many(self->atee, self->aacqueue, self->aacconvert, self->audio_encoder, NULL) ||
-      !gst_element_link_many(self->atee, self->opusqueue, self->opusconvert, self->opusencoder, NULL)) {
+  // Each encoder gets its format and rate from the front-end, converted in the
+  // source thread before the queues
+  if (!gst_element_link_many(self->afrontend, self->aacqueue, self->audio_encoder, NULL) ||
+      !gst_element_link_many(self->afrontend, self->opusqueue, self->opusencoder, NULL)) {
     GST_ERROR("Failed to link audio paths");
     return;
   }
@@ -215,6 +366,14 @@ static void gst_engine_bin_init(GstEngineBin *self)
     return;
   }
   GST_DEBUG("Linked video and audio to preview sink");
+
+  // Tagged where the main video enters the mixer, whatever its source, so
+  // the frames the mixer composes count as copies at the encoder
+  gst_pad_add_probe(self->vmixer_pad, GST_PAD_PROBE_TYPE_BUFFER, gst_engine_bin_ingest_probe, self, NULL);
+
+  GstPad *pad = gst_element_get_static_pad(self->video_encoder, "sink");
+  gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, gst_engine_bin_encoder_probe, self, NULL);
+  gst_object_unref(pad);
   
   GST_INFO("GstEngineBin initialization completed");
 }
@@ -241,12 +400,63 @@ static void gst_engine_bin_set_property(GObject *object,
       self->use_test_sources = g_value_get_boolean(value);
       GST_INFO("Use test sources set to: %s", self->use_test_sources ? "TRUE" : "FALSE");
       break;
+    case PROP_ENCODER_THREAD_POLICY:
+      gst_thread_policy_free(self->encoder_thread_policy);
+      self->encoder_thread_policy = gst_thread_policy_new_from_string("encoder", g_value_get_string(value));
+      break;
+    case PROP_PREVIEW_THREAD_POLICY:
+      g_object_set_property(G_OBJECT(self->preview), "thread-policy", value);
+      break;
+    case PROP_PUBLISH_THREAD_POLICY:
+      g_object_set_property(G_OBJECT(self->publish), "thread-policy", value);
+      break;
+    case PROP_SHARED_POOL:
+      g_object_set_property(G_OBJECT(self->publish), "shared-pool", value);
+      break;
+    case PROP_ENGINE_ID:
+      g_object_set_property(G_OBJECT(self->preview), "engine-id", value);
+      break;
+    case PROP_VIDEO_PROFILE: {
+      GstCaps *caps = NULL;
+
+      g_free(self->video_profile);
+      self->video_profile = g_value_dup_string(value);
+      if (self->video_profile && *self->video_profile)
+        caps = gst_caps_new_simple("video/x-h264", "profile", G_TYPE_STRING, self->video_profile, NULL);
+      g_object_set(self->vencfilter, "caps", caps, NULL);
+      if (caps)
+        gst_caps_unref(caps);
+      break;
+    }
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
       break;
   }
 }
 
+static GstStructure *gst_engine_bin_get_stats(GstEngineBin *self)
+{
+  GstStructure *stats, *audio = NULL;
+
+  if (self->afrontend)
+    g_object_get(self->afrontend, "stats", &audio, NULL);
+
+  GST_OBJECT_LOCK(self);
+  stats = gst_structure_new("enginebin-stats",
+      "frames", G_TYPE_UINT64, self->frames,
+      "fd-frames", G_TYPE_UINT64, self->fd_frames,
+      "copies", G_TYPE_UINT64, self->copies,
+      NULL);
+  GST_OBJECT_UNLOCK(self);
+
+  if (audio) {
+    gst_structure_set(stats, "audio", GST_TYPE_STRUCTURE, audio, NULL);
+    gst_structure_free(audio);
+  }
+
+  return stats;
+}
+
 static void gst_engine_bin_get_property(GObject *object,
                                       guint prop_id,
                                       GValue *value,
@@ -264,6 +474,27 @@ static void gst_engine_bin_get_property(GObject *object,
     case PROP_USE_TEST_SOURCES:
       g_value_set_boolean(value, self->use_test_sources);
       break;
+    case PROP_ENCODER_THREAD_POLICY:
+      g_value_set_string(value, gst_thread_policy_get_description(self->encoder_thread_policy));
+      break;
+    case PROP_PREVIEW_THREAD_POLICY:
+      g_object_get_property(G_OBJECT(self->preview), "thread-policy", value);
+      break;
+    case PROP_PUBLISH_THREAD_POLICY:
+      g_object_get_property(G_OBJECT(self->publish), "thread-policy", value);
+      break;
+    case PROP_SHARED_POOL:
+      g_object_get_property(G_OBJECT(self->publish), "shared-pool", value);
+      break;
+    case PROP_ENGINE_ID:
+      g_object_get_property(G_OBJECT(self->preview), "engine-id", value);
+      break;
+    case PROP_VIDEO_PROFILE:
+      g_value_set_string(value, self->video_profile);
+      break;
+    case PROP_STATS:
+      g_value_take_boxed(value, gst_engine_bin_get_stats(self));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
       break;
@@ -306,32 +537,271 @@ static gboolean gst_engine_bin_stop_stream(GstEngineBin *self)
     return ret;
 }
 
+static GstFlowReturn gst_engine_bin_push_sample(GstEngineBin *self, GstElement *ingest, GstSample *sample)
+{
+    GstFlowReturn ret = GST_FLOW_ERROR;
+
+    if (!ingest) {
+        GST_WARNING_OBJECT(self, "No ingest, use-test-sources is set or the stream comes from a request pad");
+        return GST_FLOW_NOT_LINKED;
+    }
+    g_signal_emit_by_name(ingest, "push-sample", sample, &ret);
+    return ret;
+}
+
+static GstFlowReturn gst_engine_bin_push_video_sample(GstEngineBin *self, GstSample *sample)
+{
+    return gst_engine_bin_push_sample(self, self->vingest, sample);
+}
+
+static GstFlowReturn gst_engine_bin_push_audio_sample(GstEngineBin *self, GstSample *sample)
+{
+    return gst_engine_bin_push_sample(self, self->aingest, sample);
+}
+
+static GstFlowReturn gst_engine_bin_end_of_stream(GstEngineBin *self)
+{
+    GstFlowReturn ret = GST_FLOW_NOT_LINKED;
+
+    GST_INFO("Ending the external sources");
+    if (self->vingest)
+        g_signal_emit_by_name(self->vingest, "end-of-stream", &ret);
+    if (self->aingest)
+        g_signal_emit_by_name(self->aingest, "end-of-stream", &ret);
+    return ret;
+}
+
+/* An input of the scene over the main video, with or without test sources,
+ * transparent until placed with set-scene */
+static GstPad *gst_engine_bin_request_overlay_pad(GstEngineBin *self, GstPadTemplate *templ)
+{
+  GstPad *target_pad, *pad;
+  gchar *name;
+
+  target_pad = gst_element_request_pad_simple(self->vmixer, "sink_%u");
+  if (!target_pad) {
+    GST_WARNING_OBJECT(self, "Failed to request a video mixer pad");
+    return NULL;
+  }
+  g_object_set(target_pad, "alpha", 0.0, NULL);
+
+  // Named after the mixer pad, so the scene names them the same way
+  name = g_strdup_printf("video_sink_%s", GST_PAD_NAME(target_pad) + strlen("sink_"));
+  pad = gst_ghost_pad_new_from_template(name, target_pad, templ);
+  g_free(name);
+  gst_object_unref(target_pad);
+
+  gst_pad_set_active(pad, TRUE);
+  gst_element_add_pad(GST_ELEMENT(self), pad);
+
+  return pad;
+}
+
+/* External sources linked to the encoders. The mixer answers the upstream
+ * allocation query itself, so upstream keeps its own memory, and the mixer
+ * and the converter pass the main video alone through in that memory as
+ * long as the encoder takes its format */
+static GstPad *gst_engine_bin_request_new_pad(GstElement *element, GstPadTemplate *templ,
+                                              const gchar *name, const GstCaps *caps)
+{
+  GstEngineBin *self = GST_ENGINE_BIN(element);
+  const gchar *template_name = GST_PAD_TEMPLATE_NAME_TEMPLATE(templ);
+  gboolean video = g_strcmp0(template_name, "video_sink") == 0;
+  GstPad *target_pad, *pad;
+
+  if (g_strcmp0(template_name, "video_sink_%u") == 0)
+    return gst_engine_bin_request_overlay_pad(self, templ);
+
+  if (self->use_test_sources) {
+    GST_WARNING_OBJECT(self, "Set use-test-sources to FALSE before requesting %s", template_name);
+    return NULL;
+  }
+  if (video ? (self->video_pad || self->vingest) : (self->audio_pad || self->aingest)) {
+    GST_WARNING_OBJECT(self, "%s already has a source", template_name);
+    return NULL;
+  }
+
+  target_pad = video ? gst_object_ref(self->vmixer_pad) : gst_element_get_static_pad(self->afrontend, "sink");
+  pad = gst_ghost_pad_new_from_template(template_name, target_pad, templ);
+  gst_object_unref(target_pad);
+
+  gst_pad_set_active(pad, TRUE);
+  gst_element_add_pad(element, pad);
+  if (video)
+    self->video_pad = pad;
+  else
+    self->audio_pad = pad;
+
+  return pad;
+}
+
+static void gst_engine_bin_release_pad(GstElement *element, GstPad *pad)
+{
+  GstEngineBin *self = GST_ENGINE_BIN(element);
+
+  if (pad == self->video_pad) {
+    self->video_pad = NULL;
+  } else if (pad == self->audio_pad) {
+    self->audio_pad = NULL;
+  } else {
+    GstPad *target_pad = gst_ghost_pad_get_target(GST_GHOST_PAD(pad));
+
+    // An overlay, its mixer pad goes with it
+    if (target_pad) {
+      gst_ghost_pad_set_target(GST_GHOST_PAD(pad), NULL);
+      gst_element_release_request_pad(self->vmixer, target_pad);
+      gst_object_unref(target_pad);
+    }
+  }
+  gst_pad_set_active(pad, FALSE);
+  gst_element_remove_pad(element, pad);
+}
+
+/* The scene of the mixer, with the pads of the bin: video_sink for the main
+ * video and video_sink_%u for the overlays */
+static gboolean gst_engine_bin_set_scene(GstEngineBin *self, GstStructure *scene)
+{
+  GstStructure *mixer_scene = gst_structure_new_empty("scene");
+  gboolean ret = TRUE;
+
+  for (gint i = 0; i < gst_structure_n_fields(scene) && ret; i++){
+    const gchar *name = gst_structure_nth_field_name(scene, i);
+    GstPad *pad, *target_pad = NULL;
+
+    if (g_strcmp0(name, "video_sink") == 0) {
+      target_pad = gst_object_ref(self->vmixer_pad);
+    } else if ((pad = gst_element_get_static_pad(GST_ELEMENT(self), name))) {
+      if (GST_IS_GHOST_PAD(pad))
+        target_pad = gst_ghost_pad_get_target(GST_GHOST_PAD(pad));
+      gst_object_unref(pad);
+    }
+
+    if (!target_pad || GST_OBJECT_PARENT(target_pad) != GST_OBJECT(self->vmixer)) {
+      GST_WARNING_OBJECT(self, "No video input %s to place in the scene", name);
+      ret = FALSE;
+    } else {
+      gst_structure_set_value(mixer_scene, GST_PAD_NAME(target_pad), gst_structure_get_value(scene, name));
+    }
+    if (target_pad)
+      gst_object_unref(target_pad);
+  }
+
+  if (ret)
+    g_signal_emit_by_name(self->vmixer, "set-scene", mixer_scene, &ret);
+  gst_structure_free(mixer_scene);
+  return ret;
+}
+
+static GstStateChangeReturn gst_engine_bin_change_state(GstElement *element, GstStateChange transition)
+{
+  GstEngineBin *self = GST_ENGINE_BIN(element);
+
+  if (transition == GST_STATE_CHANGE_NULL_TO_READY && !gst_engine_bin_add_sources(self))
+    return GST_STATE_CHANGE_FAILURE;
+
+  if (transition == GST_STATE_CHANGE_READY_TO_PAUSED) {
+    GST_OBJECT_LOCK(self);
+    self->frames = 0;
+    self->fd_frames = 0;
+    self->copies = 0;
+    self->ingest_seq = 0;
+    self->encoder_seq = 0;
+    GST_OBJECT_UNLOCK(self);
+  }
+
+  return GST_ELEMENT_CLASS(parent_class)->change_state(element, transition);
+}
+
+/* A recorder running out of disk with the lower-bitrate policy asks for the
+ * byte rate that lasts until its warning delay. The video encoder is shared
+ * by every output, its bitrate is scaled down by the same ratio whatever
+ * its unit, and never raised back. */
+static void gst_engine_bin_lower_bitrate(GstEngineBin *self, const GstStructure *structure)
+{
+  GParamSpec *pspec = g_object_class_find_property(G_OBJECT_GET_CLASS(self->video_encoder), "bitrate");
+  guint64 rate = 0, target = 0;
+  guint bitrate = 0, lowered;
+
+  if (g_strcmp0(gst_structure_get_string(structure, "action"), "lower-bitrate") != 0)
+    return;
+  if (!pspec || pspec->value_type != G_TYPE_UINT) {
+    GST_WARNING_OBJECT(self, "%s has no bitrate to lower", self->video_encoder_name);
+    return;
+  }
+  if (!gst_structure_get_uint64(structure, "byte-rate", &rate) ||
+      !gst_structure_get_uint64(structure, "target-byte-rate", &target) ||
+      rate == 0 || target >= rate)
+    return;
+
+  g_object_get(self->video_encoder, "bitrate", &bitrate, NULL);
+  lowered = MAX(gst_util_uint64_scale(bitrate, target, rate), G_PARAM_SPEC_UINT(pspec)->minimum);
+  if (lowered >= bitrate)
+    return;
+
+  GST_INFO_OBJECT(self, "Lowering the video bitrate from %u to %u for the disk", bitrate, lowered);
+  g_object_set(self->video_encoder, "bitrate", lowered, NULL);
+}
+
+/* Threads of the preview and publish bins are placed by their own policies */
+static void gst_engine_bin_handle_message(GstBin *bin, GstMessage *message)
+{
+  GstEngineBin *self = GST_ENGINE_BIN(bin);
+  GstObject *src = GST_MESSAGE_SRC(message);
+
+  if (GST_MESSAGE_TYPE(message) == GST_MESSAGE_STREAM_STATUS &&
+      src != GST_OBJECT(self->preview) && !gst_object_has_as_ancestor(src, GST_OBJECT(self->preview)) &&
+      src != GST_OBJECT(self->publish) && !gst_object_has_as_ancestor(src, GST_OBJECT(self->publish))) {
+    gst_thread_policy_handle_message(self->encoder_thread_policy, GST_ELEMENT(self), message);
+  }
+
+  if (GST_MESSAGE_TYPE(message) == GST_MESSAGE_ELEMENT &&
+      gst_message_has_name(message, "recordsink-disk") && self->video_encoder)
+    gst_engine_bin_lower_bitrate(self, gst_message_get_structure(message));
+
+  GST_BIN_CLASS(parent_class)->handle_message(bin, message);
+}
+
+static void gst_engine_bin_finalize(GObject *object)
+{
+  GstEngineBin *self = GST_ENGINE_BIN(object);
+
+  gst_thread_policy_free(self->encoder_thread_policy);
+  gst_clear_object(&self->vmixer_pad);
+  g_free(self->video_encoder_name);
+  g_free(self->audio_encoder_name);
+  g_free(self->video_profile);
+
+  G_OBJECT_CLASS(parent_class)->finalize(object);
+}
 
 static void gst_engine_bin_class_init(GstEngineBinClass *klass)
 {
   GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
   GObjectClass *object_class = G_OBJECT_CLASS(klass);
+  GstBinClass *bin_class = GST_BIN_CLASS(klass);
 
   object_class->set_property = gst_engine_bin_set_property;
   object_class->get_property = gst_engine_bin_get_property;
+  object_class->finalize = gst_engine_bin_finalize;
+  bin_class->handle_message = gst_engine_bin_handle_message;
+  element_class->change_state = gst_engine_bin_change_state;
+  element_class->request_new_pad = gst_engine_bin_request_new_pad;
+  element_class->release_pad = gst_engine_bin_release_pad;
 
-  // Add sink pads for external sources
+  ingest_seq_quark = g_quark_from_static_string("gst-engine-bin-ingest-seq");
+
+  // Add sink pads for external sources, any raw format the converter takes
   gst_element_class_add_pad_template(element_class,
       gst_pad_template_new("video_sink", GST_PAD_SINK, GST_PAD_REQUEST,
-          gst_caps_new_simple("video/x-raw",
-              "format", G_TYPE_STRING, "I420",
-              "width", G_TYPE_INT, 640,
-              "height", G_TYPE_INT, 480,
-              "framerate", GST_TYPE_FRACTION, 30, 1,
-              NULL)));
+          gst_caps_new_empty_simple("video/x-raw")));
+
+  gst_element_class_add_pad_template(element_class,
+      gst_pad_template_new("video_sink_%u", GST_PAD_SINK, GST_PAD_REQUEST,
+          gst_caps_new_empty_simple("video/x-raw")));
 
   gst_element_class_add_pad_template(element_class,
       gst_pad_template_new("audio_sink", GST_PAD_SINK, GST_PAD_REQUEST,
-          gst_caps_new_simple("audio/x-raw",
-              "format", G_TYPE_STRING, "S16LE",
-              "channels", G_TYPE_INT, 2,
-              "rate", G_TYPE_INT, 44100,
-              NULL)));
+          gst_caps_new_empty_simple("audio/x-raw")));
 
   g_object_class_install_property(object_class, PROP_VIDEO_ENCODER,
       g_param_spec_string("video-encoder", "Video Encoder",
@@ -347,10 +817,53 @@ static void gst_engine_bin_class_init(GstEngineBinClass *klass)
 
   g_object_class_install_property(object_class, PROP_USE_TEST_SOURCES,
       g_param_spec_boolean("use-test-sources", "Use Test Sources",
-          "Whether to use test sources or expect external sources",
+          "Whether to use test sources or expect external sources, through the request pads or the push-video-sample and push-audio-sample signals",
           TRUE,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property(object_class, PROP_ENCODER_THREAD_POLICY,
+      g_param_spec_string("encoder-thread-policy", "Encoder Thread Policy",
+          "Placement of the capture and encoder threads, e.g. \"cpus=0-3;rr=10\"",
+          NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property(object_class, PROP_PREVIEW_THREAD_POLICY,
+      g_param_spec_string("preview-thread-policy", "Preview Thread Policy",
+          "Placement of the WebRTC preview threads",
+          NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property(object_class, PROP_PUBLISH_THREAD_POLICY,
+      g_param_spec_string("publish-thread-policy", "Publish Thread Policy",
+          "Placement of the record and stream branch threads",
+          NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(object_class, PROP_SHARED_POOL,
+      g_param_spec_boolean("shared-pool", "Shared Pool",
+          "Drain the publish branch queues from a process-wide work-stealing pool bounded by the core count",
+          FALSE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(object_class, PROP_VIDEO_PROFILE,
+      g_param_spec_string("video-profile", "Video Profile",
+          "H.264 profile forced on the encoder output, empty lets the encoder pick",
+          DEFAULT_VIDEO_PROFILE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property(object_class, PROP_ENGINE_ID,
+      g_param_spec_string("engine-id", "Engine Id",
+          "Id under which the preview is served (/ws/<engine-id>) by the preview server shared with other engines",
+          NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property(object_class, PROP_STATS,
+      g_param_spec_boxed("stats", "Statistics",
+          "Main video frames into the mixer, how many came in fd backed memory, how many reached the encoder copied, "
+          "and the audio front-end conversions with their CPU time",
+          GST_TYPE_STRUCTURE,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
   GType record_params[1] = {G_TYPE_STRING};
   gst_engine_bin_signals[SIGNAL_START_RECORD] =
       g_signal_newv("start-record", G_TYPE_FROM_CLASS(klass),
@@ -382,6 +895,36 @@ static void gst_engine_bin_class_init(GstEngineBinClass *klass)
                     NULL, NULL, NULL, G_TYPE_BOOLEAN,
                     0, NULL);      
 
+  GType sample_params[1] = {GST_TYPE_SAMPLE};
+  gst_engine_bin_signals[SIGNAL_PUSH_VIDEO_SAMPLE] =
+      g_signal_newv("push-video-sample", G_TYPE_FROM_CLASS(klass),
+                    G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+                    g_cclosure_new(G_CALLBACK(gst_engine_bin_push_video_sample), NULL, NULL),
+                    NULL, NULL, NULL, GST_TYPE_FLOW_RETURN,
+                    1, sample_params);
+
+  gst_engine_bin_signals[SIGNAL_PUSH_AUDIO_SAMPLE] =
+      g_signal_newv("push-audio-sample", G_TYPE_FROM_CLASS(klass),
+                    G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+                    g_cclosure_new(G_CALLBACK(gst_engine_bin_push_audio_sample), NULL, NULL),
+                    NULL, NULL, NULL, GST_TYPE_FLOW_RETURN,
+                    1, sample_params);
+
+  gst_engine_bin_signals[SIGNAL_END_OF_STREAM] =
+      g_signal_newv("end-of-stream", G_TYPE_FROM_CLASS(klass),
+                    G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+                    g_cclosure_new(G_CALLBACK(gst_engine_bin_end_of_stream), NULL, NULL),
+                    NULL, NULL, NULL, GST_TYPE_FLOW_RETURN,
+                    0, NULL);
+
+  GType scene_params[1] = {GST_TYPE_STRUCTURE};
+  gst_engine_bin_signals[SIGNAL_SET_SCENE] =
+      g_signal_newv("set-scene", G_TYPE_FROM_CLASS(klass),
+                    G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+                    g_cclosure_new(G_CALLBACK(gst_engine_bin_set_scene), NULL, NULL),
+                    NULL, NULL, NULL, G_TYPE_BOOLEAN,
+                    1, scene_params);
+
   gst_element_class_set_static_metadata(element_class,
                                         "Engine Bin",
                                         "Engine Bin",
@@ -0,0 +1,993 @@
+#include "gstscenemixer.h"
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <string.h>
+
+#include <common/gstworkpool.h>
+
+#include "gstconvertscalekernels.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_scene_mixer_debug);
+#define GST_CAT_DEFAULT gst_scene_mixer_debug
+
+#define gst_scene_mixer_parent_class parent_class
+
+/* output rows per job and columns per tile, occlusion is decided per tile */
+#define BAND_ROWS 16
+#define TILE_WIDTH 64
+
+#define DEFAULT_ALPHA 1.0
+
+#define SRC_CAPS GST_VIDEO_CAPS_MAKE ("{ I420, NV12, BGRx, RGBx }")
+#define SINK_CAPS GST_VIDEO_CAPS_MAKE (GST_VIDEO_FORMATS_ALL)
+
+/* element properties */
+enum
+{
+  PROP_0,
+  PROP_WIDTH,
+  PROP_HEIGHT,
+  PROP_STATS,
+};
+
+/* pad properties */
+enum
+{
+  PROP_PAD_0,
+  PROP_PAD_XPOS,
+  PROP_PAD_YPOS,
+  PROP_PAD_WIDTH,
+  PROP_PAD_HEIGHT,
+  PROP_PAD_ALPHA,
+};
+
+enum
+{
+  SIGNAL_SET_SCENE = 0,
+  LAST_SIGNAL
+};
+
+static guint gst_scene_mixer_signals[LAST_SIGNAL] = {0};
+
+/* how the output of the current frame is made */
+typedef enum
+{
+  MODE_COMPOSE,
+  MODE_REUSE,
+  MODE_PASSTHROUGH,
+} GstSceneMixerMode;
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink_%u",
+    GST_PAD_SINK,
+    GST_PAD_REQUEST,
+    GST_STATIC_CAPS (SINK_CAPS));
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (SRC_CAPS));
+
+typedef struct
+{
+  gint xpos;
+  gint ypos;
+  gint width;
+  gint height;
+  gdouble alpha;
+  /* -1 when unchanged */
+  gint zorder;
+} GstSceneMixerGeometry;
+
+/* One input of the scene, converted to the output format and scaled to its
+ * size by the parent pad */
+struct _GstSceneMixerPad
+{
+  GstVideoAggregatorConvertPad parent_instance;
+
+  /* under the scene lock of the mixer */
+  GstSceneMixerGeometry pending;
+  gboolean changed;
+
+  /* from the aggregating thread */
+  GstSceneMixerGeometry active;
+  gboolean visible;
+  gint info_width;
+  gint info_height;
+  /* last frame drawn, only compared */
+  GstBuffer *last_buffer;
+  GstClockTime last_pts;
+};
+
+G_DEFINE_TYPE(GstSceneMixerPad, gst_scene_mixer_pad, GST_TYPE_VIDEO_AGGREGATOR_CONVERT_PAD);
+
+typedef struct
+{
+  GstSceneMixerPad *pad;
+  /* in output pixels, even for the chroma planes */
+  gint x;
+  gint y;
+  gint width;
+  gint height;
+  /* out of 256 */
+  guint alpha;
+} GstSceneMixerLayer;
+
+/* Composites N inputs by z-order before the encoder. The scene is applied
+ * between two frames, all of it at once, and turned into layers and a plan
+ * of the lowest layer each tile needs, below it an opaque layer hides
+ * everything. A frame whose inputs did not change since the last one reuses
+ * its memory, and a single opaque full-frame input in the output format
+ * goes through as it is. */
+struct _GstSceneMixer
+{
+  GstVideoAggregator parent_instance;
+
+  /* under the object lock */
+  gint width;
+  gint height;
+  guint64 frames;
+  guint64 composed;
+  guint64 reused;
+  guint64 passthrough;
+  guint64 skipped;
+  GstClockTime compose_time;
+
+  gint dirty;
+
+  /* pending geometry of all the pads, so a whole scene is set at once */
+  GMutex scene_lock;
+
+  /* from the aggregating thread */
+  GstSceneMixerLayer *layers;
+  guint n_layers;
+  gint16 *plan;
+  guint n_bands;
+  guint n_columns;
+  guint plan_skipped;
+  GstVideoInfo plan_info;
+  GstSceneMixerMode mode;
+  GstBuffer *last_output;
+};
+
+typedef struct
+{
+  GstSceneMixer *self;
+  GstVideoFrame **in;
+  GstVideoFrame *out;
+} GstSceneMixerFrame;
+
+G_DEFINE_TYPE(GstSceneMixer, gst_scene_mixer, GST_TYPE_VIDEO_AGGREGATOR);
+
+
+static void gst_scene_mixer_clear_plan(GstSceneMixer *self)
+{
+  for (guint l = 0; l < self->n_layers; l++)
+    gst_object_unref(self->layers[l].pad);
+  g_clear_pointer(&self->layers, g_free);
+  g_clear_pointer(&self->plan, g_free);
+  self->n_layers = 0;
+  self->n_bands = 0;
+  self->n_columns = 0;
+  self->plan_skipped = 0;
+  gst_video_info_init(&self->plan_info);
+}
+
+/* Size the pad is converted to, even so the chroma lines up */
+static void gst_scene_mixer_pad_get_size(GstSceneMixerPad *pad, gint *width, gint *height)
+{
+  GstVideoInfo *info = &GST_VIDEO_AGGREGATOR_PAD(pad)->info;
+
+  *width = (pad->active.width > 0 ? pad->active.width : GST_VIDEO_INFO_WIDTH(info)) & ~1;
+  *height = (pad->active.height > 0 ? pad->active.height : GST_VIDEO_INFO_HEIGHT(info)) & ~1;
+}
+
+static gboolean gst_scene_mixer_tile_bounds(GstSceneMixer *self, guint band, guint column,
+                                            gint *x0, gint *y0, gint *x1, gint *y1)
+{
+  *x0 = column * TILE_WIDTH;
+  *y0 = band * BAND_ROWS;
+  *x1 = MIN(*x0 + TILE_WIDTH, GST_VIDEO_INFO_WIDTH(&self->plan_info));
+  *y1 = MIN(*y0 + BAND_ROWS, GST_VIDEO_INFO_HEIGHT(&self->plan_info));
+  return *x0 < *x1 && *y0 < *y1;
+}
+
+static void gst_scene_mixer_build_plan(GstSceneMixer *self)
+{
+  GstVideoInfo *info = &GST_VIDEO_AGGREGATOR(self)->info;
+  gint width = GST_VIDEO_INFO_WIDTH(info), height = GST_VIDEO_INFO_HEIGHT(info);
+  guint n_pads;
+
+  gst_scene_mixer_clear_plan(self);
+  self->plan_info = *info;
+  if (GST_VIDEO_INFO_FORMAT(info) == GST_VIDEO_FORMAT_UNKNOWN)
+    return;
+
+  /* bottom first, the pads are kept sorted by z-order */
+  GST_OBJECT_LOCK(self);
+  n_pads = GST_ELEMENT(self)->numsinkpads;
+  self->layers = g_new0(GstSceneMixerLayer, MAX(n_pads, 1));
+  for (GList *l = GST_ELEMENT(self)->sinkpads; l; l = l->next){
+    GstSceneMixerPad *pad = l->data;
+    GstVideoInfo *pad_info = &GST_VIDEO_AGGREGATOR_PAD(pad)->info;
+    GstSceneMixerLayer *layer = &self->layers[self->n_layers];
+
+    pad->visible = FALSE;
+    pad->info_width = GST_VIDEO_INFO_WIDTH(pad_info);
+    pad->info_height = GST_VIDEO_INFO_HEIGHT(pad_info);
+    if (GST_VIDEO_INFO_FORMAT(pad_info) == GST_VIDEO_FORMAT_UNKNOWN)
+      continue;
+
+    layer->x = pad->active.xpos & ~1;
+    layer->y = pad->active.ypos & ~1;
+    gst_scene_mixer_pad_get_size(pad, &layer->width, &layer->height);
+    layer->alpha = lround(CLAMP(pad->active.alpha, 0, 1) * 256);
+    if (layer->alpha == 0 || layer->width <= 0 || layer->height <= 0 ||
+        layer->x >= width || layer->y >= height ||
+        layer->x + layer->width <= 0 || layer->y + layer->height <= 0)
+      continue;
+
+    layer->pad = gst_object_ref(pad);
+    self->n_layers++;
+  }
+  GST_OBJECT_UNLOCK(self);
+
+  self->n_bands = (height + BAND_ROWS - 1) / BAND_ROWS;
+  self->n_columns = (width + TILE_WIDTH - 1) / TILE_WIDTH;
+  self->plan = g_new(gint16, (gsize) self->n_bands * self->n_columns);
+
+  for (guint band = 0; band < self->n_bands; band++){
+    for (guint column = 0; column < self->n_columns; column++){
+      gint x0, y0, x1, y1, first = -1;
+
+      gst_scene_mixer_tile_bounds(self, band, column, &x0, &y0, &x1, &y1);
+
+      /* the highest opaque layer over the whole tile hides the others */
+      for (gint l = self->n_layers - 1; l >= 0; l--){
+        GstSceneMixerLayer *layer = &self->layers[l];
+
+        if (layer->alpha == 256 && layer->x <= x0 && layer->y <= y0 &&
+            layer->x + layer->width >= x1 && layer->y + layer->height >= y1){
+          first = l;
+          break;
+        }
+      }
+      self->plan[band * self->n_columns + column] = first;
+
+      for (gint l = 0; l < (gint) self->n_layers; l++){
+        GstSceneMixerLayer *layer = &self->layers[l];
+
+        if (layer->x >= x1 || layer->y >= y1 || layer->x + layer->width <= x0 || layer->y + layer->height <= y0)
+          continue;
+        if (l >= first)
+          layer->pad->visible = TRUE;
+        else
+          self->plan_skipped++;
+      }
+    }
+  }
+
+  GST_DEBUG_OBJECT(self, "Scene of %u layers on %dx%d, %u layer tiles hidden",
+      self->n_layers, width, height, self->plan_skipped);
+}
+
+/* Pending geometry becomes active between two frames, all pads at once:
+ * a scene set while it is copied waits for the lock, it never lands half
+ * on this frame */
+static gboolean gst_scene_mixer_apply_scene(GstSceneMixer *self)
+{
+  GPtrArray *pads = g_ptr_array_new_with_free_func(gst_object_unref);
+  gboolean *resized;
+  gint *zorders;
+  gboolean applied = FALSE;
+
+  GST_OBJECT_LOCK(self);
+  for (GList *l = GST_ELEMENT(self)->sinkpads; l; l = l->next)
+    g_ptr_array_add(pads, gst_object_ref(l->data));
+  GST_OBJECT_UNLOCK(self);
+
+  resized = g_newa(gboolean, MAX(pads->len, 1));
+  zorders = g_newa(gint, MAX(pads->len, 1));
+
+  g_mutex_lock(&self->scene_lock);
+  for (guint i = 0; i < pads->len; i++){
+    GstSceneMixerPad *pad = g_ptr_array_index(pads, i);
+
+    resized[i] = FALSE;
+    zorders[i] = -1;
+    if (!pad->changed)
+      continue;
+    resized[i] = pad->pending.width != pad->active.width || pad->pending.height != pad->active.height;
+    zorders[i] = pad->pending.zorder;
+    pad->pending.zorder = -1;
+    pad->active = pad->pending;
+    pad->changed = FALSE;
+    applied = TRUE;
+  }
+  g_mutex_unlock(&self->scene_lock);
+
+  for (guint i = 0; i < pads->len; i++){
+    GstSceneMixerPad *pad = g_ptr_array_index(pads, i);
+
+    /* applied before prepare_frame, so the parent pad converts this very
+     * frame at the new size */
+    if (resized[i])
+      gst_video_aggregator_convert_pad_update_conversion_info(GST_VIDEO_AGGREGATOR_CONVERT_PAD(pad));
+    if (zorders[i] >= 0)
+      g_object_set(pad, "zorder", (guint) zorders[i], NULL);
+  }
+  g_ptr_array_unref(pads);
+
+  return applied;
+}
+
+static gboolean gst_scene_mixer_inputs_resized(GstSceneMixer *self)
+{
+  gboolean resized = FALSE;
+
+  GST_OBJECT_LOCK(self);
+  for (GList *l = GST_ELEMENT(self)->sinkpads; l && !resized; l = l->next){
+    GstSceneMixerPad *pad = l->data;
+    GstVideoInfo *info = &GST_VIDEO_AGGREGATOR_PAD(pad)->info;
+
+    resized = GST_VIDEO_INFO_WIDTH(info) != pad->info_width || GST_VIDEO_INFO_HEIGHT(info) != pad->info_height;
+  }
+  GST_OBJECT_UNLOCK(self);
+
+  return resized;
+}
+
+/* A buffer from a pool can come back at the same address, not with the
+ * same timestamp */
+static gboolean gst_scene_mixer_inputs_changed(GstSceneMixer *self, gboolean update)
+{
+  gboolean changed = FALSE;
+
+  for (guint l = 0; l < self->n_layers; l++){
+    GstSceneMixerPad *pad = self->layers[l].pad;
+    GstBuffer *buffer;
+    GstClockTime pts;
+
+    if (!pad->visible)
+      continue;
+    buffer = gst_video_aggregator_pad_get_current_buffer(GST_VIDEO_AGGREGATOR_PAD(pad));
+    pts = buffer ? GST_BUFFER_PTS(buffer) : GST_CLOCK_TIME_NONE;
+    if (buffer != pad->last_buffer || pts != pad->last_pts)
+      changed = TRUE;
+    if (update){
+      pad->last_buffer = buffer;
+      pad->last_pts = pts;
+    }
+  }
+
+  return changed;
+}
+
+static GstSceneMixerLayer *gst_scene_mixer_passthrough_layer(GstSceneMixer *self)
+{
+  GstVideoInfo *info = &GST_VIDEO_AGGREGATOR(self)->info;
+  GstSceneMixerLayer *layer;
+  GstVideoInfo *pad_info;
+
+  if (self->n_layers == 0)
+    return NULL;
+
+  layer = &self->layers[self->n_layers - 1];
+  pad_info = &GST_VIDEO_AGGREGATOR_PAD(layer->pad)->info;
+  if (layer->alpha == 256 && layer->x == 0 && layer->y == 0 &&
+      layer->width == GST_VIDEO_INFO_WIDTH(info) && layer->height == GST_VIDEO_INFO_HEIGHT(info) &&
+      GST_VIDEO_INFO_FORMAT(pad_info) == GST_VIDEO_INFO_FORMAT(info) &&
+      GST_VIDEO_INFO_WIDTH(pad_info) == GST_VIDEO_INFO_WIDTH(info) &&
+      GST_VIDEO_INFO_HEIGHT(pad_info) == GST_VIDEO_INFO_HEIGHT(info))
+    return layer;
+
+  return NULL;
+}
+
+static GstFlowReturn gst_scene_mixer_create_output_buffer(GstVideoAggregator *vagg, GstBuffer **outbuf)
+{
+  GstSceneMixer *self = GST_SCENE_MIXER(vagg);
+  GstSceneMixerLayer *layer;
+  GstBuffer *buffer;
+  gboolean changed = gst_scene_mixer_apply_scene(self);
+
+  if (g_atomic_int_compare_and_exchange(&self->dirty, TRUE, FALSE))
+    changed = TRUE;
+  if (changed || !gst_video_info_is_equal(&vagg->info, &self->plan_info) || gst_scene_mixer_inputs_resized(self)){
+    gst_scene_mixer_build_plan(self);
+    changed = TRUE;
+  }
+
+  /* shallow copies, the memory is shared and never written again */
+  if (!changed && self->last_output && !gst_scene_mixer_inputs_changed(self, FALSE)){
+    self->mode = MODE_REUSE;
+    *outbuf = gst_buffer_copy(self->last_output);
+    return GST_FLOW_OK;
+  }
+  gst_scene_mixer_inputs_changed(self, TRUE);
+
+  layer = gst_scene_mixer_passthrough_layer(self);
+  buffer = layer ? gst_video_aggregator_pad_get_current_buffer(GST_VIDEO_AGGREGATOR_PAD(layer->pad)) : NULL;
+  if (buffer){
+    self->mode = MODE_PASSTHROUGH;
+    *outbuf = gst_buffer_copy(buffer);
+    return GST_FLOW_OK;
+  }
+
+  self->mode = MODE_COMPOSE;
+  return GST_VIDEO_AGGREGATOR_CLASS(parent_class)->create_output_buffer(vagg, outbuf);
+}
+
+static void gst_scene_mixer_fill(guint8 *dst, gint n, gint pstride, const guint8 *fill)
+{
+  if (pstride == 1 || memcmp(fill, fill + 1, pstride - 1) == 0){
+    memset(dst, fill[0], (gsize) n * pstride);
+    return;
+  }
+  for (gint i = 0; i < n; i++)
+    memcpy(dst + i * pstride, fill, pstride);
+}
+
+static void gst_scene_mixer_band_func(gpointer data, guint band)
+{
+  GstSceneMixerFrame *frame = data;
+  GstSceneMixer *self = frame->self;
+  GstVideoFrame *out = frame->out;
+  const GstVideoFormatInfo *finfo = out->info.finfo;
+  guint n_planes = GST_VIDEO_FRAME_N_PLANES(out);
+
+  for (guint p = 0; p < n_planes; p++){
+    guint comp = n_planes == 2 && p > 0 ? 1 : p;
+    gint w_sub = GST_VIDEO_FORMAT_INFO_W_SUB(finfo, comp);
+    gint h_sub = GST_VIDEO_FORMAT_INFO_H_SUB(finfo, comp);
+    gint pstride = GST_VIDEO_FRAME_COMP_PSTRIDE(out, comp);
+    gint plane_width = GST_VIDEO_FRAME_COMP_WIDTH(out, comp);
+    gint plane_height = GST_VIDEO_FRAME_COMP_HEIGHT(out, comp);
+    guint8 *dst = GST_VIDEO_FRAME_PLANE_DATA(out, p);
+    gint dst_stride = GST_VIDEO_FRAME_PLANE_STRIDE(out, p);
+    gint y0 = (band * BAND_ROWS) >> h_sub;
+    gint y1 = MIN(((band + 1) * BAND_ROWS) >> h_sub, plane_height);
+    guint8 fill[4];
+
+    if (GST_VIDEO_FORMAT_INFO_IS_YUV(finfo))
+      memset(fill, p == 0 ? 16 : 128, sizeof(fill));
+    else
+      memcpy(fill, (guint8[]) {0, 0, 0, 255}, sizeof(fill));
+
+    for (guint column = 0; column < self->n_columns; column++){
+      gint x0 = (column * TILE_WIDTH) >> w_sub;
+      gint x1 = MIN(((column + 1) * TILE_WIDTH) >> w_sub, plane_width);
+      gint first = self->plan[band * self->n_columns + column];
+
+      /* the layer hiding the others has no frame yet */
+      if (first >= 0 && frame->in[first] == NULL)
+        first = -1;
+      if (first < 0){
+        for (gint y = y0; y < y1; y++)
+          gst_scene_mixer_fill(dst + (gsize) y * dst_stride + x0 * pstride, x1 - x0, pstride, fill);
+        first = 0;
+      }
+
+      for (guint l = first; l < self->n_layers; l++){
+        GstSceneMixerLayer *layer = &self->layers[l];
+        GstVideoFrame *src = frame->in[l];
+        gint lx, ly, ix0, ix1, iy0, iy1, src_stride;
+        const guint8 *src_data;
+
+        if (src == NULL)
+          continue;
+
+        lx = layer->x >> w_sub;
+        ly = layer->y >> h_sub;
+        ix0 = MAX(x0, lx);
+        ix1 = MIN(x1, lx + GST_VIDEO_FRAME_COMP_WIDTH(src, comp));
+        iy0 = MAX(y0, ly);
+        iy1 = MIN(y1, ly + GST_VIDEO_FRAME_COMP_HEIGHT(src, comp));
+        if (ix0 >= ix1 || iy0 >= iy1)
+          continue;
+
+        src_data = GST_VIDEO_FRAME_PLANE_DATA(src, p);
+        src_stride = GST_VIDEO_FRAME_PLANE_STRIDE(src, p);
+        for (gint y = iy0; y < iy1; y++){
+          const guint8 *s = src_data + (gsize) (y - ly) * src_stride + (ix0 - lx) * pstride;
+          guint8 *d = dst + (gsize) y * dst_stride + ix0 * pstride;
+          gint n = (ix1 - ix0) * pstride;
+
+          if (layer->alpha == 256)
+            memcpy(d, s, n);
+          else
+            gst_convert_scale_blend(d, s, d, n, layer->alpha);
+        }
+      }
+    }
+  }
+}
+
+static GstFlowReturn gst_scene_mixer_aggregate_frames(GstVideoAggregator *vagg, GstBuffer *outbuf)
+{
+  GstSceneMixer *self = GST_SCENE_MIXER(vagg);
+  GstSceneMixerFrame frame = { self, NULL, NULL };
+  GstVideoFrame out;
+  GstClockTime elapsed;
+  gint64 started = g_get_monotonic_time();
+
+  if (self->mode == MODE_COMPOSE){
+    if (!gst_video_frame_map(&out, &vagg->info, outbuf, GST_MAP_WRITE))
+      return GST_FLOW_ERROR;
+
+    frame.out = &out;
+    frame.in = g_newa(GstVideoFrame *, MAX(self->n_layers, 1));
+    for (guint l = 0; l < self->n_layers; l++)
+      frame.in[l] = gst_video_aggregator_pad_get_prepared_frame(GST_VIDEO_AGGREGATOR_PAD(self->layers[l].pad));
+
+    gst_work_pool_parallel(gst_work_pool_get_default(), self->n_bands, gst_scene_mixer_band_func, &frame);
+    gst_video_frame_unmap(&out);
+  }
+
+  if (self->mode != MODE_REUSE)
+    gst_buffer_replace(&self->last_output, outbuf);
+
+  elapsed = (g_get_monotonic_time() - started) * GST_USECOND;
+  GST_OBJECT_LOCK(self);
+  self->frames++;
+  switch (self->mode){
+    case MODE_COMPOSE:
+      self->composed++;
+      self->skipped += self->plan_skipped;
+      self->compose_time = self->compose_time == 0 ? elapsed : (self->compose_time * 15 + elapsed) / 16;
+      break;
+    case MODE_REUSE:
+      self->reused++;
+      break;
+    case MODE_PASSTHROUGH:
+      self->passthrough++;
+      break;
+  }
+  GST_OBJECT_UNLOCK(self);
+
+  return GST_FLOW_OK;
+}
+
+static GstCaps *gst_scene_mixer_fixate_src_caps(GstAggregator *agg, GstCaps *caps)
+{
+  GstSceneMixer *self = GST_SCENE_MIXER(agg);
+  GstStructure *s;
+  gint best_width = 0, best_height = 0, best_fps_n = 0, best_fps_d = 1;
+
+  /* the largest input unless set, the scene moves within it */
+  GST_OBJECT_LOCK(agg);
+  for (GList *l = GST_ELEMENT(agg)->sinkpads; l; l = l->next){
+    GstVideoAggregatorPad *pad = l->data;
+    gint fps_n = GST_VIDEO_INFO_FPS_N(&pad->info), fps_d = GST_VIDEO_INFO_FPS_D(&pad->info);
+
+    best_width = MAX(best_width, GST_VIDEO_INFO_WIDTH(&pad->info));
+    best_height = MAX(best_height, GST_VIDEO_INFO_HEIGHT(&pad->info));
+    if (fps_n > 0 && fps_d > 0 && (best_fps_n == 0 || gst_util_fraction_compare(fps_n, fps_d, best_fps_n, best_fps_d) > 0)){
+      best_fps_n = fps_n;
+      best_fps_d = fps_d;
+    }
+  }
+  if (self->width > 0)
+    best_width = self->width;
+  if (self->height > 0)
+    best_height = self->height;
+  GST_OBJECT_UNLOCK(agg);
+
+  if (best_width <= 0 || best_height <= 0){
+    best_width = 1280;
+    best_height = 720;
+  }
+  if (best_fps_n == 0){
+    best_fps_n = 30;
+    best_fps_d = 1;
+  }
+
+  caps = gst_caps_truncate(gst_caps_make_writable(caps));
+  s = gst_caps_get_structure(caps, 0);
+  gst_structure_fixate_field_nearest_int(s, "width", best_width);
+  gst_structure_fixate_field_nearest_int(s, "height", best_height);
+  gst_structure_fixate_field_nearest_fraction(s, "framerate", best_fps_n, best_fps_d);
+  if (gst_structure_has_field(s, "pixel-aspect-ratio"))
+    gst_structure_fixate_field_nearest_fraction(s, "pixel-aspect-ratio", 1, 1);
+
+  return gst_caps_fixate(caps);
+}
+
+static GstPad *gst_scene_mixer_request_new_pad(GstElement *element, GstPadTemplate *templ,
+                                               const gchar *name, const GstCaps *caps)
+{
+  GstSceneMixer *self = GST_SCENE_MIXER(element);
+  GstPad *pad = GST_ELEMENT_CLASS(parent_class)->request_new_pad(element, templ, name, caps);
+
+  if (pad)
+    g_atomic_int_set(&self->dirty, TRUE);
+
+  return pad;
+}
+
+static void gst_scene_mixer_release_pad(GstElement *element, GstPad *pad)
+{
+  GstSceneMixer *self = GST_SCENE_MIXER(element);
+
+  g_atomic_int_set(&self->dirty, TRUE);
+
+  GST_ELEMENT_CLASS(parent_class)->release_pad(element, pad);
+}
+
+static gboolean gst_scene_mixer_stop(GstAggregator *agg)
+{
+  GstSceneMixer *self = GST_SCENE_MIXER(agg);
+
+  gst_scene_mixer_clear_plan(self);
+  gst_buffer_replace(&self->last_output, NULL);
+
+  return GST_AGGREGATOR_CLASS(parent_class)->stop(agg);
+}
+
+static void gst_scene_mixer_pad_update(GstSceneMixerPad *pad, const GstStructure *geometry)
+{
+  guint zorder;
+
+  gst_structure_get_int(geometry, "xpos", &pad->pending.xpos);
+  gst_structure_get_int(geometry, "ypos", &pad->pending.ypos);
+  gst_structure_get_int(geometry, "width", &pad->pending.width);
+  gst_structure_get_int(geometry, "height", &pad->pending.height);
+  gst_structure_get_double(geometry, "alpha", &pad->pending.alpha);
+  if (gst_structure_get_uint(geometry, "zorder", &zorder))
+    pad->pending.zorder = MIN(zorder, G_MAXINT);
+  pad->changed = TRUE;
+}
+
+/* One field per pad, named after it, holding the fields to change among
+ * xpos, ypos, width, height, alpha and zorder. Nothing changes when a pad
+ * is unknown. */
+static gboolean gst_scene_mixer_set_scene(GstSceneMixer *self, GstStructure *scene)
+{
+  GList *pads = NULL, *geometries = NULL;
+  gboolean ret = TRUE;
+
+  for (gint i = 0; i < gst_structure_n_fields(scene); i++){
+    const gchar *name = gst_structure_nth_field_name(scene, i);
+    const GValue *value = gst_structure_get_value(scene, name);
+    GstPad *pad = gst_element_get_static_pad(GST_ELEMENT(self), name);
+
+    if (pad == NULL || !GST_IS_SCENE_MIXER_PAD(pad) || !GST_VALUE_HOLDS_STRUCTURE(value)){
+      GST_WARNING_OBJECT(self, "No input %s to place in the scene", name);
+      if (pad)
+        gst_object_unref(pad);
+      ret = FALSE;
+      break;
+    }
+    pads = g_list_prepend(pads, pad);
+    geometries = g_list_prepend(geometries, (gpointer) gst_value_get_structure(value));
+  }
+
+  if (ret){
+    g_mutex_lock(&self->scene_lock);
+    for (GList *p = pads, *g = geometries; p; p = p->next, g = g->next)
+      gst_scene_mixer_pad_update(p->data, g->data);
+    g_mutex_unlock(&self->scene_lock);
+  }
+
+  g_list_free_full(pads, gst_object_unref);
+  g_list_free(geometries);
+  return ret;
+}
+
+static GstStructure *gst_scene_mixer_get_stats(GstSceneMixer *self)
+{
+  GstStructure *stats;
+
+  GST_OBJECT_LOCK(self);
+  stats = gst_structure_new("scenemixer-stats",
+      "frames", G_TYPE_UINT64, self->frames,
+      "composed", G_TYPE_UINT64, self->composed,
+      "reused", G_TYPE_UINT64, self->reused,
+      "passthrough", G_TYPE_UINT64, self->passthrough,
+      "hidden-tiles", G_TYPE_UINT64, self->skipped,
+      "compose-time", G_TYPE_UINT64, self->compose_time,
+      NULL);
+  GST_OBJECT_UNLOCK(self);
+
+  return stats;
+}
+
+static void gst_scene_mixer_init(GstSceneMixer *self)
+{
+  g_mutex_init(&self->scene_lock);
+  gst_video_info_init(&self->plan_info);
+}
+
+static void gst_scene_mixer_set_property(GObject *object,
+                                         guint prop_id,
+                                         const GValue *value,
+                                         GParamSpec *pspec){
+    GstSceneMixer *self = GST_SCENE_MIXER(object);
+
+    GST_OBJECT_LOCK(self);
+    switch (prop_id) {
+        case PROP_WIDTH:
+            self->width = g_value_get_int(value);
+            break;
+        case PROP_HEIGHT:
+            self->height = g_value_get_int(value);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+    GST_OBJECT_UNLOCK(self);
+}
+
+static void gst_scene_mixer_get_property(GObject *object,
+                                         guint prop_id,
+                                         GValue *value,
+                                         GParamSpec *pspec){
+
+    GstSceneMixer *self = GST_SCENE_MIXER(object);
+
+    if (prop_id == PROP_STATS){
+        g_value_take_boxed(value, gst_scene_mixer_get_stats(self));
+        return;
+    }
+
+    GST_OBJECT_LOCK(self);
+    switch (prop_id) {
+        case PROP_WIDTH:
+            g_value_set_int(value, self->width);
+            break;
+        case PROP_HEIGHT:
+            g_value_set_int(value, self->height);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+    GST_OBJECT_UNLOCK(self);
+}
+
+static void gst_scene_mixer_finalize(GObject *object)
+{
+  GstSceneMixer *self = GST_SCENE_MIXER(object);
+
+  gst_scene_mixer_clear_plan(self);
+  gst_buffer_replace(&self->last_output, NULL);
+  g_mutex_clear(&self->scene_lock);
+
+  G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
+static void gst_scene_mixer_class_init(GstSceneMixerClass *klass)
+{
+  GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+  GstAggregatorClass *aggregator_class = GST_AGGREGATOR_CLASS(klass);
+  GstVideoAggregatorClass *videoaggregator_class = GST_VIDEO_AGGREGATOR_CLASS(klass);
+
+  GObjectClass *object_class = G_OBJECT_CLASS(klass);
+  object_class->set_property = gst_scene_mixer_set_property;
+  object_class->get_property = gst_scene_mixer_get_property;
+  object_class->finalize = gst_scene_mixer_finalize;
+
+  element_class->request_new_pad = gst_scene_mixer_request_new_pad;
+  element_class->release_pad = gst_scene_mixer_release_pad;
+  aggregator_class->fixate_src_caps = gst_scene_mixer_fixate_src_caps;
+  aggregator_class->stop = gst_scene_mixer_stop;
+  videoaggregator_class->create_output_buffer = gst_scene_mixer_create_output_buffer;
+  videoaggregator_class->aggregate_frames = gst_scene_mixer_aggregate_frames;
+
+  gst_element_class_add_static_pad_template_with_gtype(element_class,
+      &src_template, GST_TYPE_AGGREGATOR_PAD);
+  gst_element_class_add_static_pad_template_with_gtype(element_class,
+      &sink_template, GST_TYPE_SCENE_MIXER_PAD);
+
+  g_object_class_install_property(object_class, PROP_WIDTH,
+      g_param_spec_int("width", "Width",
+          "Output width, 0 for the largest input",
+          0, G_MAXINT, 0,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property(object_class, PROP_HEIGHT,
+      g_param_spec_int("height", "Height",
+          "Output height, 0 for the largest input",
+          0, G_MAXINT, 0,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property(object_class, PROP_STATS,
+      g_param_spec_boxed("stats", "Statistics",
+          "Frames out and how they were made: composed, reusing the previous output or passed through, "
+          "tiles of hidden layers not drawn and average time to compose a frame",
+          GST_TYPE_STRUCTURE,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  GType scene_params[1] = {GST_TYPE_STRUCTURE};
+  gst_scene_mixer_signals[SIGNAL_SET_SCENE] =
+      g_signal_newv("set-scene", G_TYPE_FROM_CLASS(klass),
+                    G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+                    g_cclosure_new(G_CALLBACK(gst_scene_mixer_set_scene), NULL, NULL),
+                    NULL, NULL, NULL, G_TYPE_BOOLEAN,
+                    1, scene_params);
+
+  GST_DEBUG_CATEGORY_INIT (gst_scene_mixer_debug, "scenemixer", 0,
+      "Scene Mixer Debug");
+
+  gst_element_class_set_static_metadata(element_class,
+                                        "Scene Mixer",
+                                        "Filter/Editor/Video/Compositor",
+                                        "Composites the inputs of a scene by z-order, switching scenes between two frames",
+                                        "Ludovic Bouguerra <ludovic.bouguerra@stream.studio>");
+}
+
+
+/* Converted at the size of the layer */
+static void gst_scene_mixer_pad_create_conversion_info(GstVideoAggregatorConvertPad *pad,
+                                                       GstVideoAggregator *vagg,
+                                                       GstVideoInfo *conversion_info)
+{
+  GstVideoInfo info;
+  gint width, height;
+
+  GST_VIDEO_AGGREGATOR_CONVERT_PAD_CLASS(gst_scene_mixer_pad_parent_class)->create_conversion_info(pad,
+      vagg, conversion_info);
+  if (GST_VIDEO_INFO_FORMAT(conversion_info) == GST_VIDEO_FORMAT_UNKNOWN)
+    return;
+
+  gst_scene_mixer_pad_get_size(GST_SCENE_MIXER_PAD(pad), &width, &height);
+  if (width <= 0 || height <= 0 ||
+      (width == GST_VIDEO_INFO_WIDTH(conversion_info) && height == GST_VIDEO_INFO_HEIGHT(conversion_info)))
+    return;
+
+  gst_video_info_set_interlaced_format(&info, GST_VIDEO_INFO_FORMAT(conversion_info),
+      GST_VIDEO_INFO_INTERLACE_MODE(conversion_info), width, height);
+  info.chroma_site = conversion_info->chroma_site;
+  info.colorimetry = conversion_info->colorimetry;
+  info.par_n = conversion_info->par_n;
+  info.par_d = conversion_info->par_d;
+  info.fps_n = conversion_info->fps_n;
+  info.fps_d = conversion_info->fps_d;
+  info.flags = conversion_info->flags;
+  *conversion_info = info;
+}
+
+/* Nothing to convert for a reused or passed through frame, nor for a
+ * hidden layer */
+static gboolean gst_scene_mixer_pad_prepare_frame(GstVideoAggregatorPad *pad, GstVideoAggregator *vagg,
+                                                  GstBuffer *buffer, GstVideoFrame *prepared_frame)
+{
+  if (GST_SCENE_MIXER(vagg)->mode != MODE_COMPOSE || !GST_SCENE_MIXER_PAD(pad)->visible)
+    return TRUE;
+
+  return GST_VIDEO_AGGREGATOR_PAD_CLASS(gst_scene_mixer_pad_parent_class)->prepare_frame(pad, vagg,
+      buffer, prepared_frame);
+}
+
+/* A pad not added to a mixer yet has nothing to race with */
+static GstSceneMixer *gst_scene_mixer_pad_lock_scene(GstSceneMixerPad *pad)
+{
+  GstObject *parent = gst_object_get_parent(GST_OBJECT(pad));
+
+  if (parent)
+    g_mutex_lock(&GST_SCENE_MIXER(parent)->scene_lock);
+  return (GstSceneMixer *) parent;
+}
+
+static void gst_scene_mixer_pad_unlock_scene(GstSceneMixer *mixer)
+{
+  if (mixer){
+    g_mutex_unlock(&mixer->scene_lock);
+    gst_object_unref(mixer);
+  }
+}
+
+static void gst_scene_mixer_pad_set_property(GObject *object,
+                                             guint prop_id,
+                                             const GValue *value,
+                                             GParamSpec *pspec){
+    GstSceneMixerPad *pad = GST_SCENE_MIXER_PAD(object);
+    GstSceneMixer *mixer = gst_scene_mixer_pad_lock_scene(pad);
+
+    switch (prop_id) {
+        case PROP_PAD_XPOS:
+            pad->pending.xpos = g_value_get_int(value);
+            break;
+        case PROP_PAD_YPOS:
+            pad->pending.ypos = g_value_get_int(value);
+            break;
+        case PROP_PAD_WIDTH:
+            pad->pending.width = g_value_get_int(value);
+            break;
+        case PROP_PAD_HEIGHT:
+            pad->pending.height = g_value_get_int(value);
+            break;
+        case PROP_PAD_ALPHA:
+            pad->pending.alpha = g_value_get_double(value);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+    pad->changed = TRUE;
+    gst_scene_mixer_pad_unlock_scene(mixer);
+}
+
+static void gst_scene_mixer_pad_get_property(GObject *object,
+                                             guint prop_id,
+                                             GValue *value,
+                                             GParamSpec *pspec){
+    GstSceneMixerPad *pad = GST_SCENE_MIXER_PAD(object);
+    GstSceneMixer *mixer = gst_scene_mixer_pad_lock_scene(pad);
+
+    switch (prop_id) {
+        case PROP_PAD_XPOS:
+            g_value_set_int(value, pad->pending.xpos);
+            break;
+        case PROP_PAD_YPOS:
+            g_value_set_int(value, pad->pending.ypos);
+            break;
+        case PROP_PAD_WIDTH:
+            g_value_set_int(value, pad->pending.width);
+            break;
+        case PROP_PAD_HEIGHT:
+            g_value_set_int(value, pad->pending.height);
+            break;
+        case PROP_PAD_ALPHA:
+            g_value_set_double(value, pad->pending.alpha);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+    gst_scene_mixer_pad_unlock_scene(mixer);
+}
+
+static void gst_scene_mixer_pad_init(GstSceneMixerPad *pad)
+{
+  pad->pending.alpha = DEFAULT_ALPHA;
+  pad->pending.zorder = -1;
+  pad->active = pad->pending;
+  pad->last_pts = GST_CLOCK_TIME_NONE;
+}
+
+static void gst_scene_mixer_pad_class_init(GstSceneMixerPadClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS(klass);
+  GstVideoAggregatorPadClass *vaggpad_class = GST_VIDEO_AGGREGATOR_PAD_CLASS(klass);
+  GstVideoAggregatorConvertPadClass *convertpad_class = GST_VIDEO_AGGREGATOR_CONVERT_PAD_CLASS(klass);
+
+  object_class->set_property = gst_scene_mixer_pad_set_property;
+  object_class->get_property = gst_scene_mixer_pad_get_property;
+  vaggpad_class->prepare_frame = gst_scene_mixer_pad_prepare_frame;
+  convertpad_class->create_conversion_info = gst_scene_mixer_pad_create_conversion_info;
+
+  g_object_class_install_property(object_class, PROP_PAD_XPOS,
+      g_param_spec_int("xpos", "X position",
+          "Left of the input in the output, rounded down to an even column",
+          G_MININT, G_MAXINT, 0,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property(object_class, PROP_PAD_YPOS,
+      g_param_spec_int("ypos", "Y position",
+          "Top of the input in the output, rounded down to an even row",
+          G_MININT, G_MAXINT, 0,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property(object_class, PROP_PAD_WIDTH,
+      g_param_spec_int("width", "Width",
+          "Width of the input in the output, 0 for its own",
+          0, G_MAXINT, 0,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property(object_class, PROP_PAD_HEIGHT,
+      g_param_spec_int("height", "Height",
+          "Height of the input in the output, 0 for its own",
+          0, G_MAXINT, 0,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property(object_class, PROP_PAD_ALPHA,
+      g_param_spec_double("alpha", "Alpha",
+          "Opacity of the input, 0 leaves it out of the scene",
+          0, 1, DEFAULT_ALPHA,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING));
+}
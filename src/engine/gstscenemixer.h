@@ -0,0 +1,26 @@
+#ifndef __GST_SCENE_MIXER_H__
+#define __GST_SCENE_MIXER_H__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <gst/video/gstvideoaggregator.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_SCENE_MIXER_PAD gst_scene_mixer_pad_get_type ()
+G_DECLARE_FINAL_TYPE (GstSceneMixerPad, gst_scene_mixer_pad, GST, SCENE_MIXER_PAD, GstVideoAggregatorConvertPad)
+
+struct GstSceneMixerPadClass {
+  GstVideoAggregatorConvertPadClass parent_class;
+};
+
+#define GST_TYPE_SCENE_MIXER gst_scene_mixer_get_type ()
+G_DECLARE_FINAL_TYPE (GstSceneMixer, gst_scene_mixer, GST, SCENE_MIXER, GstVideoAggregator)
+
+struct GstSceneMixerClass {
+  GstVideoAggregatorClass parent_class;
+};
+
+G_END_DECLS
+
+#endif
@@ -5,6 +5,9 @@
 #include <gst/gst.h>
 #include "gstwebrtcsink.h"
 #include "gstpreviewsink.h"
+#include "gstrtppacer.h"
+#include "gstpreviewsnapshot.h"
+#include "gstpreviewfmp4.h"
 
 
 gboolean preview_plugin_init(GstPlugin *plugin)
@@ -19,6 +22,18 @@ gboolean preview_plugin_init(GstPlugin *plugin)
                               GST_RANK_NONE,
                               GST_TYPE_PREVIEW_SINK);     
 
+    gst_element_register(plugin, "rtppacer",
+                              GST_RANK_NONE,
+                              GST_TYPE_RTP_PACER);
+
+    gst_element_register(plugin, "previewsnapshot",
+                              GST_RANK_NONE,
+                              GST_TYPE_PREVIEW_SNAPSHOT);
+
+    gst_element_register(plugin, "previewfmp4",
+                              GST_RANK_NONE,
+                              GST_TYPE_PREVIEW_FMP4);
+
     return TRUE;
 }
 
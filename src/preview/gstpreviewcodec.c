@@ -0,0 +1,63 @@
+#include "gstpreviewcodec.h"
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+static const GstPreviewCodec codecs[] = {
+  {"H264", "video/x-h264", "h264parse", "rtph264pay",
+      "x264enc tune=zerolatency speed-preset=ultrafast key-int-max=60 bitrate=1000 ! "
+      "video/x-h264,profile=constrained-baseline ! h264parse"},
+  {"H265", "video/x-h265", "h265parse", "rtph265pay",
+      "x265enc tune=zerolatency speed-preset=ultrafast key-int-max=60 bitrate=1000 ! h265parse"},
+  {"VP8", "video/x-vp8", NULL, "rtpvp8pay",
+      "vp8enc deadline=1 cpu-used=8 keyframe-max-dist=60 target-bitrate=1000000"},
+  {"VP9", "video/x-vp9", NULL, "rtpvp9pay",
+      "vp9enc deadline=1 cpu-used=8 keyframe-max-dist=60 target-bitrate=1000000"},
+  {"AV1", "video/x-av1", "av1parse", "rtpav1pay",
+      "av1enc cpu-used=8 end-usage=cbr target-bitrate=1000 keyframe-max-dist=60 ! av1parse"},
+};
+
+const GstPreviewCodec *
+gst_preview_codec_from_caps (const GstCaps * caps)
+{
+  const gchar *name;
+
+  if (caps == NULL || gst_caps_is_empty (caps) || gst_caps_is_any (caps))
+    return NULL;
+
+  name = gst_structure_get_name (gst_caps_get_structure (caps, 0));
+  for (guint i = 0; i < G_N_ELEMENTS (codecs); i++) {
+    if (g_strcmp0 (codecs[i].media_type, name) == 0)
+      return &codecs[i];
+  }
+
+  return NULL;
+}
+
+const GstPreviewCodec *
+gst_preview_codec_from_name (const gchar * encoding_name)
+{
+  for (guint i = 0; encoding_name && i < G_N_ELEMENTS (codecs); i++) {
+    if (g_ascii_strcasecmp (codecs[i].encoding_name, encoding_name) == 0)
+      return &codecs[i];
+  }
+
+  return NULL;
+}
+
+GstElement *
+gst_preview_codec_make_payloader (const GstPreviewCodec * codec, guint pt)
+{
+  GstElement *payloader = gst_element_factory_make (codec->payloader, NULL);
+
+  if (!payloader)
+    return NULL;
+
+  g_object_set (payloader, "pt", pt, NULL);
+  /* viewers join mid-stream, repeat the parameter sets on every keyframe */
+  if (g_object_class_find_property (G_OBJECT_GET_CLASS (payloader), "config-interval"))
+    g_object_set (payloader, "config-interval", -1, NULL);
+
+  return payloader;
+}
@@ -0,0 +1,35 @@
+#ifndef __GST_PREVIEW_CODEC_H__
+#define __GST_PREVIEW_CODEC_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/**
+ * GstPreviewCodec:
+ * @encoding_name: RTP/SDP encoding name, e.g. "VP8"
+ * @media_type: caps name of the encoded stream
+ * @parser: parser put in front of the payloader, NULL if not needed
+ * @payloader: RTP payloader factory
+ * @encoder: launch description of the encoder used by transcode branches
+ *
+ * A video codec the preview can send to browsers.
+ */
+typedef struct {
+  const gchar *encoding_name;
+  const gchar *media_type;
+  const gchar *parser;
+  const gchar *payloader;
+  const gchar *encoder;
+} GstPreviewCodec;
+
+const GstPreviewCodec *gst_preview_codec_from_caps (const GstCaps * caps);
+
+const GstPreviewCodec *gst_preview_codec_from_name (const gchar * encoding_name);
+
+GstElement *gst_preview_codec_make_payloader (const GstPreviewCodec * codec,
+    guint pt);
+
+G_END_DECLS
+
+#endif
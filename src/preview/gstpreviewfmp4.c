@@ -0,0 +1,967 @@
+#include "gstpreviewfmp4.h"
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <gst/base/gstadapter.h>
+
+#include <common/gstisobmff.h>
+
+#include "gstpreviewcodec.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_preview_fmp4_debug);
+#define GST_CAT_DEFAULT gst_preview_fmp4_debug
+
+#define gst_preview_fmp4_parent_class parent_class
+
+#define DEFAULT_FRAGMENT_DURATION 200
+#define DEFAULT_MAX_LAG 2000
+/* a GOP longer than that is not cached, clients wait for the next keyframe */
+#define MAX_GOP_FRAGMENTS 300
+
+
+/* properties */
+enum
+{
+  PROP_0,
+  PROP_FRAGMENT_DURATION,
+  PROP_MAX_LAG,
+  PROP_STATS,
+};
+
+/* One muxed unit, shared by every client: the init segment (ftyp+moov) or
+ * a moof+mdat fragment. Reference counted with g_rc_box. */
+typedef struct {
+  GBytes *data;
+  guint64 seq;
+  gboolean init;
+  gboolean key;
+  /* MSE type of the stream, on init segments */
+  gchar *mime;
+} Fmp4Fragment;
+
+typedef struct {
+  gsize size;
+  gint64 queued_at;
+} Fmp4InFlight;
+
+/* A WebSocket subscriber of the engine websocket, or a chunked HTTP
+ * response when connection is NULL */
+typedef struct {
+  GstPreviewFmp4 *fmp4;
+  SoupWebsocketConnection *connection;
+  SoupServerMessage *msg;
+  /* fragments older than that were already sent or skipped */
+  guint64 next_seq;
+  /* the client got a key fragment, the following ones decode */
+  gboolean synced;
+  /* fragments written or appended but not acknowledged yet */
+  GQueue inflight;
+  gsize inflight_bytes;
+  /* binary messages the page acknowledged */
+  guint64 acked;
+  /* fragments picked for the client under the lock, written outside */
+  GPtrArray *batch;
+} Fmp4Client;
+
+/* Muxes the preview once into fragmented MP4 and hands the same fragments
+ * to every Media Source Extensions client, over the engine websocket or a
+ * chunked "live.mp4" response. The fragments since the last keyframe are
+ * cached so a new client starts decoding at once, and a client that does
+ * not keep up with the stream is evicted instead of buffering it. */
+struct _GstPreviewFmp4
+{
+  GstBin parent_instance;
+
+  GstElement *vqueue;
+  GstElement *aqueue;
+  GstElement *mux;
+  GstElement *sink;
+  GstPad *mux_vpad;
+  /* NULL once a stream started without audio */
+  GstPad *mux_apad;
+  gulong audio_drop_probe;
+
+  guint fragment_duration;
+  guint max_lag;
+
+  /* streaming thread only */
+  GstAdapter *adapter;
+  GBytes *ftyp;
+  GstIsobmffTrack track;
+
+  GMutex lock;
+  Fmp4Fragment *init;
+  GPtrArray *gop;
+  GPtrArray *outbox;
+  guint64 seq;
+  /* changed in the server context only */
+  GList *clients;
+  GstPreviewServer *server;
+
+  guint64 fragments;
+  guint64 key_fragments;
+  guint64 muxed_bytes;
+  guint64 sent_bytes;
+  guint64 evictions;
+};
+
+G_DEFINE_TYPE(GstPreviewFmp4, gst_preview_fmp4, GST_TYPE_BIN);
+
+static void fmp4_fragment_clear(gpointer data)
+{
+  Fmp4Fragment *fragment = data;
+
+  g_bytes_unref(fragment->data);
+  g_free(fragment->mime);
+}
+
+static void fmp4_fragment_unref(gpointer data)
+{
+  g_rc_box_release_full(data, fmp4_fragment_clear);
+}
+
+static void fmp4_client_free(Fmp4Client *client)
+{
+  g_queue_clear_full(&client->inflight, g_free);
+  g_ptr_array_unref(client->batch);
+  if (client->connection)
+    g_object_unref(client->connection);
+  if (client->msg)
+    g_object_unref(client->msg);
+  gst_object_unref(client->fmp4);
+  g_slice_free(Fmp4Client, client);
+}
+
+/* Client writes, in the server context without the lock */
+
+static void gst_preview_fmp4_write(Fmp4Client *client, Fmp4Fragment *fragment)
+{
+  if (client->connection){
+    if (soup_websocket_connection_get_state(client->connection) != SOUP_WEBSOCKET_STATE_OPEN)
+      return;
+    if (fragment->init){
+      gchar *mime = g_strescape(fragment->mime, NULL);
+      gchar *text = g_strdup_printf("{\"action\":\"fmp4\",\"params\":{\"mime\":\"%s\"}}", mime);
+
+      soup_websocket_connection_send_text(client->connection, text);
+      g_free(text);
+      g_free(mime);
+    }
+    soup_websocket_connection_send_message(client->connection, SOUP_WEBSOCKET_DATA_BINARY, fragment->data);
+  } else {
+    soup_message_body_append_bytes(soup_server_message_get_response_body(client->msg), fragment->data);
+    soup_server_message_unpause(client->msg);
+  }
+}
+
+static void gst_preview_fmp4_write_batch(Fmp4Client *client)
+{
+  for (guint i = 0; i < client->batch->len; i++)
+    gst_preview_fmp4_write(client, g_ptr_array_index(client->batch, i));
+  g_ptr_array_set_size(client->batch, 0);
+}
+
+/* called with the lock */
+static void gst_preview_fmp4_queue_locked(GstPreviewFmp4 *self, Fmp4Client *client, Fmp4Fragment *fragment)
+{
+  Fmp4InFlight *inflight;
+
+  if (fragment->seq < client->next_seq)
+    return;
+  client->next_seq = fragment->seq + 1;
+
+  /* after an init segment and until a keyframe, fragments would not decode */
+  if (fragment->init)
+    client->synced = FALSE;
+  else if (fragment->key)
+    client->synced = TRUE;
+  if (!fragment->init && !client->synced)
+    return;
+
+  inflight = g_new(Fmp4InFlight, 1);
+  inflight->size = g_bytes_get_size(fragment->data);
+  inflight->queued_at = g_get_monotonic_time();
+  g_queue_push_tail(&client->inflight, inflight);
+  client->inflight_bytes += inflight->size;
+  self->sent_bytes += inflight->size;
+
+  g_ptr_array_add(client->batch, g_rc_box_acquire(fragment));
+}
+
+/* called with the lock */
+static void gst_preview_fmp4_release_locked(Fmp4Client *client, guint64 count)
+{
+  while (count-- > 0 && !g_queue_is_empty(&client->inflight)){
+    Fmp4InFlight *inflight = g_queue_pop_head(&client->inflight);
+
+    client->inflight_bytes -= inflight->size;
+    g_free(inflight);
+  }
+}
+
+/* called with the lock */
+static gboolean gst_preview_fmp4_client_lagging(GstPreviewFmp4 *self, Fmp4Client *client)
+{
+  Fmp4InFlight *oldest = g_queue_peek_head(&client->inflight);
+
+  return oldest != NULL && self->max_lag > 0 &&
+      g_get_monotonic_time() - oldest->queued_at > (gint64) self->max_lag * G_TIME_SPAN_MILLISECOND;
+}
+
+static void gst_preview_fmp4_evict(Fmp4Client *client)
+{
+  if (client->connection){
+    if (soup_websocket_connection_get_state(client->connection) == SOUP_WEBSOCKET_STATE_OPEN)
+      soup_websocket_connection_send_text(client->connection, "{\"action\":\"fmp4-evicted\"}");
+    fmp4_client_free(client);
+  } else {
+    /* "finished" releases the client */
+    soup_message_body_complete(soup_server_message_get_response_body(client->msg));
+    soup_server_message_unpause(client->msg);
+  }
+}
+
+static gboolean gst_preview_fmp4_push_clients(gpointer user_data)
+{
+  GstPreviewFmp4 *self = GST_PREVIEW_FMP4(user_data);
+  GList *ready = NULL, *evicted = NULL;
+  GPtrArray *outbox;
+
+  g_mutex_lock(&self->lock);
+  outbox = self->outbox;
+  self->outbox = g_ptr_array_new_with_free_func(fmp4_fragment_unref);
+
+  for (GList *l = self->clients; l != NULL;){
+    Fmp4Client *client = l->data;
+    GList *next = l->next;
+
+    if (gst_preview_fmp4_client_lagging(self, client)){
+      self->clients = g_list_delete_link(self->clients, l);
+      evicted = g_list_prepend(evicted, client);
+      self->evictions++;
+    } else {
+      for (guint i = 0; i < outbox->len; i++)
+        gst_preview_fmp4_queue_locked(self, client, g_ptr_array_index(outbox, i));
+      if (client->batch->len > 0)
+        ready = g_list_prepend(ready, client);
+    }
+    l = next;
+  }
+  g_mutex_unlock(&self->lock);
+
+  /* clients only go away in this context */
+  for (GList *l = ready; l != NULL; l = l->next)
+    gst_preview_fmp4_write_batch(l->data);
+  for (GList *l = evicted; l != NULL; l = l->next){
+    GST_INFO_OBJECT(self, "Evicting a client more than %u ms behind", self->max_lag);
+    gst_preview_fmp4_evict(l->data);
+  }
+
+  g_list_free(ready);
+  g_list_free(evicted);
+  g_ptr_array_unref(outbox);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Fragment assembly, in the streaming thread */
+
+static void gst_preview_fmp4_unmap(gpointer data)
+{
+  GstMapInfo *map = data;
+  GstBuffer *buffer = map->user_data[0];
+
+  gst_buffer_unmap(buffer, map);
+  gst_buffer_unref(buffer);
+  g_slice_free(GstMapInfo, map);
+}
+
+/* takes @buffer */
+static GBytes *gst_preview_fmp4_wrap(GstBuffer *buffer)
+{
+  GstMapInfo *map = g_slice_new0(GstMapInfo);
+
+  if (!gst_buffer_map(buffer, map, GST_MAP_READ)){
+    g_slice_free(GstMapInfo, map);
+    gst_buffer_unref(buffer);
+    return NULL;
+  }
+  map->user_data[0] = buffer;
+  return g_bytes_new_with_free_func(map->data, map->size, gst_preview_fmp4_unmap, map);
+}
+
+/* takes @data */
+static void gst_preview_fmp4_publish(GstPreviewFmp4 *self, GBytes *data, gboolean init,
+    gboolean key, gchar *mime)
+{
+  Fmp4Fragment *fragment = g_rc_box_new0(Fmp4Fragment);
+  GMainContext *context = NULL;
+
+  fragment->data = data;
+  fragment->init = init;
+  fragment->key = key;
+  fragment->mime = mime;
+
+  g_mutex_lock(&self->lock);
+  fragment->seq = ++self->seq;
+  if (init){
+    if (self->init)
+      fmp4_fragment_unref(self->init);
+    self->init = g_rc_box_acquire(fragment);
+    g_ptr_array_set_size(self->gop, 0);
+  } else {
+    self->fragments++;
+    self->muxed_bytes += g_bytes_get_size(data);
+    if (key){
+      self->key_fragments++;
+      g_ptr_array_set_size(self->gop, 0);
+    }
+    if ((key || self->gop->len > 0) && self->gop->len < MAX_GOP_FRAGMENTS)
+      g_ptr_array_add(self->gop, g_rc_box_acquire(fragment));
+    else if (!key)
+      g_ptr_array_set_size(self->gop, 0);
+  }
+  g_ptr_array_add(self->outbox, fragment);
+  if (self->clients && self->server)
+    context = gst_preview_server_get_main_context(self->server);
+  else
+    g_ptr_array_set_size(self->outbox, 0);
+  g_mutex_unlock(&self->lock);
+
+  if (context){
+    g_main_context_invoke_full(context, G_PRIORITY_DEFAULT,
+        gst_preview_fmp4_push_clients, gst_object_ref(self), gst_object_unref);
+  }
+}
+
+static void gst_preview_fmp4_handle_box(GstPreviewFmp4 *self, guint32 type, GstBuffer *buffer)
+{
+  GBytes *bytes = gst_preview_fmp4_wrap(buffer);
+  const guint8 *data, *payload;
+  gsize size, payload_size;
+  guint32 box_type;
+
+  if (bytes == NULL)
+    return;
+  data = g_bytes_get_data(bytes, &size);
+
+  switch (type){
+    case GST_ISOBMFF_FOURCC_ftyp:
+      if (self->ftyp)
+        g_bytes_unref(self->ftyp);
+      self->ftyp = bytes;
+      return;
+    case GST_ISOBMFF_FOURCC_moov:{
+      GByteArray *init = g_byte_array_new();
+      gchar *mime = NULL;
+
+      if (gst_isobmff_box_next(&data, &size, &box_type, &payload, &payload_size)){
+        gchar *codecs = gst_isobmff_parse_moov(payload, payload_size, &self->track);
+
+        mime = g_strdup_printf("%s/mp4; codecs=\"%s\"", self->track.video ? "video" : "audio", codecs);
+        g_free(codecs);
+      }
+      if (self->ftyp)
+        g_byte_array_append(init, g_bytes_get_data(self->ftyp, NULL), g_bytes_get_size(self->ftyp));
+      g_byte_array_append(init, g_bytes_get_data(bytes, NULL), g_bytes_get_size(bytes));
+      g_bytes_unref(bytes);
+
+      GST_INFO_OBJECT(self, "New init segment for %s", mime);
+      gst_preview_fmp4_publish(self, g_byte_array_free_to_bytes(init), TRUE, FALSE, mime);
+      return;
+    }
+    case GST_ISOBMFF_FOURCC_moof:{
+      gboolean key = FALSE;
+
+      /* an audio fragment of a stream with video is not a start point */
+      if (gst_isobmff_box_next(&data, &size, &box_type, &payload, &payload_size) &&
+          !gst_isobmff_parse_moof(payload, payload_size, &self->track, &key, NULL, NULL))
+        key = FALSE;
+      gst_preview_fmp4_publish(self, bytes, FALSE, key, NULL);
+      return;
+    }
+    default:
+      GST_LOG_OBJECT(self, "Ignoring %" GST_FOURCC_FORMAT " box", GST_FOURCC_ARGS(type));
+      g_bytes_unref(bytes);
+      return;
+  }
+}
+
+/* The muxer writes a fragment as several buffers; they are gathered into
+ * one moof+mdat so each client gets it as a single message */
+static void gst_preview_fmp4_on_handoff(GstElement *sink, GstBuffer *buffer, GstPad *pad, gpointer user_data)
+{
+  GstPreviewFmp4 *self = GST_PREVIEW_FMP4(user_data);
+
+  gst_adapter_push(self->adapter, gst_buffer_ref(buffer));
+
+  for (;;){
+    gsize available = gst_adapter_available(self->adapter);
+    guint8 header[16];
+    guint64 box_size;
+    guint32 type;
+
+    if (available < 8)
+      break;
+    gst_adapter_copy(self->adapter, header, 0, 8);
+    box_size = GST_READ_UINT32_BE(header);
+    type = GST_READ_UINT32_LE(header + 4);
+    if (box_size == 1){
+      if (available < 16)
+        break;
+      gst_adapter_copy(self->adapter, header, 0, 16);
+      box_size = GST_READ_UINT64_BE(header + 8);
+    }
+    if (box_size < 8){
+      GST_WARNING_OBJECT(self, "Invalid box size, dropping %" G_GSIZE_FORMAT " bytes", available);
+      gst_adapter_clear(self->adapter);
+      break;
+    }
+
+    /* keep the mdat with its moof */
+    if (type == GST_ISOBMFF_FOURCC_moof){
+      guint64 mdat_size;
+
+      if (available < box_size + 8)
+        break;
+      gst_adapter_copy(self->adapter, header, box_size, 8);
+      mdat_size = GST_READ_UINT32_BE(header);
+      if (GST_READ_UINT32_LE(header + 4) == GST_ISOBMFF_FOURCC_mdat){
+        /* a large fragment has a 64-bit size */
+        if (mdat_size == 1){
+          if (available < box_size + 16)
+            break;
+          gst_adapter_copy(self->adapter, header, box_size, 16);
+          mdat_size = GST_READ_UINT64_BE(header + 8);
+        }
+        box_size += mdat_size;
+      }
+    }
+    if (available < box_size)
+      break;
+
+    gst_preview_fmp4_handle_box(self, type, gst_adapter_take_buffer(self->adapter, box_size));
+  }
+}
+
+static GstPadProbeReturn gst_preview_fmp4_video_caps_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+  GstPreviewFmp4 *self = GST_PREVIEW_FMP4(user_data);
+  GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+  const GstPreviewCodec *codec;
+  GstElement *parser = NULL;
+  GstCaps *caps;
+
+  if (GST_EVENT_TYPE(event) != GST_EVENT_CAPS)
+    return GST_PAD_PROBE_OK;
+  if (!self->mux_vpad)
+    return GST_PAD_PROBE_REMOVE;
+
+  gst_event_parse_caps(event, &caps);
+  codec = gst_preview_codec_from_caps(caps);
+
+  /* the parser converts to the stream format the muxer stores */
+  if (codec && codec->parser)
+    parser = gst_element_factory_make(codec->parser, NULL);
+  if (parser){
+    gst_bin_add(GST_BIN(self), parser);
+    gst_element_sync_state_with_parent(parser);
+    if (!gst_element_link(self->vqueue, parser) ||
+        !gst_element_link_pads(parser, "src", self->mux, GST_PAD_NAME(self->mux_vpad)))
+      GST_WARNING_OBJECT(self, "Cannot mux %" GST_PTR_FORMAT, caps);
+  } else if (!gst_element_link_pads(self->vqueue, "src", self->mux, GST_PAD_NAME(self->mux_vpad))){
+    GST_WARNING_OBJECT(self, "Cannot mux %" GST_PTR_FORMAT, caps);
+  }
+
+  return GST_PAD_PROBE_REMOVE;
+}
+
+static GstPadProbeReturn gst_preview_fmp4_audio_drop_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+  return GST_PAD_PROBE_DROP;
+}
+
+/* The muxer waits for every track it declared: a stream whose first video
+ * buffer comes without audio caps is muxed without the audio track */
+static GstPadProbeReturn gst_preview_fmp4_audio_check_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+  GstPreviewFmp4 *self = GST_PREVIEW_FMP4(user_data);
+  GstPad *apad;
+
+  if (!self->mux_apad)
+    return GST_PAD_PROBE_REMOVE;
+
+  apad = gst_element_get_static_pad(self->aqueue, "sink");
+  if (!gst_pad_has_current_caps(apad)){
+    GstPad *srcpad = gst_element_get_static_pad(self->aqueue, "src");
+
+    GST_INFO_OBJECT(self, "No audio, muxing the video only");
+    /* late audio has nowhere to go */
+    self->audio_drop_probe = gst_pad_add_probe(srcpad, GST_PAD_PROBE_TYPE_DATA_DOWNSTREAM,
+        gst_preview_fmp4_audio_drop_probe, NULL, NULL);
+    gst_object_unref(srcpad);
+    gst_element_release_request_pad(self->mux, self->mux_apad);
+    g_clear_object(&self->mux_apad);
+  }
+  gst_object_unref(apad);
+
+  return GST_PAD_PROBE_REMOVE;
+}
+
+/* Declares the audio track again for a new stream */
+static void gst_preview_fmp4_request_audio(GstPreviewFmp4 *self)
+{
+  GstPad *srcpad = gst_element_get_static_pad(self->aqueue, "src");
+
+  if (!self->mux_apad){
+    self->mux_apad = gst_element_request_pad_simple(self->mux, "audio_%u");
+    if (self->mux_apad && gst_pad_link(srcpad, self->mux_apad) != GST_PAD_LINK_OK)
+      GST_WARNING_OBJECT(self, "Cannot link the audio track");
+  }
+  if (self->audio_drop_probe){
+    gst_pad_remove_probe(srcpad, self->audio_drop_probe);
+    self->audio_drop_probe = 0;
+  }
+  gst_object_unref(srcpad);
+
+  srcpad = gst_element_get_static_pad(self->vqueue, "src");
+  gst_pad_add_probe(srcpad, GST_PAD_PROBE_TYPE_BUFFER,
+      gst_preview_fmp4_audio_check_probe, self, NULL);
+  gst_object_unref(srcpad);
+}
+
+/* Clients, in the server context */
+
+/* called with the lock */
+static Fmp4Client *gst_preview_fmp4_add_client_locked(GstPreviewFmp4 *self,
+    SoupWebsocketConnection *connection, SoupServerMessage *msg)
+{
+  Fmp4Client *client = g_slice_new0(Fmp4Client);
+
+  client->fmp4 = gst_object_ref(self);
+  client->connection = connection ? g_object_ref(connection) : NULL;
+  client->msg = msg ? g_object_ref(msg) : NULL;
+  client->batch = g_ptr_array_new_with_free_func(fmp4_fragment_unref);
+  g_queue_init(&client->inflight);
+  self->clients = g_list_prepend(self->clients, client);
+
+  /* start with the init segment and the current GOP, the fragments still
+   * in the outbox are older */
+  if (self->init)
+    gst_preview_fmp4_queue_locked(self, client, self->init);
+  for (guint i = 0; i < self->gop->len; i++)
+    gst_preview_fmp4_queue_locked(self, client, g_ptr_array_index(self->gop, i));
+  client->next_seq = self->seq + 1;
+
+  return client;
+}
+
+static void gst_preview_fmp4_client_wrote_chunk(SoupServerMessage *msg, gpointer user_data)
+{
+  Fmp4Client *client = user_data;
+
+  g_mutex_lock(&client->fmp4->lock);
+  gst_preview_fmp4_release_locked(client, 1);
+  g_mutex_unlock(&client->fmp4->lock);
+}
+
+static void gst_preview_fmp4_client_finished(SoupServerMessage *msg, gpointer user_data)
+{
+  Fmp4Client *client = user_data;
+  GstPreviewFmp4 *self = client->fmp4;
+
+  g_mutex_lock(&self->lock);
+  self->clients = g_list_remove(self->clients, client);
+  g_mutex_unlock(&self->lock);
+
+  g_signal_handlers_disconnect_by_data(msg, client);
+  fmp4_client_free(client);
+}
+
+static void gst_preview_fmp4_handle_stream(SoupServer *server, SoupServerMessage *msg,
+    const char *path, GHashTable *query, gpointer user_data)
+{
+  GstPreviewFmp4 *self = GST_PREVIEW_FMP4(user_data);
+  SoupMessageHeaders *headers = soup_server_message_get_response_headers(msg);
+  Fmp4Client *client;
+
+  if (soup_server_message_get_method(msg) != SOUP_METHOD_GET){
+    soup_server_message_set_status(msg, SOUP_STATUS_METHOD_NOT_ALLOWED, NULL);
+    return;
+  }
+
+  soup_message_headers_set_encoding(headers, SOUP_ENCODING_CHUNKED);
+  soup_message_headers_replace(headers, "Cache-Control", "no-cache");
+  soup_server_message_set_status(msg, SOUP_STATUS_OK, NULL);
+
+  g_mutex_lock(&self->lock);
+  client = gst_preview_fmp4_add_client_locked(self, NULL, msg);
+  if (self->init)
+    soup_message_headers_replace(headers, "Content-Type", self->init->mime);
+  else
+    soup_message_headers_set_content_type(headers, "video/mp4", NULL);
+  g_mutex_unlock(&self->lock);
+
+  g_signal_connect(msg, "wrote-chunk", G_CALLBACK(gst_preview_fmp4_client_wrote_chunk), client);
+  g_signal_connect(msg, "finished", G_CALLBACK(gst_preview_fmp4_client_finished), client);
+
+  if (client->batch->len > 0)
+    gst_preview_fmp4_write_batch(client);
+  else
+    soup_server_message_pause(msg);
+}
+
+/* called with the lock */
+static Fmp4Client *gst_preview_fmp4_find_websocket_locked(GstPreviewFmp4 *self,
+    SoupWebsocketConnection *connection)
+{
+  for (GList *l = self->clients; l != NULL; l = l->next){
+    Fmp4Client *client = l->data;
+
+    if (client->connection == connection)
+      return client;
+  }
+  return NULL;
+}
+
+/**
+ * gst_preview_fmp4_add_websocket:
+ * @fmp4: a #GstPreviewFmp4
+ * @connection: an engine websocket
+ *
+ * Sends the fragments to @connection as binary messages, each init segment
+ * preceded by an "fmp4" action giving its MSE type. The page acknowledges
+ * with "fmp4-ack" once it appended them. Called in the server context.
+ */
+void gst_preview_fmp4_add_websocket(GstPreviewFmp4 *self, SoupWebsocketConnection *connection)
+{
+  Fmp4Client *client;
+
+  g_mutex_lock(&self->lock);
+  if (gst_preview_fmp4_find_websocket_locked(self, connection)){
+    g_mutex_unlock(&self->lock);
+    return;
+  }
+  client = gst_preview_fmp4_add_client_locked(self, connection, NULL);
+  g_mutex_unlock(&self->lock);
+
+  gst_preview_fmp4_write_batch(client);
+}
+
+/**
+ * gst_preview_fmp4_ack_websocket:
+ * @fmp4: a #GstPreviewFmp4
+ * @connection: a websocket added with gst_preview_fmp4_add_websocket()
+ * @appended: binary messages the page appended since it subscribed
+ *
+ * Called in the server context.
+ */
+void gst_preview_fmp4_ack_websocket(GstPreviewFmp4 *self, SoupWebsocketConnection *connection,
+    guint64 appended)
+{
+  Fmp4Client *client;
+
+  g_mutex_lock(&self->lock);
+  client = gst_preview_fmp4_find_websocket_locked(self, connection);
+  if (client && appended > client->acked){
+    gst_preview_fmp4_release_locked(client, appended - client->acked);
+    client->acked = appended;
+  }
+  g_mutex_unlock(&self->lock);
+}
+
+/**
+ * gst_preview_fmp4_remove_websocket:
+ * @fmp4: a #GstPreviewFmp4
+ * @connection: a websocket added with gst_preview_fmp4_add_websocket()
+ *
+ * Called in the server context.
+ */
+void gst_preview_fmp4_remove_websocket(GstPreviewFmp4 *self, SoupWebsocketConnection *connection)
+{
+  Fmp4Client *client;
+
+  g_mutex_lock(&self->lock);
+  client = gst_preview_fmp4_find_websocket_locked(self, connection);
+  if (client)
+    self->clients = g_list_remove(self->clients, client);
+  g_mutex_unlock(&self->lock);
+
+  if (client)
+    fmp4_client_free(client);
+}
+
+/**
+ * gst_preview_fmp4_attach:
+ * @fmp4: a #GstPreviewFmp4
+ * @server: the server of the engine
+ * @engine_id: (nullable): the engine, registered on @server
+ *
+ * Serves "live.mp4" next to the engine websocket.
+ */
+gboolean gst_preview_fmp4_attach(GstPreviewFmp4 *self, GstPreviewServer *server, const gchar *engine_id)
+{
+  if (!gst_preview_server_add_resource(server, engine_id, "live.mp4",
+          gst_preview_fmp4_handle_stream, self))
+    return FALSE;
+
+  g_mutex_lock(&self->lock);
+  self->server = server;
+  g_mutex_unlock(&self->lock);
+
+  return TRUE;
+}
+
+static gboolean gst_preview_fmp4_close_clients(gpointer user_data)
+{
+  GstPreviewFmp4 *self = GST_PREVIEW_FMP4(user_data);
+  GList *clients;
+
+  g_mutex_lock(&self->lock);
+  clients = self->clients;
+  self->clients = NULL;
+  g_mutex_unlock(&self->lock);
+
+  /* websockets stay open for the engine, responses end */
+  for (GList *l = clients; l != NULL; l = l->next){
+    Fmp4Client *client = l->data;
+
+    if (client->connection){
+      fmp4_client_free(client);
+    } else {
+      soup_message_body_complete(soup_server_message_get_response_body(client->msg));
+      soup_server_message_unpause(client->msg);
+    }
+  }
+  g_list_free(clients);
+
+  return G_SOURCE_REMOVE;
+}
+
+/**
+ * gst_preview_fmp4_detach:
+ * @fmp4: a #GstPreviewFmp4
+ *
+ * Ends the streams. The resource goes away with the engine.
+ */
+void gst_preview_fmp4_detach(GstPreviewFmp4 *self)
+{
+  GMainContext *context = NULL;
+
+  g_mutex_lock(&self->lock);
+  if (self->server)
+    context = gst_preview_server_get_main_context(self->server);
+  self->server = NULL;
+  g_mutex_unlock(&self->lock);
+
+  if (context){
+    g_main_context_invoke_full(context, G_PRIORITY_DEFAULT,
+        gst_preview_fmp4_close_clients, gst_object_ref(self), gst_object_unref);
+  }
+}
+
+static GstStructure *gst_preview_fmp4_get_stats(GstPreviewFmp4 *self)
+{
+  GstStructure *stats;
+  guint64 gop_bytes = 0;
+  gsize max_inflight = 0;
+
+  g_mutex_lock(&self->lock);
+  for (guint i = 0; i < self->gop->len; i++)
+    gop_bytes += g_bytes_get_size(((Fmp4Fragment *) g_ptr_array_index(self->gop, i))->data);
+  for (GList *l = self->clients; l != NULL; l = l->next)
+    max_inflight = MAX(max_inflight, ((Fmp4Client *) l->data)->inflight_bytes);
+
+  stats = gst_structure_new("preview-fmp4-stats",
+      "fragments", G_TYPE_UINT64, self->fragments,
+      "key-fragments", G_TYPE_UINT64, self->key_fragments,
+      "muxed-bytes", G_TYPE_UINT64, self->muxed_bytes,
+      "gop-fragments", G_TYPE_UINT, self->gop->len,
+      "gop-bytes", G_TYPE_UINT64, gop_bytes,
+      "clients", G_TYPE_UINT, g_list_length(self->clients),
+      "sent-bytes", G_TYPE_UINT64, self->sent_bytes,
+      "max-inflight-bytes", G_TYPE_UINT64, (guint64) max_inflight,
+      "evictions", G_TYPE_UINT64, self->evictions,
+      "mime", G_TYPE_STRING, self->init ? self->init->mime : NULL,
+      NULL);
+  g_mutex_unlock(&self->lock);
+
+  return stats;
+}
+
+static void gst_preview_fmp4_init(GstPreviewFmp4 *self)
+{
+  GstBin *bin = GST_BIN(self);
+  GstPad *pad;
+
+  g_mutex_init(&self->lock);
+  self->fragment_duration = DEFAULT_FRAGMENT_DURATION;
+  self->max_lag = DEFAULT_MAX_LAG;
+  self->adapter = gst_adapter_new();
+  self->gop = g_ptr_array_new_with_free_func(fmp4_fragment_unref);
+  self->outbox = g_ptr_array_new_with_free_func(fmp4_fragment_unref);
+
+  self->vqueue = gst_element_factory_make("queue", "fvqueue");
+  self->aqueue = gst_element_factory_make("queue", "faqueue");
+  self->mux = gst_element_factory_make("mp4mux", "fmux");
+  self->sink = gst_element_factory_make("fakesink", "fsink");
+  if (!self->vqueue || !self->aqueue || !self->mux || !self->sink){
+    GST_ERROR("Failed to create fMP4 elements");
+    return;
+  }
+
+  g_object_set(self->vqueue, "leaky", 2, "max-size-buffers", 0,
+      "max-size-bytes", 0, "max-size-time", GST_SECOND, NULL);
+  g_object_set(self->aqueue, "leaky", 2, "max-size-buffers", 0,
+      "max-size-bytes", 0, "max-size-time", GST_SECOND, NULL);
+  g_object_set(self->mux, "streamable", TRUE,
+      "fragment-duration", self->fragment_duration, NULL);
+  g_object_set(self->sink, "sync", FALSE, "async", FALSE,
+      "signal-handoffs", TRUE, NULL);
+
+  gst_bin_add_many(bin, self->vqueue, self->aqueue, self->mux, self->sink, NULL);
+  gst_element_link(self->mux, self->sink);
+
+  /* both tracks are declared before the first fragment, the video one is
+   * linked once its caps tell which parser it needs, the audio one is
+   * released on start if no audio comes */
+  self->mux_vpad = gst_element_request_pad_simple(self->mux, "video_%u");
+
+  g_signal_connect(self->sink, "handoff", G_CALLBACK(gst_preview_fmp4_on_handoff), self);
+
+  pad = gst_element_get_static_pad(self->vqueue, "src");
+  gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+      gst_preview_fmp4_video_caps_probe, self, NULL);
+  gst_object_unref(pad);
+
+  pad = gst_element_get_static_pad(self->vqueue, "sink");
+  gst_element_add_pad(GST_ELEMENT(self), gst_ghost_pad_new("video_sink", pad));
+  gst_object_unref(pad);
+
+  pad = gst_element_get_static_pad(self->aqueue, "sink");
+  gst_element_add_pad(GST_ELEMENT(self), gst_ghost_pad_new("audio_sink", pad));
+  gst_object_unref(pad);
+}
+
+static GstStateChangeReturn gst_preview_fmp4_change_state(GstElement *element, GstStateChange transition)
+{
+  GstPreviewFmp4 *self = GST_PREVIEW_FMP4(element);
+  GstStateChangeReturn ret;
+
+  if (transition == GST_STATE_CHANGE_READY_TO_PAUSED && self->mux_vpad)
+    gst_preview_fmp4_request_audio(self);
+
+  ret = GST_ELEMENT_CLASS(parent_class)->change_state(element, transition);
+
+  if (transition == GST_STATE_CHANGE_PAUSED_TO_READY){
+    gst_adapter_clear(self->adapter);
+    g_clear_pointer(&self->ftyp, g_bytes_unref);
+  }
+
+  return ret;
+}
+
+static void gst_preview_fmp4_set_property(GObject *object,
+                                          guint prop_id,
+                                          const GValue *value,
+                                          GParamSpec *pspec){
+    GstPreviewFmp4 *self = GST_PREVIEW_FMP4(object);
+
+    switch (prop_id) {
+        case PROP_FRAGMENT_DURATION:
+            self->fragment_duration = g_value_get_uint(value);
+            if (self->mux)
+                g_object_set(self->mux, "fragment-duration", self->fragment_duration, NULL);
+            break;
+        case PROP_MAX_LAG:
+            self->max_lag = g_value_get_uint(value);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+}
+
+static void gst_preview_fmp4_get_property(GObject *object,
+                                          guint prop_id,
+                                          GValue *value,
+                                          GParamSpec *pspec){
+    GstPreviewFmp4 *self = GST_PREVIEW_FMP4(object);
+
+    switch (prop_id) {
+        case PROP_FRAGMENT_DURATION:
+            g_value_set_uint(value, self->fragment_duration);
+            break;
+        case PROP_MAX_LAG:
+            g_value_set_uint(value, self->max_lag);
+            break;
+        case PROP_STATS:
+            g_value_take_boxed(value, gst_preview_fmp4_get_stats(self));
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+}
+
+static void gst_preview_fmp4_finalize(GObject *object)
+{
+  GstPreviewFmp4 *self = GST_PREVIEW_FMP4(object);
+
+  if (self->mux_vpad)
+    gst_object_unref(self->mux_vpad);
+  if (self->mux_apad)
+    gst_object_unref(self->mux_apad);
+  g_object_unref(self->adapter);
+  if (self->ftyp)
+    g_bytes_unref(self->ftyp);
+  if (self->init)
+    fmp4_fragment_unref(self->init);
+  g_ptr_array_unref(self->gop);
+  g_ptr_array_unref(self->outbox);
+  g_mutex_clear(&self->lock);
+
+  G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
+static void gst_preview_fmp4_class_init(GstPreviewFmp4Class *klass)
+{
+  GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+  GObjectClass *object_class = G_OBJECT_CLASS(klass);
+
+  object_class->set_property = gst_preview_fmp4_set_property;
+  object_class->get_property = gst_preview_fmp4_get_property;
+  object_class->finalize = gst_preview_fmp4_finalize;
+  element_class->change_state = gst_preview_fmp4_change_state;
+
+  g_object_class_install_property(object_class, PROP_FRAGMENT_DURATION,
+      g_param_spec_uint("fragment-duration", "Fragment Duration",
+          "Duration of the CMAF chunks in ms, the latency added over WebRTC",
+          1, G_MAXUINT, DEFAULT_FRAGMENT_DURATION,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property(object_class, PROP_MAX_LAG,
+      g_param_spec_uint("max-lag", "Max Lag",
+          "A client with a fragment unacknowledged for that long in ms is evicted (0 = never)",
+          0, G_MAXUINT, DEFAULT_MAX_LAG,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(object_class, PROP_STATS,
+      g_param_spec_boxed("stats", "Statistics",
+          "Fragments muxed, GOP cache size, clients and evictions",
+          GST_TYPE_STRUCTURE,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  GST_DEBUG_CATEGORY_INIT (gst_preview_fmp4_debug, "previewfmp4", 0,
+      "Preview fMP4 Debug");
+
+  gst_element_class_set_static_metadata(element_class,
+                                        "Preview fMP4",
+                                        "Sink/Network",
+                                        "Fragmented MP4 preview for Media Source Extensions players",
+                                        "Ludovic Bouguerra <ludovic.bouguerra@stream.studio>");
+}
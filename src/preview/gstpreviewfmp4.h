@@ -0,0 +1,34 @@
+#ifndef __GST_PREVIEW_FMP4_H__
+#define __GST_PREVIEW_FMP4_H__
+
+#include <gst/gst.h>
+#include <libsoup/soup.h>
+
+#include "gstpreviewserver.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_PREVIEW_FMP4 gst_preview_fmp4_get_type ()
+G_DECLARE_FINAL_TYPE (GstPreviewFmp4, gst_preview_fmp4, GST, PREVIEW_FMP4, GstBin)
+
+struct GstPreviewFmp4Class {
+  GstBinClass parent_class;
+};
+
+gboolean gst_preview_fmp4_attach (GstPreviewFmp4 * fmp4,
+    GstPreviewServer * server, const gchar * engine_id);
+
+void gst_preview_fmp4_detach (GstPreviewFmp4 * fmp4);
+
+void gst_preview_fmp4_add_websocket (GstPreviewFmp4 * fmp4,
+    SoupWebsocketConnection * connection);
+
+void gst_preview_fmp4_ack_websocket (GstPreviewFmp4 * fmp4,
+    SoupWebsocketConnection * connection, guint64 appended);
+
+void gst_preview_fmp4_remove_websocket (GstPreviewFmp4 * fmp4,
+    SoupWebsocketConnection * connection);
+
+G_END_DECLS
+
+#endif
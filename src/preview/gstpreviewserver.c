@@ -0,0 +1,569 @@
+#include "gstpreviewserver.h"
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+GST_DEBUG_CATEGORY_STATIC (gst_preview_server_debug);
+#define GST_CAT_DEFAULT gst_preview_server_debug
+
+typedef struct
+{
+  gint refcount;
+  GstPreviewServer *server;
+  /* key in the stats, the id or the path of the engine without id, which
+   * no id can collide with */
+  gchar *name;
+  gchar *path;
+
+  /* held while func runs, no call starts once removed is set */
+  GMutex dispatch_lock;
+  gboolean removed;
+  GstPreviewServerConnectionFunc func;
+  gpointer user_data;
+
+  /* open connections of this engine, owned */
+  GHashTable *connections;
+  guint64 accepted;
+
+  /* paths of the plain HTTP resources of this engine */
+  GPtrArray *resources;
+} GstPreviewServerEngine;
+
+struct _GstPreviewServer
+{
+  gint refcount;
+  gint port;
+  gchar *host;
+
+  SoupServer *soup_server;
+  /* context the listener was attached to, where the handlers run */
+  GMainContext *context;
+
+  GMutex lock;
+  GHashTable *engines;
+
+  guint ice_min_port;
+  guint ice_max_port;
+};
+
+/* servers by port */
+static GMutex servers_lock;
+static GHashTable *servers = NULL;
+
+static void ensure_debug_category(void)
+{
+  static gsize initialized = 0;
+
+  if (g_once_init_enter(&initialized)){
+    GST_DEBUG_CATEGORY_INIT (gst_preview_server_debug, "previewserver", 0,
+        "Shared preview signalling server");
+    g_once_init_leave(&initialized, 1);
+  }
+}
+
+static gboolean engine_id_is_valid(const gchar *engine_id)
+{
+  for (const gchar *c = engine_id; *c != '\0'; c++){
+    if (!g_ascii_isalnum(*c) && *c != '-' && *c != '_' && *c != '.')
+      return FALSE;
+  }
+  return TRUE;
+}
+
+static gchar *engine_path(const gchar *engine_id)
+{
+  if (engine_id == NULL || *engine_id == '\0')
+    return g_strdup("/ws");
+
+  return g_strdup_printf("/ws/%s", engine_id);
+}
+
+static gchar *resource_path(const gchar *engine_id, const gchar *resource)
+{
+  if (engine_id == NULL || *engine_id == '\0')
+    return g_strdup_printf("/%s", resource);
+
+  return g_strdup_printf("/%s/%s", engine_id, resource);
+}
+
+static GstPreviewServerEngine *gst_preview_server_engine_ref(GstPreviewServerEngine *engine)
+{
+  g_atomic_int_inc(&engine->refcount);
+  return engine;
+}
+
+/* The table, the websocket handler and each "closed" handler hold a
+ * reference, so a handler running in the server context while the engine
+ * is removed keeps it alive */
+static void gst_preview_server_engine_unref(gpointer data)
+{
+  GstPreviewServerEngine *engine = data;
+
+  if (!g_atomic_int_dec_and_test(&engine->refcount))
+    return;
+
+  g_hash_table_unref(engine->connections);
+  g_ptr_array_unref(engine->resources);
+  g_mutex_clear(&engine->dispatch_lock);
+  g_free(engine->name);
+  g_free(engine->path);
+  g_free(engine);
+}
+
+static void gst_preview_server_connection_closed(SoupWebsocketConnection *connection, gpointer user_data)
+{
+  GstPreviewServerEngine *engine = user_data;
+  GstPreviewServer *server = engine->server;
+
+  g_mutex_lock(&server->lock);
+  g_signal_handlers_disconnect_by_data(connection, engine);
+  g_hash_table_remove(engine->connections, connection);
+  GST_INFO("Engine %s has %u connections", engine->path,
+      g_hash_table_size(engine->connections));
+  g_mutex_unlock(&server->lock);
+}
+
+static void gst_preview_server_websocket_handler(SoupServer *soup_server,
+                                                 SoupServerMessage *msg,
+                                                 const char *path,
+                                                 SoupWebsocketConnection *connection,
+                                                 gpointer user_data)
+{
+  GstPreviewServerEngine *engine = user_data;
+  GstPreviewServer *server = engine->server;
+
+  g_mutex_lock(&engine->dispatch_lock);
+  if (engine->removed){
+    g_mutex_unlock(&engine->dispatch_lock);
+    GST_DEBUG("Engine %s is being removed, dropping the connection", engine->path);
+    return;
+  }
+
+  g_mutex_lock(&server->lock);
+  g_hash_table_add(engine->connections, g_object_ref(connection));
+  engine->accepted++;
+  g_signal_connect_data(connection, "closed",
+      G_CALLBACK(gst_preview_server_connection_closed), gst_preview_server_engine_ref(engine),
+      (GClosureNotify) gst_preview_server_engine_unref, 0);
+  GST_INFO("New connection on %s, engine has %u connections", engine->path,
+      g_hash_table_size(engine->connections));
+  g_mutex_unlock(&server->lock);
+
+  engine->func(connection, engine->user_data);
+  g_mutex_unlock(&engine->dispatch_lock);
+}
+
+/* called with the server lock */
+static void gst_preview_server_engine_free(gpointer data)
+{
+  GstPreviewServerEngine *engine = data;
+  GHashTableIter iter;
+  gpointer connection;
+
+  g_hash_table_iter_init(&iter, engine->connections);
+  while (g_hash_table_iter_next(&iter, &connection, NULL)){
+    g_signal_handlers_disconnect_by_data(connection, engine);
+  }
+  g_hash_table_remove_all(engine->connections);
+
+  gst_preview_server_engine_unref(engine);
+}
+
+/* Listens on @host, a literal address or a name resolved to its addresses,
+ * or on all interfaces without one */
+static gboolean gst_preview_server_listen(GstPreviewServer *server, const gchar *host, gint port)
+{
+  GInetAddress *address;
+  GList *addresses = NULL;
+  GError *error = NULL;
+  gboolean ret = FALSE;
+
+  if (host == NULL || *host == '\0')
+    return soup_server_listen_all(server->soup_server, port, 0, NULL);
+
+  address = g_inet_address_new_from_string(host);
+  if (address != NULL){
+    addresses = g_list_prepend(NULL, address);
+  } else {
+    GResolver *resolver = g_resolver_get_default();
+
+    addresses = g_resolver_lookup_by_name(resolver, host, NULL, &error);
+    g_object_unref(resolver);
+    if (addresses == NULL){
+      GST_ERROR("Cannot resolve %s: %s", host, error->message);
+      g_clear_error(&error);
+      return FALSE;
+    }
+  }
+
+  for (GList *l = addresses; l != NULL; l = l->next){
+    GSocketAddress *socket_address = g_inet_socket_address_new(l->data, port);
+
+    if (soup_server_listen(server->soup_server, socket_address, 0, &error)){
+      ret = TRUE;
+    } else {
+      GST_WARNING("Cannot listen on %s:%d: %s", host, port, error->message);
+      g_clear_error(&error);
+    }
+    g_object_unref(socket_address);
+  }
+  g_resolver_free_addresses(addresses);
+
+  return ret;
+}
+
+/**
+ * gst_preview_server_acquire:
+ * @host: address the caller would like to listen on
+ * @port: port of the listener
+ *
+ * Returns the server already listening on @port or starts a new one.
+ *
+ * Returns: (transfer full) (nullable): the server, or NULL if the port
+ *   could not be bound
+ */
+GstPreviewServer *gst_preview_server_acquire(const gchar *host, gint port)
+{
+  GstPreviewServer *server;
+
+  ensure_debug_category();
+
+  g_mutex_lock(&servers_lock);
+  if (servers == NULL)
+    servers = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+  server = g_hash_table_lookup(servers, GINT_TO_POINTER(port));
+  if (server != NULL){
+    if (g_strcmp0(server->host, host) != 0){
+      GST_WARNING("Port %d is already served for host %s, ignoring host %s",
+          port, server->host, host);
+    }
+    server->refcount++;
+    g_mutex_unlock(&servers_lock);
+    return server;
+  }
+
+  server = g_new0(GstPreviewServer, 1);
+  server->refcount = 1;
+  server->port = port;
+  server->host = g_strdup(host);
+  g_mutex_init(&server->lock);
+  server->engines = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+      gst_preview_server_engine_free);
+
+  server->soup_server = soup_server_new("server-header", "webrtc-soup-server", NULL);
+  if (!gst_preview_server_listen(server, host, port)){
+    GST_ERROR("Failed to start SoupServer on %s:%d", host, port);
+    g_object_unref(server->soup_server);
+    g_hash_table_unref(server->engines);
+    g_mutex_clear(&server->lock);
+    g_free(server->host);
+    g_free(server);
+    g_mutex_unlock(&servers_lock);
+    return NULL;
+  }
+
+  server->context = g_main_context_ref_thread_default();
+  g_hash_table_insert(servers, GINT_TO_POINTER(port), server);
+  GST_INFO("Preview server listening on %s:%d", host, port);
+  g_mutex_unlock(&servers_lock);
+
+  return server;
+}
+
+void gst_preview_server_release(GstPreviewServer *server)
+{
+  if (server == NULL)
+    return;
+
+  g_mutex_lock(&servers_lock);
+  if (--server->refcount > 0){
+    g_mutex_unlock(&servers_lock);
+    return;
+  }
+  g_hash_table_remove(servers, GINT_TO_POINTER(server->port));
+  g_mutex_unlock(&servers_lock);
+
+  GST_INFO("Stopping preview server on port %d", server->port);
+
+  g_object_unref(server->soup_server);
+  g_main_context_unref(server->context);
+  g_mutex_lock(&server->lock);
+  g_hash_table_unref(server->engines);
+  g_mutex_unlock(&server->lock);
+  g_mutex_clear(&server->lock);
+  g_free(server->host);
+  g_free(server);
+}
+
+/**
+ * gst_preview_server_add_engine:
+ * @server: a #GstPreviewServer
+ * @engine_id: (nullable): id of the engine, NULL for the legacy "/ws" path
+ * @func: called for each new websocket connection of the engine
+ * @user_data: data for @func
+ *
+ * Returns: FALSE if @engine_id is invalid or already registered
+ */
+gboolean gst_preview_server_add_engine(GstPreviewServer *server, const gchar *engine_id,
+    GstPreviewServerConnectionFunc func, gpointer user_data)
+{
+  GstPreviewServerEngine *engine;
+  gchar *path;
+
+  if (engine_id != NULL && !engine_id_is_valid(engine_id)){
+    GST_ERROR("Invalid engine id '%s'", engine_id);
+    return FALSE;
+  }
+
+  path = engine_path(engine_id);
+
+  g_mutex_lock(&server->lock);
+  if (g_hash_table_contains(server->engines, path)){
+    g_mutex_unlock(&server->lock);
+    GST_ERROR("Path %s is already registered on port %d", path, server->port);
+    g_free(path);
+    return FALSE;
+  }
+
+  engine = g_new0(GstPreviewServerEngine, 1);
+  engine->refcount = 1;
+  engine->server = server;
+  engine->name = g_strdup(engine_id && *engine_id ? engine_id : path);
+  engine->path = path;
+  g_mutex_init(&engine->dispatch_lock);
+  engine->func = func;
+  engine->user_data = user_data;
+  engine->connections = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+      g_object_unref, NULL);
+  engine->resources = g_ptr_array_new_with_free_func(g_free);
+  g_hash_table_insert(server->engines, engine->path, engine);
+  g_mutex_unlock(&server->lock);
+
+  soup_server_add_websocket_handler(server->soup_server, engine->path, NULL, NULL,
+      gst_preview_server_websocket_handler, gst_preview_server_engine_ref(engine),
+      gst_preview_server_engine_unref);
+
+  GST_INFO("Registered engine %s on port %d", engine->path, server->port);
+  return TRUE;
+}
+
+void gst_preview_server_remove_engine(GstPreviewServer *server, const gchar *engine_id)
+{
+  gchar *path = engine_path(engine_id);
+  GstPreviewServerEngine *engine;
+
+  g_mutex_lock(&server->lock);
+  engine = g_hash_table_lookup(server->engines, path);
+  if (engine != NULL)
+    gst_preview_server_engine_ref(engine);
+  g_mutex_unlock(&server->lock);
+
+  if (engine != NULL){
+    /* waits for a connection being handed over, none starts after that */
+    g_mutex_lock(&engine->dispatch_lock);
+    engine->removed = TRUE;
+    g_mutex_unlock(&engine->dispatch_lock);
+  }
+
+  soup_server_remove_handler(server->soup_server, path);
+
+  g_mutex_lock(&server->lock);
+  for (guint i = 0; engine != NULL && i < engine->resources->len; i++){
+    soup_server_remove_handler(server->soup_server, g_ptr_array_index(engine->resources, i));
+  }
+  g_hash_table_remove(server->engines, path);
+  g_mutex_unlock(&server->lock);
+
+  if (engine != NULL)
+    gst_preview_server_engine_unref(engine);
+
+  GST_INFO("Unregistered engine %s from port %d", path, server->port);
+  g_free(path);
+}
+
+/**
+ * gst_preview_server_add_resource:
+ * @server: a #GstPreviewServer
+ * @engine_id: (nullable): id of a registered engine
+ * @resource: file name of the resource, e.g. "snapshot.jpg"
+ * @callback: handler of the requests
+ * @user_data: data for @callback
+ *
+ * Serves "/<engine-id>/<resource>" ("/<resource>" without id) on the shared
+ * listener until the engine is removed.
+ *
+ * Returns: FALSE if the engine is not registered
+ */
+gboolean gst_preview_server_add_resource(GstPreviewServer *server, const gchar *engine_id,
+    const gchar *resource, SoupServerCallback callback, gpointer user_data)
+{
+  gchar *path = engine_path(engine_id);
+  GstPreviewServerEngine *engine;
+  gchar *rpath;
+
+  g_mutex_lock(&server->lock);
+  engine = g_hash_table_lookup(server->engines, path);
+  g_free(path);
+  if (engine == NULL){
+    g_mutex_unlock(&server->lock);
+    GST_ERROR("Engine %s is not registered on port %d", engine_id, server->port);
+    return FALSE;
+  }
+  rpath = resource_path(engine_id, resource);
+  g_ptr_array_add(engine->resources, rpath);
+  g_mutex_unlock(&server->lock);
+
+  soup_server_add_handler(server->soup_server, rpath, callback, user_data, NULL);
+
+  GST_INFO("Serving %s on port %d", rpath, server->port);
+  return TRUE;
+}
+
+/**
+ * gst_preview_server_remove_resource:
+ * @server: a #GstPreviewServer
+ * @engine_id: (nullable): id of a registered engine
+ * @resource: file name given to gst_preview_server_add_resource()
+ *
+ * Stops serving @resource before the engine is removed.
+ */
+void gst_preview_server_remove_resource(GstPreviewServer *server, const gchar *engine_id,
+    const gchar *resource)
+{
+  gchar *path = engine_path(engine_id);
+  gchar *rpath = resource_path(engine_id, resource);
+  GstPreviewServerEngine *engine;
+  gboolean found = FALSE;
+
+  g_mutex_lock(&server->lock);
+  engine = g_hash_table_lookup(server->engines, path);
+  for (guint i = 0; engine != NULL && i < engine->resources->len; i++){
+    if (g_str_equal(g_ptr_array_index(engine->resources, i), rpath)){
+      g_ptr_array_remove_index(engine->resources, i);
+      found = TRUE;
+      break;
+    }
+  }
+  g_mutex_unlock(&server->lock);
+
+  if (found){
+    soup_server_remove_handler(server->soup_server, rpath);
+    GST_INFO("Stopped serving %s on port %d", rpath, server->port);
+  }
+
+  g_free(rpath);
+  g_free(path);
+}
+
+/**
+ * gst_preview_server_get_main_context:
+ * @server: a #GstPreviewServer
+ *
+ * Returns: (transfer none): the context the request handlers run in, where
+ *   responses must be written from
+ */
+GMainContext *gst_preview_server_get_main_context(GstPreviewServer *server)
+{
+  return server->context;
+}
+
+/**
+ * gst_preview_server_set_ice_port_range:
+ * @server: a #GstPreviewServer
+ * @min_port: first UDP port of the range, 0 for ephemeral ports
+ * @max_port: last UDP port of the range
+ *
+ * All peers of all engines on @server allocate their ICE sockets from the
+ * same range, so one firewall rule covers the whole process.
+ *
+ * Returns: FALSE if another engine already configured a different range
+ */
+gboolean gst_preview_server_set_ice_port_range(GstPreviewServer *server, guint min_port, guint max_port)
+{
+  gboolean ret = TRUE;
+
+  if (min_port == 0)
+    return TRUE;
+
+  g_mutex_lock(&server->lock);
+  if (server->ice_min_port == 0){
+    server->ice_min_port = min_port;
+    server->ice_max_port = MAX(min_port, max_port);
+  } else if (server->ice_min_port != min_port || server->ice_max_port != MAX(min_port, max_port)){
+    GST_WARNING("Port %d already uses ICE ports %u-%u, ignoring %u-%u",
+        server->port, server->ice_min_port, server->ice_max_port, min_port, max_port);
+    ret = FALSE;
+  }
+  g_mutex_unlock(&server->lock);
+
+  return ret;
+}
+
+void gst_preview_server_configure_peer(GstPreviewServer *server, GstElement *webrtcsink)
+{
+  g_mutex_lock(&server->lock);
+  if (server->ice_min_port != 0){
+    g_object_set(webrtcsink, "ice-min-port", server->ice_min_port,
+        "ice-max-port", server->ice_max_port, NULL);
+  }
+  g_mutex_unlock(&server->lock);
+}
+
+guint gst_preview_server_get_connections(GstPreviewServer *server, const gchar *engine_id)
+{
+  gchar *path = engine_path(engine_id);
+  GstPreviewServerEngine *engine;
+  guint connections = 0;
+
+  g_mutex_lock(&server->lock);
+  engine = g_hash_table_lookup(server->engines, path);
+  if (engine != NULL)
+    connections = g_hash_table_size(engine->connections);
+  g_mutex_unlock(&server->lock);
+
+  g_free(path);
+  return connections;
+}
+
+/**
+ * gst_preview_server_get_stats:
+ * @server: a #GstPreviewServer
+ *
+ * Returns: (transfer full): a "preview-server-stats" structure with the
+ *   listener port, the totals, and an "engines" structure holding the open
+ *   connection count of each engine by id, "/ws" for the engine without id
+ */
+GstStructure *gst_preview_server_get_stats(GstPreviewServer *server)
+{
+  GstStructure *engines = gst_structure_new_empty("engines");
+  GHashTableIter iter;
+  gpointer value;
+  guint connections = 0;
+  guint64 accepted = 0;
+
+  g_mutex_lock(&server->lock);
+  g_hash_table_iter_init(&iter, server->engines);
+  while (g_hash_table_iter_next(&iter, NULL, &value)){
+    GstPreviewServerEngine *engine = value;
+    guint n = g_hash_table_size(engine->connections);
+
+    gst_structure_set(engines, engine->name, G_TYPE_UINT, n, NULL);
+    connections += n;
+    accepted += engine->accepted;
+  }
+
+  GstStructure *stats = gst_structure_new("preview-server-stats",
+      "port", G_TYPE_INT, server->port,
+      "engines", GST_TYPE_STRUCTURE, engines,
+      "connections", G_TYPE_UINT, connections,
+      "accepted", G_TYPE_UINT64, accepted,
+      "ice-min-port", G_TYPE_UINT, server->ice_min_port,
+      "ice-max-port", G_TYPE_UINT, server->ice_max_port,
+      NULL);
+  g_mutex_unlock(&server->lock);
+
+  gst_structure_free(engines);
+  return stats;
+}
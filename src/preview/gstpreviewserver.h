@@ -0,0 +1,55 @@
+#ifndef __GST_PREVIEW_SERVER_H__
+#define __GST_PREVIEW_SERVER_H__
+
+#include <gst/gst.h>
+#include <libsoup/soup.h>
+
+G_BEGIN_DECLS
+
+/**
+ * GstPreviewServer:
+ *
+ * Process-wide signalling server shared by the previewsink instances
+ * listening on the same port. Each engine registers a websocket path
+ * "/ws/<engine-id>" ("/ws" without id) on the single listener, and the
+ * server owns the UDP port range handed to every ICE agent.
+ */
+typedef struct _GstPreviewServer GstPreviewServer;
+
+typedef void (*GstPreviewServerConnectionFunc) (SoupWebsocketConnection *
+    connection, gpointer user_data);
+
+GstPreviewServer *gst_preview_server_acquire (const gchar * host, gint port);
+
+void gst_preview_server_release (GstPreviewServer * server);
+
+gboolean gst_preview_server_add_engine (GstPreviewServer * server,
+    const gchar * engine_id, GstPreviewServerConnectionFunc func,
+    gpointer user_data);
+
+void gst_preview_server_remove_engine (GstPreviewServer * server,
+    const gchar * engine_id);
+
+gboolean gst_preview_server_add_resource (GstPreviewServer * server,
+    const gchar * engine_id, const gchar * resource,
+    SoupServerCallback callback, gpointer user_data);
+
+void gst_preview_server_remove_resource (GstPreviewServer * server,
+    const gchar * engine_id, const gchar * resource);
+
+GMainContext *gst_preview_server_get_main_context (GstPreviewServer * server);
+
+gboolean gst_preview_server_set_ice_port_range (GstPreviewServer * server,
+    guint min_port, guint max_port);
+
+void gst_preview_server_configure_peer (GstPreviewServer * server,
+    GstElement * webrtcsink);
+
+guint gst_preview_server_get_connections (GstPreviewServer * server,
+    const gchar * engine_id);
+
+GstStructure *gst_preview_server_get_stats (GstPreviewServer * server);
+
+G_END_DECLS
+
+#endif
@@ -13,6 +13,13 @@
 
 #include <json-glib/json-glib.h>
 
+#include <common/gstthreadpolicy.h>
+
+#include "gstpreviewserver.h"
+#include "gstpreviewcodec.h"
+#include "gstpreviewsnapshot.h"
+#include "gstpreviewfmp4.h"
+
 
 #define DEFAULT_HOST "0.0.0.0"
 #define DEFAULT_PORT 9000
@@ -28,7 +35,17 @@ enum
 {
   PROP_0,
   PROP_PORT,
-  PROP_HOST
+  PROP_HOST,
+  PROP_THREAD_POLICY,
+  PROP_ENGINE_ID,
+  PROP_ICE_MIN_PORT,
+  PROP_ICE_MAX_PORT,
+  PROP_FEC_PERCENTAGE,
+  PROP_SNAPSHOT,
+  PROP_SNAPSHOT_WIDTH,
+  PROP_FMP4,
+  PROP_FMP4_MAX_LAG,
+  PROP_STATS
 };
 
 struct _GstPreviewSink
@@ -38,35 +55,68 @@ struct _GstPreviewSink
   GstElement* aqueue;  
   GstElement* vqueue;
   
-  GstElement* h264parse;
   GstElement* opusparse;
 
   GstElement* tee;
   GHashTable* receivers;
   GMutex receivers_mutex;  // Protects access to receivers hash table
 
+  const GstPreviewCodec *video_codec;  // Upstream codec, set from the caps
+  gchar *video_profile;  // Upstream profile, NULL when the caps carry none
+  GHashTable* transcodes;  // Encoding name -> shared transcode branch, under receivers_mutex
+
   GSocketAddress* addr;
 
   gchar* host;
   gint port;
 
-  SoupServer *soup_server;
+  gchar* engine_id;
+  guint ice_min_port;
+  guint ice_max_port;
+  guint fec_percentage;
+
+  gboolean snapshot_enabled;
+  guint snapshot_width;
+  GstElement *snapshot;  // Keyframe JPEG branch on the tee, under server_mutex
+
+  gboolean fmp4_enabled;
+  guint fmp4_max_lag;
+  GstElement *fmp4;  // Fragmented MP4 branch on the tee, under server_mutex
+
+  GstPreviewServer *server;
   GMutex server_mutex;  // Protects server operations
 
+  GstThreadPolicy *thread_policy;
 };
 
+/* Viewers that cannot decode the upstream codec share one decode/encode
+ * branch per codec. The branch is started on the main tee like a viewer,
+ * and its own dynamic tee feeds the viewers of that codec. */
+typedef struct{
+  GstPreviewSink* parent;
+  const GstPreviewCodec *codec;
+  GstElement* bin;
+  GstElement* tee;
+  guint viewers;
+} PreviewSinkTranscode;
+
 typedef struct{
   SoupWebsocketConnection *connection;
   GstElement* bin;
   GstPreviewSink* parent;
   gboolean cleaned_up;
+  gchar **codecs;  // Codecs the viewer can decode, NULL accepts any
+  GstElement* tee;  // Tee the bin was started on
+  PreviewSinkTranscode *transcode;
+  gboolean fmp4;  // Subscribed to the fMP4 fallback
 } PreviewSinkReceiverEntry;
 
 
 G_DEFINE_TYPE(GstPreviewSink, gst_preview_sink, GST_TYPE_BIN);
 
 
-static void cleanup_receiver_entry_resources(PreviewSinkReceiverEntry*);
+static PreviewSinkTranscode *cleanup_receiver_entry_resources(PreviewSinkReceiverEntry*);
+static void gst_preview_sink_transcode_free(gpointer data);
 
 void play_receiver_entry (PreviewSinkReceiverEntry * receiver_entry);
 
@@ -95,15 +145,18 @@ soup_websocket_closed_cb (SoupWebsocketConnection * connection,
 {
     GstPreviewSink *self = GST_PREVIEW_SINK(user_data);
     PreviewSinkReceiverEntry *receiver_entry = NULL;
+    PreviewSinkTranscode *transcode = NULL;
+    gboolean fmp4 = FALSE;
     
     g_mutex_lock(&self->receivers_mutex);
     receiver_entry = g_hash_table_lookup(self->receivers, connection);
     if (receiver_entry) {
+        fmp4 = receiver_entry->fmp4;
         // Remove from hash table first to prevent any new operations
         
         
         // Cleanup resources while still holding the mutex
-        cleanup_receiver_entry_resources(receiver_entry);
+        transcode = cleanup_receiver_entry_resources(receiver_entry);
         if (!receiver_entry->cleaned_up) {
             g_slice_free1(sizeof(PreviewSinkReceiverEntry), receiver_entry);
         }
@@ -112,6 +165,16 @@ soup_websocket_closed_cb (SoupWebsocketConnection * connection,
     }
     g_mutex_unlock(&self->receivers_mutex);
 
+    if (transcode)
+        gst_preview_sink_transcode_free(transcode);
+
+    if (fmp4) {
+        g_mutex_lock(&self->server_mutex);
+        if (self->fmp4)
+            gst_preview_fmp4_remove_websocket(GST_PREVIEW_FMP4(self->fmp4), connection);
+        g_mutex_unlock(&self->server_mutex);
+    }
+
     GST_INFO("Closed WebSocket connection %p, now there is %i active connexions\n", 
              (gpointer) connection, g_hash_table_size(self->receivers));
 }
@@ -222,8 +285,41 @@ soup_websocket_message_cb (G_GNUC_UNUSED SoupWebsocketConnection * connection,
 
     if (g_strcmp0 (action_string, "play") == 0) {
         GST_INFO("Received play action, setting up WebRTC resources");
+
+        if (data_json_object && json_object_has_member (data_json_object, "codecs")) {
+            JsonArray *codecs = json_object_get_array_member (data_json_object, "codecs");
+            guint n_codecs = codecs ? json_array_get_length (codecs) : 0;
+
+            g_strfreev (receiver_entry->codecs);
+            receiver_entry->codecs = g_new0 (gchar *, n_codecs + 1);
+            for (guint i = 0; i < n_codecs; i++)
+                receiver_entry->codecs[i] = g_strdup (json_array_get_string_element (codecs, i));
+        }
         play_receiver_entry(receiver_entry);
 
+    } else if (g_strcmp0 (action_string, "fmp4") == 0) {
+        // MSE fallback when WebRTC cannot connect
+        g_mutex_lock(&self->server_mutex);
+        if (self->fmp4) {
+            gst_preview_fmp4_add_websocket(GST_PREVIEW_FMP4(self->fmp4), connection);
+            receiver_entry->fmp4 = TRUE;
+        } else {
+            GST_WARNING("fMP4 preview requested but disabled");
+        }
+        g_mutex_unlock(&self->server_mutex);
+
+    } else if (g_strcmp0 (action_string, "fmp4-ack") == 0) {
+        if (!data_json_object || !json_object_has_member (data_json_object, "appended")) {
+            GST_DEBUG("fMP4 ack without appended count");
+            goto cleanup;
+        }
+
+        g_mutex_lock(&self->server_mutex);
+        if (self->fmp4)
+            gst_preview_fmp4_ack_websocket(GST_PREVIEW_FMP4(self->fmp4), connection,
+                json_object_get_int_member (data_json_object, "appended"));
+        g_mutex_unlock(&self->server_mutex);
+
     } else if (g_strcmp0 (action_string, "sdp") == 0) {
         if (!data_json_object) {
             GST_ERROR("SDP action requires params field");
@@ -440,6 +536,177 @@ static void gst_preview_sink_on_ice_candidate (G_GNUC_UNUSED GstElement * webrtc
     g_free (json_string);
 }
 
+static void gst_preview_sink_transcode_free(gpointer data)
+{
+  PreviewSinkTranscode *transcode = data;
+  gboolean result = FALSE;
+
+  GST_INFO("Stopping %s transcode branch", transcode->codec->encoding_name);
+
+  g_signal_emit_by_name(transcode->parent->tee, "stop", transcode->bin, &result);
+  if (!result)
+    gst_element_set_state(transcode->bin, GST_STATE_NULL);
+
+  gst_object_unref(transcode->tee);
+  gst_object_unref(transcode->bin);
+  g_slice_free(PreviewSinkTranscode, transcode);
+}
+
+/* takes the receivers lock itself, the branch is started on the main tee
+ * unlocked and dropped again if another viewer started one meanwhile */
+static PreviewSinkTranscode *gst_preview_sink_acquire_transcode(GstPreviewSink *self, const GstPreviewCodec *codec)
+{
+  PreviewSinkTranscode *transcode;
+  GstElement *transcode_bin;
+  GError *error = NULL;
+  gboolean result = FALSE;
+
+  g_mutex_lock(&self->receivers_mutex);
+  transcode = g_hash_table_lookup(self->transcodes, codec->encoding_name);
+  if (transcode)
+    transcode->viewers++;
+  g_mutex_unlock(&self->receivers_mutex);
+  if (transcode)
+    return transcode;
+
+  gchar *description = g_strdup_printf("dynamictee name=ttee "
+      "queue name=tvqueue leaky=downstream ! decodebin ! videoconvert ! %s ! ttee.video_sink "
+      "queue name=taqueue leaky=downstream ! ttee.audio_sink", codec->encoder);
+  transcode_bin = gst_parse_bin_from_description(description, FALSE, &error);
+  g_free(description);
+  if (!transcode_bin) {
+    GST_ERROR("Cannot build %s transcode branch: %s", codec->encoding_name, error->message);
+    g_clear_error(&error);
+    return NULL;
+  }
+  gst_object_ref_sink(transcode_bin);
+
+  GstElement *queue = gst_bin_get_by_name(GST_BIN(transcode_bin), "tvqueue");
+  GstPad *pad = gst_element_get_static_pad(queue, "sink");
+  gst_element_add_pad(transcode_bin, gst_ghost_pad_new("video_sink", pad));
+  gst_object_unref(pad);
+  gst_object_unref(queue);
+
+  queue = gst_bin_get_by_name(GST_BIN(transcode_bin), "taqueue");
+  pad = gst_element_get_static_pad(queue, "sink");
+  gst_element_add_pad(transcode_bin, gst_ghost_pad_new("audio_sink", pad));
+  gst_object_unref(pad);
+  gst_object_unref(queue);
+
+  g_signal_emit_by_name(self->tee, "start", transcode_bin, &result);
+  if (!result) {
+    GST_ERROR("Failed to start %s transcode branch", codec->encoding_name);
+    gst_object_unref(transcode_bin);
+    return NULL;
+  }
+
+  GST_INFO("Started %s transcode branch", codec->encoding_name);
+
+  transcode = g_slice_new0(PreviewSinkTranscode);
+  transcode->parent = self;
+  transcode->codec = codec;
+  transcode->bin = transcode_bin;
+  transcode->tee = gst_bin_get_by_name(GST_BIN(transcode_bin), "ttee");
+  transcode->viewers = 1;
+
+  PreviewSinkTranscode *existing;
+
+  g_mutex_lock(&self->receivers_mutex);
+  existing = g_hash_table_lookup(self->transcodes, codec->encoding_name);
+  if (existing)
+    existing->viewers++;
+  else
+    g_hash_table_insert(self->transcodes, (gpointer) codec->encoding_name, transcode);
+  g_mutex_unlock(&self->receivers_mutex);
+
+  if (existing) {
+    gst_preview_sink_transcode_free(transcode);
+    return existing;
+  }
+
+  return transcode;
+}
+
+/* called with the receivers lock, returns the branch the last viewer leaves
+ * so the caller stops it once unlocked */
+static PreviewSinkTranscode *gst_preview_sink_release_transcode(GstPreviewSink *self, PreviewSinkTranscode *transcode)
+{
+  if (--transcode->viewers > 0)
+    return NULL;
+
+  g_hash_table_steal(self->transcodes, transcode->codec->encoding_name);
+  return transcode;
+}
+
+/* browsers only agree on constrained baseline H.264, an unknown profile
+ * is taken as it is */
+static gboolean gst_preview_sink_profile_is_baseline(const gchar *profile)
+{
+  return !profile || g_str_equal(profile, "constrained-baseline") || g_str_equal(profile, "baseline");
+}
+
+/* picks the main tee when the viewer takes the upstream stream and a shared
+ * transcode branch otherwise, the tees are called without the receivers lock */
+static GstElement *gst_preview_sink_select_tee(GstPreviewSink *self, PreviewSinkReceiverEntry *receiver_entry)
+{
+  static const gchar * const h264_only[] = {"H264", NULL};
+  const gchar * const *candidates;
+  PreviewSinkTranscode *transcode = NULL;
+  const GstPreviewCodec *upstream;
+  gboolean compatible;
+  gchar **codecs;
+  GstElement *tee = self->tee;
+
+  g_mutex_lock(&self->receivers_mutex);
+  if (receiver_entry->transcode) {
+    transcode = gst_preview_sink_release_transcode(self, receiver_entry->transcode);
+    receiver_entry->transcode = NULL;
+  }
+  codecs = g_strdupv(receiver_entry->codecs);
+  g_mutex_unlock(&self->receivers_mutex);
+
+  if (transcode)
+    gst_preview_sink_transcode_free(transcode);
+  transcode = NULL;
+
+  GST_OBJECT_LOCK(self);
+  upstream = self->video_codec;
+  compatible = !upstream || !g_str_equal(upstream->encoding_name, "H264") ||
+      gst_preview_sink_profile_is_baseline(self->video_profile);
+  GST_OBJECT_UNLOCK(self);
+
+  // A viewer listing no codecs takes the upstream one, H.264 as baseline
+  if (!upstream || (!codecs && compatible))
+    goto done;
+
+  for (guint i = 0; compatible && codecs[i]; i++) {
+    if (g_ascii_strcasecmp(codecs[i], upstream->encoding_name) == 0)
+      goto done;
+  }
+
+  // Same codec at another profile goes through the transcode as well
+  candidates = codecs ? (const gchar * const *) codecs : h264_only;
+  for (guint i = 0; !transcode && candidates[i]; i++) {
+    const GstPreviewCodec *codec = gst_preview_codec_from_name(candidates[i]);
+
+    if (codec)
+      transcode = gst_preview_sink_acquire_transcode(self, codec);
+  }
+
+  if (transcode) {
+    tee = transcode->tee;
+    g_mutex_lock(&self->receivers_mutex);
+    receiver_entry->transcode = transcode;
+    g_mutex_unlock(&self->receivers_mutex);
+  } else {
+    GST_WARNING("No codec in common with the viewer, offering %s", upstream->encoding_name);
+  }
+
+done:
+  g_strfreev(codecs);
+  return tee;
+}
+
 void play_receiver_entry (PreviewSinkReceiverEntry * receiver_entry){
     if (!receiver_entry || !receiver_entry->parent) {
         GST_ERROR("Invalid receiver entry or parent");
@@ -463,6 +730,12 @@ void play_receiver_entry (PreviewSinkReceiverEntry * receiver_entry){
         GST_ERROR("Failed to create webrtcsink element");
         return;
     }
+
+    g_mutex_lock(&self->server_mutex);
+    if (self->server) {
+        gst_preview_server_configure_peer(self->server, sender_bin);
+    }
+    g_mutex_unlock(&self->server_mutex);
     
     GST_DEBUG("Created webrtcsink element %p", sender_bin);
     
@@ -473,6 +746,8 @@ void play_receiver_entry (PreviewSinkReceiverEntry * receiver_entry){
     g_object_set(sender_bin, "stun-server", "stun://stun.l.google.com:19302", NULL);
     GST_DEBUG("Configured STUN server");
 
+    g_object_set(sender_bin, "fec-percentage", self->fec_percentage, NULL);
+
     // Store the sender_bin in the receiver entry
     g_mutex_lock(&self->receivers_mutex);
     if (receiver_entry->bin) {
@@ -509,7 +784,11 @@ void play_receiver_entry (PreviewSinkReceiverEntry * receiver_entry){
 
     // Start the sender bin
     gboolean result = FALSE;
-    g_signal_emit_by_name(receiver_entry->parent->tee, "start", sender_bin, &result);
+    GstElement *tee = gst_preview_sink_select_tee(self, receiver_entry);
+    g_mutex_lock(&self->receivers_mutex);
+    receiver_entry->tee = tee;
+    g_mutex_unlock(&self->receivers_mutex);
+    g_signal_emit_by_name(tee, "start", sender_bin, &result);
     
     if (!result) {
         GST_ERROR("Failed to start WebRTC sender bin");
@@ -541,10 +820,7 @@ create_receiver_entry (GstPreviewSink *self, SoupWebsocketConnection * connectio
 
 
 static void
-soup_websocket_handler (SoupServer *server,
-                        SoupServerMessage       *msg,
-                        const char *path,
-                        SoupWebsocketConnection *connection,
+soup_websocket_handler (SoupWebsocketConnection *connection,
                         gpointer user_data)
 {
   GstPreviewSink *self = GST_PREVIEW_SINK(user_data);
@@ -563,24 +839,96 @@ soup_websocket_handler (SoupServer *server,
 
 
 
+/* Server side branches (snapshots, fMP4) run on the main tee like viewers,
+ * for as long as the server. Called with the server lock. */
+static GstElement *gst_preview_sink_start_branch(GstPreviewSink *self, const gchar *factory)
+{
+  GstElement *branch = gst_element_factory_make(factory, NULL);
+  gboolean result = FALSE;
+
+  if (!branch) {
+    GST_WARNING_OBJECT (self, "%s is missing, branch disabled", factory);
+    return NULL;
+  }
+  gst_object_ref_sink(branch);
+
+  g_signal_emit_by_name(self->tee, "start", branch, &result);
+  if (!result) {
+    GST_WARNING_OBJECT (self, "Failed to start the %s branch", factory);
+    gst_object_unref(branch);
+    return NULL;
+  }
+  return branch;
+}
+
+/* called with the server lock, the caller drops its reference */
+static void gst_preview_sink_stop_branch(GstPreviewSink *self, GstElement *branch)
+{
+  gboolean result = FALSE;
+
+  g_signal_emit_by_name(self->tee, "stop", branch, &result);
+  if (!result)
+    gst_element_set_state(branch, GST_STATE_NULL);
+}
+
+/* called with the server lock */
+static void gst_preview_sink_start_snapshot(GstPreviewSink *self)
+{
+  self->snapshot = gst_preview_sink_start_branch(self, "previewsnapshot");
+  if (!self->snapshot)
+    return;
+
+  g_object_set(self->snapshot, "width", self->snapshot_width, NULL);
+  if (!gst_preview_snapshot_attach(GST_PREVIEW_SNAPSHOT(self->snapshot),
+          self->server, self->engine_id)) {
+    GST_WARNING_OBJECT (self, "Snapshot resources already served");
+    gst_preview_sink_stop_branch(self, self->snapshot);
+    gst_object_unref(self->snapshot);
+    self->snapshot = NULL;
+  }
+}
+
+/* called with the server lock */
+static void gst_preview_sink_start_fmp4(GstPreviewSink *self)
+{
+  self->fmp4 = gst_preview_sink_start_branch(self, "previewfmp4");
+  if (!self->fmp4)
+    return;
+
+  g_object_set(self->fmp4, "max-lag", self->fmp4_max_lag, NULL);
+  if (!gst_preview_fmp4_attach(GST_PREVIEW_FMP4(self->fmp4), self->server, self->engine_id)) {
+    GST_WARNING_OBJECT (self, "fMP4 resource already served");
+    gst_preview_sink_stop_branch(self, self->fmp4);
+    gst_object_unref(self->fmp4);
+    self->fmp4 = NULL;
+  }
+}
+
 static gboolean gst_preview_sink_start_server(GstPreviewSink *self)
 {
   gboolean ret = FALSE;
   
   g_mutex_lock(&self->server_mutex);
-  
-  GST_INFO ("Libsoup 3.0 server now listening for connections");
 
-  self->soup_server = soup_server_new ("server-header", "webrtc-soup-server", NULL);
-
-  soup_server_add_websocket_handler (self->soup_server, "/ws", NULL, NULL,
-      soup_websocket_handler, (gpointer) self, NULL);
-
-  if (!soup_server_listen_all (self->soup_server, self->port, 0, NULL)) {
-    GST_ERROR ("Failed to start SoupServer on port %d", self->port);
-    g_object_unref (G_OBJECT (self->soup_server));
-    self->soup_server = NULL;
+  // Engines on the same port share one listener, each under its own path
+  self->server = gst_preview_server_acquire (self->host, self->port);
+
+  if (self->server == NULL) {
+    GST_ERROR_OBJECT (self, "Failed to start preview server on port %d", self->port);
+  } else if (!gst_preview_server_add_engine (self->server, self->engine_id,
+          soup_websocket_handler, (gpointer) self)) {
+    GST_ERROR_OBJECT (self, "Engine %s is already served on port %d",
+        self->engine_id ? self->engine_id : "(default)", self->port);
+    gst_preview_server_release (self->server);
+    self->server = NULL;
   } else {
+    gst_preview_server_set_ice_port_range (self->server, self->ice_min_port, self->ice_max_port);
+    if (self->snapshot_enabled)
+      gst_preview_sink_start_snapshot (self);
+    if (self->fmp4_enabled)
+      gst_preview_sink_start_fmp4 (self);
+    GST_INFO_OBJECT (self, "Preview for engine %s listening on port %d",
+        self->engine_id ? self->engine_id : "(default)", self->port);
     ret = TRUE;
   }
   
@@ -593,15 +941,46 @@ static gboolean gst_preview_sink_stop_server(GstPreviewSink *self)
 {
   g_mutex_lock(&self->server_mutex);
   
-  if (self->soup_server != NULL) {
-    g_object_unref (G_OBJECT (self->soup_server));
-    self->soup_server = NULL;
+  if (self->snapshot != NULL) {
+    gst_preview_snapshot_detach (GST_PREVIEW_SNAPSHOT (self->snapshot));
+    gst_preview_sink_stop_branch (self, self->snapshot);
+  }
+  if (self->fmp4 != NULL) {
+    gst_preview_fmp4_detach (GST_PREVIEW_FMP4 (self->fmp4));
+    gst_preview_sink_stop_branch (self, self->fmp4);
   }
+  if (self->server != NULL) {
+    // The branch resources go away with the engine
+    gst_preview_server_remove_engine (self->server, self->engine_id);
+    gst_preview_server_release (self->server);
+    self->server = NULL;
+  }
+  g_clear_object (&self->snapshot);
+  g_clear_object (&self->fmp4);
   
   g_mutex_unlock(&self->server_mutex);
   return TRUE;
 }
 
+static GstPadProbeReturn gst_preview_sink_video_caps_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+  GstPreviewSink *self = GST_PREVIEW_SINK(user_data);
+  GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+  GstCaps *caps;
+
+  if (GST_EVENT_TYPE(event) == GST_EVENT_CAPS) {
+    gst_event_parse_caps(event, &caps);
+    GST_OBJECT_LOCK(self);
+    self->video_codec = gst_preview_codec_from_caps(caps);
+    g_free(self->video_profile);
+    self->video_profile = g_strdup(gst_structure_get_string(gst_caps_get_structure(caps, 0), "profile"));
+    GST_OBJECT_UNLOCK(self);
+    GST_INFO("Upstream video is %" GST_PTR_FORMAT, caps);
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
 static void gst_preview_sink_init(GstPreviewSink *self)
 {
   GstBin *bin = GST_BIN(self);
@@ -620,10 +999,10 @@ static void gst_preview_sink_init(GstPreviewSink *self)
 
   GST_INFO("Created audio and video queues");
 
-  self->h264parse = gst_element_factory_make("h264parse", "vparse");
+  // Video is passed as is, each webrtcsink payloads it from its caps
   self->opusparse = gst_element_factory_make("opusparse", "aparse");
 
-  GST_INFO("Created H264 and Opus parsers");
+  GST_INFO("Created Opus parser");
 
   self->tee = gst_element_factory_make("dynamictee", "dtee");
   self->receivers = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
@@ -631,14 +1010,27 @@ static void gst_preview_sink_init(GstPreviewSink *self)
 
   GST_INFO("Created dynamic tee and receiver hash table");
 
-  gst_bin_add_many(bin, self->aqueue, self->vqueue, self->h264parse, self->opusparse, self->tee, NULL);
-  gst_element_link_many(self->vqueue, self->h264parse, self->tee, NULL);
-  gst_element_link_many(self->aqueue, self->opusparse, self->tee, NULL);
+  self->transcodes = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+      gst_preview_sink_transcode_free);
+
+  gst_bin_add_many(bin, self->aqueue, self->vqueue, self->opusparse, self->tee, NULL);
+  gst_element_link_pads(self->vqueue, NULL, self->tee, "video_sink");
+
+  GstPad *vsrcpad = gst_element_get_static_pad(self->vqueue, "src");
+  gst_pad_add_probe(vsrcpad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+      gst_preview_sink_video_caps_probe, self, NULL);
+  gst_object_unref(vsrcpad);
+  gst_element_link(self->aqueue, self->opusparse);
+  gst_element_link_pads(self->opusparse, NULL, self->tee, "audio_sink");
 
   GST_INFO("Added and linked elements in bin");
 
   self->host = g_strdup_printf("%s", DEFAULT_HOST);
   self->port = DEFAULT_PORT;
+  self->snapshot_enabled = FALSE;
+  self->snapshot_width = 640;
+  self->fmp4_enabled = FALSE;
+  self->fmp4_max_lag = 2000;
 
   GST_INFO("Set default host: %s, port: %d", self->host, self->port);
 
@@ -653,10 +1045,14 @@ static void gst_preview_sink_init(GstPreviewSink *self)
   GST_INFO("Added ghost pads for audio and video sinks");
 }
 
-static void cleanup_receiver_entry_resources(PreviewSinkReceiverEntry *receiver_entry)
+/* called with the receivers lock, returns the transcode branch to stop once
+ * unlocked when this was its last viewer */
+static PreviewSinkTranscode *cleanup_receiver_entry_resources(PreviewSinkReceiverEntry *receiver_entry)
 {
+    PreviewSinkTranscode *transcode = NULL;
+
     if (!receiver_entry || receiver_entry->cleaned_up) {
-        return;
+        return NULL;
     }
 
     GST_INFO("Cleaning up resources for receiver entry %p", receiver_entry);
@@ -669,16 +1065,28 @@ static void cleanup_receiver_entry_resources(PreviewSinkReceiverEntry *receiver_
         GST_INFO("Stopping and cleaning up WebRTC bin %p", receiver_entry->bin);
 
         gboolean result = FALSE;
-        if (receiver_entry->parent && receiver_entry->parent->tee) {
-            g_signal_emit_by_name(receiver_entry->parent->tee, "stop", receiver_entry->bin, &result);
+        if (receiver_entry->tee) {
+            g_signal_emit_by_name(receiver_entry->tee, "stop", receiver_entry->bin, &result);
         }
 
-        gst_element_set_state(receiver_entry->bin, GST_STATE_NULL);
+        // The dynamic tee reaper sets the bin to NULL once it is drained
+        if (!result) {
+            gst_element_set_state(receiver_entry->bin, GST_STATE_NULL);
+        }
 
         gst_object_unref(receiver_entry->bin);
         receiver_entry->bin = NULL;
     }
 
+    // Last viewer of a transcode branch stops it
+    if (receiver_entry->transcode && receiver_entry->parent) {
+        transcode = gst_preview_sink_release_transcode(receiver_entry->parent, receiver_entry->transcode);
+        receiver_entry->transcode = NULL;
+    }
+    receiver_entry->tee = NULL;
+    g_strfreev(receiver_entry->codecs);
+    receiver_entry->codecs = NULL;
+
     // 🔻 Ferme la WebSocket
     /*if (SOUP_IS_WEBSOCKET_CONNECTION(receiver_entry->connection)) {
         GST_INFO("Closing WebSocket connection %p", receiver_entry->connection);
@@ -686,12 +1094,15 @@ static void cleanup_receiver_entry_resources(PreviewSinkReceiverEntry *receiver_
         g_object_unref(receiver_entry->connection);
         receiver_entry->connection = NULL;
     }/*/
+
+    return transcode;
 }
 
 static void gst_preview_sink_cleanup_all_connections(GstPreviewSink *self)
 {
     GHashTableIter iter;
     gpointer key, value;
+    GSList *transcodes = NULL;
 
     GST_INFO("Cleaning up all connections");
 
@@ -699,11 +1110,16 @@ static void gst_preview_sink_cleanup_all_connections(GstPreviewSink *self)
     g_hash_table_iter_init(&iter, self->receivers);
     while (g_hash_table_iter_next(&iter, &key, &value)) {
         PreviewSinkReceiverEntry *entry = (PreviewSinkReceiverEntry *)value;
-        cleanup_receiver_entry_resources(entry);
-        g_slice_free1(sizeof(PreviewSinkReceiverEntry), entry);
+        // the entry itself is released by the table
+        PreviewSinkTranscode *transcode = cleanup_receiver_entry_resources(entry);
+        if (transcode)
+            transcodes = g_slist_prepend(transcodes, transcode);
     }
     g_hash_table_remove_all(self->receivers);
     g_mutex_unlock(&self->receivers_mutex);
+
+    // Transcode branches are stopped on the main tee unlocked
+    g_slist_free_full(transcodes, gst_preview_sink_transcode_free);
 }
 
 static GstStateChangeReturn gst_preview_sink_change_state(GstElement *element, GstStateChange transition)
@@ -735,6 +1151,74 @@ static GstStateChangeReturn gst_preview_sink_change_state(GstElement *element, G
 }
 
 
+static GstStructure *gst_preview_sink_get_stats(GstPreviewSink *self)
+{
+  GstStructure *stats;
+  guint receivers;
+
+  GValue viewers = G_VALUE_INIT;
+  GHashTableIter iter;
+  gpointer value;
+
+  g_value_init(&viewers, GST_TYPE_ARRAY);
+
+  g_mutex_lock(&self->receivers_mutex);
+  receivers = g_hash_table_size(self->receivers);
+  g_hash_table_iter_init(&iter, self->receivers);
+  while (g_hash_table_iter_next(&iter, NULL, &value)) {
+    PreviewSinkReceiverEntry *receiver_entry = value;
+    GValue viewer = G_VALUE_INIT;
+
+    if (!receiver_entry->bin)
+      continue;
+
+    g_value_init(&viewer, GST_TYPE_STRUCTURE);
+    g_object_get_property(G_OBJECT(receiver_entry->bin), "stats", &viewer);
+    gst_value_array_append_and_take_value(&viewers, &viewer);
+  }
+
+  GstStructure *transcodes = gst_structure_new_empty("transcodes");
+  g_hash_table_iter_init(&iter, self->transcodes);
+  while (g_hash_table_iter_next(&iter, NULL, &value)) {
+    PreviewSinkTranscode *transcode = value;
+    gst_structure_set(transcodes, transcode->codec->encoding_name, G_TYPE_UINT, transcode->viewers, NULL);
+  }
+  g_mutex_unlock(&self->receivers_mutex);
+
+  stats = gst_structure_new("previewsink-stats",
+      "engine-id", G_TYPE_STRING, self->engine_id,
+      "receivers", G_TYPE_UINT, receivers,
+      "transcodes", GST_TYPE_STRUCTURE, transcodes,
+      NULL);
+  gst_structure_free(transcodes);
+  gst_structure_take_value(stats, "viewers", &viewers);
+
+  g_mutex_lock(&self->server_mutex);
+  if (self->snapshot) {
+    GstStructure *snapshot_stats = NULL;
+    g_object_get(self->snapshot, "stats", &snapshot_stats, NULL);
+    gst_structure_set(stats, "snapshot", GST_TYPE_STRUCTURE, snapshot_stats, NULL);
+    gst_structure_free(snapshot_stats);
+  }
+  if (self->fmp4) {
+    GstStructure *fmp4_stats = NULL;
+    g_object_get(self->fmp4, "stats", &fmp4_stats, NULL);
+    gst_structure_set(stats, "fmp4", GST_TYPE_STRUCTURE, fmp4_stats, NULL);
+    gst_structure_free(fmp4_stats);
+  }
+  if (self->server) {
+    GstStructure *server_stats = gst_preview_server_get_stats(self->server);
+    gst_structure_set(stats,
+        "connections", G_TYPE_UINT, gst_preview_server_get_connections(self->server, self->engine_id),
+        "server", GST_TYPE_STRUCTURE, server_stats,
+        NULL);
+    gst_structure_free(server_stats);
+  }
+  g_mutex_unlock(&self->server_mutex);
+
+  return stats;
+}
+
 static void gst_preview_sink_set_property(GObject *object,
                                                 guint prop_id,
                                                 const GValue *value,
@@ -751,6 +1235,35 @@ static void gst_preview_sink_set_property(GObject *object,
         case PROP_PORT:
             self->port = g_value_get_int(value);
           break;      
+        case PROP_THREAD_POLICY:
+            gst_thread_policy_free(self->thread_policy);
+            self->thread_policy = gst_thread_policy_new_from_string("preview", g_value_get_string(value));
+          break;
+        case PROP_ENGINE_ID:
+            g_free(self->engine_id);
+            self->engine_id = g_value_dup_string(value);
+          break;
+        case PROP_ICE_MIN_PORT:
+            self->ice_min_port = g_value_get_uint(value);
+          break;
+        case PROP_ICE_MAX_PORT:
+            self->ice_max_port = g_value_get_uint(value);
+          break;
+        case PROP_FEC_PERCENTAGE:
+            self->fec_percentage = g_value_get_uint(value);
+          break;
+        case PROP_SNAPSHOT:
+            self->snapshot_enabled = g_value_get_boolean(value);
+          break;
+        case PROP_SNAPSHOT_WIDTH:
+            self->snapshot_width = g_value_get_uint(value);
+          break;
+        case PROP_FMP4:
+            self->fmp4_enabled = g_value_get_boolean(value);
+          break;
+        case PROP_FMP4_MAX_LAG:
+            self->fmp4_max_lag = g_value_get_uint(value);
+          break;
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
             break;    
@@ -772,6 +1285,36 @@ static void gst_preview_sink_get_property(GObject *object,
         case PROP_PORT:
             g_value_set_int(value, self->port);
           break;      
+        case PROP_THREAD_POLICY:
+            g_value_set_string(value, gst_thread_policy_get_description(self->thread_policy));
+          break;
+        case PROP_ENGINE_ID:
+            g_value_set_string(value, self->engine_id);
+          break;
+        case PROP_ICE_MIN_PORT:
+            g_value_set_uint(value, self->ice_min_port);
+          break;
+        case PROP_ICE_MAX_PORT:
+            g_value_set_uint(value, self->ice_max_port);
+          break;
+        case PROP_FEC_PERCENTAGE:
+            g_value_set_uint(value, self->fec_percentage);
+          break;
+        case PROP_SNAPSHOT:
+            g_value_set_boolean(value, self->snapshot_enabled);
+          break;
+        case PROP_SNAPSHOT_WIDTH:
+            g_value_set_uint(value, self->snapshot_width);
+          break;
+        case PROP_FMP4:
+            g_value_set_boolean(value, self->fmp4_enabled);
+          break;
+        case PROP_FMP4_MAX_LAG:
+            g_value_set_uint(value, self->fmp4_max_lag);
+          break;
+        case PROP_STATS:
+            g_value_take_boxed(value, gst_preview_sink_get_stats(self));
+          break;
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
             break;
@@ -788,21 +1331,43 @@ static void gst_preview_sink_finalize(GObject *object)
     self->host = NULL;
   }
 
+  gst_thread_policy_free(self->thread_policy);
+  g_free(self->engine_id);
+
+  g_hash_table_unref(self->transcodes);
+  g_free(self->video_profile);
+
   g_mutex_clear(&self->receivers_mutex);
   g_mutex_clear(&self->server_mutex);
 
   G_OBJECT_CLASS(parent_class)->finalize(object);
 }
 
+static void gst_preview_sink_handle_message(GstBin *bin, GstMessage *message)
+{
+  GstPreviewSink *self = GST_PREVIEW_SINK(bin);
+
+  GstObject *src = GST_MESSAGE_SRC(message);
+
+  // The snapshot decoder keeps its own low priority
+  if (!self->snapshot || (src != GST_OBJECT(self->snapshot) &&
+          !gst_object_has_as_ancestor(src, GST_OBJECT(self->snapshot))))
+    gst_thread_policy_handle_message(self->thread_policy, GST_ELEMENT(self), message);
+
+  GST_BIN_CLASS(parent_class)->handle_message(bin, message);
+}
+
 static void gst_preview_sink_class_init(GstPreviewSinkClass *klass)
 {
   GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
   GObjectClass *object_class = G_OBJECT_CLASS(klass);
+  GstBinClass *bin_class = GST_BIN_CLASS(klass);
 
   object_class->set_property = gst_preview_sink_set_property;
   object_class->get_property = gst_preview_sink_get_property;
   object_class->finalize = gst_preview_sink_finalize;
   element_class->change_state = gst_preview_sink_change_state;
+  bin_class->handle_message = gst_preview_sink_handle_message;
 
   g_object_class_install_property(object_class, PROP_HOST,
                                   g_param_spec_string("host", "host",
@@ -814,6 +1379,66 @@ static void gst_preview_sink_class_init(GstPreviewSinkClass *klass)
                                                    "port", 1, 65535, DEFAULT_PORT,
                                                    G_PARAM_READWRITE));
 
+  g_object_class_install_property(object_class, PROP_THREAD_POLICY,
+                                  g_param_spec_string("thread-policy", "Thread policy",
+                                                   "Placement of the preview streaming threads, e.g. \"cpus=4-7;nice=10\"",
+                                                   NULL,
+                                                   G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property(object_class, PROP_ENGINE_ID,
+                                  g_param_spec_string("engine-id", "engine-id",
+                                                   "Id of the engine, viewers connect to /ws/<engine-id> on the port shared by all engines (/ws when unset)",
+                                                   NULL,
+                                                   G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property(object_class, PROP_ICE_MIN_PORT,
+                                  g_param_spec_uint("ice-min-port", "ice-min-port",
+                                                   "First UDP port shared by the ICE agents of every engine on the port (0 = ephemeral)",
+                                                   0, 65535, 0,
+                                                   G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property(object_class, PROP_ICE_MAX_PORT,
+                                  g_param_spec_uint("ice-max-port", "ice-max-port",
+                                                   "Last UDP port shared by the ICE agents of every engine on the port",
+                                                   0, 65535, 0,
+                                                   G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property(object_class, PROP_FEC_PERCENTAGE,
+                                  g_param_spec_uint("fec-percentage", "fec-percentage",
+                                                   "ULPFEC/RED protection offered to new viewers (0 = RTX only)",
+                                                   0, 100, 0,
+                                                   G_PARAM_READWRITE));
+
+  g_object_class_install_property(object_class, PROP_SNAPSHOT,
+                                  g_param_spec_boolean("snapshot", "snapshot",
+                                                   "Serve snapshot.jpg and thumbnail.mjpg next to the websocket, from decoded keyframes",
+                                                   FALSE,
+                                                   G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property(object_class, PROP_SNAPSHOT_WIDTH,
+                                  g_param_spec_uint("snapshot-width", "snapshot-width",
+                                                   "Width of the snapshots, 0 keeps the source size",
+                                                   0, G_MAXUINT, 640,
+                                                   G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property(object_class, PROP_FMP4,
+                                  g_param_spec_boolean("fmp4", "fmp4",
+                                                   "Offer a fragmented MP4 preview for MSE players, on the websocket and as live.mp4",
+                                                   FALSE,
+                                                   G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property(object_class, PROP_FMP4_MAX_LAG,
+                                  g_param_spec_uint("fmp4-max-lag", "fmp4-max-lag",
+                                                   "fMP4 clients that fall behind by more than that (ms) are evicted, 0 = never",
+                                                   0, G_MAXUINT, 2000,
+                                                   G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property(object_class, PROP_STATS,
+                                  g_param_spec_boxed("stats", "stats",
+                                                   "Connections and per viewer RTX/FEC stats of this engine and the shared preview server",
+                                                   GST_TYPE_STRUCTURE,
+                                                   G_PARAM_READABLE));
+
 
   GST_DEBUG_CATEGORY_INIT (gst_preview_sink_debug, "previewsink", 0,
       "Preview Sink Debug");
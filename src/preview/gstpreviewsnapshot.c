@@ -0,0 +1,618 @@
+#include "gstpreviewsnapshot.h"
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <common/gstthreadpolicy.h>
+
+GST_DEBUG_CATEGORY_STATIC (gst_preview_snapshot_debug);
+#define GST_CAT_DEFAULT gst_preview_snapshot_debug
+
+#define gst_preview_snapshot_parent_class parent_class
+
+#define DEFAULT_WIDTH 640
+#define DEFAULT_THREAD_POLICY "nice=19"
+/* keyframes are not decoded when nobody asked for a snapshot for that long,
+ * and the cached one is dropped as stale */
+#define IDLE_TIMEOUT (30 * G_TIME_SPAN_SECOND)
+#define BOUNDARY "snapshot"
+/* chunks appended per multipart part */
+#define PART_CHUNKS 3
+
+/* properties */
+enum
+{
+  PROP_0,
+  PROP_WIDTH,
+  PROP_THREAD_POLICY,
+  PROP_STATS,
+};
+
+typedef struct {
+  GstPreviewSnapshot *snapshot;
+  SoupServerMessage *msg;
+  /* chunks queued but not written yet */
+  guint pending;
+} SnapshotClient;
+
+/* Decodes the keyframes only, on a low priority thread, and keeps the last
+ * one as JPEG. "/snapshot.jpg" requests are answered from that cache and
+ * "/thumbnail.mjpg" clients get each new JPEG as a multipart part, so the
+ * decode cost is one frame per GOP whatever the request rate. Requests
+ * coming while the cache is empty wait for the next keyframe. */
+struct _GstPreviewSnapshot
+{
+  GstBin parent_instance;
+
+  GstElement *queue;
+  GstElement *decoder;
+  GstElement *convert;
+  GstElement *scale;
+  GstElement *filter;
+  GstElement *encoder;
+  GstElement *sink;
+
+  guint width;
+  GstThreadPolicy *thread_policy;
+
+  GMutex lock;
+  GBytes *jpeg;
+  GstClockTime jpeg_pts;
+  gint64 last_request;
+  /* paused "/snapshot.jpg" requests, SoupServerMessage */
+  GList *waiting;
+  GList *clients;
+  GstPreviewServer *server;
+
+  guint64 keyframes;
+  guint64 skipped;
+  guint64 decoded;
+  guint64 requests;
+  guint64 stream_parts;
+  guint64 stream_drops;
+};
+
+G_DEFINE_TYPE(GstPreviewSnapshot, gst_preview_snapshot, GST_TYPE_BIN);
+
+static void gst_preview_snapshot_update_caps(GstPreviewSnapshot *self)
+{
+  GstCaps *caps = gst_caps_new_simple("video/x-raw",
+      "pixel-aspect-ratio", GST_TYPE_FRACTION, 1, 1, NULL);
+
+  if (self->width > 0)
+    gst_caps_set_simple(caps, "width", G_TYPE_INT, self->width, NULL);
+  g_object_set(self->filter, "caps", caps, NULL);
+  gst_caps_unref(caps);
+}
+
+static GstPadProbeReturn gst_preview_snapshot_keyframe_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+  GstPreviewSnapshot *self = GST_PREVIEW_SNAPSHOT(user_data);
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+  gboolean idle;
+
+  if (GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT))
+    return GST_PAD_PROBE_DROP;
+
+  g_mutex_lock(&self->lock);
+  self->keyframes++;
+  idle = self->clients == NULL && self->waiting == NULL &&
+      g_get_monotonic_time() - self->last_request > IDLE_TIMEOUT;
+  if (idle){
+    self->skipped++;
+    g_clear_pointer(&self->jpeg, g_bytes_unref);
+    self->jpeg_pts = GST_CLOCK_TIME_NONE;
+  }
+  g_mutex_unlock(&self->lock);
+
+  return idle ? GST_PAD_PROBE_DROP : GST_PAD_PROBE_OK;
+}
+
+/* called in the server context, without the lock; the caller accounted
+ * the chunks in client->pending */
+static void gst_preview_snapshot_write_part(SnapshotClient *client, GBytes *jpeg)
+{
+  SoupMessageBody *body = soup_server_message_get_response_body(client->msg);
+  gchar *header = g_strdup_printf("--" BOUNDARY "\r\nContent-Type: image/jpeg\r\n"
+      "Content-Length: %" G_GSIZE_FORMAT "\r\n\r\n", g_bytes_get_size(jpeg));
+
+  soup_message_body_append(body, SOUP_MEMORY_TAKE, header, strlen(header));
+  soup_message_body_append_bytes(body, jpeg);
+  soup_message_body_append(body, SOUP_MEMORY_STATIC, "\r\n", 2);
+  soup_server_message_unpause(client->msg);
+}
+
+/* called in the server context */
+static void gst_preview_snapshot_reply(SoupServerMessage *msg, GBytes *jpeg)
+{
+  SoupMessageHeaders *headers = soup_server_message_get_response_headers(msg);
+
+  soup_message_headers_replace(headers, "Cache-Control", "no-cache");
+  if (jpeg == NULL){
+    soup_message_headers_replace(headers, "Retry-After", "1");
+    soup_server_message_set_status(msg, SOUP_STATUS_SERVICE_UNAVAILABLE, NULL);
+    return;
+  }
+
+  soup_message_headers_set_content_type(headers, "image/jpeg", NULL);
+  soup_message_body_append_bytes(soup_server_message_get_response_body(msg), jpeg);
+  soup_server_message_set_status(msg, SOUP_STATUS_OK, NULL);
+}
+
+static void gst_preview_snapshot_waiting_finished(SoupServerMessage *msg, gpointer user_data)
+{
+  GstPreviewSnapshot *self = GST_PREVIEW_SNAPSHOT(user_data);
+  GList *link;
+
+  g_mutex_lock(&self->lock);
+  link = g_list_find(self->waiting, msg);
+  if (link)
+    self->waiting = g_list_delete_link(self->waiting, link);
+  g_mutex_unlock(&self->lock);
+
+  if (link){
+    g_signal_handlers_disconnect_by_func(msg, gst_preview_snapshot_waiting_finished, self);
+    g_object_unref(msg);
+  }
+}
+
+/* called in the server context, answers the paused requests with @jpeg,
+ * unavailable when NULL */
+static void gst_preview_snapshot_answer_waiting(GstPreviewSnapshot *self, GBytes *jpeg)
+{
+  GList *waiting;
+
+  g_mutex_lock(&self->lock);
+  waiting = self->waiting;
+  self->waiting = NULL;
+  g_mutex_unlock(&self->lock);
+
+  for (GList *l = waiting; l != NULL; l = l->next){
+    SoupServerMessage *msg = l->data;
+
+    g_signal_handlers_disconnect_by_func(msg, gst_preview_snapshot_waiting_finished, self);
+    gst_preview_snapshot_reply(msg, jpeg);
+    soup_server_message_unpause(msg);
+  }
+  g_list_free_full(waiting, g_object_unref);
+}
+
+static gboolean gst_preview_snapshot_push_clients(gpointer user_data)
+{
+  GstPreviewSnapshot *self = GST_PREVIEW_SNAPSHOT(user_data);
+  GList *ready = NULL;
+  GBytes *jpeg = NULL;
+
+  g_mutex_lock(&self->lock);
+  if (self->jpeg)
+    jpeg = g_bytes_ref(self->jpeg);
+  for (GList *l = self->clients; l != NULL && self->jpeg != NULL; l = l->next){
+    SnapshotClient *client = l->data;
+
+    /* a client still writing the previous thumbnail skips this one */
+    if (client->pending > 0){
+      self->stream_drops++;
+      continue;
+    }
+    client->pending += PART_CHUNKS;
+    ready = g_list_prepend(ready, client);
+    self->stream_parts++;
+  }
+  g_mutex_unlock(&self->lock);
+
+  if (jpeg)
+    gst_preview_snapshot_answer_waiting(self, jpeg);
+
+  /* clients only go away from "finished", in this context */
+  for (GList *l = ready; l != NULL; l = l->next)
+    gst_preview_snapshot_write_part(l->data, jpeg);
+
+  g_list_free(ready);
+  if (jpeg)
+    g_bytes_unref(jpeg);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void gst_preview_snapshot_unmap(gpointer data)
+{
+  GstMapInfo *map = data;
+  GstBuffer *buffer = map->user_data[0];
+
+  gst_buffer_unmap(buffer, map);
+  gst_buffer_unref(buffer);
+  g_slice_free(GstMapInfo, map);
+}
+
+static void gst_preview_snapshot_on_handoff(GstElement *sink, GstBuffer *buffer, GstPad *pad, gpointer user_data)
+{
+  GstPreviewSnapshot *self = GST_PREVIEW_SNAPSHOT(user_data);
+  GstMapInfo *map = g_slice_new0(GstMapInfo);
+  GBytes *jpeg;
+  GMainContext *context = NULL;
+
+  /* the JPEG is served from the buffer memory, without a copy */
+  if (!gst_buffer_map(buffer, map, GST_MAP_READ)){
+    g_slice_free(GstMapInfo, map);
+    return;
+  }
+  map->user_data[0] = gst_buffer_ref(buffer);
+  jpeg = g_bytes_new_with_free_func(map->data, map->size, gst_preview_snapshot_unmap, map);
+
+  g_mutex_lock(&self->lock);
+  if (self->jpeg)
+    g_bytes_unref(self->jpeg);
+  self->jpeg = jpeg;
+  self->jpeg_pts = GST_BUFFER_PTS(buffer);
+  self->decoded++;
+  if ((self->clients || self->waiting) && self->server)
+    context = gst_preview_server_get_main_context(self->server);
+  g_mutex_unlock(&self->lock);
+
+  if (context){
+    g_main_context_invoke_full(context, G_PRIORITY_DEFAULT,
+        gst_preview_snapshot_push_clients, gst_object_ref(self), gst_object_unref);
+  }
+}
+
+static void gst_preview_snapshot_handle_snapshot(SoupServer *server, SoupServerMessage *msg,
+    const char *path, GHashTable *query, gpointer user_data)
+{
+  GstPreviewSnapshot *self = GST_PREVIEW_SNAPSHOT(user_data);
+  const gchar *method = soup_server_message_get_method(msg);
+  gboolean wait = FALSE;
+  GBytes *jpeg;
+
+  if (method != SOUP_METHOD_GET && method != SOUP_METHOD_HEAD){
+    soup_server_message_set_status(msg, SOUP_STATUS_METHOD_NOT_ALLOWED, NULL);
+    return;
+  }
+
+  g_mutex_lock(&self->lock);
+  self->requests++;
+  self->last_request = g_get_monotonic_time();
+  jpeg = self->jpeg ? g_bytes_ref(self->jpeg) : NULL;
+  /* the next keyframe is decoded for it, never a stale one */
+  if (jpeg == NULL && self->server){
+    self->waiting = g_list_prepend(self->waiting, g_object_ref(msg));
+    wait = TRUE;
+  }
+  g_mutex_unlock(&self->lock);
+
+  if (wait){
+    g_signal_connect(msg, "finished", G_CALLBACK(gst_preview_snapshot_waiting_finished), self);
+    soup_server_message_pause(msg);
+    return;
+  }
+
+  gst_preview_snapshot_reply(msg, jpeg);
+  if (jpeg)
+    g_bytes_unref(jpeg);
+}
+
+static void gst_preview_snapshot_client_wrote_chunk(SoupServerMessage *msg, gpointer user_data)
+{
+  SnapshotClient *client = user_data;
+
+  g_mutex_lock(&client->snapshot->lock);
+  if (client->pending > 0)
+    client->pending--;
+  g_mutex_unlock(&client->snapshot->lock);
+}
+
+static void gst_preview_snapshot_client_finished(SoupServerMessage *msg, gpointer user_data)
+{
+  SnapshotClient *client = user_data;
+  GstPreviewSnapshot *self = client->snapshot;
+
+  g_mutex_lock(&self->lock);
+  self->clients = g_list_remove(self->clients, client);
+  g_mutex_unlock(&self->lock);
+
+  g_signal_handlers_disconnect_by_data(msg, client);
+  g_object_unref(client->msg);
+  gst_object_unref(client->snapshot);
+  g_slice_free(SnapshotClient, client);
+}
+
+static void gst_preview_snapshot_handle_stream(SoupServer *server, SoupServerMessage *msg,
+    const char *path, GHashTable *query, gpointer user_data)
+{
+  GstPreviewSnapshot *self = GST_PREVIEW_SNAPSHOT(user_data);
+  SoupMessageHeaders *headers = soup_server_message_get_response_headers(msg);
+  SnapshotClient *client;
+  GBytes *jpeg;
+
+  if (soup_server_message_get_method(msg) != SOUP_METHOD_GET){
+    soup_server_message_set_status(msg, SOUP_STATUS_METHOD_NOT_ALLOWED, NULL);
+    return;
+  }
+
+  soup_message_headers_set_encoding(headers, SOUP_ENCODING_CHUNKED);
+  soup_message_headers_set_content_type(headers, "multipart/x-mixed-replace;boundary=" BOUNDARY, NULL);
+  soup_message_headers_replace(headers, "Cache-Control", "no-cache");
+  soup_server_message_set_status(msg, SOUP_STATUS_OK, NULL);
+
+  client = g_slice_new0(SnapshotClient);
+  client->snapshot = gst_object_ref(self);
+  client->msg = g_object_ref(msg);
+  g_signal_connect(msg, "wrote-chunk", G_CALLBACK(gst_preview_snapshot_client_wrote_chunk), client);
+  g_signal_connect(msg, "finished", G_CALLBACK(gst_preview_snapshot_client_finished), client);
+
+  g_mutex_lock(&self->lock);
+  self->requests++;
+  self->last_request = g_get_monotonic_time();
+  self->clients = g_list_prepend(self->clients, client);
+  jpeg = self->jpeg ? g_bytes_ref(self->jpeg) : NULL;
+  if (jpeg)
+    client->pending += PART_CHUNKS;
+  g_mutex_unlock(&self->lock);
+
+  /* start with the cached thumbnail, the next ones follow the keyframes */
+  if (jpeg){
+    gst_preview_snapshot_write_part(client, jpeg);
+    g_bytes_unref(jpeg);
+  } else {
+    soup_server_message_pause(msg);
+  }
+}
+
+/**
+ * gst_preview_snapshot_attach:
+ * @snapshot: a #GstPreviewSnapshot
+ * @server: the server of the engine
+ * @engine_id: (nullable): the engine, registered on @server
+ *
+ * Serves "snapshot.jpg" and "thumbnail.mjpg" next to the engine websocket.
+ */
+gboolean gst_preview_snapshot_attach(GstPreviewSnapshot *self, GstPreviewServer *server, const gchar *engine_id)
+{
+  if (!gst_preview_server_add_resource(server, engine_id, "snapshot.jpg",
+          gst_preview_snapshot_handle_snapshot, self))
+    return FALSE;
+  if (!gst_preview_server_add_resource(server, engine_id, "thumbnail.mjpg",
+          gst_preview_snapshot_handle_stream, self)){
+    gst_preview_server_remove_resource(server, engine_id, "snapshot.jpg");
+    return FALSE;
+  }
+
+  g_mutex_lock(&self->lock);
+  self->server = server;
+  g_mutex_unlock(&self->lock);
+
+  return TRUE;
+}
+
+static gboolean gst_preview_snapshot_close_clients(gpointer user_data)
+{
+  GstPreviewSnapshot *self = GST_PREVIEW_SNAPSHOT(user_data);
+  GList *clients;
+
+  gst_preview_snapshot_answer_waiting(self, NULL);
+
+  g_mutex_lock(&self->lock);
+  clients = g_list_copy(self->clients);
+  g_mutex_unlock(&self->lock);
+
+  /* "finished" releases each client */
+  for (GList *l = clients; l != NULL; l = l->next){
+    SnapshotClient *client = l->data;
+
+    soup_message_body_complete(soup_server_message_get_response_body(client->msg));
+    soup_server_message_unpause(client->msg);
+  }
+  g_list_free(clients);
+
+  return G_SOURCE_REMOVE;
+}
+
+/**
+ * gst_preview_snapshot_detach:
+ * @snapshot: a #GstPreviewSnapshot
+ *
+ * Ends the thumbnail streams and the waiting snapshot requests. The
+ * resources go away with the engine.
+ */
+void gst_preview_snapshot_detach(GstPreviewSnapshot *self)
+{
+  GMainContext *context = NULL;
+
+  g_mutex_lock(&self->lock);
+  if (self->server)
+    context = gst_preview_server_get_main_context(self->server);
+  self->server = NULL;
+  g_mutex_unlock(&self->lock);
+
+  if (context){
+    g_main_context_invoke_full(context, G_PRIORITY_DEFAULT,
+        gst_preview_snapshot_close_clients, gst_object_ref(self), gst_object_unref);
+  }
+}
+
+static GstStructure *gst_preview_snapshot_get_stats(GstPreviewSnapshot *self)
+{
+  GstStructure *stats;
+
+  g_mutex_lock(&self->lock);
+  stats = gst_structure_new("preview-snapshot-stats",
+      "keyframes", G_TYPE_UINT64, self->keyframes,
+      "skipped", G_TYPE_UINT64, self->skipped,
+      "decoded", G_TYPE_UINT64, self->decoded,
+      "requests", G_TYPE_UINT64, self->requests,
+      "stream-clients", G_TYPE_UINT, g_list_length(self->clients),
+      "stream-parts", G_TYPE_UINT64, self->stream_parts,
+      "stream-drops", G_TYPE_UINT64, self->stream_drops,
+      "jpeg-size", G_TYPE_UINT64, (guint64) (self->jpeg ? g_bytes_get_size(self->jpeg) : 0),
+      "jpeg-pts", G_TYPE_UINT64, self->jpeg_pts,
+      NULL);
+  g_mutex_unlock(&self->lock);
+
+  return stats;
+}
+
+static void gst_preview_snapshot_on_pad_added(GstElement *decoder, GstPad *pad, gpointer user_data)
+{
+  GstPreviewSnapshot *self = GST_PREVIEW_SNAPSHOT(user_data);
+  GstPad *sinkpad = gst_element_get_static_pad(self->convert, "sink");
+
+  if (!gst_pad_is_linked(sinkpad) && GST_PAD_LINK_FAILED(gst_pad_link(pad, sinkpad)))
+    GST_WARNING_OBJECT(self, "Cannot link decoder pad %s", GST_PAD_NAME(pad));
+  gst_object_unref(sinkpad);
+}
+
+/* Frame threaded decoders hold frames back; with one frame per GOP that
+ * would delay the snapshot by several GOPs */
+static void gst_preview_snapshot_on_deep_element_added(GstBin *bin, GstBin *sub_bin, GstElement *element, gpointer user_data)
+{
+  if (g_object_class_find_property(G_OBJECT_GET_CLASS(element), "max-threads"))
+    g_object_set(element, "max-threads", 1, NULL);
+}
+
+static void gst_preview_snapshot_handle_message(GstBin *bin, GstMessage *message)
+{
+  GstPreviewSnapshot *self = GST_PREVIEW_SNAPSHOT(bin);
+
+  gst_thread_policy_handle_message(self->thread_policy, GST_ELEMENT(self), message);
+
+  GST_BIN_CLASS(parent_class)->handle_message(bin, message);
+}
+
+static void gst_preview_snapshot_init(GstPreviewSnapshot *self)
+{
+  GstBin *bin = GST_BIN(self);
+
+  g_mutex_init(&self->lock);
+  self->width = DEFAULT_WIDTH;
+  self->jpeg_pts = GST_CLOCK_TIME_NONE;
+  self->thread_policy = gst_thread_policy_new_from_string("snapshot", DEFAULT_THREAD_POLICY);
+
+  self->queue = gst_element_factory_make("queue", "squeue");
+  self->decoder = gst_element_factory_make("decodebin", "sdecoder");
+  self->convert = gst_element_factory_make("videoconvert", "sconvert");
+  self->scale = gst_element_factory_make("videoscale", "sscale");
+  self->filter = gst_element_factory_make("capsfilter", "sfilter");
+  self->encoder = gst_element_factory_make("jpegenc", "sencoder");
+  self->sink = gst_element_factory_make("fakesink", "ssink");
+  if (!self->queue || !self->decoder || !self->convert || !self->scale ||
+      !self->filter || !self->encoder || !self->sink){
+    GST_ERROR("Failed to create snapshot elements");
+    return;
+  }
+
+  g_object_set(self->queue, "leaky", 2, "max-size-buffers", 2,
+      "max-size-bytes", 0, "max-size-time", (guint64) 0, NULL);
+  g_object_set(self->sink, "sync", FALSE, "async", FALSE,
+      "signal-handoffs", TRUE, NULL);
+  gst_preview_snapshot_update_caps(self);
+
+  gst_bin_add_many(bin, self->queue, self->decoder, self->convert, self->scale,
+      self->filter, self->encoder, self->sink, NULL);
+  gst_element_link(self->queue, self->decoder);
+  gst_element_link_many(self->convert, self->scale, self->filter, self->encoder, self->sink, NULL);
+
+  g_signal_connect(self->decoder, "pad-added", G_CALLBACK(gst_preview_snapshot_on_pad_added), self);
+  g_signal_connect(self, "deep-element-added", G_CALLBACK(gst_preview_snapshot_on_deep_element_added), NULL);
+  g_signal_connect(self->sink, "handoff", G_CALLBACK(gst_preview_snapshot_on_handoff), self);
+
+  GstPad *pad = gst_element_get_static_pad(self->queue, "sink");
+  gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, gst_preview_snapshot_keyframe_probe, self, NULL);
+  gst_element_add_pad(GST_ELEMENT(self), gst_ghost_pad_new("video_sink", pad));
+  gst_object_unref(pad);
+}
+
+static void gst_preview_snapshot_set_property(GObject *object,
+                                              guint prop_id,
+                                              const GValue *value,
+                                              GParamSpec *pspec){
+    GstPreviewSnapshot *self = GST_PREVIEW_SNAPSHOT(object);
+
+    switch (prop_id) {
+        case PROP_WIDTH:
+            self->width = g_value_get_uint(value);
+            gst_preview_snapshot_update_caps(self);
+            break;
+        case PROP_THREAD_POLICY:
+            gst_thread_policy_free(self->thread_policy);
+            self->thread_policy = gst_thread_policy_new_from_string("snapshot", g_value_get_string(value));
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+}
+
+static void gst_preview_snapshot_get_property(GObject *object,
+                                              guint prop_id,
+                                              GValue *value,
+                                              GParamSpec *pspec){
+    GstPreviewSnapshot *self = GST_PREVIEW_SNAPSHOT(object);
+
+    switch (prop_id) {
+        case PROP_WIDTH:
+            g_value_set_uint(value, self->width);
+            break;
+        case PROP_THREAD_POLICY:
+            g_value_set_string(value, gst_thread_policy_get_description(self->thread_policy));
+            break;
+        case PROP_STATS:
+            g_value_take_boxed(value, gst_preview_snapshot_get_stats(self));
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+}
+
+static void gst_preview_snapshot_finalize(GObject *object)
+{
+  GstPreviewSnapshot *self = GST_PREVIEW_SNAPSHOT(object);
+
+  if (self->jpeg)
+    g_bytes_unref(self->jpeg);
+  gst_thread_policy_free(self->thread_policy);
+  g_mutex_clear(&self->lock);
+
+  G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
+static void gst_preview_snapshot_class_init(GstPreviewSnapshotClass *klass)
+{
+  GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+  GObjectClass *object_class = G_OBJECT_CLASS(klass);
+  GstBinClass *bin_class = GST_BIN_CLASS(klass);
+
+  object_class->set_property = gst_preview_snapshot_set_property;
+  object_class->get_property = gst_preview_snapshot_get_property;
+  object_class->finalize = gst_preview_snapshot_finalize;
+  bin_class->handle_message = gst_preview_snapshot_handle_message;
+
+  g_object_class_install_property(object_class, PROP_WIDTH,
+      g_param_spec_uint("width", "Width",
+          "Width of the JPEG, the height keeps the aspect ratio (0 = source width)",
+          0, G_MAXUINT, DEFAULT_WIDTH,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property(object_class, PROP_THREAD_POLICY,
+      g_param_spec_string("thread-policy", "Thread Policy",
+          "Placement of the decode thread",
+          DEFAULT_THREAD_POLICY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property(object_class, PROP_STATS,
+      g_param_spec_boxed("stats", "Statistics",
+          "Keyframes seen, decoded and skipped while idle, requests served from the cache",
+          GST_TYPE_STRUCTURE,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  GST_DEBUG_CATEGORY_INIT (gst_preview_snapshot_debug, "previewsnapshot", 0,
+      "Preview Snapshot Debug");
+
+  gst_element_class_set_static_metadata(element_class,
+                                        "Preview Snapshot",
+                                        "Sink/Video",
+                                        "Keyframe JPEG cache served by the preview server",
+                                        "Ludovic Bouguerra <ludovic.bouguerra@stream.studio>");
+}
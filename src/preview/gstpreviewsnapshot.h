@@ -0,0 +1,24 @@
+#ifndef __GST_PREVIEW_SNAPSHOT_H__
+#define __GST_PREVIEW_SNAPSHOT_H__
+
+#include <gst/gst.h>
+
+#include "gstpreviewserver.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_PREVIEW_SNAPSHOT gst_preview_snapshot_get_type ()
+G_DECLARE_FINAL_TYPE (GstPreviewSnapshot, gst_preview_snapshot, GST, PREVIEW_SNAPSHOT, GstBin)
+
+struct GstPreviewSnapshotClass {
+  GstBinClass parent_class;
+};
+
+gboolean gst_preview_snapshot_attach (GstPreviewSnapshot * snapshot,
+    GstPreviewServer * server, const gchar * engine_id);
+
+void gst_preview_snapshot_detach (GstPreviewSnapshot * snapshot);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,557 @@
+#include "gstrtppacer.h"
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+GST_DEBUG_CATEGORY_STATIC (gst_rtp_pacer_debug);
+#define GST_CAT_DEFAULT gst_rtp_pacer_debug
+
+#define gst_rtp_pacer_parent_class parent_class
+
+#define DEFAULT_BITRATE 0
+#define DEFAULT_MAX_SIZE_PACKETS 1000
+/* credit a flow may build up while idle, a few ms of media */
+#define MAX_BURST_US 5000
+#define MIN_BURST_BYTES 1500
+
+/* properties */
+enum
+{
+  PROP_0,
+  PROP_BITRATE,
+  PROP_MAX_SIZE_PACKETS,
+  PROP_STATS,
+};
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("application/x-rtp"));
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("application/x-rtp"));
+
+typedef struct {
+  GstMiniObject *object;
+  gint64 queued_at;
+} PacerItem;
+
+/* Every pacer of the process is a flow of one scheduler thread. The thread
+ * releases one packet per flow in turn, so the packets of a keyframe sent
+ * to many viewers go out interleaved instead of viewer after viewer, and
+ * each flow only sends while its token bucket, refilled at "bitrate", has
+ * credit. The scheduler only decides the order, each flow pushes the
+ * packet it was released on its own src pad task, so a slow viewer never
+ * holds up the others. All the flow state below is protected by the
+ * scheduler lock. */
+struct _GstRtpPacer
+{
+  GstElement parent_instance;
+
+  GstPad *sinkpad;
+  GstPad *srcpad;
+
+  GQueue items;
+  guint n_packets;
+  /* handed to the src pad task, one at a time */
+  PacerItem *released;
+  GCond cond;
+
+  guint bitrate;
+  guint max_size_packets;
+
+  gdouble budget;
+  gint64 last_refill;
+
+  gboolean flushing;
+  gboolean pushing;
+  GstFlowReturn srcresult;
+
+  guint64 sent;
+  guint64 dropped;
+  guint64 delay_avg;
+  guint64 delay_max;
+};
+
+typedef struct {
+  GMutex lock;
+  GCond cond;
+  GPtrArray *flows;
+  guint next;
+  GThread *thread;
+} GstRtpPacerScheduler;
+
+G_DEFINE_TYPE(GstRtpPacer, gst_rtp_pacer, GST_TYPE_ELEMENT);
+
+static gpointer gst_rtp_pacer_scheduler_loop(gpointer data);
+
+static GstRtpPacerScheduler *gst_rtp_pacer_scheduler_get(void)
+{
+  static gsize once = 0;
+  static GstRtpPacerScheduler scheduler;
+
+  if (g_once_init_enter(&once)){
+    g_mutex_init(&scheduler.lock);
+    g_cond_init(&scheduler.cond);
+    scheduler.flows = g_ptr_array_new();
+    scheduler.thread = g_thread_new("rtppacer", gst_rtp_pacer_scheduler_loop, &scheduler);
+    g_once_init_leave(&once, 1);
+  }
+
+  return &scheduler;
+}
+
+static void gst_rtp_pacer_item_free(PacerItem *item)
+{
+  gst_mini_object_unref(item->object);
+  g_slice_free(PacerItem, item);
+}
+
+/* called with the scheduler lock */
+static void gst_rtp_pacer_clear(GstRtpPacer *self)
+{
+  PacerItem *item;
+
+  while ((item = g_queue_pop_head(&self->items)) != NULL)
+    gst_rtp_pacer_item_free(item);
+  g_clear_pointer(&self->released, gst_rtp_pacer_item_free);
+  self->n_packets = 0;
+}
+
+/* called with the scheduler lock */
+static void gst_rtp_pacer_refill(GstRtpPacer *self, gint64 now)
+{
+  gdouble rate = self->bitrate / 8.0;
+  gdouble burst = MAX(rate * MAX_BURST_US / G_USEC_PER_SEC, MIN_BURST_BYTES);
+
+  gint64 elapsed = now - self->last_refill;
+
+  self->last_refill = now;
+  /* an unpaced flow owes nothing once it gets a rate */
+  if (self->bitrate == 0){
+    self->budget = 0;
+    return;
+  }
+
+  self->budget += rate * elapsed / G_USEC_PER_SEC;
+  self->budget = MIN(self->budget, burst);
+}
+
+/* called with the scheduler lock, returns the time the head item may be
+ * sent at, now when it can go right away */
+static gint64 gst_rtp_pacer_ready_time(GstRtpPacer *self, gint64 now)
+{
+  PacerItem *head = g_queue_peek_head(&self->items);
+
+  /* a flow still sending its last packet signals when done */
+  if (head == NULL || self->released || self->pushing)
+    return G_MAXINT64;
+
+  /* events and unpaced flows never wait */
+  if (!GST_IS_BUFFER(head->object) || self->bitrate == 0 || self->budget >= 0)
+    return now;
+
+  return now + (gint64) (-self->budget * 8 * G_USEC_PER_SEC / self->bitrate) + 1;
+}
+
+static gpointer gst_rtp_pacer_scheduler_loop(gpointer data)
+{
+  GstRtpPacerScheduler *scheduler = data;
+
+  g_mutex_lock(&scheduler->lock);
+
+  while (TRUE){
+    gint64 now = g_get_monotonic_time();
+    gint64 wakeup = G_MAXINT64;
+    GstRtpPacer *flow = NULL;
+    guint n = scheduler->flows->len;
+    PacerItem *item;
+
+    /* round robin, one item per flow */
+    for (guint i = 0; i < n; i++){
+      guint index = (scheduler->next + i) % n;
+      GstRtpPacer *candidate = g_ptr_array_index(scheduler->flows, index);
+      gint64 ready;
+
+      gst_rtp_pacer_refill(candidate, now);
+      ready = gst_rtp_pacer_ready_time(candidate, now);
+      if (ready <= now){
+        flow = candidate;
+        scheduler->next = index + 1;
+        break;
+      }
+      wakeup = MIN(wakeup, ready);
+    }
+
+    if (flow == NULL){
+      if (wakeup == G_MAXINT64)
+        g_cond_wait(&scheduler->cond, &scheduler->lock);
+      else
+        g_cond_wait_until(&scheduler->cond, &scheduler->lock, wakeup);
+      continue;
+    }
+
+    item = g_queue_pop_head(&flow->items);
+    if (GST_IS_BUFFER(item->object)){
+      guint64 delay = (now - item->queued_at) * GST_USECOND;
+
+      flow->n_packets--;
+      if (flow->bitrate > 0)
+        flow->budget -= gst_buffer_get_size(GST_BUFFER(item->object));
+      flow->sent++;
+      flow->delay_avg = flow->sent == 1 ? delay : (flow->delay_avg * 15 + delay) / 16;
+      flow->delay_max = MAX(flow->delay_max, delay);
+    }
+
+    flow->released = item;
+    g_cond_signal(&flow->cond);
+  }
+
+  return NULL;
+}
+
+/* src pad task, pushes what the scheduler released to this flow */
+static void gst_rtp_pacer_loop(gpointer data)
+{
+  GstRtpPacer *self = GST_RTP_PACER(data);
+  GstRtpPacerScheduler *scheduler = gst_rtp_pacer_scheduler_get();
+  GstFlowReturn ret = GST_FLOW_OK;
+  PacerItem *item;
+
+  g_mutex_lock(&scheduler->lock);
+  while (self->released == NULL && !self->flushing)
+    g_cond_wait(&self->cond, &scheduler->lock);
+  if (self->flushing){
+    g_mutex_unlock(&scheduler->lock);
+    gst_pad_pause_task(self->srcpad);
+    return;
+  }
+  item = self->released;
+  self->released = NULL;
+  self->pushing = TRUE;
+  g_mutex_unlock(&scheduler->lock);
+
+  if (GST_IS_BUFFER(item->object)){
+    ret = gst_pad_push(self->srcpad, GST_BUFFER(item->object));
+  } else {
+    if (GST_EVENT_TYPE(item->object) == GST_EVENT_EOS)
+      ret = GST_FLOW_EOS;
+    gst_pad_push_event(self->srcpad, GST_EVENT(item->object));
+  }
+  g_slice_free(PacerItem, item);
+
+  g_mutex_lock(&scheduler->lock);
+  if (ret != GST_FLOW_OK && !self->flushing){
+    GST_DEBUG_OBJECT(self, "Downstream returned %s", gst_flow_get_name(ret));
+    self->srcresult = ret;
+  }
+  self->pushing = FALSE;
+  g_cond_signal(&scheduler->cond);
+  g_mutex_unlock(&scheduler->lock);
+
+  if (ret != GST_FLOW_OK)
+    gst_pad_pause_task(self->srcpad);
+}
+
+static GstFlowReturn gst_rtp_pacer_queue(GstRtpPacer *self, GstMiniObject *object)
+{
+  GstRtpPacerScheduler *scheduler = gst_rtp_pacer_scheduler_get();
+  PacerItem *item;
+  GstFlowReturn ret;
+
+  g_mutex_lock(&scheduler->lock);
+
+  if (self->flushing){
+    ret = GST_FLOW_FLUSHING;
+    gst_mini_object_unref(object);
+    goto done;
+  }
+  if (self->srcresult != GST_FLOW_OK){
+    ret = self->srcresult;
+    gst_mini_object_unref(object);
+    goto done;
+  }
+
+  if (GST_IS_BUFFER(object)){
+    /* a viewer far behind its estimate loses its oldest packets, NACK and
+     * the next keyframe recover them */
+    while (self->n_packets >= self->max_size_packets){
+      for (GList *l = self->items.head; l != NULL; l = l->next){
+        PacerItem *old = l->data;
+
+        if (GST_IS_BUFFER(old->object)){
+          gst_mini_object_unref(old->object);
+          g_slice_free(PacerItem, old);
+          g_queue_delete_link(&self->items, l);
+          self->n_packets--;
+          self->dropped++;
+          break;
+        }
+      }
+    }
+    self->n_packets++;
+  }
+
+  item = g_slice_new(PacerItem);
+  item->object = object;
+  item->queued_at = g_get_monotonic_time();
+  g_queue_push_tail(&self->items, item);
+  g_cond_signal(&scheduler->cond);
+  ret = GST_FLOW_OK;
+
+done:
+  g_mutex_unlock(&scheduler->lock);
+
+  return ret;
+}
+
+static GstFlowReturn gst_rtp_pacer_chain(GstPad *pad, GstObject *parent, GstBuffer *buffer)
+{
+  return gst_rtp_pacer_queue(GST_RTP_PACER(parent), GST_MINI_OBJECT_CAST(buffer));
+}
+
+/* payloaders push a fragmented frame as one list, it is paced packet by
+ * packet */
+static GstFlowReturn gst_rtp_pacer_chain_list(GstPad *pad, GstObject *parent, GstBufferList *list)
+{
+  GstRtpPacer *self = GST_RTP_PACER(parent);
+  guint n = gst_buffer_list_length(list);
+  GstFlowReturn ret = GST_FLOW_OK;
+
+  for (guint i = 0; i < n && ret == GST_FLOW_OK; i++)
+    ret = gst_rtp_pacer_queue(self, GST_MINI_OBJECT_CAST(gst_buffer_ref(gst_buffer_list_get(list, i))));
+  gst_buffer_list_unref(list);
+
+  return ret;
+}
+
+static void gst_rtp_pacer_set_flushing(GstRtpPacer *self, gboolean flushing)
+{
+  GstRtpPacerScheduler *scheduler = gst_rtp_pacer_scheduler_get();
+
+  g_mutex_lock(&scheduler->lock);
+  self->flushing = flushing;
+  if (flushing){
+    gst_rtp_pacer_clear(self);
+    self->srcresult = GST_FLOW_FLUSHING;
+    /* wakes the src pad task up, to pause */
+    g_cond_signal(&self->cond);
+  } else {
+    self->srcresult = GST_FLOW_OK;
+  }
+  g_mutex_unlock(&scheduler->lock);
+}
+
+static gboolean gst_rtp_pacer_sink_event(GstPad *pad, GstObject *parent, GstEvent *event)
+{
+  GstRtpPacer *self = GST_RTP_PACER(parent);
+
+  switch (GST_EVENT_TYPE(event)){
+    case GST_EVENT_FLUSH_START:
+      gst_pad_push_event(self->srcpad, event);
+      gst_rtp_pacer_set_flushing(self, TRUE);
+      gst_pad_pause_task(self->srcpad);
+      return TRUE;
+    case GST_EVENT_FLUSH_STOP:
+      gst_rtp_pacer_set_flushing(self, FALSE);
+      if (!gst_pad_push_event(self->srcpad, event))
+        return FALSE;
+      return gst_pad_start_task(self->srcpad, gst_rtp_pacer_loop, self, NULL);
+    default:
+      break;
+  }
+
+  if (!GST_EVENT_IS_SERIALIZED(event))
+    return gst_pad_push_event(self->srcpad, event);
+
+  return gst_rtp_pacer_queue(self, GST_MINI_OBJECT_CAST(event)) == GST_FLOW_OK;
+}
+
+static gboolean gst_rtp_pacer_src_activate_mode(GstPad *pad, GstObject *parent, GstPadMode mode, gboolean active)
+{
+  GstRtpPacer *self = GST_RTP_PACER(parent);
+
+  if (mode != GST_PAD_MODE_PUSH)
+    return FALSE;
+
+  if (active){
+    gst_rtp_pacer_set_flushing(self, FALSE);
+    return gst_pad_start_task(pad, gst_rtp_pacer_loop, self, NULL);
+  }
+
+  gst_rtp_pacer_set_flushing(self, TRUE);
+  return gst_pad_stop_task(pad);
+}
+
+static GstStateChangeReturn gst_rtp_pacer_change_state(GstElement *element, GstStateChange transition)
+{
+  GstRtpPacer *self = GST_RTP_PACER(element);
+  GstRtpPacerScheduler *scheduler = gst_rtp_pacer_scheduler_get();
+  GstStateChangeReturn ret;
+
+  switch (transition){
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+      g_mutex_lock(&scheduler->lock);
+      self->budget = 0;
+      self->last_refill = g_get_monotonic_time();
+      g_ptr_array_add(scheduler->flows, self);
+      g_mutex_unlock(&scheduler->lock);
+      break;
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      g_mutex_lock(&scheduler->lock);
+      g_ptr_array_remove(scheduler->flows, self);
+      g_mutex_unlock(&scheduler->lock);
+      break;
+    default:
+      break;
+  }
+
+  ret = GST_ELEMENT_CLASS(parent_class)->change_state(element, transition);
+
+  return ret;
+}
+
+static GstStructure *gst_rtp_pacer_get_stats(GstRtpPacer *self)
+{
+  GstRtpPacerScheduler *scheduler = gst_rtp_pacer_scheduler_get();
+  GstStructure *stats;
+
+  g_mutex_lock(&scheduler->lock);
+  stats = gst_structure_new("rtppacer-stats",
+      "bitrate", G_TYPE_UINT, self->bitrate,
+      "queued-packets", G_TYPE_UINT, self->n_packets,
+      "sent-packets", G_TYPE_UINT64, self->sent,
+      "dropped", G_TYPE_UINT64, self->dropped,
+      "queue-delay", G_TYPE_UINT64, self->delay_avg,
+      "max-queue-delay", G_TYPE_UINT64, self->delay_max,
+      "flows", G_TYPE_UINT, scheduler->flows->len,
+      NULL);
+  g_mutex_unlock(&scheduler->lock);
+
+  return stats;
+}
+
+static void gst_rtp_pacer_init(GstRtpPacer *self)
+{
+  self->sinkpad = gst_pad_new_from_static_template(&sink_template, "sink");
+  gst_pad_set_chain_function(self->sinkpad, gst_rtp_pacer_chain);
+  gst_pad_set_chain_list_function(self->sinkpad, gst_rtp_pacer_chain_list);
+  gst_pad_set_event_function(self->sinkpad, gst_rtp_pacer_sink_event);
+  GST_PAD_SET_PROXY_CAPS(self->sinkpad);
+  GST_PAD_SET_PROXY_ALLOCATION(self->sinkpad);
+  gst_element_add_pad(GST_ELEMENT(self), self->sinkpad);
+
+  self->srcpad = gst_pad_new_from_static_template(&src_template, "src");
+  gst_pad_set_activatemode_function(self->srcpad, gst_rtp_pacer_src_activate_mode);
+  GST_PAD_SET_PROXY_CAPS(self->srcpad);
+  gst_element_add_pad(GST_ELEMENT(self), self->srcpad);
+
+  g_queue_init(&self->items);
+  g_cond_init(&self->cond);
+
+  self->bitrate = DEFAULT_BITRATE;
+  self->max_size_packets = DEFAULT_MAX_SIZE_PACKETS;
+  self->flushing = TRUE;
+  self->srcresult = GST_FLOW_FLUSHING;
+}
+
+static void gst_rtp_pacer_set_property(GObject *object,
+                                       guint prop_id,
+                                       const GValue *value,
+                                       GParamSpec *pspec){
+    GstRtpPacer *self = GST_RTP_PACER(object);
+    GstRtpPacerScheduler *scheduler = gst_rtp_pacer_scheduler_get();
+
+    switch (prop_id) {
+        case PROP_BITRATE:
+            g_mutex_lock(&scheduler->lock);
+            self->bitrate = g_value_get_uint(value);
+            g_cond_signal(&scheduler->cond);
+            g_mutex_unlock(&scheduler->lock);
+            break;
+        case PROP_MAX_SIZE_PACKETS:
+            g_mutex_lock(&scheduler->lock);
+            self->max_size_packets = g_value_get_uint(value);
+            g_mutex_unlock(&scheduler->lock);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+}
+
+static void gst_rtp_pacer_get_property(GObject *object,
+                                       guint prop_id,
+                                       GValue *value,
+                                       GParamSpec *pspec){
+    GstRtpPacer *self = GST_RTP_PACER(object);
+
+    switch (prop_id) {
+        case PROP_BITRATE:
+            g_value_set_uint(value, self->bitrate);
+            break;
+        case PROP_MAX_SIZE_PACKETS:
+            g_value_set_uint(value, self->max_size_packets);
+            break;
+        case PROP_STATS:
+            g_value_take_boxed(value, gst_rtp_pacer_get_stats(self));
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+}
+
+static void gst_rtp_pacer_finalize(GObject *object)
+{
+  GstRtpPacer *self = GST_RTP_PACER(object);
+
+  gst_rtp_pacer_clear(self);
+  g_cond_clear(&self->cond);
+
+  G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
+static void gst_rtp_pacer_class_init(GstRtpPacerClass *klass)
+{
+  GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+  GObjectClass *object_class = G_OBJECT_CLASS(klass);
+
+  object_class->set_property = gst_rtp_pacer_set_property;
+  object_class->get_property = gst_rtp_pacer_get_property;
+  object_class->finalize = gst_rtp_pacer_finalize;
+  element_class->change_state = gst_rtp_pacer_change_state;
+
+  g_object_class_install_property(object_class, PROP_BITRATE,
+      g_param_spec_uint("bitrate", "Bitrate",
+          "Pacing rate in bits per second, 0 sends as fast as the shared scheduler goes",
+          0, G_MAXUINT, DEFAULT_BITRATE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(object_class, PROP_MAX_SIZE_PACKETS,
+      g_param_spec_uint("max-size-packets", "Max size packets",
+          "Packets held before the oldest ones are dropped",
+          1, G_MAXUINT, DEFAULT_MAX_SIZE_PACKETS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(object_class, PROP_STATS,
+      g_param_spec_boxed("stats", "Statistics",
+          "Pacing rate, queue depth, drops and queueing delay in ns",
+          GST_TYPE_STRUCTURE,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  gst_element_class_add_static_pad_template(element_class, &sink_template);
+  gst_element_class_add_static_pad_template(element_class, &src_template);
+
+  GST_DEBUG_CATEGORY_INIT (gst_rtp_pacer_debug, "rtppacer", 0,
+      "RTP Pacer Debug");
+
+  gst_element_class_set_static_metadata(element_class,
+                                        "RTP Pacer",
+                                        "Network",
+                                        "Spreads RTP bursts over time, interleaving the flows of all viewers",
+                                        "Ludovic Bouguerra <ludovic.bouguerra@stream.studio>");
+}
@@ -0,0 +1,17 @@
+#ifndef __GST_RTP_PACER_H__
+#define __GST_RTP_PACER_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_RTP_PACER gst_rtp_pacer_get_type ()
+G_DECLARE_FINAL_TYPE (GstRtpPacer, gst_rtp_pacer, GST, RTP_PACER, GstElement)
+
+struct GstRtpPacerClass {
+  GstElementClass parent_class;
+};
+
+G_END_DECLS
+
+#endif
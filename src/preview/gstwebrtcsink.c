@@ -7,8 +7,22 @@
 #define GST_USE_UNSTABLE_API
 #include <gst/webrtc/webrtc.h>
 
+#include "gstpreviewcodec.h"
+
 #define DEFAULT_TURN_SERVER ""
 #define DEFAULT_STUN_SERVER ""
+#define DEFAULT_RTX TRUE
+#define DEFAULT_RTX_MAX_PACKETS 600
+#define DEFAULT_RTX_MAX_TIME 1000
+#define DEFAULT_FEC_PERCENTAGE 0
+#define VIDEO_PT 96
+#define AUDIO_PT 97
+#define DEFAULT_START_BITRATE 2000000
+#define DEFAULT_MIN_BITRATE 150000
+#define DEFAULT_MAX_BITRATE 8000000
+/* the pacer drains above the estimate, it smooths bursts without adding
+ * steady state delay */
+#define PACING_FACTOR 2.5
 
 
 /* properties */
@@ -16,7 +30,17 @@ enum
 {
   PROP_0,
   PROP_STUN_SERVER,
-  PROP_TURN_SERVER
+  PROP_TURN_SERVER,
+  PROP_ICE_MIN_PORT,
+  PROP_ICE_MAX_PORT,
+  PROP_RTX,
+  PROP_RTX_MAX_PACKETS,
+  PROP_RTX_MAX_TIME,
+  PROP_FEC_PERCENTAGE,
+  PROP_START_BITRATE,
+  PROP_MIN_BITRATE,
+  PROP_MAX_BITRATE,
+  PROP_STATS
 };
 
 
@@ -43,20 +67,234 @@ struct _GstWebrtcSink
   GstElement *aqueue;
   GstElement *vqueue;
 
-  GstElement *h264parse;
+  /* built from the upstream caps */
+  const GstPreviewCodec *video_codec;
+  GstElement *vparse;
   GstElement *opusparse;
 
-  GstElement *rtph264pay;
+  GstElement *vpay;
   GstElement *rtpopuspay;
+  GstElement *vpacer;
 
 
   GstElement *webrtcbin;
+
+  /* loss recovery profile, negotiated in the offer */
+  gboolean rtx;
+  guint rtx_max_packets;
+  guint rtx_max_time;
+  guint fec_percentage;
+
+  /* created by webrtcbin, protected by the object lock */
+  GList *rtx_senders;
+  guint64 fec_media_packets;
+  guint64 fec_output_packets;
+
+  /* loss based bandwidth estimate driving the pacer */
+  guint min_bitrate;
+  guint max_bitrate;
+  guint estimated_bitrate;
+  gdouble fraction_lost;
 };
 
 G_DEFINE_TYPE(GstWebrtcSink, gst_webrtc_sink, GST_TYPE_BIN);
 
 
 
+/* Applied before the offer is created so NACK, RTX and ULPFEC/RED payloads
+ * show up in the SDP */
+static void gst_webrtc_sink_apply_profile(GstWebrtcSink *self)
+{
+  GArray *transceivers = NULL;
+
+  g_signal_emit_by_name (self->webrtcbin, "get-transceivers", &transceivers);
+  if (!transceivers)
+    return;
+
+  for (guint i = 0; i < transceivers->len; i++) {
+    GstWebRTCRTPTransceiver *trans = g_array_index (transceivers, GstWebRTCRTPTransceiver *, i);
+    GstWebRTCKind kind = GST_WEBRTC_KIND_UNKNOWN;
+    guint fec_percentage;
+
+    g_object_get (trans, "kind", &kind, NULL);
+    /* the kind is only known once caps flowed, video is linked first */
+    if (kind == GST_WEBRTC_KIND_UNKNOWN)
+      kind = i == 0 ? GST_WEBRTC_KIND_VIDEO : GST_WEBRTC_KIND_AUDIO;
+    /* Opus has its own in-band FEC */
+    fec_percentage = kind == GST_WEBRTC_KIND_VIDEO ? self->fec_percentage : 0;
+
+    g_object_set (trans, "do-nack", self->rtx,
+        "fec-type", fec_percentage ? GST_WEBRTC_FEC_TYPE_ULP_RED : GST_WEBRTC_FEC_TYPE_NONE,
+        "fec-percentage", fec_percentage,
+        NULL);
+  }
+
+  g_array_unref (transceivers);
+}
+
+static GstPadProbeReturn
+count_packets_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  GstWebrtcSink *self = GST_WEBRTC_SINK(user_data);
+  guint n = 1;
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER_LIST)
+    n = gst_buffer_list_length (GST_PAD_PROBE_INFO_BUFFER_LIST (info));
+
+  GST_OBJECT_LOCK (self);
+  if (GST_PAD_IS_SINK (pad))
+    self->fec_media_packets += n;
+  else
+    self->fec_output_packets += n;
+  GST_OBJECT_UNLOCK (self);
+
+  return GST_PAD_PROBE_OK;
+}
+
+static void gst_webrtc_sink_set_estimate(GstWebrtcSink *self, guint bitrate)
+{
+  GST_OBJECT_LOCK (self);
+  self->estimated_bitrate = CLAMP (bitrate, self->min_bitrate, self->max_bitrate);
+  bitrate = self->estimated_bitrate;
+  GST_OBJECT_UNLOCK (self);
+
+  if (self->vpacer)
+    g_object_set (self->vpacer, "bitrate", (guint) (bitrate * PACING_FACTOR), NULL);
+}
+
+/* Loss based controller of GCC: back off when the receiver reports more
+ * than 10% loss, probe up below 2%, hold in between. Called for every RTCP
+ * packet of the viewer, i.e. at the receiver report rate. */
+static void
+on_ssrc_active_cb (GstElement * rtpbin, guint session_id, guint ssrc, gpointer user_data)
+{
+  GstWebrtcSink *self = GST_WEBRTC_SINK(user_data);
+  GObject *session = NULL;
+  GstStructure *stats = NULL;
+  GValueArray *sources;
+  guint fraction_lost = 0;
+  gboolean have_rb = FALSE;
+  gdouble loss, bitrate;
+
+  g_signal_emit_by_name (rtpbin, "get-internal-session", session_id, &session);
+  if (!session)
+    return;
+  g_object_get (session, "stats", &stats, NULL);
+  g_object_unref (session);
+  if (!stats)
+    return;
+
+  /* the report blocks about our own senders, the worst one counts,
+   * rtpsession still hands the sources out as a GValueArray */
+  G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+  sources = g_value_get_boxed (gst_structure_get_value (stats, "source-stats"));
+  for (guint i = 0; sources && i < sources->n_values; i++) {
+    const GstStructure *source = gst_value_get_structure (g_value_array_get_nth (sources, i));
+    gboolean internal = FALSE, source_have_rb = FALSE;
+    guint source_lost = 0;
+
+    gst_structure_get (source, "internal", G_TYPE_BOOLEAN, &internal,
+        "have-rb", G_TYPE_BOOLEAN, &source_have_rb, NULL);
+    if (!internal || !source_have_rb)
+      continue;
+
+    gst_structure_get_uint (source, "rb-fractionlost", &source_lost);
+    fraction_lost = MAX (fraction_lost, source_lost);
+    have_rb = TRUE;
+  }
+  G_GNUC_END_IGNORE_DEPRECATIONS
+  gst_structure_free (stats);
+
+  if (!have_rb)
+    return;
+
+  loss = fraction_lost / 256.0;
+  GST_OBJECT_LOCK (self);
+  self->fraction_lost = loss;
+  bitrate = self->estimated_bitrate;
+  GST_OBJECT_UNLOCK (self);
+
+  if (loss > 0.10)
+    bitrate *= 1.0 - 0.5 * loss;
+  else if (loss < 0.02)
+    bitrate *= 1.08;
+
+  GST_LOG_OBJECT (self, "Receiver reports %.1f%% loss, estimate %u bps", loss * 100, (guint) bitrate);
+  gst_webrtc_sink_set_estimate (self, (guint) bitrate);
+}
+
+static void
+on_deep_element_added_cb (GstBin * bin, GstBin * sub_bin, GstElement * element, gpointer user_data)
+{
+  GstWebrtcSink *self = GST_WEBRTC_SINK(user_data);
+  GstElementFactory *factory = gst_element_get_factory (element);
+  const gchar *name = factory ? GST_OBJECT_NAME (factory) : NULL;
+
+  if (g_strcmp0 (name, "rtpbin") == 0) {
+    g_signal_connect (element, "on-ssrc-active", G_CALLBACK (on_ssrc_active_cb), self);
+  } else if (g_strcmp0 (name, "rtprtxsend") == 0) {
+    /* bounded retransmission history per peer */
+    g_object_set (element, "max-size-packets", self->rtx_max_packets,
+        "max-size-time", self->rtx_max_time, NULL);
+
+    GST_OBJECT_LOCK (self);
+    self->rtx_senders = g_list_prepend (self->rtx_senders, gst_object_ref (element));
+    GST_OBJECT_UNLOCK (self);
+  } else if (g_strcmp0 (name, "rtpulpfecenc") == 0) {
+    /* the encoder forwards the media packets and adds the FEC ones */
+    GstPad *pad = gst_element_get_static_pad (element, "sink");
+    gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+        count_packets_probe, self, NULL);
+    gst_object_unref (pad);
+
+    pad = gst_element_get_static_pad (element, "src");
+    gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+        count_packets_probe, self, NULL);
+    gst_object_unref (pad);
+  }
+}
+
+static GstStructure *gst_webrtc_sink_get_stats(GstWebrtcSink *self)
+{
+  guint64 rtx_requests = 0, rtx_packets = 0;
+  guint64 media, output;
+  GstStructure *stats, *pacer = NULL;
+
+  GST_OBJECT_LOCK (self);
+  for (GList *l = self->rtx_senders; l != NULL; l = l->next) {
+    guint requests = 0, packets = 0;
+
+    g_object_get (l->data, "num-rtx-requests", &requests, "num-rtx-packets", &packets, NULL);
+    rtx_requests += requests;
+    rtx_packets += packets;
+  }
+  media = self->fec_media_packets;
+  output = self->fec_output_packets;
+  GST_OBJECT_UNLOCK (self);
+
+  if (self->vpacer)
+    g_object_get (self->vpacer, "stats", &pacer, NULL);
+
+  stats = gst_structure_new ("webrtcsink-stats",
+      "rtx-requests", G_TYPE_UINT64, rtx_requests,
+      "rtx-packets", G_TYPE_UINT64, rtx_packets,
+      "rtx-hit-rate", G_TYPE_DOUBLE, rtx_requests ? (gdouble) rtx_packets / rtx_requests : 0.0,
+      "fec-percentage", G_TYPE_UINT, self->fec_percentage,
+      "fec-packets", G_TYPE_UINT64, output > media ? output - media : 0,
+      "fec-overhead", G_TYPE_DOUBLE, media && output > media ? (gdouble) (output - media) / media : 0.0,
+      "estimated-bitrate", G_TYPE_UINT, self->estimated_bitrate,
+      "fraction-lost", G_TYPE_DOUBLE, self->fraction_lost,
+      "video-codec", G_TYPE_STRING, self->video_codec ? self->video_codec->encoding_name : NULL,
+      NULL);
+
+  if (pacer) {
+    gst_structure_set (stats, "pacer", GST_TYPE_STRUCTURE, pacer, NULL);
+    gst_structure_free (pacer);
+  }
+
+  return stats;
+}
+
 static void
 on_ice_candidate_cb (GstElement * webrtcbin, guint mline_index,
     gchar * candidate, gpointer user_data)
@@ -187,6 +425,81 @@ on_negotiation_needed_cb (GstElement * webrtcbin, gpointer user_data)
 }
 
 
+static gboolean gst_webrtc_sink_build_video_chain(GstWebrtcSink *self, const GstPreviewCodec *codec)
+{
+  GstElement *parse = NULL;
+  GstElement *pay = gst_preview_codec_make_payloader(codec, VIDEO_PT);
+
+  if (codec->parser)
+    parse = gst_element_factory_make(codec->parser, "vparse");
+
+  if (!pay || (codec->parser && !parse)) {
+    GST_ERROR_OBJECT(self, "Missing %s or %s for %s", codec->payloader,
+        codec->parser ? codec->parser : "(no parser)", codec->encoding_name);
+    if (pay)
+      gst_object_unref(pay);
+    if (parse)
+      gst_object_unref(parse);
+    return FALSE;
+  }
+
+  gst_bin_add(GST_BIN(self), pay);
+  if (!gst_element_link(pay, self->vpacer))
+    return FALSE;
+  gst_element_sync_state_with_parent(pay);
+
+  if (parse) {
+    gst_bin_add(GST_BIN(self), parse);
+    if (!gst_element_link_many(self->vqueue, parse, pay, NULL))
+      return FALSE;
+    gst_element_sync_state_with_parent(parse);
+  } else if (!gst_element_link(self->vqueue, pay)) {
+    return FALSE;
+  }
+
+  self->vparse = parse;
+  self->vpay = pay;
+  self->video_codec = codec;
+  GST_INFO_OBJECT(self, "Sending %s video through %s", codec->encoding_name, codec->payloader);
+
+  return TRUE;
+}
+
+/* The parser and payloader are picked from the first caps; the caps event
+ * then flows into the new chain. webrtcbin holds the offer back until its
+ * video pad has caps, so the SDP carries the upstream codec. */
+static GstPadProbeReturn
+on_video_caps_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  GstWebrtcSink *self = GST_WEBRTC_SINK(user_data);
+  GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+  const GstPreviewCodec *codec;
+  GstCaps *caps;
+
+  if (GST_EVENT_TYPE (event) != GST_EVENT_CAPS)
+    return GST_PAD_PROBE_OK;
+
+  gst_event_parse_caps (event, &caps);
+  codec = gst_preview_codec_from_caps (caps);
+
+  if (self->video_codec) {
+    if (codec != self->video_codec)
+      GST_WARNING_OBJECT (self, "Video codec changed to %" GST_PTR_FORMAT ", still sending %s",
+          caps, self->video_codec->encoding_name);
+    return GST_PAD_PROBE_OK;
+  }
+
+  if (!codec) {
+    GST_ELEMENT_ERROR (self, STREAM, CODEC_NOT_FOUND, (NULL),
+        ("No RTP payloader for %" GST_PTR_FORMAT, caps));
+  } else if (!gst_webrtc_sink_build_video_chain (self, codec)) {
+    GST_ELEMENT_ERROR (self, CORE, MISSING_PLUGIN, (NULL),
+        ("Cannot payload %s video", codec->encoding_name));
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
 static void gst_webrtc_sink_init(GstWebrtcSink *self)
 {
   GstBin *bin = GST_BIN(self);
@@ -211,59 +524,76 @@ static void gst_webrtc_sink_init(GstWebrtcSink *self)
   
   GST_INFO("Created audio and video queues");
 
-  self->h264parse = gst_element_factory_make("h264parse", "h264parse");
   self->opusparse = gst_element_factory_make("opusparse", "opusparse");
-  if (!self->h264parse || !self->opusparse) {
-    GST_ERROR("Failed to create parsers");
+  if (!self->opusparse) {
+    GST_ERROR("Failed to create Opus parser");
     return;
   }
 
-  GST_INFO("Created H264 and Opus parsers");
+  GST_INFO("Created Opus parser");
 
-  self->rtph264pay = gst_element_factory_make("rtph264pay", "rtph264pay");
   self->rtpopuspay = gst_element_factory_make("rtpopuspay", "opuspay");
-  if (!self->rtph264pay || !self->rtpopuspay) {
-    GST_ERROR("Failed to create RTP payloaders");
+  if (!self->rtpopuspay) {
+    GST_ERROR("Failed to create Opus RTP payloader");
     return;
   }
 
-  GST_INFO("Created RTP payloaders");
+  GST_INFO("Created Opus RTP payloader, video payloader follows the caps");
+
+  // Keyframe bursts are spread according to the bandwidth estimate
+  self->vpacer = gst_element_factory_make("rtppacer", "vpacer");
+  if (!self->vpacer) {
+    GST_ERROR("Failed to create RTP pacer");
+    return;
+  }
 
   self->webrtcbin = gst_element_factory_make("webrtcbin", NULL);
   if (!self->webrtcbin) {
     GST_ERROR("Failed to create webrtcbin");
     return;
   }
-  //g_object_set(self->webrtcbin, "bundle-policy", GST_WEBRTC_BUNDLE_POLICY_MAX_BUNDLE, NULL);
+  // One ICE/DTLS transport for audio and video
+  g_object_set(self->webrtcbin, "bundle-policy", GST_WEBRTC_BUNDLE_POLICY_MAX_BUNDLE, NULL);
+
+  self->rtx = DEFAULT_RTX;
+  self->rtx_max_packets = DEFAULT_RTX_MAX_PACKETS;
+  self->rtx_max_time = DEFAULT_RTX_MAX_TIME;
+  self->fec_percentage = DEFAULT_FEC_PERCENTAGE;
+  self->min_bitrate = DEFAULT_MIN_BITRATE;
+  self->max_bitrate = DEFAULT_MAX_BITRATE;
+  gst_webrtc_sink_set_estimate(self, DEFAULT_START_BITRATE);
+  g_signal_connect (self, "deep-element-added",
+      G_CALLBACK (on_deep_element_added_cb), self);
 
   GST_INFO("Created webrtcbin element");
     
   gst_bin_add_many(bin, self->aqueue, self->opusparse, self->rtpopuspay,
-                                          self->vqueue, self->h264parse, self->rtph264pay,
+                                          self->vqueue, self->vpacer,
                                           self->webrtcbin, 
                                           NULL);
 
   GST_INFO("Added elements to bin");
 
-  gst_element_link_many(self->vqueue, self->h264parse, self->rtph264pay, NULL);
   gst_element_link_many(self->aqueue, self->opusparse, self->rtpopuspay, NULL);
 
-  GST_INFO("Linked video and audio pipelines");
+  GST_INFO("Linked audio pipeline");
 
-  GstCaps *caps = gst_caps_new_simple ("application/x-rtp",
-     "media", G_TYPE_STRING, "video",
-     "encoding-name", G_TYPE_STRING, "H264",
-     "payload", G_TYPE_INT, 96,
-        NULL);
+  // The video transceiver comes first, its codec is known once caps arrive
+  GstPad *vsinkpad = gst_element_request_pad_simple(self->webrtcbin, "sink_%u");
+  GstPad *vsrcpad = gst_element_get_static_pad(self->vpacer, "src");
+  gst_pad_link(vsrcpad, vsinkpad);
+  gst_object_unref(vsrcpad);
+  gst_object_unref(vsinkpad);
 
-  GST_DEBUG("Linking video RTP payloader to webrtcbin");
-  gst_element_link_filtered(self->rtph264pay, self->webrtcbin, caps);
-  gst_caps_unref(caps);
+  vsrcpad = gst_element_get_static_pad(self->vqueue, "src");
+  gst_pad_add_probe(vsrcpad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+      on_video_caps_probe, self, NULL);
+  gst_object_unref(vsrcpad);
 
-  caps = gst_caps_new_simple ("application/x-rtp",
+  GstCaps *caps = gst_caps_new_simple ("application/x-rtp",
      "media", G_TYPE_STRING, "audio",
      "encoding-name", G_TYPE_STRING, "OPUS",
-     "payload", G_TYPE_INT, 97,
+     "payload", G_TYPE_INT, AUDIO_PT,
         NULL);
 
   GST_DEBUG("Linking audio RTP payloader to webrtcbin");
@@ -283,6 +613,9 @@ static void gst_webrtc_sink_init(GstWebrtcSink *self)
       g_object_set (trans, "direction",
           GST_WEBRTC_RTP_TRANSCEIVER_DIRECTION_SENDONLY, NULL);
   }
+  g_array_unref (transceivers);
+
+  gst_webrtc_sink_apply_profile(self);
 
   GST_INFO("Connecting WebRTC signals");
 
@@ -345,6 +678,39 @@ static void gst_webrtc_sink_set_property(GObject *object,
         case PROP_TURN_SERVER:
             g_object_set_property(G_OBJECT(self->webrtcbin), "turn-server", value);
             break;      
+        case PROP_ICE_MIN_PORT:
+        case PROP_ICE_MAX_PORT:{
+            GObject *ice = NULL;
+            g_object_get(self->webrtcbin, "ice-agent", &ice, NULL);
+            if (ice) {
+                g_object_set_property(ice, prop_id == PROP_ICE_MIN_PORT ? "min-rtp-port" : "max-rtp-port", value);
+                g_object_unref(ice);
+            }
+            break;
+        }
+        case PROP_RTX:
+            self->rtx = g_value_get_boolean(value);
+            gst_webrtc_sink_apply_profile(self);
+            break;
+        case PROP_RTX_MAX_PACKETS:
+            self->rtx_max_packets = g_value_get_uint(value);
+            break;
+        case PROP_RTX_MAX_TIME:
+            self->rtx_max_time = g_value_get_uint(value);
+            break;
+        case PROP_FEC_PERCENTAGE:
+            self->fec_percentage = g_value_get_uint(value);
+            gst_webrtc_sink_apply_profile(self);
+            break;
+        case PROP_START_BITRATE:
+            gst_webrtc_sink_set_estimate(self, g_value_get_uint(value));
+            break;
+        case PROP_MIN_BITRATE:
+            self->min_bitrate = g_value_get_uint(value);
+            break;
+        case PROP_MAX_BITRATE:
+            self->max_bitrate = g_value_get_uint(value);
+            break;
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
             break;    
@@ -366,6 +732,40 @@ static void gst_webrtc_sink_get_property(GObject *object,
         case PROP_TURN_SERVER:
             g_object_get_property(G_OBJECT(self->webrtcbin), "turn-server", value);
             break;
+        case PROP_ICE_MIN_PORT:
+        case PROP_ICE_MAX_PORT:{
+            GObject *ice = NULL;
+            g_object_get(self->webrtcbin, "ice-agent", &ice, NULL);
+            if (ice) {
+                g_object_get_property(ice, prop_id == PROP_ICE_MIN_PORT ? "min-rtp-port" : "max-rtp-port", value);
+                g_object_unref(ice);
+            }
+            break;
+        }
+        case PROP_RTX:
+            g_value_set_boolean(value, self->rtx);
+            break;
+        case PROP_RTX_MAX_PACKETS:
+            g_value_set_uint(value, self->rtx_max_packets);
+            break;
+        case PROP_RTX_MAX_TIME:
+            g_value_set_uint(value, self->rtx_max_time);
+            break;
+        case PROP_FEC_PERCENTAGE:
+            g_value_set_uint(value, self->fec_percentage);
+            break;
+        case PROP_START_BITRATE:
+            g_value_set_uint(value, self->estimated_bitrate);
+            break;
+        case PROP_MIN_BITRATE:
+            g_value_set_uint(value, self->min_bitrate);
+            break;
+        case PROP_MAX_BITRATE:
+            g_value_set_uint(value, self->max_bitrate);
+            break;
+        case PROP_STATS:
+            g_value_take_boxed(value, gst_webrtc_sink_get_stats(self));
+            break;
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
             break;
@@ -455,6 +855,15 @@ cleanup:
     return ret;
 }
 
+static void gst_webrtc_sink_finalize(GObject *object)
+{
+  GstWebrtcSink *self = GST_WEBRTC_SINK(object);
+
+  g_list_free_full(self->rtx_senders, gst_object_unref);
+
+  G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
 static void gst_webrtc_sink_class_init(GstWebrtcSinkClass *klass)
 {
   GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
@@ -462,6 +871,7 @@ static void gst_webrtc_sink_class_init(GstWebrtcSinkClass *klass)
   GObjectClass *object_class = G_OBJECT_CLASS(klass);
   object_class->set_property = gst_webrtc_sink_set_property;
   object_class->get_property = gst_webrtc_sink_get_property;
+  object_class->finalize = gst_webrtc_sink_finalize;
 
 
   g_object_class_install_property(object_class, PROP_TURN_SERVER,
@@ -474,6 +884,56 @@ static void gst_webrtc_sink_class_init(GstWebrtcSinkClass *klass)
                                                    "stun-server", DEFAULT_STUN_SERVER,
                                                    G_PARAM_READWRITE));
 
+  g_object_class_install_property(object_class, PROP_ICE_MIN_PORT,
+                                  g_param_spec_uint("ice-min-port", "ice-min-port",
+                                                   "First UDP port the ICE agent may bind", 0, 65535, 0,
+                                                   G_PARAM_READWRITE));
+
+  g_object_class_install_property(object_class, PROP_ICE_MAX_PORT,
+                                  g_param_spec_uint("ice-max-port", "ice-max-port",
+                                                   "Last UDP port the ICE agent may bind", 0, 65535, 65535,
+                                                   G_PARAM_READWRITE));
+
+  g_object_class_install_property(object_class, PROP_RTX,
+                                  g_param_spec_boolean("rtx", "rtx",
+                                                   "Offer NACK and answer it with RTX retransmissions", DEFAULT_RTX,
+                                                   G_PARAM_READWRITE));
+
+  g_object_class_install_property(object_class, PROP_RTX_MAX_PACKETS,
+                                  g_param_spec_uint("rtx-max-packets", "rtx-max-packets",
+                                                   "Packets kept for retransmission per peer", 0, G_MAXUINT, DEFAULT_RTX_MAX_PACKETS,
+                                                   G_PARAM_READWRITE));
+
+  g_object_class_install_property(object_class, PROP_RTX_MAX_TIME,
+                                  g_param_spec_uint("rtx-max-time", "rtx-max-time",
+                                                   "Age in ms after which packets leave the retransmission cache", 0, G_MAXUINT, DEFAULT_RTX_MAX_TIME,
+                                                   G_PARAM_READWRITE));
+
+  g_object_class_install_property(object_class, PROP_FEC_PERCENTAGE,
+                                  g_param_spec_uint("fec-percentage", "fec-percentage",
+                                                   "ULPFEC/RED protection of the video, 0 disables FEC", 0, 100, DEFAULT_FEC_PERCENTAGE,
+                                                   G_PARAM_READWRITE));
+
+  g_object_class_install_property(object_class, PROP_START_BITRATE,
+                                  g_param_spec_uint("start-bitrate", "start-bitrate",
+                                                   "Bandwidth estimate in bps the video is paced at until the viewer reports loss", 0, G_MAXUINT, DEFAULT_START_BITRATE,
+                                                   G_PARAM_READWRITE));
+
+  g_object_class_install_property(object_class, PROP_MIN_BITRATE,
+                                  g_param_spec_uint("min-bitrate", "min-bitrate",
+                                                   "Lower bound of the bandwidth estimate in bps", 0, G_MAXUINT, DEFAULT_MIN_BITRATE,
+                                                   G_PARAM_READWRITE));
+
+  g_object_class_install_property(object_class, PROP_MAX_BITRATE,
+                                  g_param_spec_uint("max-bitrate", "max-bitrate",
+                                                   "Upper bound of the bandwidth estimate in bps", 0, G_MAXUINT, DEFAULT_MAX_BITRATE,
+                                                   G_PARAM_READWRITE));
+
+  g_object_class_install_property(object_class, PROP_STATS,
+                                  g_param_spec_boxed("stats", "stats",
+                                                   "Retransmission hit rate, FEC overhead, bandwidth estimate and pacing delay of this viewer", GST_TYPE_STRUCTURE,
+                                                   G_PARAM_READABLE));
+
   GType record_params[2] = {G_TYPE_UINT, G_TYPE_STRING};
   gst_webrtc_sink_signals[SIGNAL_ADD_ICE_CANDIDATE] =
       g_signal_newv("add-ice-candidate", G_TYPE_FROM_CLASS(klass),
@@ -0,0 +1,747 @@
+#include "gstclipbuffer.h"
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <glib/gstdio.h>
+
+GST_DEBUG_CATEGORY_STATIC (gst_clip_buffer_debug);
+#define GST_CAT_DEFAULT gst_clip_buffer_debug
+
+#define gst_clip_buffer_parent_class parent_class
+
+#define DEFAULT_LOCATION "clipbuffer.bin"
+#define DEFAULT_MAX_SIZE (256 * 1024 * 1024)
+#define DEFAULT_MAX_DURATION 60000
+
+/* a clip that takes longer than that to remux has failed */
+#define CLIP_TIMEOUT (30 * GST_SECOND)
+
+enum
+{
+  STREAM_VIDEO = 0,
+  STREAM_AUDIO,
+  N_STREAMS
+};
+
+/* properties */
+enum
+{
+  PROP_0,
+  PROP_LOCATION,
+  PROP_MAX_SIZE,
+  PROP_MAX_DURATION,
+  PROP_STATS,
+};
+
+enum
+{
+  SIGNAL_SAVE_CLIP = 0,
+  LAST_SIGNAL
+};
+
+static guint gst_clip_buffer_signals[LAST_SIGNAL] = {0};
+
+typedef struct {
+  guint64 seq;
+  guint64 offset;
+  gsize size;
+  GstClockTime pts;
+  GstClockTime dts;
+  GstClockTime duration;
+  gboolean key;
+  guint stream;
+} ClipSample;
+
+typedef struct {
+  gchar *location;
+  gint64 start;
+  gint64 stop;
+} ClipJob;
+
+/* State of the clip pipeline the save worker waits on */
+typedef struct {
+  GMutex lock;
+  GCond cond;
+  GstElement *srcs[N_STREAMS];
+  gboolean full[N_STREAMS];
+  gboolean error;
+} ClipSave;
+
+/* Keeps the last minute or so of the parsed encoded streams in a memory
+ * mapped ring file, with an index of the samples in memory. A clip is
+ * cut from the keyframe before its start and remuxed from the ring on a
+ * worker thread, as fast as the disk allows. The samples overwritten
+ * while a clip is written end it early rather than block the ring. */
+struct _GstClipBuffer
+{
+  GstBin parent_instance;
+
+  GstElement *vsink;
+  GstElement *asink;
+
+  gchar *location;
+  guint64 max_size;
+  guint max_duration;
+
+  GThreadPool *clips;
+
+  GMutex lock;
+  gint fd;
+  guint8 *ring;
+  guint64 ring_size;
+  guint64 position;
+  /* oldest first */
+  GQueue samples;
+  guint64 next_seq;
+  guint64 bytes;
+  GstClockTime last_pts;
+  GstCaps *caps[N_STREAMS];
+
+  guint64 clips_saved;
+  guint64 clips_failed;
+  guint64 clips_truncated;
+  GstClockTime last_clip_time;
+};
+
+G_DEFINE_TYPE(GstClipBuffer, gst_clip_buffer, GST_TYPE_BIN);
+
+
+static void gst_clip_buffer_drop_oldest(GstClipBuffer *self)
+{
+  ClipSample *sample = g_queue_pop_head(&self->samples);
+
+  self->bytes -= sample->size;
+  g_free(sample);
+}
+
+static void gst_clip_buffer_clear(GstClipBuffer *self)
+{
+  while (!g_queue_is_empty(&self->samples))
+    gst_clip_buffer_drop_oldest(self);
+  self->position = 0;
+  self->last_pts = GST_CLOCK_TIME_NONE;
+  for (guint i = 0; i < N_STREAMS; i++)
+    gst_clear_caps(&self->caps[i]);
+}
+
+static gboolean gst_clip_buffer_open(GstClipBuffer *self)
+{
+  gint fd = g_open(self->location, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  guint8 *ring;
+
+  if (fd < 0){
+    GST_ELEMENT_ERROR(self, RESOURCE, OPEN_READ_WRITE, ("Cannot open %s", self->location), ("%s", g_strerror(errno)));
+    return FALSE;
+  }
+  if (ftruncate(fd, self->max_size) < 0){
+    GST_ELEMENT_ERROR(self, RESOURCE, NO_SPACE_LEFT, ("Cannot size %s", self->location), ("%s", g_strerror(errno)));
+    close(fd);
+    return FALSE;
+  }
+  ring = mmap(NULL, self->max_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (ring == MAP_FAILED){
+    GST_ELEMENT_ERROR(self, RESOURCE, OPEN_READ_WRITE, ("Cannot map %s", self->location), ("%s", g_strerror(errno)));
+    close(fd);
+    return FALSE;
+  }
+
+  g_mutex_lock(&self->lock);
+  self->fd = fd;
+  self->ring = ring;
+  self->ring_size = self->max_size;
+  gst_clip_buffer_clear(self);
+  g_mutex_unlock(&self->lock);
+
+  return TRUE;
+}
+
+static void gst_clip_buffer_close(GstClipBuffer *self)
+{
+  g_mutex_lock(&self->lock);
+  if (self->ring){
+    munmap(self->ring, self->ring_size);
+    close(self->fd);
+    self->ring = NULL;
+    self->fd = -1;
+  }
+  gst_clip_buffer_clear(self);
+  g_mutex_unlock(&self->lock);
+}
+
+static void gst_clip_buffer_on_handoff(GstElement *sink, GstBuffer *buffer, GstPad *pad, gpointer user_data)
+{
+  GstClipBuffer *self = GST_CLIP_BUFFER(user_data);
+  guint stream = sink == self->vsink ? STREAM_VIDEO : STREAM_AUDIO;
+  GstCaps *caps = gst_pad_get_current_caps(pad);
+  gsize size = gst_buffer_get_size(buffer);
+  ClipSample *sample, *oldest;
+
+  g_mutex_lock(&self->lock);
+  if (!self->ring || size == 0 || size > self->ring_size){
+    g_mutex_unlock(&self->lock);
+    gst_clear_caps(&caps);
+    return;
+  }
+
+  /* the samples stored so far cannot be muxed with the new caps */
+  if (caps && self->caps[stream] && !gst_caps_is_equal(caps, self->caps[stream])){
+    GST_DEBUG_OBJECT(self, "Caps changed, dropping the buffered samples");
+    gst_clip_buffer_clear(self);
+  }
+  if (caps && !self->caps[stream])
+    self->caps[stream] = gst_caps_ref(caps);
+
+  /* samples never wrap, the rest of the lap is dropped along with the
+   * oldest ones it still holds */
+  if (self->position + size > self->ring_size){
+    while ((oldest = g_queue_peek_head(&self->samples)) && oldest->offset >= self->position)
+      gst_clip_buffer_drop_oldest(self);
+    self->position = 0;
+  }
+  while ((oldest = g_queue_peek_head(&self->samples)) &&
+      oldest->offset < self->position + size && oldest->offset + oldest->size > self->position)
+    gst_clip_buffer_drop_oldest(self);
+
+  gst_buffer_extract(buffer, 0, self->ring + self->position, size);
+
+  sample = g_new0(ClipSample, 1);
+  sample->seq = self->next_seq++;
+  sample->offset = self->position;
+  sample->size = size;
+  sample->pts = GST_BUFFER_PTS(buffer);
+  sample->dts = GST_BUFFER_DTS(buffer);
+  sample->duration = GST_BUFFER_DURATION(buffer);
+  sample->key = stream == STREAM_AUDIO || !GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+  sample->stream = stream;
+  g_queue_push_tail(&self->samples, sample);
+  self->position += size;
+  self->bytes += size;
+
+  if (stream == STREAM_VIDEO && GST_CLOCK_TIME_IS_VALID(sample->pts)){
+    self->last_pts = GST_CLOCK_TIME_IS_VALID(self->last_pts) ? MAX(self->last_pts, sample->pts) : sample->pts;
+    while ((oldest = g_queue_peek_head(&self->samples)) && GST_CLOCK_TIME_IS_VALID(oldest->pts) &&
+        oldest->pts + self->max_duration * GST_MSECOND < self->last_pts)
+      gst_clip_buffer_drop_oldest(self);
+  }
+  g_mutex_unlock(&self->lock);
+
+  gst_clear_caps(&caps);
+}
+
+/* Negative and zero times count back from the newest video sample */
+static GstClockTime gst_clip_buffer_resolve_time(GstClipBuffer *self, gint64 time)
+{
+  if (time > 0)
+    return time * GST_MSECOND;
+  if ((guint64) -time * GST_MSECOND > self->last_pts)
+    return 0;
+  return self->last_pts + time * GST_MSECOND;
+}
+
+/* Metadata of the samples of the clip, from the keyframe at or before its
+ * start. Called with the lock held. */
+static GArray *gst_clip_buffer_select(GstClipBuffer *self, ClipJob *job)
+{
+  GArray *selected = g_array_new(FALSE, FALSE, sizeof(ClipSample));
+  GstClockTime start, stop;
+  ClipSample *key = NULL;
+
+  if (!GST_CLOCK_TIME_IS_VALID(self->last_pts) || !self->caps[STREAM_VIDEO])
+    return selected;
+
+  start = gst_clip_buffer_resolve_time(self, job->start);
+  stop = gst_clip_buffer_resolve_time(self, job->stop);
+
+  for (GList *l = self->samples.head; l; l = l->next){
+    ClipSample *sample = l->data;
+
+    if (sample->stream != STREAM_VIDEO || !sample->key || !GST_CLOCK_TIME_IS_VALID(sample->pts))
+      continue;
+    if (key && sample->pts > start)
+      break;
+    key = sample;
+  }
+  if (key == NULL)
+    return selected;
+
+  for (GList *l = self->samples.head; l; l = l->next){
+    ClipSample *sample = l->data;
+
+    if (sample->seq < key->seq || !GST_CLOCK_TIME_IS_VALID(sample->pts) || sample->pts < key->pts)
+      continue;
+    if (sample->stream == STREAM_AUDIO && !self->caps[STREAM_AUDIO])
+      continue;
+    if (sample->pts > stop)
+      continue;
+    g_array_append_val(selected, *sample);
+  }
+
+  return selected;
+}
+
+static void gst_clip_buffer_set_full(GstElement *src, ClipSave *save, gboolean full)
+{
+  g_mutex_lock(&save->lock);
+  for (guint i = 0; i < N_STREAMS; i++){
+    if (save->srcs[i] == src)
+      save->full[i] = full;
+  }
+  g_cond_broadcast(&save->cond);
+  g_mutex_unlock(&save->lock);
+}
+
+static void gst_clip_buffer_on_enough_data(GstElement *src, gpointer user_data)
+{
+  gst_clip_buffer_set_full(src, user_data, TRUE);
+}
+
+static void gst_clip_buffer_on_need_data(GstElement *src, guint length, gpointer user_data)
+{
+  gst_clip_buffer_set_full(src, user_data, FALSE);
+}
+
+/* An error stops the clip pipeline, the worker must not wait on it */
+static GstBusSyncReply gst_clip_buffer_clip_bus(GstBus *bus, GstMessage *message, gpointer user_data)
+{
+  ClipSave *save = user_data;
+
+  if (GST_MESSAGE_TYPE(message) == GST_MESSAGE_ERROR){
+    g_mutex_lock(&save->lock);
+    save->error = TRUE;
+    g_cond_broadcast(&save->cond);
+    g_mutex_unlock(&save->lock);
+  }
+
+  return GST_BUS_PASS;
+}
+
+static GstElement *gst_clip_buffer_make_src(GstElement *pipeline, GstElement *mux, GstCaps *caps,
+    ClipSave *save)
+{
+  GstElement *src = gst_element_factory_make("appsrc", NULL);
+
+  /* the worker waits for room instead of queueing the whole clip in
+   * memory, never blocked in the push itself */
+  g_object_set(src, "caps", caps, "format", GST_FORMAT_TIME, "block", FALSE,
+      "max-bytes", (guint64) 4 * 1024 * 1024, "min-percent", 50, NULL);
+  g_signal_connect(src, "enough-data", G_CALLBACK(gst_clip_buffer_on_enough_data), save);
+  g_signal_connect(src, "need-data", G_CALLBACK(gst_clip_buffer_on_need_data), save);
+  gst_bin_add(GST_BIN(pipeline), src);
+  gst_element_link(src, mux);
+
+  return src;
+}
+
+/* Waits until the appsrc of stream has room. FALSE on an error of the clip
+ * pipeline or past the deadline */
+static gboolean gst_clip_buffer_wait_room(ClipSave *save, guint stream, gint64 deadline)
+{
+  gboolean ready;
+
+  g_mutex_lock(&save->lock);
+  while (save->full[stream] && !save->error &&
+      g_cond_wait_until(&save->cond, &save->lock, deadline));
+  ready = !save->full[stream] && !save->error;
+  g_mutex_unlock(&save->lock);
+
+  return ready;
+}
+
+static void gst_clip_buffer_post_result(GstClipBuffer *self, ClipJob *job, gboolean success,
+    GstClockTime duration, GstClockTime elapsed)
+{
+  gst_element_post_message(GST_ELEMENT(self),
+      gst_message_new_element(GST_OBJECT(self),
+          gst_structure_new("clipbuffer-clip",
+              "location", G_TYPE_STRING, job->location,
+              "success", G_TYPE_BOOLEAN, success,
+              "duration", G_TYPE_UINT64, duration,
+              "elapsed", G_TYPE_UINT64, elapsed,
+              NULL)));
+}
+
+static void gst_clip_buffer_save(gpointer data, gpointer user_data)
+{
+  GstClipBuffer *self = GST_CLIP_BUFFER(user_data);
+  ClipJob *job = data;
+  GstElement *pipeline = NULL, *mux, *sink;
+  gint64 started = g_get_monotonic_time();
+  gint64 deadline = started + CLIP_TIMEOUT / GST_USECOND, remaining;
+  GstClockTime base, duration = 0, elapsed;
+  gboolean success = FALSE, truncated = FALSE;
+  GstMessage *message;
+  GArray *selected;
+  GstBus *bus = NULL;
+  ClipSave save = { 0 };
+
+  g_mutex_init(&save.lock);
+  g_cond_init(&save.cond);
+
+  g_mutex_lock(&self->lock);
+  selected = gst_clip_buffer_select(self, job);
+  if (selected->len > 0){
+    pipeline = gst_pipeline_new(NULL);
+    mux = gst_element_factory_make("mp4mux", NULL);
+    sink = gst_element_factory_make("filesink", NULL);
+    g_object_set(mux, "faststart", TRUE, NULL);
+    g_object_set(sink, "location", job->location, "sync", FALSE, "async", FALSE, NULL);
+    gst_bin_add_many(GST_BIN(pipeline), mux, sink, NULL);
+    gst_element_link(mux, sink);
+    for (guint i = 0; i < N_STREAMS; i++){
+      if (self->caps[i])
+        save.srcs[i] = gst_clip_buffer_make_src(pipeline, mux, self->caps[i], &save);
+    }
+  }
+  g_mutex_unlock(&self->lock);
+
+  if (pipeline == NULL){
+    GST_WARNING_OBJECT(self, "Nothing buffered for clip %s", job->location);
+    goto done;
+  }
+
+  bus = gst_element_get_bus(pipeline);
+  gst_bus_set_sync_handler(bus, gst_clip_buffer_clip_bus, &save, NULL);
+
+  if (gst_element_set_state(pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE)
+    goto done;
+
+  /* the clip starts at 0 from its first keyframe */
+  base = g_array_index(selected, ClipSample, 0).pts;
+  if (GST_CLOCK_TIME_IS_VALID(g_array_index(selected, ClipSample, 0).dts))
+    base = MIN(base, g_array_index(selected, ClipSample, 0).dts);
+
+  for (guint i = 0; i < selected->len; i++){
+    ClipSample *sample = &g_array_index(selected, ClipSample, i);
+    GstBuffer *buffer = gst_buffer_new_allocate(NULL, sample->size, NULL);
+    GstFlowReturn ret;
+
+    g_mutex_lock(&self->lock);
+    truncated = self->ring == NULL || g_queue_is_empty(&self->samples) ||
+        ((ClipSample *) g_queue_peek_head(&self->samples))->seq > sample->seq;
+    if (!truncated)
+      gst_buffer_fill(buffer, 0, self->ring + sample->offset, sample->size);
+    g_mutex_unlock(&self->lock);
+
+    if (truncated){
+      GST_WARNING_OBJECT(self, "Clip %s overwritten in the ring, ending it early", job->location);
+      gst_buffer_unref(buffer);
+      break;
+    }
+
+    if (!gst_clip_buffer_wait_room(&save, sample->stream, deadline)){
+      GST_WARNING_OBJECT(self, "Clip %s stalled, giving up", job->location);
+      gst_buffer_unref(buffer);
+      break;
+    }
+
+    GST_BUFFER_PTS(buffer) = sample->pts - base;
+    GST_BUFFER_DTS(buffer) = GST_CLOCK_TIME_IS_VALID(sample->dts) && sample->dts >= base ?
+        sample->dts - base : GST_CLOCK_TIME_NONE;
+    GST_BUFFER_DURATION(buffer) = sample->duration;
+    if (!sample->key)
+      GST_BUFFER_FLAG_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+    duration = MAX(duration, GST_BUFFER_PTS(buffer) +
+        (GST_CLOCK_TIME_IS_VALID(sample->duration) ? sample->duration : 0));
+
+    g_signal_emit_by_name(save.srcs[sample->stream], "push-buffer", buffer, &ret);
+    gst_buffer_unref(buffer);
+    if (ret != GST_FLOW_OK)
+      break;
+  }
+
+  for (guint i = 0; i < N_STREAMS; i++){
+    GstFlowReturn ret;
+
+    if (save.srcs[i])
+      g_signal_emit_by_name(save.srcs[i], "end-of-stream", &ret);
+  }
+
+  remaining = MAX(deadline - g_get_monotonic_time(), 0);
+  message = gst_bus_timed_pop_filtered(bus, remaining * GST_USECOND, GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  success = message && GST_MESSAGE_TYPE(message) == GST_MESSAGE_EOS;
+  if (message && GST_MESSAGE_TYPE(message) == GST_MESSAGE_ERROR){
+    GError *err;
+
+    gst_message_parse_error(message, &err, NULL);
+    GST_WARNING_OBJECT(self, "Clip %s failed: %s", job->location, err->message);
+    g_error_free(err);
+  }
+  if (message)
+    gst_message_unref(message);
+
+done:
+  if (pipeline){
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+  }
+  if (bus){
+    gst_bus_set_sync_handler(bus, NULL, NULL, NULL);
+    gst_object_unref(bus);
+  }
+  g_mutex_clear(&save.lock);
+  g_cond_clear(&save.cond);
+  g_array_unref(selected);
+
+  elapsed = (g_get_monotonic_time() - started) * GST_USECOND;
+  g_mutex_lock(&self->lock);
+  if (success)
+    self->clips_saved++;
+  else
+    self->clips_failed++;
+  if (truncated)
+    self->clips_truncated++;
+  self->last_clip_time = elapsed;
+  g_mutex_unlock(&self->lock);
+
+  GST_DEBUG_OBJECT(self, "Clip %s of %" GST_TIME_FORMAT " written in %" GST_TIME_FORMAT,
+      job->location, GST_TIME_ARGS(duration), GST_TIME_ARGS(elapsed));
+  gst_clip_buffer_post_result(self, job, success, duration, elapsed);
+
+  g_free(job->location);
+  g_free(job);
+  gst_object_unref(self);
+}
+
+static gboolean gst_clip_buffer_save_clip(GstClipBuffer *self, gchar *location, gint64 start, gint64 stop)
+{
+  ClipJob *job;
+  gboolean queued = FALSE;
+
+  if (location == NULL)
+    return FALSE;
+
+  job = g_new0(ClipJob, 1);
+  job->location = g_strdup(location);
+  job->start = start;
+  job->stop = stop;
+
+  /* the job holds a reference, released on the worker */
+  g_mutex_lock(&self->lock);
+  if (self->clips)
+    queued = g_thread_pool_push(self->clips, job, NULL);
+  if (queued)
+    gst_object_ref(self);
+  g_mutex_unlock(&self->lock);
+
+  if (!queued){
+    g_free(job->location);
+    g_free(job);
+  }
+
+  return queued;
+}
+
+static GstStructure *gst_clip_buffer_get_stats(GstClipBuffer *self)
+{
+  GstStructure *stats;
+  GstClockTime available = 0;
+  ClipSample *oldest;
+
+  g_mutex_lock(&self->lock);
+  oldest = g_queue_peek_head(&self->samples);
+  if (oldest && GST_CLOCK_TIME_IS_VALID(oldest->pts) && GST_CLOCK_TIME_IS_VALID(self->last_pts) &&
+      self->last_pts > oldest->pts)
+    available = self->last_pts - oldest->pts;
+  stats = gst_structure_new("clipbuffer-stats",
+      "samples", G_TYPE_UINT, g_queue_get_length(&self->samples),
+      "bytes", G_TYPE_UINT64, self->bytes,
+      "available", G_TYPE_UINT64, available,
+      "clips-saved", G_TYPE_UINT64, self->clips_saved,
+      "clips-failed", G_TYPE_UINT64, self->clips_failed,
+      "clips-truncated", G_TYPE_UINT64, self->clips_truncated,
+      "last-clip-time", G_TYPE_UINT64, self->last_clip_time,
+      NULL);
+  g_mutex_unlock(&self->lock);
+
+  return stats;
+}
+
+static GstStateChangeReturn gst_clip_buffer_change_state(GstElement *element, GstStateChange transition)
+{
+  GstClipBuffer *self = GST_CLIP_BUFFER(element);
+  GstStateChangeReturn ret;
+
+  if (transition == GST_STATE_CHANGE_NULL_TO_READY){
+    if (!gst_clip_buffer_open(self))
+      return GST_STATE_CHANGE_FAILURE;
+    g_mutex_lock(&self->lock);
+    self->clips = g_thread_pool_new(gst_clip_buffer_save, self, 1, FALSE, NULL);
+    g_mutex_unlock(&self->lock);
+  }
+
+  ret = GST_ELEMENT_CLASS(parent_class)->change_state(element, transition);
+
+  if (transition == GST_STATE_CHANGE_READY_TO_NULL){
+    GThreadPool *clips;
+
+    /* the queued clips are still written before the ring goes away */
+    g_mutex_lock(&self->lock);
+    clips = self->clips;
+    self->clips = NULL;
+    g_mutex_unlock(&self->lock);
+    if (clips)
+      g_thread_pool_free(clips, FALSE, TRUE);
+    gst_clip_buffer_close(self);
+  }
+
+  return ret;
+}
+
+static void gst_clip_buffer_init(GstClipBuffer *self)
+{
+  GstBin *bin = GST_BIN(self);
+  GstElement *element = GST_ELEMENT(self);
+
+  g_mutex_init(&self->lock);
+  g_queue_init(&self->samples);
+  self->location = g_strdup(DEFAULT_LOCATION);
+  self->max_size = DEFAULT_MAX_SIZE;
+  self->max_duration = DEFAULT_MAX_DURATION;
+  self->fd = -1;
+  self->last_pts = GST_CLOCK_TIME_NONE;
+  self->clips = NULL;
+
+  self->vsink = gst_element_factory_make("fakesink", "vsink");
+  self->asink = gst_element_factory_make("fakesink", "asink");
+  g_object_set(self->vsink, "sync", FALSE, "async", FALSE, "signal-handoffs", TRUE, NULL);
+  g_object_set(self->asink, "sync", FALSE, "async", FALSE, "signal-handoffs", TRUE, NULL);
+  g_signal_connect(self->vsink, "handoff", G_CALLBACK(gst_clip_buffer_on_handoff), self);
+  g_signal_connect(self->asink, "handoff", G_CALLBACK(gst_clip_buffer_on_handoff), self);
+
+  gst_bin_add_many(bin, self->vsink, self->asink, NULL);
+
+  GstPad *pad = gst_element_get_static_pad(self->asink, "sink");
+  gst_element_add_pad(element, gst_ghost_pad_new("audio_sink", pad));
+  gst_object_unref(GST_OBJECT(pad));
+
+  pad = gst_element_get_static_pad(self->vsink, "sink");
+  gst_element_add_pad(element, gst_ghost_pad_new("video_sink", pad));
+  gst_object_unref(GST_OBJECT(pad));
+}
+
+static void gst_clip_buffer_set_property(GObject *object,
+                                         guint prop_id,
+                                         const GValue *value,
+                                         GParamSpec *pspec){
+    GstClipBuffer *self = GST_CLIP_BUFFER(object);
+
+    switch (prop_id) {
+        case PROP_LOCATION:
+            g_free(self->location);
+            self->location = g_value_dup_string(value);
+            break;
+        case PROP_MAX_SIZE:
+            self->max_size = g_value_get_uint64(value);
+            break;
+        case PROP_MAX_DURATION:
+            self->max_duration = g_value_get_uint(value);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+}
+
+static void gst_clip_buffer_get_property(GObject *object,
+                                         guint prop_id,
+                                         GValue *value,
+                                         GParamSpec *pspec){
+    GstClipBuffer *self = GST_CLIP_BUFFER(object);
+
+    switch (prop_id) {
+        case PROP_LOCATION:
+            g_value_set_string(value, self->location);
+            break;
+        case PROP_MAX_SIZE:
+            g_value_set_uint64(value, self->max_size);
+            break;
+        case PROP_MAX_DURATION:
+            g_value_set_uint(value, self->max_duration);
+            break;
+        case PROP_STATS:
+            g_value_take_boxed(value, gst_clip_buffer_get_stats(self));
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+}
+
+static void gst_clip_buffer_finalize(GObject *object)
+{
+  GstClipBuffer *self = GST_CLIP_BUFFER(object);
+
+  gst_clip_buffer_close(self);
+  g_free(self->location);
+  g_mutex_clear(&self->lock);
+
+  G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
+static void gst_clip_buffer_class_init(GstClipBufferClass *klass)
+{
+  GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+  GObjectClass *object_class = G_OBJECT_CLASS(klass);
+
+  object_class->set_property = gst_clip_buffer_set_property;
+  object_class->get_property = gst_clip_buffer_get_property;
+  object_class->finalize = gst_clip_buffer_finalize;
+  element_class->change_state = gst_clip_buffer_change_state;
+
+  g_object_class_install_property(object_class, PROP_LOCATION,
+                                  g_param_spec_string("location", "Location",
+                                                   "Ring file backing the buffered media", DEFAULT_LOCATION,
+                                                   G_PARAM_READWRITE));
+
+  g_object_class_install_property(object_class, PROP_MAX_SIZE,
+                                  g_param_spec_uint64("max-size", "Maximum size",
+                                                   "Size of the ring file in bytes",
+                                                   1024 * 1024, G_MAXUINT64, DEFAULT_MAX_SIZE,
+                                                   G_PARAM_READWRITE));
+
+  g_object_class_install_property(object_class, PROP_MAX_DURATION,
+                                  g_param_spec_uint("max-duration", "Maximum duration",
+                                                   "Milliseconds of media kept in the ring",
+                                                   1000, G_MAXUINT, DEFAULT_MAX_DURATION,
+                                                   G_PARAM_READWRITE));
+
+  g_object_class_install_property(object_class, PROP_STATS,
+                                  g_param_spec_boxed("stats", "Statistics",
+                                                   "Buffered media and saved clips",
+                                                   GST_TYPE_STRUCTURE,
+                                                   G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstClipBuffer::save-clip:
+   * @location: file the clip is written to
+   * @start: start in ms, from the newest sample back when 0 or negative
+   * @stop: stop in ms, from the newest sample back when 0 or negative
+   *
+   * Queues the clip, a "clipbuffer-clip" element message tells when it is
+   * written. Saving the last 30 seconds is (-30000, 0).
+   */
+  GType save_clip_params[3] = {G_TYPE_STRING, G_TYPE_INT64, G_TYPE_INT64};
+  gst_clip_buffer_signals[SIGNAL_SAVE_CLIP] =
+      g_signal_newv("save-clip", G_TYPE_FROM_CLASS(klass),
+                    G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+                    g_cclosure_new(G_CALLBACK(gst_clip_buffer_save_clip), NULL, NULL),
+                    NULL, NULL, NULL, G_TYPE_BOOLEAN,
+                    3, save_clip_params);
+
+  GST_DEBUG_CATEGORY_INIT (gst_clip_buffer_debug, "clipbuffer", 0,
+      "Clip Buffer Debug");
+
+  gst_element_class_set_static_metadata(element_class,
+                                        "Clip Buffer",
+                                        "Sink",
+                                        "Keeps the last minutes of the encoded streams to save clips on demand",
+                                        "Ludovic Bouguerra <ludovic.bouguerra@stream.studio>");
+}
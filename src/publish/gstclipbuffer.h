@@ -0,0 +1,17 @@
+#ifndef __GST_CLIP_BUFFER_H__
+#define __GST_CLIP_BUFFER_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_CLIP_BUFFER gst_clip_buffer_get_type ()
+G_DECLARE_FINAL_TYPE (GstClipBuffer, gst_clip_buffer, GST, CLIP_BUFFER, GstBin)
+
+struct GstClipBufferClass {
+  GstBinClass parent_class;
+};
+
+G_END_DECLS
+
+#endif
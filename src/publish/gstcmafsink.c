@@ -0,0 +1,904 @@
+/* fallocate() */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "gstcmafsink.h"
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <glib/gstdio.h>
+#include <gst/base/gstadapter.h>
+
+#include <common/gstisobmff.h>
+
+GST_DEBUG_CATEGORY_STATIC (gst_cmaf_sink_debug);
+#define GST_CAT_DEFAULT gst_cmaf_sink_debug
+
+#define gst_cmaf_sink_parent_class parent_class
+
+#define DEFAULT_LOCATION "."
+#define DEFAULT_PLAYLIST_NAME "index.m3u8"
+#define DEFAULT_TARGET_DURATION 2
+#define DEFAULT_PART_DURATION 333
+#define DEFAULT_PLAYLIST_LENGTH 6
+#define DEFAULT_LOW_LATENCY TRUE
+#define DEFAULT_PREALLOCATE TRUE
+
+/* parts are listed for the last segments only, older ones are whole */
+#define PART_SEGMENTS 3
+#define MAX_IOV 64
+
+/* properties */
+enum
+{
+  PROP_0,
+  PROP_LOCATION,
+  PROP_PLAYLIST_NAME,
+  PROP_TARGET_DURATION,
+  PROP_PART_DURATION,
+  PROP_PLAYLIST_LENGTH,
+  PROP_LOW_LATENCY,
+  PROP_PREALLOCATE,
+  PROP_STATS,
+};
+
+typedef struct {
+  guint64 offset;
+  guint64 size;
+  gdouble duration;
+  gboolean independent;
+} CmafPart;
+
+typedef struct {
+  guint sequence;
+  gchar *name;
+  gchar *map;
+  gboolean discontinuity;
+  gdouble duration;
+  guint64 size;
+  GArray *parts;
+} CmafSegment;
+
+/* Writes the branch as CMAF segments and an HLS playlist in a directory,
+ * for a web server or a tmpfs mount to serve. Each muxer fragment is a
+ * part, listed as a byte range of its segment for LL-HLS, so parts and
+ * segments are the same bytes written once. The sample data goes from the
+ * muxer buffers to the file without being copied, and segment files are
+ * preallocated from the size of the previous ones. Segments leaving the
+ * playlist are deleted on a background thread. */
+struct _GstCmafSink
+{
+  GstBin parent_instance;
+
+  GstElement *vqueue;
+  GstElement *aqueue;
+  GstElement *h264parse;
+  GstElement *aacparse;
+  GstElement *mp4mux;
+  GstElement *sink;
+
+  gchar *location;
+  gchar *playlist_name;
+  guint target_duration;
+  guint part_duration;
+  guint playlist_length;
+  gboolean low_latency;
+  gboolean preallocate;
+
+  /* streaming thread only */
+  GstAdapter *adapter;
+  GstBuffer *ftyp;
+  GstIsobmffTrack track;
+  guint init_count;
+  gchar *map;
+  gboolean discontinuity;
+  /* mdat payload still to come, written as it arrives */
+  guint64 mdat_left;
+  gboolean discard;
+  gboolean fragment_main;
+  gdouble fragment_duration;
+  gboolean fragment_key;
+
+  gint fd;
+  guint next_sequence;
+  CmafSegment *current;
+  CmafPart part;
+  GQueue segments;
+  GQueue expired;
+  gdouble max_segment_duration;
+  guint64 segment_size_avg;
+
+  GThreadPool *gc;
+
+  GMutex lock;
+  guint64 segments_written;
+  guint64 parts_written;
+  guint64 bytes_written;
+  guint64 writes;
+  guint64 write_errors;
+  GstClockTime write_latency;
+  GstClockTime write_latency_max;
+  guint64 gc_deleted;
+  guint gc_pending;
+};
+
+G_DEFINE_TYPE(GstCmafSink, gst_cmaf_sink, GST_TYPE_BIN);
+
+static void cmaf_segment_free(CmafSegment *segment)
+{
+  g_free(segment->name);
+  g_free(segment->map);
+  g_array_unref(segment->parts);
+  g_slice_free(CmafSegment, segment);
+}
+
+static gchar *cmaf_format_seconds(gchar *buffer, gdouble seconds)
+{
+  /* playlists use a dot whatever the locale */
+  return g_ascii_formatd(buffer, G_ASCII_DTOSTR_BUF_SIZE, "%.3f", seconds);
+}
+
+/* Deletes the segments that left the playlist, off the streaming thread */
+static void gst_cmaf_sink_gc(gpointer data, gpointer user_data)
+{
+  GstCmafSink *self = GST_CMAF_SINK(user_data);
+  gchar *path = data;
+  gboolean deleted = g_unlink(path) == 0 || errno == ENOENT;
+
+  if (!deleted)
+    GST_WARNING_OBJECT(self, "Cannot delete %s: %s", path, g_strerror(errno));
+
+  g_mutex_lock(&self->lock);
+  self->gc_pending--;
+  if (deleted)
+    self->gc_deleted++;
+  g_mutex_unlock(&self->lock);
+
+  g_free(path);
+}
+
+static void gst_cmaf_sink_delete_segment(GstCmafSink *self, CmafSegment *segment)
+{
+  g_mutex_lock(&self->lock);
+  self->gc_pending++;
+  g_mutex_unlock(&self->lock);
+  g_thread_pool_push(self->gc, g_build_filename(self->location, segment->name, NULL), NULL);
+  cmaf_segment_free(segment);
+}
+
+/* Forgets the segments of the playlist in location: the listed ones stay
+ * with it, the expired ones go */
+static void gst_cmaf_sink_drop_segments(GstCmafSink *self)
+{
+  CmafSegment *segment;
+
+  g_queue_clear_full(&self->segments, (GDestroyNotify) cmaf_segment_free);
+  while ((segment = g_queue_pop_head(&self->expired)))
+    gst_cmaf_sink_delete_segment(self, segment);
+  self->max_segment_duration = 0;
+}
+
+static void gst_cmaf_sink_account_write(GstCmafSink *self, gsize size, gint64 started, gboolean ok)
+{
+  GstClockTime latency = (g_get_monotonic_time() - started) * GST_USECOND;
+
+  g_mutex_lock(&self->lock);
+  self->writes++;
+  if (ok){
+    self->bytes_written += size;
+  } else {
+    self->write_errors++;
+  }
+  /* moving average over the last ~16 writes */
+  self->write_latency = self->write_latency == 0 ? latency :
+      (self->write_latency * 15 + latency) / 16;
+  self->write_latency_max = MAX(self->write_latency_max, latency);
+  g_mutex_unlock(&self->lock);
+}
+
+/* Writes the memories of @buffer straight from the muxer output */
+static void gst_cmaf_sink_write_buffer(GstCmafSink *self, GstBuffer *buffer)
+{
+  guint n_memory = gst_buffer_n_memory(buffer);
+  gint64 started = g_get_monotonic_time();
+  gsize total = 0;
+  gboolean ok = TRUE;
+
+  for (guint first = 0; first < n_memory && ok; first += MAX_IOV){
+    guint count = MIN(MAX_IOV, n_memory - first);
+    GstMapInfo maps[MAX_IOV];
+    struct iovec iov[MAX_IOV];
+    guint mapped = 0, index = 0;
+
+    for (; mapped < count; mapped++){
+      if (!gst_memory_map(gst_buffer_peek_memory(buffer, first + mapped), &maps[mapped], GST_MAP_READ))
+        break;
+      iov[mapped].iov_base = maps[mapped].data;
+      iov[mapped].iov_len = maps[mapped].size;
+    }
+    ok = mapped == count;
+
+    while (ok && index < mapped){
+      ssize_t written = writev(self->fd, iov + index, mapped - index);
+
+      if (written < 0){
+        if (errno == EINTR)
+          continue;
+        ok = FALSE;
+        break;
+      }
+      total += written;
+      /* short write, skip what went out */
+      while (index < mapped && (gsize) written >= iov[index].iov_len){
+        written -= iov[index].iov_len;
+        index++;
+      }
+      if (index < mapped){
+        iov[index].iov_base = (guint8 *) iov[index].iov_base + written;
+        iov[index].iov_len -= written;
+      }
+    }
+
+    for (guint i = 0; i < mapped; i++)
+      gst_memory_unmap(gst_buffer_peek_memory(buffer, first + i), &maps[i]);
+  }
+
+  if (!ok)
+    GST_WARNING_OBJECT(self, "Segment write failed: %s", g_strerror(errno));
+  if (self->current){
+    self->current->size += total;
+  }
+  gst_cmaf_sink_account_write(self, total, started, ok);
+  gst_buffer_unref(buffer);
+}
+
+static gboolean gst_cmaf_sink_write_file(GstCmafSink *self, const gchar *name, const gchar *data, gsize size)
+{
+  gchar *path = g_build_filename(self->location, name, NULL);
+  gchar *tmp = g_strconcat(path, ".tmp", NULL);
+  gint64 started = g_get_monotonic_time();
+  gboolean ok = FALSE;
+  gint fd;
+
+  /* readers see the old file or the new one, never a partial one */
+  fd = g_open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd >= 0){
+    gsize done = 0;
+
+    while (done < size){
+      ssize_t written = write(fd, data + done, size - done);
+
+      if (written < 0 && errno == EINTR)
+        continue;
+      if (written <= 0)
+        break;
+      done += written;
+    }
+    ok = done == size;
+    close(fd);
+    ok = ok && g_rename(tmp, path) == 0;
+  }
+  if (!ok){
+    GST_WARNING_OBJECT(self, "Cannot write %s: %s", path, g_strerror(errno));
+    g_unlink(tmp);
+  }
+  gst_cmaf_sink_account_write(self, size, started, ok);
+
+  g_free(tmp);
+  g_free(path);
+  return ok;
+}
+
+static void gst_cmaf_sink_append_parts(GstCmafSink *self, GString *playlist, CmafSegment *segment)
+{
+  gchar duration[G_ASCII_DTOSTR_BUF_SIZE];
+
+  for (guint i = 0; i < segment->parts->len; i++){
+    CmafPart *part = &g_array_index(segment->parts, CmafPart, i);
+
+    g_string_append_printf(playlist,
+        "#EXT-X-PART:DURATION=%s,URI=\"%s\",BYTERANGE=\"%" G_GUINT64_FORMAT "@%" G_GUINT64_FORMAT "\"%s\n",
+        cmaf_format_seconds(duration, part->duration), segment->name, part->size, part->offset,
+        part->independent ? ",INDEPENDENT=YES" : "");
+  }
+}
+
+static void gst_cmaf_sink_append_map(GString *playlist, CmafSegment *segment, const gchar **map)
+{
+  if (g_strcmp0(*map, segment->map) == 0)
+    return;
+  if (*map != NULL || segment->discontinuity)
+    g_string_append(playlist, "#EXT-X-DISCONTINUITY\n");
+  g_string_append_printf(playlist, "#EXT-X-MAP:URI=\"%s\"\n", segment->map);
+  *map = segment->map;
+}
+
+static void gst_cmaf_sink_write_playlist(GstCmafSink *self)
+{
+  GString *playlist = g_string_new("#EXTM3U\n");
+  gchar seconds[G_ASCII_DTOSTR_BUF_SIZE];
+  guint target = MAX(self->target_duration, (guint) (self->max_segment_duration + 0.999));
+  gdouble part_target = self->part_duration / 1000.0;
+  guint n_segments = g_queue_get_length(&self->segments);
+  CmafSegment *first = g_queue_peek_head(&self->segments);
+  const gchar *map = NULL;
+  guint index = 0;
+
+  if (!first)
+    first = self->current;
+  if (!first){
+    g_string_free(playlist, TRUE);
+    return;
+  }
+
+  g_string_append_printf(playlist, "#EXT-X-VERSION:%u\n", self->low_latency ? 9 : 7);
+  g_string_append_printf(playlist, "#EXT-X-TARGETDURATION:%u\n", target);
+  if (self->low_latency){
+    g_string_append_printf(playlist, "#EXT-X-SERVER-CONTROL:PART-HOLD-BACK=%s\n",
+        cmaf_format_seconds(seconds, 3 * part_target));
+    g_string_append_printf(playlist, "#EXT-X-PART-INF:PART-TARGET=%s\n",
+        cmaf_format_seconds(seconds, part_target));
+  }
+  g_string_append_printf(playlist, "#EXT-X-MEDIA-SEQUENCE:%u\n", first->sequence);
+
+  for (GList *l = self->segments.head; l != NULL; l = l->next, index++){
+    CmafSegment *segment = l->data;
+
+    gst_cmaf_sink_append_map(playlist, segment, &map);
+    if (self->low_latency && index + PART_SEGMENTS >= n_segments)
+      gst_cmaf_sink_append_parts(self, playlist, segment);
+    g_string_append_printf(playlist, "#EXTINF:%s,\n%s\n",
+        cmaf_format_seconds(seconds, segment->duration), segment->name);
+  }
+
+  /* the segment being written only shows up as parts */
+  if (self->low_latency && self->current){
+    gst_cmaf_sink_append_map(playlist, self->current, &map);
+    gst_cmaf_sink_append_parts(self, playlist, self->current);
+    g_string_append_printf(playlist,
+        "#EXT-X-PRELOAD-HINT:TYPE=PART,URI=\"%s\",BYTERANGE-START=%" G_GUINT64_FORMAT "\n",
+        self->current->name, self->current->size);
+  }
+
+  gst_cmaf_sink_write_file(self, self->playlist_name, playlist->str, playlist->len);
+  g_string_free(playlist, TRUE);
+}
+
+/* Ends the part being written, if it has data */
+static void gst_cmaf_sink_close_part(GstCmafSink *self)
+{
+  if (!self->current || self->current->size == self->part.offset)
+    return;
+
+  self->part.size = self->current->size - self->part.offset;
+  g_array_append_val(self->current->parts, self->part);
+  self->current->duration += self->part.duration;
+
+  memset(&self->part, 0, sizeof(CmafPart));
+  self->part.offset = self->current->size;
+
+  g_mutex_lock(&self->lock);
+  self->parts_written++;
+  g_mutex_unlock(&self->lock);
+}
+
+static void gst_cmaf_sink_close_segment(GstCmafSink *self)
+{
+  CmafSegment *segment = self->current;
+
+  if (!segment)
+    return;
+
+  gst_cmaf_sink_close_part(self);
+  self->current = NULL;
+
+  /* the preallocation past the end goes back to the filesystem */
+  if (self->preallocate && ftruncate(self->fd, segment->size) < 0)
+    GST_DEBUG_OBJECT(self, "Cannot trim %s: %s", segment->name, g_strerror(errno));
+  close(self->fd);
+  self->fd = -1;
+
+  self->max_segment_duration = MAX(self->max_segment_duration, segment->duration);
+  self->segment_size_avg = self->segment_size_avg == 0 ? segment->size :
+      (self->segment_size_avg * 3 + segment->size) / 4;
+  g_queue_push_tail(&self->segments, segment);
+
+  /* expired segments stay on disk for a playlist length, for the players
+   * still fetching them */
+  while (g_queue_get_length(&self->segments) > self->playlist_length)
+    g_queue_push_tail(&self->expired, g_queue_pop_head(&self->segments));
+  while (g_queue_get_length(&self->expired) > self->playlist_length)
+    gst_cmaf_sink_delete_segment(self, g_queue_pop_head(&self->expired));
+
+  g_mutex_lock(&self->lock);
+  self->segments_written++;
+  g_mutex_unlock(&self->lock);
+}
+
+static gboolean gst_cmaf_sink_open_segment(GstCmafSink *self)
+{
+  CmafSegment *segment = g_slice_new0(CmafSegment);
+  gchar *path;
+
+  segment->sequence = self->next_sequence++;
+  segment->name = g_strdup_printf("segment%05u.m4s", segment->sequence);
+  segment->map = g_strdup(self->map);
+  segment->discontinuity = self->discontinuity;
+  segment->parts = g_array_new(FALSE, TRUE, sizeof(CmafPart));
+  self->discontinuity = FALSE;
+
+  path = g_build_filename(self->location, segment->name, NULL);
+  self->fd = g_open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (self->fd < 0){
+    GST_ELEMENT_WARNING(self, RESOURCE, OPEN_WRITE, ("Cannot open %s", path), ("%s", g_strerror(errno)));
+    g_free(path);
+    cmaf_segment_free(segment);
+    return FALSE;
+  }
+  g_free(path);
+
+#if defined(__linux__) && defined(FALLOC_FL_KEEP_SIZE)
+  /* reserve the blocks without changing the visible size, the segment is
+   * then written without the filesystem allocating on each write */
+  if (self->preallocate && self->segment_size_avg > 0 &&
+      fallocate(self->fd, FALLOC_FL_KEEP_SIZE, 0, self->segment_size_avg + self->segment_size_avg / 4) < 0)
+    GST_DEBUG_OBJECT(self, "No preallocation for %s: %s", segment->name, g_strerror(errno));
+#endif
+
+  self->current = segment;
+  memset(&self->part, 0, sizeof(CmafPart));
+  return TRUE;
+}
+
+static void gst_cmaf_sink_handle_init(GstCmafSink *self, GstBuffer *moov)
+{
+  GstMapInfo map;
+  GByteArray *init = g_byte_array_new();
+  gchar *codecs = NULL;
+
+  if (self->ftyp && gst_buffer_map(self->ftyp, &map, GST_MAP_READ)){
+    g_byte_array_append(init, map.data, map.size);
+    gst_buffer_unmap(self->ftyp, &map);
+  }
+  if (gst_buffer_map(moov, &map, GST_MAP_READ)){
+    const guint8 *data = map.data, *payload;
+    gsize size = map.size, payload_size;
+    guint32 type;
+
+    if (gst_isobmff_box_next(&data, &size, &type, &payload, &payload_size))
+      codecs = gst_isobmff_parse_moov(payload, payload_size, &self->track);
+    g_byte_array_append(init, map.data, map.size);
+    gst_buffer_unmap(moov, &map);
+  }
+
+  /* a new init starts a new segment, behind a discontinuity */
+  gst_cmaf_sink_close_segment(self);
+  self->discontinuity = self->map != NULL || !g_queue_is_empty(&self->segments);
+  g_free(self->map);
+  self->map = g_strdup_printf("init%u.mp4", self->init_count++);
+  GST_INFO_OBJECT(self, "Init segment %s for %s", self->map, codecs);
+
+  gst_cmaf_sink_write_file(self, self->map, (const gchar *) init->data, init->len);
+
+  g_byte_array_unref(init);
+  g_free(codecs);
+}
+
+/* A fragment starts: cuts the segment on a keyframe once it is long enough */
+static void gst_cmaf_sink_handle_moof(GstCmafSink *self, GstBuffer *moof)
+{
+  GstMapInfo map;
+  guint64 duration = 0;
+
+  self->fragment_main = FALSE;
+  self->fragment_key = FALSE;
+  if (gst_buffer_map(moof, &map, GST_MAP_READ)){
+    const guint8 *data = map.data, *payload;
+    gsize size = map.size, payload_size;
+    guint32 type;
+
+    if (gst_isobmff_box_next(&data, &size, &type, &payload, &payload_size))
+      self->fragment_main = gst_isobmff_parse_moof(payload, payload_size, &self->track,
+          &self->fragment_key, NULL, &duration);
+    gst_buffer_unmap(moof, &map);
+  }
+  self->fragment_duration = self->track.timescale ?
+      (gdouble) duration / self->track.timescale : 0;
+
+  if (self->fragment_main && self->fragment_key && self->map &&
+      (!self->current || self->current->duration + self->part.duration >= self->target_duration * 0.95)){
+    gst_cmaf_sink_close_segment(self);
+    if (gst_cmaf_sink_open_segment(self))
+      gst_cmaf_sink_write_playlist(self);
+  }
+
+  /* nothing decodes before the first keyframe */
+  self->discard = self->current == NULL;
+  if (self->discard){
+    gst_buffer_unref(moof);
+    return;
+  }
+
+  if (self->current->size == self->part.offset)
+    self->part.independent = self->fragment_main && self->fragment_key;
+  gst_cmaf_sink_write_buffer(self, moof);
+}
+
+/* The fragment data is written: publishes the part once it is long enough */
+static void gst_cmaf_sink_fragment_done(GstCmafSink *self)
+{
+  if (self->discard || !self->fragment_main)
+    return;
+
+  self->part.duration += self->fragment_duration;
+  if (self->part.duration >= self->part_duration / 1000.0 * 0.85){
+    gst_cmaf_sink_close_part(self);
+    if (self->low_latency)
+      gst_cmaf_sink_write_playlist(self);
+  }
+}
+
+static void gst_cmaf_sink_on_handoff(GstElement *sink, GstBuffer *buffer, GstPad *pad, gpointer user_data)
+{
+  GstCmafSink *self = GST_CMAF_SINK(user_data);
+
+  gst_adapter_push(self->adapter, gst_buffer_ref(buffer));
+
+  for (;;){
+    gsize available = gst_adapter_available(self->adapter);
+    guint8 header[16];
+    guint64 box_size;
+    gsize header_size = 8;
+    guint32 type;
+
+    if (self->mdat_left > 0){
+      gsize size = MIN(available, self->mdat_left);
+      GstBuffer *data;
+
+      if (size == 0)
+        break;
+      /* sub-buffers of the muxer output, no copy */
+      data = gst_adapter_take_buffer_fast(self->adapter, size);
+      self->mdat_left -= size;
+      if (self->discard)
+        gst_buffer_unref(data);
+      else
+        gst_cmaf_sink_write_buffer(self, data);
+      if (self->mdat_left == 0)
+        gst_cmaf_sink_fragment_done(self);
+      continue;
+    }
+
+    if (available < 8)
+      break;
+    gst_adapter_copy(self->adapter, header, 0, 8);
+    box_size = GST_READ_UINT32_BE(header);
+    type = GST_READ_UINT32_LE(header + 4);
+    if (box_size == 1){
+      if (available < 16)
+        break;
+      gst_adapter_copy(self->adapter, header, 0, 16);
+      box_size = GST_READ_UINT64_BE(header + 8);
+      header_size = 16;
+    }
+    if (box_size < header_size){
+      GST_WARNING_OBJECT(self, "Invalid box size, dropping %" G_GSIZE_FORMAT " bytes", available);
+      gst_adapter_clear(self->adapter);
+      break;
+    }
+
+    if (type == GST_ISOBMFF_FOURCC_mdat){
+      GstBuffer *mdat_header = gst_adapter_take_buffer(self->adapter, header_size);
+
+      if (self->discard)
+        gst_buffer_unref(mdat_header);
+      else
+        gst_cmaf_sink_write_buffer(self, mdat_header);
+      self->mdat_left = box_size - header_size;
+      if (self->mdat_left == 0)
+        gst_cmaf_sink_fragment_done(self);
+      continue;
+    }
+
+    if (available < box_size)
+      break;
+
+    switch (type){
+      case GST_ISOBMFF_FOURCC_ftyp:
+        gst_buffer_replace(&self->ftyp, NULL);
+        self->ftyp = gst_adapter_take_buffer(self->adapter, box_size);
+        break;
+      case GST_ISOBMFF_FOURCC_moov:{
+        GstBuffer *moov = gst_adapter_take_buffer(self->adapter, box_size);
+
+        gst_cmaf_sink_handle_init(self, moov);
+        gst_buffer_unref(moov);
+        break;
+      }
+      case GST_ISOBMFF_FOURCC_moof:
+        gst_cmaf_sink_handle_moof(self, gst_adapter_take_buffer(self->adapter, box_size));
+        break;
+      default:
+        GST_LOG_OBJECT(self, "Ignoring %" GST_FOURCC_FORMAT " box", GST_FOURCC_ARGS(type));
+        gst_adapter_flush(self->adapter, box_size);
+        break;
+    }
+  }
+}
+
+static void gst_cmaf_sink_reset(GstCmafSink *self)
+{
+  gst_adapter_clear(self->adapter);
+  gst_buffer_replace(&self->ftyp, NULL);
+  g_clear_pointer(&self->map, g_free);
+  self->mdat_left = 0;
+  self->discard = FALSE;
+  self->discontinuity = FALSE;
+  if (self->current){
+    close(self->fd);
+    self->fd = -1;
+    cmaf_segment_free(self->current);
+    self->current = NULL;
+  }
+  /* a restart continues the numbering and the playlist, its segments
+   * then expire like the new ones */
+}
+
+static GstStateChangeReturn gst_cmaf_sink_change_state(GstElement *element, GstStateChange transition)
+{
+  GstCmafSink *self = GST_CMAF_SINK(element);
+  GstStateChangeReturn ret;
+
+  if (transition == GST_STATE_CHANGE_READY_TO_PAUSED &&
+      g_mkdir_with_parents(self->location, 0755) < 0){
+    GST_ELEMENT_ERROR(self, RESOURCE, OPEN_WRITE, ("Cannot create %s", self->location),
+        ("%s", g_strerror(errno)));
+    return GST_STATE_CHANGE_FAILURE;
+  }
+
+  ret = GST_ELEMENT_CLASS(parent_class)->change_state(element, transition);
+
+  if (transition == GST_STATE_CHANGE_PAUSED_TO_READY){
+    /* the last segment is complete, list it */
+    gst_cmaf_sink_close_segment(self);
+    gst_cmaf_sink_write_playlist(self);
+    gst_cmaf_sink_reset(self);
+  }
+
+  return ret;
+}
+
+static GstStructure *gst_cmaf_sink_get_stats(GstCmafSink *self)
+{
+  GstStructure *stats;
+
+  g_mutex_lock(&self->lock);
+  stats = gst_structure_new("cmafsink-stats",
+      "segments", G_TYPE_UINT64, self->segments_written,
+      "parts", G_TYPE_UINT64, self->parts_written,
+      "bytes", G_TYPE_UINT64, self->bytes_written,
+      "writes", G_TYPE_UINT64, self->writes,
+      "write-errors", G_TYPE_UINT64, self->write_errors,
+      "write-latency", G_TYPE_UINT64, self->write_latency,
+      "max-write-latency", G_TYPE_UINT64, self->write_latency_max,
+      "gc-deleted", G_TYPE_UINT64, self->gc_deleted,
+      "gc-pending", G_TYPE_UINT, self->gc_pending,
+      NULL);
+  g_mutex_unlock(&self->lock);
+
+  return stats;
+}
+
+static void gst_cmaf_sink_init(GstCmafSink *self)
+{
+  GstBin *bin = GST_BIN(self);
+  GstElement *element = GST_ELEMENT(self);
+
+  g_mutex_init(&self->lock);
+  self->location = g_strdup(DEFAULT_LOCATION);
+  self->playlist_name = g_strdup(DEFAULT_PLAYLIST_NAME);
+  self->target_duration = DEFAULT_TARGET_DURATION;
+  self->part_duration = DEFAULT_PART_DURATION;
+  self->playlist_length = DEFAULT_PLAYLIST_LENGTH;
+  self->low_latency = DEFAULT_LOW_LATENCY;
+  self->preallocate = DEFAULT_PREALLOCATE;
+  self->fd = -1;
+  self->adapter = gst_adapter_new();
+  g_queue_init(&self->segments);
+  g_queue_init(&self->expired);
+  self->gc = g_thread_pool_new(gst_cmaf_sink_gc, self, 1, FALSE, NULL);
+
+  self->aqueue = gst_element_factory_make("queue", "aqueue");
+  self->vqueue = gst_element_factory_make("queue", "vqueue");
+
+  self->h264parse = gst_element_factory_make("h264parse", "vparse");
+  self->aacparse = gst_element_factory_make("aacparse", "aparse");
+
+  self->mp4mux = gst_element_factory_make("mp4mux", "mux");
+  self->sink = gst_element_factory_make("fakesink", "sink");
+
+  /* one fragment per part, the muxer also cuts on each keyframe */
+  g_object_set(self->mp4mux, "streamable", TRUE,
+      "fragment-duration", self->part_duration, NULL);
+  g_object_set(self->sink, "sync", FALSE, "async", FALSE,
+      "signal-handoffs", TRUE, NULL);
+  g_signal_connect(self->sink, "handoff", G_CALLBACK(gst_cmaf_sink_on_handoff), self);
+
+  gst_bin_add_many(bin, self->vqueue, self->h264parse, self->aqueue, self->aacparse, self->mp4mux, self->sink, NULL);
+  gst_element_link_many(self->aqueue, self->aacparse, self->mp4mux, self->sink, NULL);
+  gst_element_link_many(self->vqueue, self->h264parse, self->mp4mux, NULL);
+
+  GstPad *pad = gst_element_get_static_pad(self->aqueue, "sink");
+  gst_element_add_pad(element, gst_ghost_pad_new("audio_sink", pad));
+  gst_object_unref(GST_OBJECT(pad));
+
+  pad = gst_element_get_static_pad(self->vqueue, "sink");
+  gst_element_add_pad(element, gst_ghost_pad_new("video_sink", pad));
+  gst_object_unref(GST_OBJECT(pad));
+}
+
+static void gst_cmaf_sink_set_property(GObject *object,
+                                       guint prop_id,
+                                       const GValue *value,
+                                       GParamSpec *pspec){
+    GstCmafSink *self = GST_CMAF_SINK(object);
+
+    switch (prop_id) {
+        case PROP_LOCATION:
+            gst_cmaf_sink_drop_segments(self);
+            g_free(self->location);
+            self->location = g_value_dup_string(value);
+            break;
+        case PROP_PLAYLIST_NAME:
+            g_free(self->playlist_name);
+            self->playlist_name = g_value_dup_string(value);
+            break;
+        case PROP_TARGET_DURATION:
+            self->target_duration = g_value_get_uint(value);
+            break;
+        case PROP_PART_DURATION:
+            self->part_duration = g_value_get_uint(value);
+            g_object_set(self->mp4mux, "fragment-duration", self->part_duration, NULL);
+            break;
+        case PROP_PLAYLIST_LENGTH:
+            self->playlist_length = g_value_get_uint(value);
+            break;
+        case PROP_LOW_LATENCY:
+            self->low_latency = g_value_get_boolean(value);
+            break;
+        case PROP_PREALLOCATE:
+            self->preallocate = g_value_get_boolean(value);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+}
+
+static void gst_cmaf_sink_get_property(GObject *object,
+                                       guint prop_id,
+                                       GValue *value,
+                                       GParamSpec *pspec){
+    GstCmafSink *self = GST_CMAF_SINK(object);
+
+    switch (prop_id) {
+        case PROP_LOCATION:
+            g_value_set_string(value, self->location);
+            break;
+        case PROP_PLAYLIST_NAME:
+            g_value_set_string(value, self->playlist_name);
+            break;
+        case PROP_TARGET_DURATION:
+            g_value_set_uint(value, self->target_duration);
+            break;
+        case PROP_PART_DURATION:
+            g_value_set_uint(value, self->part_duration);
+            break;
+        case PROP_PLAYLIST_LENGTH:
+            g_value_set_uint(value, self->playlist_length);
+            break;
+        case PROP_LOW_LATENCY:
+            g_value_set_boolean(value, self->low_latency);
+            break;
+        case PROP_PREALLOCATE:
+            g_value_set_boolean(value, self->preallocate);
+            break;
+        case PROP_STATS:
+            g_value_take_boxed(value, gst_cmaf_sink_get_stats(self));
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+}
+
+static void gst_cmaf_sink_finalize(GObject *object)
+{
+  GstCmafSink *self = GST_CMAF_SINK(object);
+
+  gst_cmaf_sink_reset(self);
+  gst_cmaf_sink_drop_segments(self);
+  /* let the pending deletions finish */
+  g_thread_pool_free(self->gc, FALSE, TRUE);
+  g_object_unref(self->adapter);
+  g_free(self->location);
+  g_free(self->playlist_name);
+  g_mutex_clear(&self->lock);
+
+  G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
+static void gst_cmaf_sink_class_init(GstCmafSinkClass *klass)
+{
+  GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+  GObjectClass *object_class = G_OBJECT_CLASS(klass);
+
+  object_class->set_property = gst_cmaf_sink_set_property;
+  object_class->get_property = gst_cmaf_sink_get_property;
+  object_class->finalize = gst_cmaf_sink_finalize;
+  element_class->change_state = gst_cmaf_sink_change_state;
+
+  g_object_class_install_property(object_class, PROP_LOCATION,
+      g_param_spec_string("location", "Location",
+          "Directory of the playlist and segments, created if needed", DEFAULT_LOCATION,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property(object_class, PROP_PLAYLIST_NAME,
+      g_param_spec_string("playlist-name", "Playlist Name",
+          "File name of the media playlist", DEFAULT_PLAYLIST_NAME,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property(object_class, PROP_TARGET_DURATION,
+      g_param_spec_uint("target-duration", "Target Duration",
+          "Segment duration in seconds, segments start on the first keyframe after it",
+          1, G_MAXUINT, DEFAULT_TARGET_DURATION,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property(object_class, PROP_PART_DURATION,
+      g_param_spec_uint("part-duration", "Part Duration",
+          "Partial segment duration in ms, the muxer fragment duration",
+          10, G_MAXUINT, DEFAULT_PART_DURATION,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property(object_class, PROP_PLAYLIST_LENGTH,
+      g_param_spec_uint("playlist-length", "Playlist Length",
+          "Segments listed; as many more stay on disk before being deleted",
+          1, G_MAXUINT, DEFAULT_PLAYLIST_LENGTH,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property(object_class, PROP_LOW_LATENCY,
+      g_param_spec_boolean("low-latency", "Low Latency",
+          "List the parts (LL-HLS) and update the playlist on each of them",
+          DEFAULT_LOW_LATENCY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property(object_class, PROP_PREALLOCATE,
+      g_param_spec_boolean("preallocate", "Preallocate",
+          "Reserve the disk blocks of each segment from the size of the previous ones",
+          DEFAULT_PREALLOCATE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property(object_class, PROP_STATS,
+      g_param_spec_boxed("stats", "Statistics",
+          "Segments, parts and bytes written, write latency (ns) and pending deletions",
+          GST_TYPE_STRUCTURE,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  GST_DEBUG_CATEGORY_INIT (gst_cmaf_sink_debug, "cmafsink", 0,
+      "CMAF Sink Debug");
+
+  gst_element_class_set_static_metadata(element_class,
+                                        "CMAF Sink",
+                                        "Sink/File",
+                                        "HLS and LL-HLS CMAF segments with a rolling playlist",
+                                        "Ludovic Bouguerra <ludovic.bouguerra@stream.studio>");
+}
@@ -0,0 +1,17 @@
+#ifndef __GST_CMAF_SINK_H__
+#define __GST_CMAF_SINK_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_CMAF_SINK gst_cmaf_sink_get_type ()
+G_DECLARE_FINAL_TYPE (GstCmafSink, gst_cmaf_sink, GST, CMAF_SINK, GstBin)
+
+struct GstCmafSinkClass {
+  GstBinClass parent_class;
+};
+
+G_END_DECLS
+
+#endif
@@ -8,9 +8,15 @@
 /* properties */
 enum
 {
-  PROP_0
+  PROP_0,
+  PROP_STATS,
+  PROP_TEARDOWN_TIMEOUT,
+  PROP_MAX_PENDING_TEARDOWNS
 };
 
+#define DEFAULT_TEARDOWN_TIMEOUT (5 * GST_SECOND)
+#define DEFAULT_MAX_PENDING_TEARDOWNS 32
+
 enum
 {
   SIGNAL_START,
@@ -21,41 +27,628 @@ enum
 static guint gst_dynamic_tee_signals[LAST_SIGNAL] = {0};
 
 
-GST_DEBUG_CATEGORY_STATIC (gst_preview_sink_debug); 
+GST_DEBUG_CATEGORY_STATIC (gst_preview_sink_debug);
 #define GST_CAT_DEFAULT gst_preview_sink_debug
 
 #define gst_dynamic_tee_parent_class parent_class
 
+/* One reader slot per sink pad, each one is only ever touched by the
+ * streaming thread of that pad */
+enum
+{
+  STREAM_VIDEO = 0,
+  STREAM_AUDIO,
+  N_STREAMS
+};
+
+static const gchar *stream_pad_names[N_STREAMS] = {"video_sink", "audio_sink"};
+
+static GstStaticPadTemplate video_sink_template = GST_STATIC_PAD_TEMPLATE ("video_sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS_ANY);
+
+static GstStaticPadTemplate audio_sink_template = GST_STATIC_PAD_TEMPLATE ("audio_sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS_ANY);
+
+/* A consumer attached to the tee. The src pads are internal to the tee and
+ * are linked straight to the branch sink pads, like the proxy pads of a ghost
+ * pad, so pushing to a branch never goes through an element lock */
+typedef struct
+{
+  gint refcount;
+  GstDynamicTee *tee;
+  GstElement *element;
+  GstPad *srcpads[N_STREAMS];
+  /* sticky events of the tee sink pad still have to be replayed, only read
+   * and written by the streaming thread of the stream */
+  gboolean pending_sticky[N_STREAMS];
+  /* push EOS to the branch once no streaming thread can see it anymore */
+  gboolean send_eos;
+} GstDynamicTeeBranch;
+
+/* Immutable snapshot of the consumer set. Writers publish a new copy and
+ * retire the old one, which is freed once every streaming thread went through
+ * a buffer boundary after the swap */
+typedef struct
+{
+  gint epoch;
+  guint len;
+  GstDynamicTeeBranch *branches[];
+} GstDynamicTeeBranchList;
+
+/* A stopped branch waiting for its EOS before being set to NULL and removed
+ * by the reaper thread */
+typedef struct
+{
+  GstElement *element;
+  gint64 requested;
+  gint64 deadline;
+  gboolean ready;
+} GstDynamicTeeTeardown;
 
 struct _GstDynamicTee
 {
   GstBin parent_instance;
-  GstElement *taudio;
-  GstElement *tvideo;
+  GstPad *sinkpads[N_STREAMS];
+
+  /* read-copy-update state, see gst_dynamic_tee_read_lock() */
+  GstDynamicTeeBranchList *branches;
+  gint epoch;
+  gint reader_epoch[N_STREAMS];
+  gint n_retired;
+
+  /* serializes writers and protects the retired lists */
+  GMutex lock;
+  GSList *retired;
+
+  /* counted by the streaming threads, atomically */
+  gsize buffers[N_STREAMS];
+  guint64 attached;
+  guint64 detached;
+  guint64 reclaimed;
+
+  /* branch finalization, protected by reaper_lock */
+  GThread *reaper;
+  GMutex reaper_lock;
+  GCond reaper_cond;
+  GQueue teardowns;
+  gboolean reaper_running;
+  GstClockTime teardown_timeout;
+  guint max_pending_teardowns;
+
+  guint64 torn_down;
+  guint64 timed_out;
+  GstClockTime last_teardown_duration;
+  GstClockTime max_teardown_duration;
 };
 
 G_DEFINE_TYPE(GstDynamicTee, gst_dynamic_tee, GST_TYPE_BIN);
 
 
+static GstDynamicTeeBranchList *gst_dynamic_tee_branch_list_new(guint len)
+{
+  GstDynamicTeeBranchList *list = g_malloc0(sizeof(GstDynamicTeeBranchList) +
+      len * sizeof(GstDynamicTeeBranch *));
+  list->len = len;
+  return list;
+}
+
+static gboolean forward_sticky_event(GstPad *pad, GstEvent **event, gpointer user_data)
+{
+  GstPad *srcpad = GST_PAD(user_data);
+
+  if (GST_EVENT_TYPE(*event) != GST_EVENT_EOS){
+    gst_pad_store_sticky_event(srcpad, *event);
+  }
+
+  return TRUE;
+}
+
+static void gst_dynamic_tee_branch_replay_sticky(GstDynamicTeeBranch *branch, GstPad *sinkpad, guint stream)
+{
+  if (G_LIKELY(!branch->pending_sticky[stream]))
+    return;
+
+  gst_pad_sticky_events_foreach(sinkpad, forward_sticky_event, branch->srcpads[stream]);
+  branch->pending_sticky[stream] = FALSE;
+}
+
+static GstDynamicTeeBranch *gst_dynamic_tee_branch_ref(GstDynamicTeeBranch *branch)
+{
+  g_atomic_int_inc(&branch->refcount);
+  return branch;
+}
+
+static void gst_dynamic_tee_branch_unref(GstDynamicTeeBranch *branch)
+{
+  if (!g_atomic_int_dec_and_test(&branch->refcount))
+    return;
+
+  GST_DEBUG("Releasing branch %s", GST_OBJECT_NAME(branch->element));
+
+  for (guint i = 0; i < N_STREAMS; i++){
+    GstPad *srcpad = branch->srcpads[i];
+    if (srcpad == NULL)
+      continue;
+
+    if (branch->send_eos){
+      gst_dynamic_tee_branch_replay_sticky(branch, branch->tee->sinkpads[i], i);
+      gst_pad_push_event(srcpad, gst_event_new_eos());
+    }
+
+    GstPad *peer = gst_pad_get_peer(srcpad);
+    if (peer != NULL){
+      gst_pad_unlink(srcpad, peer);
+      gst_object_unref(peer);
+    }
+    gst_pad_set_active(srcpad, FALSE);
+    gst_object_unref(srcpad);
+  }
+
+  gst_object_unref(branch->element);
+  g_slice_free(GstDynamicTeeBranch, branch);
+}
+
+static void gst_dynamic_tee_branch_list_free(GstDynamicTeeBranchList *list)
+{
+  for (guint i = 0; i < list->len; i++){
+    gst_dynamic_tee_branch_unref(list->branches[i]);
+  }
+  g_free(list);
+}
+
+/* Releasing a list can push EOS to its branches, which must never happen
+ * under self->lock: a branch posting its EOS takes it */
+static void gst_dynamic_tee_free_lists(GSList *lists)
+{
+  g_slist_free_full(lists, (GDestroyNotify) gst_dynamic_tee_branch_list_free);
+}
+
+/* Read side: announce the epoch we are running in before loading the list.
+ * Never blocks, a writer can only delay the release of an old list */
+static GstDynamicTeeBranchList *gst_dynamic_tee_read_lock(GstDynamicTee *self, guint stream)
+{
+  g_atomic_int_set(&self->reader_epoch[stream], g_atomic_int_get(&self->epoch));
+  return g_atomic_pointer_get(&self->branches);
+}
+
+/* Must be called with self->lock held, returns the lists no reader can see
+ * anymore, to free once the lock is released */
+static GSList *gst_dynamic_tee_reclaim(GstDynamicTee *self)
+{
+  GSList *reclaimed = NULL;
+  gint oldest = G_MAXINT;
+
+  for (guint i = 0; i < N_STREAMS; i++){
+    gint epoch = g_atomic_int_get(&self->reader_epoch[i]);
+    if (epoch != 0 && epoch < oldest)
+      oldest = epoch;
+  }
+
+  GSList *l = self->retired;
+  while (l != NULL){
+    GSList *next = l->next;
+    GstDynamicTeeBranchList *list = l->data;
+
+    if (list->epoch <= oldest){
+      self->retired = g_slist_remove_link(self->retired, l);
+      reclaimed = g_slist_concat(l, reclaimed);
+      g_atomic_int_add(&self->n_retired, -1);
+      self->reclaimed++;
+    }
+    l = next;
+  }
+
+  return reclaimed;
+}
+
+/* A buffer boundary is a quiescent state: old lists retired before it can
+ * go. Only try the lock so the streaming thread never waits on a writer */
+static void gst_dynamic_tee_read_unlock(GstDynamicTee *self, guint stream)
+{
+  g_atomic_int_set(&self->reader_epoch[stream], 0);
+
+  if (g_atomic_int_get(&self->n_retired) > 0 && g_mutex_trylock(&self->lock)){
+    GSList *reclaimed = gst_dynamic_tee_reclaim(self);
+
+    g_mutex_unlock(&self->lock);
+    gst_dynamic_tee_free_lists(reclaimed);
+  }
+}
+
+/* Must be called with self->lock held, returns the lists to free once it is
+ * released */
+static GSList *gst_dynamic_tee_publish(GstDynamicTee *self, GstDynamicTeeBranchList *list)
+{
+  GstDynamicTeeBranchList *old = g_atomic_pointer_get(&self->branches);
+
+  g_atomic_pointer_set(&self->branches, list);
+  old->epoch = g_atomic_int_add(&self->epoch, 1) + 1;
+
+  self->retired = g_slist_prepend(self->retired, old);
+  g_atomic_int_inc(&self->n_retired);
+
+  return gst_dynamic_tee_reclaim(self);
+}
+
+static GstFlowReturn gst_dynamic_tee_chain(GstPad *pad, GstObject *parent, GstBuffer *buffer)
+{
+  GstDynamicTee *self = GST_DYNAMIC_TEE(parent);
+  guint stream = GPOINTER_TO_UINT(gst_pad_get_element_private(pad));
+
+  GstDynamicTeeBranchList *list = gst_dynamic_tee_read_lock(self, stream);
+
+  for (guint i = 0; i < list->len; i++){
+    GstDynamicTeeBranch *branch = list->branches[i];
+    GstPad *srcpad = branch->srcpads[stream];
+
+    if (srcpad == NULL)
+      continue;
+
+    gst_dynamic_tee_branch_replay_sticky(branch, pad, stream);
+
+    GstFlowReturn ret = gst_pad_push(srcpad, gst_buffer_ref(buffer));
+    if (ret != GST_FLOW_OK && ret != GST_FLOW_FLUSHING && ret != GST_FLOW_EOS){
+      GST_LOG_OBJECT(self, "Branch %s returned %s", GST_OBJECT_NAME(branch->element),
+          gst_flow_get_name(ret));
+    }
+  }
+  g_atomic_pointer_add(&self->buffers[stream], 1);
+
+  gst_dynamic_tee_read_unlock(self, stream);
+
+  gst_buffer_unref(buffer);
+
+  /* same as tee allow-not-linked, a failing consumer never stops the producer */
+  return GST_FLOW_OK;
+}
+
+static void gst_dynamic_tee_forward_event(GstDynamicTeeBranchList *list, GstPad *sinkpad,
+    guint stream, GstEvent *event)
+{
+  for (guint i = 0; i < list->len; i++){
+    GstDynamicTeeBranch *branch = list->branches[i];
+
+    /* The event will be part of the sticky events replayed before the first
+     * buffer of this branch */
+    if (branch->srcpads[stream] == NULL || branch->pending_sticky[stream])
+      continue;
+
+    gst_pad_push_event(branch->srcpads[stream], gst_event_ref(event));
+  }
+}
+
+static gboolean gst_dynamic_tee_sink_event(GstPad *pad, GstObject *parent, GstEvent *event)
+{
+  GstDynamicTee *self = GST_DYNAMIC_TEE(parent);
+  guint stream = GPOINTER_TO_UINT(gst_pad_get_element_private(pad));
+
+  if (GST_EVENT_IS_SERIALIZED(event)){
+    GstDynamicTeeBranchList *list = gst_dynamic_tee_read_lock(self, stream);
+    gst_dynamic_tee_forward_event(list, pad, stream, event);
+    gst_dynamic_tee_read_unlock(self, stream);
+  } else {
+    /* out of band events do not come from the streaming thread, hold the
+     * writer lock so the list cannot be released under us */
+    g_mutex_lock(&self->lock);
+    gst_dynamic_tee_forward_event(self->branches, pad, stream, event);
+    g_mutex_unlock(&self->lock);
+  }
+
+  gst_event_unref(event);
+  return TRUE;
+}
+
+static gboolean gst_dynamic_tee_src_event(GstPad *pad, GstObject *parent, GstEvent *event)
+{
+  GstDynamicTeeBranch *branch = gst_pad_get_element_private(pad);
+  guint stream = GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(pad), "stream"));
+
+  return gst_pad_push_event(branch->tee->sinkpads[stream], event);
+}
+
+static gboolean gst_dynamic_tee_src_query(GstPad *pad, GstObject *parent, GstQuery *query)
+{
+  GstDynamicTeeBranch *branch = gst_pad_get_element_private(pad);
+  guint stream = GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(pad), "stream"));
+
+  return gst_pad_peer_query(branch->tee->sinkpads[stream], query);
+}
+
+static GstDynamicTeeBranch *gst_dynamic_tee_branch_new(GstDynamicTee *self, GstElement *element)
+{
+  GstDynamicTeeBranch *branch = g_slice_new0(GstDynamicTeeBranch);
+  branch->refcount = 1;
+  branch->tee = self;
+  branch->element = gst_object_ref(element);
+
+  for (guint i = 0; i < N_STREAMS; i++){
+    GstPad *sinkpad = gst_element_get_static_pad(element, stream_pad_names[i]);
+    if (sinkpad == NULL){
+      GST_DEBUG("Branch %s has no %s pad", GST_OBJECT_NAME(element), stream_pad_names[i]);
+      continue;
+    }
+
+    gchar *name = g_strdup_printf("%s_%s", GST_OBJECT_NAME(element), stream_pad_names[i]);
+    GstPad *srcpad = gst_pad_new(name, GST_PAD_SRC);
+    g_free(name);
+
+    gst_object_ref_sink(srcpad);
+    gst_pad_set_element_private(srcpad, branch);
+    g_object_set_data(G_OBJECT(srcpad), "stream", GUINT_TO_POINTER(i));
+    gst_pad_set_event_function(srcpad, gst_dynamic_tee_src_event);
+    gst_pad_set_query_function(srcpad, gst_dynamic_tee_src_query);
+    gst_pad_set_active(srcpad, TRUE);
+
+    if (GST_PAD_LINK_FAILED(gst_pad_link_full(srcpad, sinkpad, GST_PAD_LINK_CHECK_NOTHING))){
+      GST_ERROR("Failed to link %s", GST_PAD_NAME(sinkpad));
+      gst_pad_set_active(srcpad, FALSE);
+      gst_object_unref(srcpad);
+    } else {
+      branch->srcpads[i] = srcpad;
+      branch->pending_sticky[i] = TRUE;
+    }
+    gst_object_unref(sinkpad);
+  }
+
+  return branch;
+}
+
+/* Removes the branch of element from the consumer set. Returns FALSE if the
+ * element is not attached. Must be called with self->lock held, the lists to
+ * free once it is released are added to @reclaimed */
+static gboolean gst_dynamic_tee_detach(GstDynamicTee *self, GstElement *element, gboolean send_eos,
+    GSList **reclaimed)
+{
+  GstDynamicTeeBranchList *old = self->branches;
+  gint index = -1;
+
+  for (guint i = 0; i < old->len; i++){
+    if (old->branches[i]->element == element){
+      index = i;
+      break;
+    }
+  }
+
+  if (index < 0)
+    return FALSE;
+
+  GstDynamicTeeBranchList *list = gst_dynamic_tee_branch_list_new(old->len - 1);
+  for (guint i = 0, j = 0; i < old->len; i++){
+    if (i == (guint) index)
+      continue;
+    list->branches[j++] = gst_dynamic_tee_branch_ref(old->branches[i]);
+  }
+
+  old->branches[index]->send_eos = send_eos;
+  *reclaimed = g_slist_concat(*reclaimed, gst_dynamic_tee_publish(self, list));
+  self->detached++;
+
+  return TRUE;
+}
+
+/* Fallback teardown, from the element thread pool */
+static void gst_dynamic_tee_clean_branch(GstElement *tee, gpointer user_data)
+{
+  GstElement *element = GST_ELEMENT(user_data);
+
+  gst_element_set_state(element, GST_STATE_NULL);
+  if (GST_OBJECT_PARENT(element) == GST_OBJECT(tee))
+    gst_bin_remove(GST_BIN(tee), element);
+}
+
+/* Must be called with reaper_lock held */
+static GstDynamicTeeTeardown *gst_dynamic_tee_find_teardown(GstDynamicTee *self, GstElement *element)
+{
+  for (GList *l = self->teardowns.head; l != NULL; l = l->next){
+    GstDynamicTeeTeardown *teardown = l->data;
+    if (teardown->element == element)
+      return teardown;
+  }
+
+  return NULL;
+}
+
+/* Hands element over to the reaper thread. Control threads wait for room in
+ * the queue, streaming threads must not since the reaper may be joining them:
+ * when the queue is full they fall back to an async call on the tee, which
+ * needs no main loop */
+static gboolean gst_dynamic_tee_queue_teardown(GstDynamicTee *self, GstElement *element,
+    gboolean ready, gboolean may_block)
+{
+  g_mutex_lock(&self->reaper_lock);
+
+  GstDynamicTeeTeardown *teardown = gst_dynamic_tee_find_teardown(self, element);
+  if (teardown != NULL){
+    teardown->ready |= ready;
+    g_cond_broadcast(&self->reaper_cond);
+    g_mutex_unlock(&self->reaper_lock);
+    return TRUE;
+  }
+
+  while (self->reaper_running && may_block &&
+      self->teardowns.length >= self->max_pending_teardowns){
+    g_cond_wait(&self->reaper_cond, &self->reaper_lock);
+  }
+
+  if (!self->reaper_running || self->teardowns.length >= self->max_pending_teardowns){
+    g_mutex_unlock(&self->reaper_lock);
+
+    GST_WARNING("Teardown queue full, removing %s asynchronously", GST_OBJECT_NAME(element));
+    gst_element_call_async(GST_ELEMENT(self), gst_dynamic_tee_clean_branch,
+        gst_object_ref(element), gst_object_unref);
+    return FALSE;
+  }
+
+  teardown = g_slice_new0(GstDynamicTeeTeardown);
+  teardown->element = gst_object_ref(element);
+  teardown->requested = g_get_monotonic_time();
+  teardown->deadline = teardown->requested + self->teardown_timeout / GST_USECOND;
+  teardown->ready = ready;
+  g_queue_push_tail(&self->teardowns, teardown);
+  g_cond_broadcast(&self->reaper_cond);
+
+  g_mutex_unlock(&self->reaper_lock);
+  return TRUE;
+}
+
+static void gst_dynamic_tee_finalize_branch(GstDynamicTee *self, GstDynamicTeeTeardown *teardown)
+{
+  GstElement *element = teardown->element;
+  gboolean timed_out = !teardown->ready;
+
+  if (timed_out){
+    GST_WARNING("Branch %s did not deliver EOS in time, tearing it down", GST_OBJECT_NAME(element));
+  }
+
+  gst_element_set_state(element, GST_STATE_NULL);
+  if (GST_OBJECT_PARENT(element) == GST_OBJECT(self)){
+    gst_bin_remove(GST_BIN(self), element);
+  }
+
+  GstClockTime duration = (g_get_monotonic_time() - teardown->requested) * GST_USECOND;
+  GST_INFO("Branch %s torn down in %" GST_TIME_FORMAT, GST_OBJECT_NAME(element), GST_TIME_ARGS(duration));
+
+  g_mutex_lock(&self->reaper_lock);
+  self->torn_down++;
+  if (timed_out)
+    self->timed_out++;
+  self->last_teardown_duration = duration;
+  self->max_teardown_duration = MAX(self->max_teardown_duration, duration);
+  g_mutex_unlock(&self->reaper_lock);
+
+  gst_element_post_message(GST_ELEMENT(self),
+      gst_message_new_element(GST_OBJECT(self),
+          gst_structure_new("dynamictee-teardown",
+              "element", G_TYPE_STRING, GST_OBJECT_NAME(element),
+              "duration", G_TYPE_UINT64, duration,
+              "timed-out", G_TYPE_BOOLEAN, timed_out,
+              NULL)));
+
+  gst_object_unref(element);
+  g_slice_free(GstDynamicTeeTeardown, teardown);
+}
+
+static gpointer gst_dynamic_tee_reaper_func(gpointer data)
+{
+  GstDynamicTee *self = GST_DYNAMIC_TEE(data);
+
+  g_mutex_lock(&self->reaper_lock);
+  while (self->reaper_running || self->teardowns.length > 0){
+    gint64 now = g_get_monotonic_time();
+    gint64 next_deadline = G_MAXINT64;
+    GstDynamicTeeTeardown *teardown = NULL;
+
+    for (GList *l = self->teardowns.head; l != NULL; l = l->next){
+      GstDynamicTeeTeardown *candidate = l->data;
+      if (candidate->ready || candidate->deadline <= now || !self->reaper_running){
+        teardown = candidate;
+        g_queue_delete_link(&self->teardowns, l);
+        break;
+      }
+      next_deadline = MIN(next_deadline, candidate->deadline);
+    }
+
+    if (teardown == NULL){
+      if (next_deadline == G_MAXINT64)
+        g_cond_wait(&self->reaper_cond, &self->reaper_lock);
+      else
+        g_cond_wait_until(&self->reaper_cond, &self->reaper_lock, next_deadline);
+      continue;
+    }
+
+    /* room for a waiting stop request */
+    g_cond_broadcast(&self->reaper_cond);
+    g_mutex_unlock(&self->reaper_lock);
+
+    gst_dynamic_tee_finalize_branch(self, teardown);
+
+    g_mutex_lock(&self->reaper_lock);
+  }
+  g_mutex_unlock(&self->reaper_lock);
+
+  return NULL;
+}
+
 static void gst_dynamic_tee_init(GstDynamicTee *self)
 {
-  GstBin *bin = GST_BIN(self);
   GstElement *element = GST_ELEMENT(self);
-  self->taudio = gst_element_factory_make("tee", "atee");
-  self->tvideo = gst_element_factory_make("tee", "vtee");
 
-  g_object_set(self->taudio, "allow-not-linked", TRUE, NULL);
-  g_object_set(self->tvideo, "allow-not-linked", TRUE, NULL);
-  gst_bin_add_many(bin, self->taudio, self->tvideo, NULL);
+  g_mutex_init(&self->lock);
+  self->branches = gst_dynamic_tee_branch_list_new(0);
+  self->epoch = 1;
 
-  GstPad *pad = gst_element_get_static_pad(self->taudio, "sink");
-  gst_element_add_pad(element, gst_ghost_pad_new("audio_sink", pad));
-  gst_object_unref(GST_OBJECT(pad));
+  self->sinkpads[STREAM_VIDEO] = gst_pad_new_from_static_template(&video_sink_template, "video_sink");
+  self->sinkpads[STREAM_AUDIO] = gst_pad_new_from_static_template(&audio_sink_template, "audio_sink");
 
-  pad = gst_element_get_static_pad(self->tvideo, "sink");
-  gst_element_add_pad(element, gst_ghost_pad_new("video_sink", pad));
-  gst_object_unref(GST_OBJECT(pad));
+  for (guint i = 0; i < N_STREAMS; i++){
+    GstPad *pad = self->sinkpads[i];
+    gst_pad_set_element_private(pad, GUINT_TO_POINTER(i));
+    gst_pad_set_chain_function(pad, gst_dynamic_tee_chain);
+    gst_pad_set_event_function(pad, gst_dynamic_tee_sink_event);
+    gst_element_add_pad(element, pad);
+  }
+
+  g_mutex_init(&self->reaper_lock);
+  g_cond_init(&self->reaper_cond);
+  g_queue_init(&self->teardowns);
+  self->teardown_timeout = DEFAULT_TEARDOWN_TIMEOUT;
+  self->max_pending_teardowns = DEFAULT_MAX_PENDING_TEARDOWNS;
+  self->reaper_running = TRUE;
+  self->reaper = g_thread_new("dtee-reaper", gst_dynamic_tee_reaper_func, self);
+
+}
+
+static void gst_dynamic_tee_forget_eos(gpointer data, gpointer user_data)
+{
+  GstDynamicTeeBranchList *list = data;
+
+  for (guint i = 0; i < list->len; i++){
+    list->branches[i]->send_eos = FALSE;
+  }
+}
+
+static void gst_dynamic_tee_dispose(GObject *object)
+{
+  GstDynamicTee *self = GST_DYNAMIC_TEE(object);
+
+  /* pending teardowns are finalized right away while the children are still
+   * around */
+  if (self->reaper != NULL){
+    g_mutex_lock(&self->reaper_lock);
+    self->reaper_running = FALSE;
+    g_cond_broadcast(&self->reaper_cond);
+    g_mutex_unlock(&self->reaper_lock);
+
+    g_thread_join(self->reaper);
+    self->reaper = NULL;
+  }
+
+  /* the sink pads go away with the element, pending EOS can't be replayed */
+  g_mutex_lock(&self->lock);
+  g_slist_foreach(self->retired, gst_dynamic_tee_forget_eos, NULL);
+  g_mutex_unlock(&self->lock);
+
+  G_OBJECT_CLASS(parent_class)->dispose(object);
+}
+
+static void gst_dynamic_tee_finalize(GObject *object)
+{
+  GstDynamicTee *self = GST_DYNAMIC_TEE(object);
+
+  g_slist_free_full(self->retired, (GDestroyNotify) gst_dynamic_tee_branch_list_free);
+  self->retired = NULL;
+  gst_dynamic_tee_branch_list_free(self->branches);
+  self->branches = NULL;
 
+  g_mutex_clear(&self->lock);
+  g_mutex_clear(&self->reaper_lock);
+  g_cond_clear(&self->reaper_cond);
+
+  G_OBJECT_CLASS(parent_class)->finalize(object);
 }
 
 static void gst_dynamic_tee_set_property(GObject *object,
@@ -65,13 +658,51 @@ static void gst_dynamic_tee_set_property(GObject *object,
     GstDynamicTee *self = GST_DYNAMIC_TEE(object);
 
     switch (prop_id) {
+        case PROP_TEARDOWN_TIMEOUT:
+            g_mutex_lock(&self->reaper_lock);
+            self->teardown_timeout = g_value_get_uint64(value);
+            g_mutex_unlock(&self->reaper_lock);
+            break;
+        case PROP_MAX_PENDING_TEARDOWNS:
+            g_mutex_lock(&self->reaper_lock);
+            self->max_pending_teardowns = g_value_get_uint(value);
+            g_cond_broadcast(&self->reaper_cond);
+            g_mutex_unlock(&self->reaper_lock);
+            break;
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
-            break;    
+            break;
     }
 
 }
 
+static GstStructure *gst_dynamic_tee_get_stats(GstDynamicTee *self)
+{
+  g_mutex_lock(&self->lock);
+  GstStructure *stats = gst_structure_new("dynamictee-stats",
+      "branches", G_TYPE_UINT, self->branches->len,
+      "attached", G_TYPE_UINT64, self->attached,
+      "detached", G_TYPE_UINT64, self->detached,
+      "video-buffers", G_TYPE_UINT64, (guint64) (gsize) g_atomic_pointer_get(&self->buffers[STREAM_VIDEO]),
+      "audio-buffers", G_TYPE_UINT64, (guint64) (gsize) g_atomic_pointer_get(&self->buffers[STREAM_AUDIO]),
+      "retired-lists", G_TYPE_INT, g_atomic_int_get(&self->n_retired),
+      "reclaimed-lists", G_TYPE_UINT64, self->reclaimed,
+      NULL);
+  g_mutex_unlock(&self->lock);
+
+  g_mutex_lock(&self->reaper_lock);
+  gst_structure_set(stats,
+      "pending-teardowns", G_TYPE_UINT, self->teardowns.length,
+      "teardowns", G_TYPE_UINT64, self->torn_down,
+      "teardown-timeouts", G_TYPE_UINT64, self->timed_out,
+      "last-teardown-duration", G_TYPE_UINT64, self->last_teardown_duration,
+      "max-teardown-duration", G_TYPE_UINT64, self->max_teardown_duration,
+      NULL);
+  g_mutex_unlock(&self->reaper_lock);
+
+  return stats;
+}
+
 static void gst_dynamic_tee_get_property(GObject *object,
                                                 guint prop_id,
                                                 GValue *value,
@@ -79,7 +710,16 @@ static void gst_dynamic_tee_get_property(GObject *object,
 
     GstDynamicTee *self = GST_DYNAMIC_TEE(object);
 
-    switch (prop_id) {   
+    switch (prop_id) {
+        case PROP_STATS:
+            g_value_take_boxed(value, gst_dynamic_tee_get_stats(self));
+            break;
+        case PROP_TEARDOWN_TIMEOUT:
+            g_value_set_uint64(value, self->teardown_timeout);
+            break;
+        case PROP_MAX_PENDING_TEARDOWNS:
+            g_value_set_uint(value, self->max_pending_teardowns);
+            break;
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
             break;
@@ -89,18 +729,31 @@ static void gst_dynamic_tee_get_property(GObject *object,
 
 static void gst_dynamic_tee_on_element_error (GstElement* proxy, gchar* message, gpointer user_data){
     GST_DEBUG ("ERROR from element %s with message %s\n", GST_OBJECT_NAME(proxy), message);
-    GstDynamicTee* tee = GST_DYNAMIC_TEE(user_data);  
-    gst_element_set_state(proxy, GST_STATE_NULL);
-    gst_bin_remove(GST_BIN(tee), proxy);
-    
-    
+    GstDynamicTee* tee = GST_DYNAMIC_TEE(user_data);
+    GSList *reclaimed = NULL;
+
+    g_mutex_lock(&tee->lock);
+    gst_dynamic_tee_detach(tee, proxy, FALSE, &reclaimed);
+    g_mutex_unlock(&tee->lock);
+    gst_dynamic_tee_free_lists(reclaimed);
+
+    gst_dynamic_tee_queue_teardown(tee, proxy, TRUE, FALSE);
+
+
 }
 
 static void gst_dynamic_tee_on_element_eos (GstElement* proxy, gpointer user_data){
-    GST_DEBUG ("EOS from element %s\n", GST_OBJECT_NAME(proxy)); 
-    GstDynamicTee* tee = GST_DYNAMIC_TEE(user_data);  
-    gst_element_set_state(proxy, GST_STATE_NULL);
-    gst_bin_remove(GST_BIN(tee), proxy);
+    GST_DEBUG ("EOS from element %s\n", GST_OBJECT_NAME(proxy));
+    GstDynamicTee* tee = GST_DYNAMIC_TEE(user_data);
+    GSList *reclaimed = NULL;
+
+    /* no streaming thread may push to it once it is torn down */
+    g_mutex_lock(&tee->lock);
+    gst_dynamic_tee_detach(tee, proxy, FALSE, &reclaimed);
+    g_mutex_unlock(&tee->lock);
+    gst_dynamic_tee_free_lists(reclaimed);
+
+    gst_dynamic_tee_queue_teardown(tee, proxy, TRUE, FALSE);
 
 }
 
@@ -108,7 +761,7 @@ static void gst_dynamic_tee_on_element_eos (GstElement* proxy, gpointer user_dat
 static gboolean gst_dynamic_tee_start(GstDynamicTee *self, gpointer element_ptr){
   GST_DEBUG("DynamicTee start with new element");
   GstElement* element = GST_ELEMENT(element_ptr);
-  
+
   if (GST_IS_PROXY_BIN(element)){
     GST_DEBUG("Proxy bin detected");
     g_signal_connect (element, "on-error",
@@ -121,81 +774,65 @@ static gboolean gst_dynamic_tee_start(GstDynamicTee *self, gpointer element_ptr)
 
 
 
-  gst_bin_add(GST_BIN(self), element);
-  gst_element_set_locked_state(element, TRUE);
+  if (!gst_bin_add(GST_BIN(self), element)){
+    GST_ERROR("Failed to add %s", GST_OBJECT_NAME(element));
+    return FALSE;
+  }
   gst_element_sync_state_with_parent(element);
-  gst_element_link(self->tvideo, element);
-  gst_element_link(self->taudio, element);
-  gst_element_set_locked_state(element, FALSE);
-  
-  return TRUE;
-}
 
-static GstPadProbeReturn stop_bin_callback (GstPad * pad, GstPadProbeInfo * info, gpointer user_data){
-    gst_pad_remove_probe (pad, GST_PAD_PROBE_INFO_ID (info));
-    GstPad *sink_pad = gst_pad_get_peer(pad);
-    gst_pad_send_event(sink_pad, gst_event_new_eos());
-    
-    gst_pad_unlink(pad, sink_pad);
-    g_object_unref(sink_pad);
- 
-    return GST_PAD_PROBE_DROP;
-}
-
-static void stop_bin(GstDynamicTee *self, GstElement *element){
-  GstPad *vsink = gst_element_get_static_pad(element, "video_sink");
-  GstPad *asink = gst_element_get_static_pad(element, "audio_sink");
+  GstDynamicTeeBranch *branch = gst_dynamic_tee_branch_new(self, element);
 
-  GstPad *vsrc = gst_pad_get_peer(vsink);
-  GstPad *asrc = gst_pad_get_peer(asink);
+  /* The streaming threads pick the new list up at their next buffer */
+  g_mutex_lock(&self->lock);
+  GstDynamicTeeBranchList *old = self->branches;
+  GstDynamicTeeBranchList *list = gst_dynamic_tee_branch_list_new(old->len + 1);
+  for (guint i = 0; i < old->len; i++){
+    list->branches[i] = gst_dynamic_tee_branch_ref(old->branches[i]);
+  }
+  list->branches[old->len] = branch;
+  GSList *reclaimed = gst_dynamic_tee_publish(self, list);
+  self->attached++;
+  g_mutex_unlock(&self->lock);
+  gst_dynamic_tee_free_lists(reclaimed);
 
-  gst_pad_add_probe(vsrc, GST_PAD_PROBE_TYPE_BLOCK_DOWNSTREAM, stop_bin_callback, self, NULL);
-  gst_pad_add_probe(asrc, GST_PAD_PROBE_TYPE_BLOCK_DOWNSTREAM, stop_bin_callback, self, NULL);
-  
-  gst_object_unref(vsink);
-  gst_object_unref(asink);
-  gst_object_unref(vsrc);
-  gst_object_unref(asrc);
-        
+  return TRUE;
 }
 
 static gboolean gst_dynamic_tee_stop(GstDynamicTee *self, gpointer element_ptr){
   GstElement* element = GST_ELEMENT(element_ptr);
-  stop_bin(self, element);
-  return FALSE;
-}
-
-typedef struct{
-  const gchar* name;
-  GstElement *element;
-  GstDynamicTee* tee;
-} clean_bin_t;
 
-static gboolean clean_bin(gpointer data_ptr){
-  clean_bin_t *data = (clean_bin_t*) data_ptr;
-  GstBin* bin = GST_BIN(data->tee);
-  if (data->element != NULL){
-    gst_element_set_state(data->element, GST_STATE_NULL);
-    gst_bin_remove(bin, data->element);
+  /* EOS is pushed to the branch when the last streaming thread that could
+   * still see it is done with its buffer */
+  GSList *reclaimed = NULL;
+  g_mutex_lock(&self->lock);
+  gboolean ret = gst_dynamic_tee_detach(self, element, TRUE, &reclaimed);
+  g_mutex_unlock(&self->lock);
+  gst_dynamic_tee_free_lists(reclaimed);
+
+  if (!ret){
+    GST_WARNING("Element %s is not attached", GST_OBJECT_NAME(element));
+    return FALSE;
   }
 
-  return G_SOURCE_REMOVE;
+  return gst_dynamic_tee_queue_teardown(self, element, FALSE, TRUE);
 }
 
-
-
 static void handle_message (GstBin * bin, GstMessage * message){
     if (GST_MESSAGE_TYPE (message) == GST_MESSAGE_EOS) {
 
           GST_DEBUG ("EOS from element %s\n", GST_OBJECT_NAME (GST_MESSAGE_SRC (message)));
-          const gchar* src_name = GST_OBJECT_NAME(GST_MESSAGE_SRC (message));
           GstDynamicTee* tee = GST_DYNAMIC_TEE(bin);
-        
-          clean_bin_t *clean_bin_data = malloc(sizeof(clean_bin_t));
-          clean_bin_data->element = GST_ELEMENT(GST_MESSAGE_SRC (message));
-          clean_bin_data->name = src_name;
-          clean_bin_data->tee = tee;
-          g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, clean_bin, clean_bin_data, g_free);
+          GstElement *element = GST_ELEMENT(GST_MESSAGE_SRC (message));
+          GSList *reclaimed = NULL;
+
+          /* posted from the streaming thread of the branch, a branch still
+           * attached is detached before it goes */
+          g_mutex_lock(&tee->lock);
+          gst_dynamic_tee_detach(tee, element, FALSE, &reclaimed);
+          g_mutex_unlock(&tee->lock);
+          gst_dynamic_tee_free_lists(reclaimed);
+
+          gst_dynamic_tee_queue_teardown(tee, element, TRUE, FALSE);
     }
 
     if(message){
@@ -211,8 +848,30 @@ static void gst_dynamic_tee_class_init(GstDynamicTeeClass *klass)
 
   object_class->set_property = gst_dynamic_tee_set_property;
   object_class->get_property = gst_dynamic_tee_get_property;
+  object_class->dispose = gst_dynamic_tee_dispose;
+  object_class->finalize = gst_dynamic_tee_finalize;
   bin_class->handle_message = handle_message;
 
+  gst_element_class_add_static_pad_template(element_class, &video_sink_template);
+  gst_element_class_add_static_pad_template(element_class, &audio_sink_template);
+
+  g_object_class_install_property(object_class, PROP_STATS,
+                                  g_param_spec_boxed("stats", "Stats",
+                                                   "Branch churn and buffer counters", GST_TYPE_STRUCTURE,
+                                                   G_PARAM_READABLE));
+
+  g_object_class_install_property(object_class, PROP_TEARDOWN_TIMEOUT,
+                                  g_param_spec_uint64("teardown-timeout", "Teardown timeout",
+                                                   "Time to wait for the EOS of a stopped branch before tearing it down (in ns)",
+                                                   0, G_MAXUINT64, DEFAULT_TEARDOWN_TIMEOUT,
+                                                   G_PARAM_READWRITE));
+
+  g_object_class_install_property(object_class, PROP_MAX_PENDING_TEARDOWNS,
+                                  g_param_spec_uint("max-pending-teardowns", "Max pending teardowns",
+                                                   "Maximum number of stopped branches waiting to be torn down",
+                                                   1, G_MAXUINT, DEFAULT_MAX_PENDING_TEARDOWNS,
+                                                   G_PARAM_READWRITE));
+
   GType tee_params[1] = {G_TYPE_POINTER};
 
   gst_dynamic_tee_signals[SIGNAL_START] =
@@ -220,14 +879,14 @@ static void gst_dynamic_tee_class_init(GstDynamicTeeClass *klass)
                     G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
                     g_cclosure_new(G_CALLBACK(gst_dynamic_tee_start), NULL, NULL),
                     NULL, NULL, NULL, G_TYPE_BOOLEAN,
-                    1, tee_params); 
+                    1, tee_params);
 
   gst_dynamic_tee_signals[SIGNAL_STOP] =
       g_signal_newv("stop", G_TYPE_FROM_CLASS(klass),
                     G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
                     g_cclosure_new(G_CALLBACK(gst_dynamic_tee_stop), NULL, NULL),
                     NULL, NULL, NULL, G_TYPE_BOOLEAN,
-                    1, tee_params);      
+                    1, tee_params);
 
   GST_DEBUG_CATEGORY_INIT (gst_preview_sink_debug, "dynamictee", 0,
       "dynamictee");
@@ -238,4 +897,4 @@ static void gst_dynamic_tee_class_init(GstDynamicTeeClass *klass)
                                         "DynamicTee",
                                         "DynamicTee",
                                         "Ludovic Bouguerra <ludovic.bouguerra@stream.studio>");
-}
\ No newline at end of file
+}
@@ -0,0 +1,612 @@
+#include "gstpoolqueue.h"
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <common/gstworkpool.h>
+
+GST_DEBUG_CATEGORY_STATIC (gst_pool_queue_debug);
+#define GST_CAT_DEFAULT gst_pool_queue_debug
+
+#define gst_pool_queue_parent_class parent_class
+
+#define DEFAULT_MAX_SIZE_BUFFERS 200
+#define DEFAULT_LEAKY TRUE
+/* items pushed per job before yielding the worker to other queues */
+#define DRAIN_BATCH 16
+/* a push taking longer blocks the pool, the queue gets a thread of its own */
+#define BLOCKING_PUSH (20 * G_TIME_SPAN_MILLISECOND)
+/* fast pushes in a row on the task before the queue goes back to the pool */
+#define RECOVER_PUSHES 100
+
+/* queues on a task of their own because downstream blocked the pool, at
+ * most as many as pool threads in the process */
+static gint n_blocked = 0;
+
+/* properties */
+enum
+{
+  PROP_0,
+  PROP_MAX_SIZE_BUFFERS,
+  PROP_LEAKY,
+  PROP_STATS,
+};
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS_ANY);
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS_ANY);
+
+/* A leaky queue without a streaming thread of its own: buffers are pushed
+ * downstream by a drain job on the shared work pool. At most one job per
+ * queue is in flight, so the output keeps the input order. Where
+ * downstream may block, before PLAYING while the sinks wait for preroll
+ * or once a push was seen blocking, the queue drains on a src pad task
+ * instead, which owns the "scheduled" slot as long as it runs. A blocked
+ * queue returns to the pool once downstream keeps up again, and past the
+ * process-wide cap it stays on the pool. */
+struct _GstPoolQueue
+{
+  GstElement parent_instance;
+
+  GstPad *sinkpad;
+  GstPad *srcpad;
+
+  GMutex lock;
+  GCond cond;
+  GQueue items;
+  guint n_buffers;
+
+  guint max_size_buffers;
+  gboolean leaky;
+
+  gboolean flushing;
+  gboolean scheduled;
+  gboolean dedicated;
+  /* downstream blocked a pool worker, until it keeps up again or READY */
+  gboolean blocked;
+  guint fast_pushes;
+  gboolean playing;
+  GstFlowReturn srcresult;
+
+  GstQuery *pending_query;
+  gboolean query_result;
+
+  guint max_level;
+  guint64 dropped;
+  guint64 runs;
+  guint64 steals;
+  guint64 blocking_pushes;
+  guint64 fallbacks;
+  guint64 refused_fallbacks;
+};
+
+G_DEFINE_TYPE(GstPoolQueue, gst_pool_queue, GST_TYPE_ELEMENT);
+
+static void gst_pool_queue_drain(gpointer data, gboolean stolen);
+static void gst_pool_queue_loop(gpointer data);
+
+static void gst_pool_queue_clear(GstPoolQueue *self)
+{
+  GstMiniObject *item;
+
+  /* queries are borrowed from the thread waiting in the query function */
+  while ((item = g_queue_pop_head(&self->items)) != NULL){
+    if (!GST_IS_QUERY(item))
+      gst_mini_object_unref(item);
+    else if (item == GST_MINI_OBJECT_CAST(self->pending_query))
+      self->pending_query = NULL;
+  }
+  self->n_buffers = 0;
+}
+
+/* called with the lock */
+static void gst_pool_queue_schedule(GstPoolQueue *self)
+{
+  if (self->flushing || g_queue_is_empty(&self->items))
+    return;
+
+  /* the task waits for items */
+  if (self->scheduled){
+    g_cond_broadcast(&self->cond);
+    return;
+  }
+
+  self->scheduled = TRUE;
+  gst_work_pool_push(gst_work_pool_get_default(), gst_pool_queue_drain, gst_object_ref(self));
+}
+
+/* called with the lock, FALSE when as many queues as pool threads already
+ * drain on tasks of their own */
+static gboolean gst_pool_queue_set_blocked(GstPoolQueue *self, gboolean blocked)
+{
+  if (blocked == self->blocked)
+    return TRUE;
+
+  if (blocked){
+    gint max = gst_work_pool_get_n_threads(gst_work_pool_get_default());
+
+    if (g_atomic_int_add(&n_blocked, 1) >= max){
+      g_atomic_int_add(&n_blocked, -1);
+      self->refused_fallbacks++;
+      return FALSE;
+    }
+    self->fallbacks++;
+  } else {
+    g_atomic_int_add(&n_blocked, -1);
+  }
+  self->blocked = blocked;
+  self->fast_pushes = 0;
+
+  return TRUE;
+}
+
+/* called with the lock, returns TRUE if the caller must start the task */
+static gboolean gst_pool_queue_set_dedicated(GstPoolQueue *self, gboolean dedicated)
+{
+  self->dedicated = dedicated;
+  g_cond_broadcast(&self->cond);
+  if (!dedicated || self->scheduled || self->flushing)
+    return FALSE;
+
+  self->scheduled = TRUE;
+  return TRUE;
+}
+
+/* called with the lock, pushes the head item without it. Returns FALSE
+ * when there is nothing to push. */
+static gboolean gst_pool_queue_push_head(GstPoolQueue *self)
+{
+  GstMiniObject *item;
+  GstFlowReturn ret = GST_FLOW_OK;
+
+  if (self->flushing || (item = g_queue_pop_head(&self->items)) == NULL)
+    return FALSE;
+
+  if (GST_IS_BUFFER(item))
+    self->n_buffers--;
+  g_cond_broadcast(&self->cond);
+  g_mutex_unlock(&self->lock);
+
+  if (GST_IS_BUFFER(item)){
+    ret = gst_pad_push(self->srcpad, GST_BUFFER(item));
+  } else if (GST_IS_EVENT(item)){
+    if (GST_EVENT_TYPE(item) == GST_EVENT_EOS)
+      ret = GST_FLOW_EOS;
+    gst_pad_push_event(self->srcpad, GST_EVENT(item));
+  } else {
+    GstQuery *query = GST_QUERY(item);
+    gboolean res = gst_pad_peer_query(self->srcpad, query);
+
+    g_mutex_lock(&self->lock);
+    if (self->pending_query == query){
+      self->query_result = res;
+      self->pending_query = NULL;
+      g_cond_broadcast(&self->cond);
+    }
+    g_mutex_unlock(&self->lock);
+  }
+
+  g_mutex_lock(&self->lock);
+  if (ret != GST_FLOW_OK && !self->flushing){
+    GST_DEBUG_OBJECT(self, "Downstream returned %s", gst_flow_get_name(ret));
+    self->srcresult = ret;
+  }
+
+  return TRUE;
+}
+
+static void gst_pool_queue_drain(gpointer data, gboolean stolen)
+{
+  GstPoolQueue *self = GST_POOL_QUEUE(data);
+  gboolean dedicated;
+
+  g_mutex_lock(&self->lock);
+  self->runs++;
+  if (stolen)
+    self->steals++;
+
+  for (guint i = 0; i < DRAIN_BATCH && !self->dedicated; i++){
+    gint64 start = g_get_monotonic_time();
+
+    if (!gst_pool_queue_push_head(self))
+      break;
+    if (g_get_monotonic_time() - start > BLOCKING_PUSH && !self->flushing){
+      self->blocking_pushes++;
+      if (gst_pool_queue_set_blocked(self, TRUE)){
+        GST_INFO_OBJECT(self, "Downstream blocked a pool thread, draining on a task");
+        self->dedicated = TRUE;
+      } else {
+        GST_DEBUG_OBJECT(self, "Downstream blocked a pool thread, no task left for it");
+      }
+    }
+  }
+
+  /* the task takes the slot over */
+  dedicated = self->dedicated && !self->flushing;
+  if (!dedicated){
+    self->scheduled = FALSE;
+    gst_pool_queue_schedule(self);
+  }
+  g_cond_broadcast(&self->cond);
+  g_mutex_unlock(&self->lock);
+
+  if (dedicated)
+    gst_pad_start_task(self->srcpad, gst_pool_queue_loop, self, NULL);
+
+  gst_object_unref(self);
+}
+
+/* src pad task, drains while downstream may block */
+static void gst_pool_queue_loop(gpointer data)
+{
+  GstPoolQueue *self = GST_POOL_QUEUE(data);
+  gboolean restart;
+
+  g_mutex_lock(&self->lock);
+  while (!self->flushing && self->dedicated && g_queue_is_empty(&self->items))
+    g_cond_wait(&self->cond, &self->lock);
+
+  if (!self->flushing && self->dedicated){
+    gint64 start = g_get_monotonic_time();
+
+    if (gst_pool_queue_push_head(self) && self->blocked && self->playing){
+      if (g_get_monotonic_time() - start > BLOCKING_PUSH){
+        self->fast_pushes = 0;
+      } else if (++self->fast_pushes >= RECOVER_PUSHES && !self->flushing){
+        /* the next iteration gives the slot back to the pool */
+        GST_INFO_OBJECT(self, "Downstream keeps up again, draining on the pool");
+        gst_pool_queue_set_blocked(self, FALSE);
+        self->dedicated = FALSE;
+      }
+    }
+    g_mutex_unlock(&self->lock);
+    return;
+  }
+  g_mutex_unlock(&self->lock);
+
+  /* gives the slot back, to the pool unless flushing */
+  gst_pad_pause_task(self->srcpad);
+
+  g_mutex_lock(&self->lock);
+  restart = self->dedicated && !self->flushing;
+  if (!restart){
+    self->scheduled = FALSE;
+    gst_pool_queue_schedule(self);
+  }
+  g_cond_broadcast(&self->cond);
+  g_mutex_unlock(&self->lock);
+
+  if (restart)
+    gst_pad_start_task(self->srcpad, gst_pool_queue_loop, self, NULL);
+}
+
+static GstFlowReturn gst_pool_queue_chain(GstPad *pad, GstObject *parent, GstBuffer *buffer)
+{
+  GstPoolQueue *self = GST_POOL_QUEUE(parent);
+  GstFlowReturn ret;
+
+  g_mutex_lock(&self->lock);
+
+  while (!self->flushing && self->n_buffers >= self->max_size_buffers){
+    if (self->leaky){
+      /* drop the oldest buffer, keep serialized events */
+      for (GList *l = self->items.head; l != NULL; l = l->next){
+        if (GST_IS_BUFFER(l->data)){
+          gst_buffer_unref(GST_BUFFER(l->data));
+          g_queue_delete_link(&self->items, l);
+          self->n_buffers--;
+          self->dropped++;
+          break;
+        }
+      }
+    } else {
+      g_cond_wait(&self->cond, &self->lock);
+    }
+  }
+
+  if (self->flushing){
+    ret = GST_FLOW_FLUSHING;
+    gst_buffer_unref(buffer);
+  } else if (self->srcresult != GST_FLOW_OK){
+    ret = self->srcresult;
+    gst_buffer_unref(buffer);
+  } else {
+    g_queue_push_tail(&self->items, buffer);
+    self->n_buffers++;
+    self->max_level = MAX(self->max_level, self->n_buffers);
+    gst_pool_queue_schedule(self);
+    ret = GST_FLOW_OK;
+  }
+
+  g_mutex_unlock(&self->lock);
+
+  return ret;
+}
+
+static void gst_pool_queue_set_flushing(GstPoolQueue *self, gboolean flushing)
+{
+  gboolean start = FALSE;
+
+  g_mutex_lock(&self->lock);
+  self->flushing = flushing;
+  if (flushing){
+    gst_pool_queue_clear(self);
+    self->srcresult = GST_FLOW_FLUSHING;
+    /* wait for the drain job or the task to give the src pad back */
+    g_cond_broadcast(&self->cond);
+    while (self->scheduled)
+      g_cond_wait(&self->cond, &self->lock);
+  } else {
+    self->srcresult = GST_FLOW_OK;
+    start = gst_pool_queue_set_dedicated(self, self->dedicated);
+  }
+  g_mutex_unlock(&self->lock);
+
+  if (start)
+    gst_pad_start_task(self->srcpad, gst_pool_queue_loop, self, NULL);
+}
+
+/* Sinks wait for preroll before PLAYING, a pool thread must not */
+static void gst_pool_queue_update_dedicated(GstPoolQueue *self, gboolean playing)
+{
+  gboolean start;
+
+  g_mutex_lock(&self->lock);
+  self->playing = playing;
+  start = gst_pool_queue_set_dedicated(self, !playing || self->blocked);
+  g_mutex_unlock(&self->lock);
+
+  if (start)
+    gst_pad_start_task(self->srcpad, gst_pool_queue_loop, self, NULL);
+}
+
+static gboolean gst_pool_queue_sink_event(GstPad *pad, GstObject *parent, GstEvent *event)
+{
+  GstPoolQueue *self = GST_POOL_QUEUE(parent);
+
+  switch (GST_EVENT_TYPE(event)){
+    case GST_EVENT_FLUSH_START:
+      gst_pad_push_event(self->srcpad, event);
+      gst_pool_queue_set_flushing(self, TRUE);
+      gst_pad_pause_task(self->srcpad);
+      return TRUE;
+    case GST_EVENT_FLUSH_STOP:
+      gst_pool_queue_set_flushing(self, FALSE);
+      return gst_pad_push_event(self->srcpad, event);
+    default:
+      break;
+  }
+
+  if (!GST_EVENT_IS_SERIALIZED(event))
+    return gst_pad_push_event(self->srcpad, event);
+
+  g_mutex_lock(&self->lock);
+  if (self->flushing){
+    g_mutex_unlock(&self->lock);
+    gst_event_unref(event);
+    return FALSE;
+  }
+  g_queue_push_tail(&self->items, event);
+  gst_pool_queue_schedule(self);
+  g_mutex_unlock(&self->lock);
+
+  return TRUE;
+}
+
+static gboolean gst_pool_queue_sink_query(GstPad *pad, GstObject *parent, GstQuery *query)
+{
+  GstPoolQueue *self = GST_POOL_QUEUE(parent);
+
+  if (!GST_QUERY_IS_SERIALIZED(query))
+    return gst_pad_query_default(pad, parent, query);
+
+  /* serialized queries must reach downstream after the queued data */
+  g_mutex_lock(&self->lock);
+  if (self->flushing){
+    g_mutex_unlock(&self->lock);
+    return FALSE;
+  }
+  g_queue_push_tail(&self->items, query);
+  self->pending_query = query;
+  self->query_result = FALSE;
+  gst_pool_queue_schedule(self);
+  /* cleared by the drain job once answered, or by a flush */
+  while (self->pending_query == query)
+    g_cond_wait(&self->cond, &self->lock);
+  gboolean res = self->query_result;
+  g_mutex_unlock(&self->lock);
+
+  return res;
+}
+
+static GstStateChangeReturn gst_pool_queue_change_state(GstElement *element, GstStateChange transition)
+{
+  GstPoolQueue *self = GST_POOL_QUEUE(element);
+  GstStateChangeReturn ret;
+
+  switch (transition){
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+      g_mutex_lock(&self->lock);
+      self->dedicated = TRUE;
+      self->playing = FALSE;
+      gst_pool_queue_set_blocked(self, FALSE);
+      g_mutex_unlock(&self->lock);
+      gst_pool_queue_set_flushing(self, FALSE);
+      break;
+    case GST_STATE_CHANGE_PLAYING_TO_PAUSED:
+      gst_pool_queue_update_dedicated(self, FALSE);
+      break;
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      gst_pool_queue_set_flushing(self, TRUE);
+      gst_pad_stop_task(self->srcpad);
+      /* the task is gone, its place under the cap too */
+      g_mutex_lock(&self->lock);
+      gst_pool_queue_set_blocked(self, FALSE);
+      g_mutex_unlock(&self->lock);
+      break;
+    default:
+      break;
+  }
+
+  ret = GST_ELEMENT_CLASS(parent_class)->change_state(element, transition);
+
+  /* downstream is playing */
+  if (transition == GST_STATE_CHANGE_PAUSED_TO_PLAYING)
+    gst_pool_queue_update_dedicated(self, TRUE);
+
+  return ret;
+}
+
+static GstStructure *gst_pool_queue_get_stats(GstPoolQueue *self)
+{
+  GstStructure *stats;
+
+  g_mutex_lock(&self->lock);
+  stats = gst_structure_new("poolqueue-stats",
+      "current-level-buffers", G_TYPE_UINT, self->n_buffers,
+      "max-level-buffers", G_TYPE_UINT, self->max_level,
+      "dropped", G_TYPE_UINT64, self->dropped,
+      "runs", G_TYPE_UINT64, self->runs,
+      "steals", G_TYPE_UINT64, self->steals,
+      "blocking-pushes", G_TYPE_UINT64, self->blocking_pushes,
+      "dedicated", G_TYPE_BOOLEAN, self->dedicated,
+      "blocked", G_TYPE_BOOLEAN, self->blocked,
+      "fallbacks", G_TYPE_UINT64, self->fallbacks,
+      "refused-fallbacks", G_TYPE_UINT64, self->refused_fallbacks,
+      "blocked-queues", G_TYPE_UINT, (guint) g_atomic_int_get(&n_blocked),
+      "pool-threads", G_TYPE_UINT, gst_work_pool_get_n_threads(gst_work_pool_get_default()),
+      NULL);
+  g_mutex_unlock(&self->lock);
+
+  return stats;
+}
+
+static void gst_pool_queue_init(GstPoolQueue *self)
+{
+  self->sinkpad = gst_pad_new_from_static_template(&sink_template, "sink");
+  gst_pad_set_chain_function(self->sinkpad, gst_pool_queue_chain);
+  gst_pad_set_event_function(self->sinkpad, gst_pool_queue_sink_event);
+  gst_pad_set_query_function(self->sinkpad, gst_pool_queue_sink_query);
+  GST_PAD_SET_PROXY_CAPS(self->sinkpad);
+  gst_element_add_pad(GST_ELEMENT(self), self->sinkpad);
+
+  self->srcpad = gst_pad_new_from_static_template(&src_template, "src");
+  GST_PAD_SET_PROXY_CAPS(self->srcpad);
+  gst_element_add_pad(GST_ELEMENT(self), self->srcpad);
+
+  g_mutex_init(&self->lock);
+  g_cond_init(&self->cond);
+  g_queue_init(&self->items);
+
+  self->max_size_buffers = DEFAULT_MAX_SIZE_BUFFERS;
+  self->leaky = DEFAULT_LEAKY;
+  self->flushing = TRUE;
+  self->srcresult = GST_FLOW_FLUSHING;
+}
+
+static void gst_pool_queue_set_property(GObject *object,
+                                        guint prop_id,
+                                        const GValue *value,
+                                        GParamSpec *pspec){
+    GstPoolQueue *self = GST_POOL_QUEUE(object);
+
+    switch (prop_id) {
+        case PROP_MAX_SIZE_BUFFERS:
+            g_mutex_lock(&self->lock);
+            self->max_size_buffers = g_value_get_uint(value);
+            g_cond_broadcast(&self->cond);
+            g_mutex_unlock(&self->lock);
+            break;
+        case PROP_LEAKY:
+            g_mutex_lock(&self->lock);
+            self->leaky = g_value_get_boolean(value);
+            g_cond_broadcast(&self->cond);
+            g_mutex_unlock(&self->lock);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+}
+
+static void gst_pool_queue_get_property(GObject *object,
+                                        guint prop_id,
+                                        GValue *value,
+                                        GParamSpec *pspec){
+    GstPoolQueue *self = GST_POOL_QUEUE(object);
+
+    switch (prop_id) {
+        case PROP_MAX_SIZE_BUFFERS:
+            g_value_set_uint(value, self->max_size_buffers);
+            break;
+        case PROP_LEAKY:
+            g_value_set_boolean(value, self->leaky);
+            break;
+        case PROP_STATS:
+            g_value_take_boxed(value, gst_pool_queue_get_stats(self));
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+}
+
+static void gst_pool_queue_finalize(GObject *object)
+{
+  GstPoolQueue *self = GST_POOL_QUEUE(object);
+
+  gst_pool_queue_clear(self);
+  g_mutex_clear(&self->lock);
+  g_cond_clear(&self->cond);
+
+  G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
+static void gst_pool_queue_class_init(GstPoolQueueClass *klass)
+{
+  GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+  GObjectClass *object_class = G_OBJECT_CLASS(klass);
+
+  object_class->set_property = gst_pool_queue_set_property;
+  object_class->get_property = gst_pool_queue_get_property;
+  object_class->finalize = gst_pool_queue_finalize;
+  element_class->change_state = gst_pool_queue_change_state;
+
+  g_object_class_install_property(object_class, PROP_MAX_SIZE_BUFFERS,
+      g_param_spec_uint("max-size-buffers", "Max size buffers",
+          "Buffers held before the queue leaks or blocks",
+          1, G_MAXUINT, DEFAULT_MAX_SIZE_BUFFERS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(object_class, PROP_LEAKY,
+      g_param_spec_boolean("leaky", "Leaky",
+          "Drop the oldest buffer when full instead of blocking upstream",
+          DEFAULT_LEAKY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(object_class, PROP_STATS,
+      g_param_spec_boxed("stats", "Statistics",
+          "Queue depth, drops, drain runs, how many of them were stolen by another pool thread, pushes that blocked the pool "
+          "and the moves to a task of its own, refused past one blocked queue per pool thread",
+          GST_TYPE_STRUCTURE,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  gst_element_class_add_static_pad_template(element_class, &sink_template);
+  gst_element_class_add_static_pad_template(element_class, &src_template);
+
+  GST_DEBUG_CATEGORY_INIT (gst_pool_queue_debug, "poolqueue", 0,
+      "Pool Queue Debug");
+
+  gst_element_class_set_static_metadata(element_class,
+                                        "Pool Queue",
+                                        "Generic",
+                                        "Leaky queue drained by the shared work-stealing pool",
+                                        "Ludovic Bouguerra <ludovic.bouguerra@stream.studio>");
+}
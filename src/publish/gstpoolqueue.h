@@ -0,0 +1,17 @@
+#ifndef __GST_POOL_QUEUE_H__
+#define __GST_POOL_QUEUE_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_POOL_QUEUE gst_pool_queue_get_type ()
+G_DECLARE_FINAL_TYPE (GstPoolQueue, gst_pool_queue, GST, POOL_QUEUE, GstElement)
+
+struct GstPoolQueueClass {
+  GstElementClass parent_class;
+};
+
+G_END_DECLS
+
+#endif
@@ -4,11 +4,15 @@
 #include <config.h>
 #endif
 
+#include <common/gstthreadpolicy.h>
+
 /* properties */
 enum
 {
   PROP_0,
   PROP_CHILD,
+  PROP_THREAD_POLICY,
+  PROP_SHARED_POOL,
 };
 
 enum {
@@ -46,6 +50,9 @@ struct _GstProxyBin
   GstElement *vsrc;
 
   GstElement *child;
+
+  GstThreadPolicy *thread_policy;
+  gboolean shared_pool;
 };
 
 
@@ -56,7 +63,9 @@ G_DEFINE_TYPE(GstProxyBin, gst_proxy_bin, GST_TYPE_BIN);
 
 
 
-static gboolean bus_callback (GstBus * bus, GstMessage * message, gpointer data)
+/* Runs in the thread posting the message so on-eos and on-error are emitted
+ * even when no main loop is running */
+static GstBusSyncReply bus_sync_handler (GstBus * bus, GstMessage * message, gpointer data)
 {
   GstProxyBin *self = GST_PROXY_BIN(data);
 
@@ -74,13 +83,59 @@ static gboolean bus_callback (GstBus * bus, GstMessage * message, gpointer data)
     case GST_MESSAGE_EOS:
       g_signal_emit_by_name(self, "on-eos");
       break;
+    case GST_MESSAGE_STREAM_STATUS:
+      gst_thread_policy_handle_message(self->thread_policy, GST_ELEMENT(self), message);
+      break;
+    case GST_MESSAGE_WARNING:
+    case GST_MESSAGE_ELEMENT:
+      /* the application watches the outer bus, not the child pipeline */
+      gst_element_post_message(GST_ELEMENT(self), gst_message_ref(message));
+      break;
     default:
       /* unhandled message */
       break;
   }
 
 
-  return TRUE;
+  return GST_BUS_DROP;
+}
+
+static GstElement *gst_proxy_bin_make_ingress(GstProxyBin *self, const gchar *name,
+    GstElement *sink, const gchar *ghost_name)
+{
+  GstElement *queue;
+
+  if (self->shared_pool){
+    queue = gst_element_factory_make("poolqueue", name);
+  } else {
+    queue = gst_element_factory_make("queue", name);
+    g_object_set(queue, "leaky", 2, NULL);
+  }
+
+  gst_bin_add(GST_BIN(self), queue);
+  gst_element_link(queue, sink);
+
+  GstPad *pad = gst_element_get_static_pad(queue, "sink");
+  GstPad *ghost = gst_element_get_static_pad(GST_ELEMENT(self), ghost_name);
+  gst_ghost_pad_set_target(GST_GHOST_PAD(ghost), pad);
+  gst_object_unref(ghost);
+  gst_object_unref(pad);
+
+  return queue;
+}
+
+/* The ingress queues decouple the tee from the branch. With shared-pool they
+ * are poolqueues drained by the process-wide work pool instead of owning a
+ * streaming thread each. */
+static void gst_proxy_bin_setup_ingress(GstProxyBin *self)
+{
+  if (self->aqueue){
+    gst_bin_remove(GST_BIN(self), self->aqueue);
+    gst_bin_remove(GST_BIN(self), self->vqueue);
+  }
+
+  self->aqueue = gst_proxy_bin_make_ingress(self, "aqueue", self->asink, "audio_sink");
+  self->vqueue = gst_proxy_bin_make_ingress(self, "vqueue", self->vsink, "video_sink");
 }
 
 static void gst_proxy_bin_init(GstProxyBin *self)
@@ -99,20 +154,13 @@ static void gst_proxy_bin_init(GstProxyBin *self)
 
 
   self->bus = gst_pipeline_get_bus(GST_PIPELINE(self->pipeline));
-  gst_bus_add_watch (self->bus, bus_callback, self);
+  gst_bus_set_sync_handler (self->bus, bus_sync_handler, self, NULL);
 
   GstClock *clock = gst_system_clock_obtain ();
   gst_pipeline_use_clock (GST_PIPELINE (self->pipeline), clock);
   gst_object_unref(clock);
   gst_element_set_base_time (self->pipeline, 0);
 
-  self->aqueue = gst_element_factory_make("queue", "aqueue");
-  self->vqueue = gst_element_factory_make("queue", "vqueue");
-  g_object_set(self->aqueue, "leaky", 2, NULL);
-  g_object_set(self->vqueue, "leaky", 2, NULL);
-
-
-
   self->asink = gst_element_factory_make("proxysink", "asink");
   self->vsink = gst_element_factory_make("proxysink", "vsink");
 
@@ -120,20 +168,15 @@ static void gst_proxy_bin_init(GstProxyBin *self)
   self->vsrc = gst_element_factory_make("proxysrc", "vsrc");
   gst_bin_add_many(GST_BIN(self->pipeline), self->asrc, self->vsrc, NULL);
 
-  gst_bin_add_many(bin, self->aqueue, self->vqueue, self->asink, self->vsink, NULL);
-  
-  gst_element_link(self->aqueue, self->asink);
-  gst_element_link(self->vqueue, self->vsink);
-
-  GstPad *pad = gst_element_get_static_pad(self->aqueue, "sink");
-  gst_element_add_pad(element, gst_ghost_pad_new("audio_sink", pad));
-  gst_object_unref(GST_OBJECT(pad));
-
-  pad = gst_element_get_static_pad(self->vqueue, "sink");
-  gst_element_add_pad(element, gst_ghost_pad_new("video_sink", pad));
-  gst_object_unref(GST_OBJECT(pad));
+  gst_bin_add_many(bin, self->asink, self->vsink, NULL);
 
+  gst_element_add_pad(element, gst_ghost_pad_new_no_target("audio_sink", GST_PAD_SINK));
+  gst_element_add_pad(element, gst_ghost_pad_new_no_target("video_sink", GST_PAD_SINK));
 
+  self->aqueue = NULL;
+  self->vqueue = NULL;
+  self->shared_pool = FALSE;
+  gst_proxy_bin_setup_ingress(self);
 }
 
 
@@ -197,6 +240,16 @@ static void gst_proxy_bin_set_property(GObject *object,
         case PROP_CHILD:
             self->child = GST_ELEMENT(g_value_get_object(value));
         break;           
+        case PROP_THREAD_POLICY:
+            gst_thread_policy_free(self->thread_policy);
+            self->thread_policy = gst_thread_policy_new_from_string("publish", g_value_get_string(value));
+        break;
+        case PROP_SHARED_POOL:
+            if (self->shared_pool != g_value_get_boolean(value)){
+              self->shared_pool = g_value_get_boolean(value);
+              gst_proxy_bin_setup_ingress(self);
+            }
+        break;
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
             break;    
@@ -215,6 +268,12 @@ static void gst_proxy_bin_get_property(GObject *object,
         case PROP_CHILD:
             g_value_set_object(value, self->child);
         break;          
+        case PROP_THREAD_POLICY:
+            g_value_set_string(value, gst_thread_policy_get_description(self->thread_policy));
+        break;
+        case PROP_SHARED_POOL:
+            g_value_set_boolean(value, self->shared_pool);
+        break;
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
             break;
@@ -222,16 +281,36 @@ static void gst_proxy_bin_get_property(GObject *object,
 
 }
 
+static void handle_message (GstBin * bin, GstMessage * message){
+    GstProxyBin *self = GST_PROXY_BIN(bin);
+
+    gst_thread_policy_handle_message(self->thread_policy, GST_ELEMENT(self), message);
+
+    GST_BIN_CLASS (parent_class)->handle_message (bin, message);
+}
+
+static void gst_proxy_bin_finalize(GObject *object)
+{
+  GstProxyBin *self = GST_PROXY_BIN(object);
+
+  gst_thread_policy_free(self->thread_policy);
+
+  G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
 static void gst_proxy_bin_class_init(GstProxyBinClass *klass)
 {
   GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+  GstBinClass *bin_class = GST_BIN_CLASS(klass);
 
 
 
   GObjectClass *object_class = G_OBJECT_CLASS(klass);
   object_class->set_property = gst_proxy_bin_set_property;
   object_class->get_property = gst_proxy_bin_get_property;
+  object_class->finalize = gst_proxy_bin_finalize;
   element_class->change_state = gst_proxy_bin_change_state;
+  bin_class->handle_message = handle_message;
 
 
   gst_proxy_bin_signals[SIGNAL_ON_EOS] =
@@ -250,6 +329,18 @@ static void gst_proxy_bin_class_init(GstProxyBinClass *klass)
                                                    "child", GST_TYPE_ELEMENT,
                                                    G_PARAM_READWRITE));
 
+  g_object_class_install_property(object_class, PROP_THREAD_POLICY,
+                                  g_param_spec_string("thread-policy", "Thread policy",
+                                                   "Placement of the branch streaming threads, e.g. \"cpus=2-3;nice=5;pool=shared\"",
+                                                   NULL,
+                                                   G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property(object_class, PROP_SHARED_POOL,
+                                  g_param_spec_boolean("shared-pool", "Shared pool",
+                                                   "Drain the ingress queues from the process-wide work-stealing pool instead of one thread per queue",
+                                                   FALSE,
+                                                   G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY));
+
   gst_element_class_set_static_metadata(element_class,
                                         "Proxy Bin",
                                         "Proxy Bin",
@@ -8,6 +8,11 @@
 #include "gstrecordsink.h"
 #include "gststreamsink.h"
 #include "gstpublishbin.h"
+#include "gstpoolqueue.h"
+#include "gstcmafsink.h"
+#include "gstsrtstreamsink.h"
+#include "gstrecordwriter.h"
+#include "gstclipbuffer.h"
 
 gboolean publish_plugin_init(GstPlugin *plugin)
 {
@@ -33,6 +38,26 @@ gboolean publish_plugin_init(GstPlugin *plugin)
                               GST_RANK_NONE,
                               GST_TYPE_STREAM_SINK);                              
 
+    gst_element_register(plugin, "poolqueue",
+                              GST_RANK_NONE,
+                              GST_TYPE_POOL_QUEUE);
+
+    gst_element_register(plugin, "cmafsink",
+                              GST_RANK_NONE,
+                              GST_TYPE_CMAF_SINK);
+
+    gst_element_register(plugin, "srtstreamsink",
+                              GST_RANK_NONE,
+                              GST_TYPE_SRT_STREAM_SINK);
+
+    gst_element_register(plugin, "recordwriter",
+                              GST_RANK_NONE,
+                              GST_TYPE_RECORD_WRITER);
+
+    gst_element_register(plugin, "clipbuffer",
+                              GST_RANK_NONE,
+                              GST_TYPE_CLIP_BUFFER);
+
     return TRUE;
 }
 
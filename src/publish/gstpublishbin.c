@@ -4,17 +4,32 @@
 #include <config.h>
 #endif
 
+/* id of the recorder driven by start-record and stop-record */
+#define DEFAULT_RECORDER_ID "record"
+
 enum
 {
   PROP_0,
+  PROP_THREAD_POLICY,
+  PROP_SHARED_POOL,
+  PROP_RECORDERS,
 };
 
 enum
 {
   SIGNAL_START_RECORD = 0,
   SIGNAL_STOP_RECORD,
+  SIGNAL_START_RECORDER,
+  SIGNAL_STOP_RECORDER,
   SIGNAL_START_STREAM,
   SIGNAL_STOP_STREAM,
+  SIGNAL_START_HLS,
+  SIGNAL_STOP_HLS,
+  SIGNAL_START_SRT,
+  SIGNAL_STOP_SRT,
+  SIGNAL_START_CLIP_BUFFER,
+  SIGNAL_STOP_CLIP_BUFFER,
+  SIGNAL_SAVE_CLIP,
   LAST_SIGNAL
 };
 
@@ -30,12 +45,32 @@ struct _GstPublishBin
 
   GstElement *dtee;
 
-  GstElement *recorder;
+  /* parsed once for every recorder */
+  GstElement *vparse;
+  GstElement *vcaps;
+  GstElement *aparse;
+  GstElement *acaps;
+  GstElement *rtee;
+
+  /* id -> proxybin, under the object lock */
+  GHashTable *recorders;
+  guint recorder_count;
   GstElement *streamer;
+  /* branches started on the tees and the count naming them, under the
+   * object lock */
+  guint branch_count;
+  GstElement *hls;
+  GstElement *srt;
+  GstElement *clips;
+
+  gchar *thread_policy;
+  gboolean shared_pool;
 };
 
 G_DEFINE_TYPE(GstPublishBin, gst_publish_bin, GST_TYPE_BIN);
 
+static GstStructure *gst_publish_bin_get_recorders(GstPublishBin *self);
+
 
 static void gst_publish_bin_init(GstPublishBin *self)
 {
@@ -49,10 +84,29 @@ static void gst_publish_bin_init(GstPublishBin *self)
   self->dtee = gst_element_factory_make("dynamictee", "dtee");
   
 
+  self->vparse = gst_element_factory_make("h264parse", "rvparse");
+  self->vcaps = gst_element_factory_make("capsfilter", "rvcaps");
+  self->aparse = gst_element_factory_make("aacparse", "raparse");
+  self->acaps = gst_element_factory_make("capsfilter", "racaps");
+  self->rtee = gst_element_factory_make("dynamictee", "rtee");
+
+  GstCaps *caps = gst_caps_from_string("video/x-h264,stream-format=avc,alignment=au");
+  g_object_set(self->vcaps, "caps", caps, NULL);
+  gst_caps_unref(caps);
+  caps = gst_caps_from_string("audio/mpeg,stream-format=raw");
+  g_object_set(self->acaps, "caps", caps, NULL);
+  gst_caps_unref(caps);
+
   gst_bin_add_many(bin, self->venctee, self->aacenctee, self->dtee, NULL);
   gst_element_link_pads(self->venctee, NULL, self->dtee, "video_sink");
   gst_element_link_pads(self->aacenctee, NULL, self->dtee, "audio_sink");
 
+  gst_bin_add_many(bin, self->vparse, self->vcaps, self->aparse, self->acaps, self->rtee, NULL);
+  gst_element_link_many(self->venctee, self->vparse, self->vcaps, NULL);
+  gst_element_link_pads(self->vcaps, NULL, self->rtee, "video_sink");
+  gst_element_link_many(self->aacenctee, self->aparse, self->acaps, NULL);
+  gst_element_link_pads(self->acaps, NULL, self->rtee, "audio_sink");
+
 
   GstPad *pad = gst_element_get_static_pad(self->aacenctee, "sink");
   gst_element_add_pad(element, gst_ghost_pad_new("audio_sink", pad));
@@ -62,8 +116,12 @@ static void gst_publish_bin_init(GstPublishBin *self)
   gst_element_add_pad(element, gst_ghost_pad_new("video_sink", pad));
   gst_object_unref(GST_OBJECT(pad));
   
-  self->recorder = NULL;
+  self->recorders = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, gst_object_unref);
+  self->recorder_count = 0;
   self->streamer = NULL;
+  self->hls = NULL;
+  self->srt = NULL;
+  self->clips = NULL;
 
 
 }
@@ -75,6 +133,13 @@ static void gst_publish_bin_set_property(GObject *object,
     GstPublishBin *self = GST_PUBLISH_BIN(object);
 
     switch (prop_id) {
+        case PROP_THREAD_POLICY:
+            g_free(self->thread_policy);
+            self->thread_policy = g_value_dup_string(value);
+            break;
+        case PROP_SHARED_POOL:
+            self->shared_pool = g_value_get_boolean(value);
+            break;
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
             break;    
@@ -90,6 +155,15 @@ static void gst_publish_bin_get_property(GObject *object,
     GstPublishBin *self = GST_PUBLISH_BIN(object);
 
     switch (prop_id) {   
+        case PROP_THREAD_POLICY:
+            g_value_set_string(value, self->thread_policy);
+            break;
+        case PROP_SHARED_POOL:
+            g_value_set_boolean(value, self->shared_pool);
+            break;
+        case PROP_RECORDERS:
+            g_value_take_boxed(value, gst_publish_bin_get_recorders(self));
+            break;
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
             break;
@@ -98,36 +172,106 @@ static void gst_publish_bin_get_property(GObject *object,
 }
 
 
-static gboolean gst_publish_bin_start_record(GstPublishBin *self, gchar* destination){
+/* Recorders run on their own tee after the shared parsers, each one
+ * started and stopped on its own under its id. The table holds a
+ * reference until stop, or until the tee tore the recorder down after it
+ * failed. */
+static gboolean gst_publish_bin_start_recorder(GstPublishBin *self, gchar* id, gchar* destination){
     gboolean ret = FALSE;
-    
-    if (!self->recorder){
-      self->recorder = gst_element_factory_make("proxybin", "precorder"); 
-      GstElement *recorder = gst_element_factory_make("recordsink", "recorder");
-      g_object_set(recorder, "location", destination, NULL);
-      g_object_set(self->recorder, "child", recorder, NULL);
-
-      g_signal_emit_by_name(self->dtee, "start", self->recorder, &ret);
-      
-      ret = TRUE;
+    GstElement *proxy, *recorder;
+    gchar *name;
 
+    GST_OBJECT_LOCK(self);
+    if (id == NULL || g_hash_table_contains(self->recorders, id)){
+      GST_OBJECT_UNLOCK(self);
+      return FALSE;
     }
-    
+    /* a stopped recorder may still be tearing down under its old name */
+    name = g_strdup_printf("precorder-%s-%u", id, self->recorder_count++);
+    GST_OBJECT_UNLOCK(self);
+
+    proxy = gst_object_ref_sink(gst_element_factory_make("proxybin", name));
+    g_free(name);
+    recorder = gst_element_factory_make("recordsink", NULL);
+    g_object_set(recorder, "location", destination, "parse", FALSE, NULL);
+    g_object_set(proxy, "child", recorder, "thread-policy", self->thread_policy,
+        "shared-pool", self->shared_pool, NULL);
+
+    GST_OBJECT_LOCK(self);
+    g_hash_table_insert(self->recorders, g_strdup(id), proxy);
+    GST_OBJECT_UNLOCK(self);
+
+    g_signal_emit_by_name(self->rtee, "start", proxy, &ret);
+    if (!ret){
+      GST_OBJECT_LOCK(self);
+      g_hash_table_remove(self->recorders, id);
+      GST_OBJECT_UNLOCK(self);
+    }
+
     return ret;
 }
 
-static gboolean gst_publish_bin_stop_record(GstPublishBin *self){
+static gboolean gst_publish_bin_stop_recorder(GstPublishBin *self, gchar* id){
     gboolean ret = FALSE;
-    
-    if (self->recorder){
-      g_signal_emit_by_name(self->dtee, "stop", self->recorder, &ret);
-      self->recorder = NULL;
-      ret = TRUE;
+    GstElement *proxy = NULL;
+    gpointer key;
+
+    GST_OBJECT_LOCK(self);
+    if (id && g_hash_table_steal_extended(self->recorders, id, &key, (gpointer *) &proxy))
+      g_free(key);
+    GST_OBJECT_UNLOCK(self);
+
+    if (proxy){
+      g_signal_emit_by_name(self->rtee, "stop", proxy, &ret);
+      gst_object_unref(proxy);
     }
-        
+
     return ret;
 }
 
+static gboolean gst_publish_bin_start_record(GstPublishBin *self, gchar* destination){
+    return gst_publish_bin_start_recorder(self, DEFAULT_RECORDER_ID, destination);
+}
+
+static gboolean gst_publish_bin_stop_record(GstPublishBin *self){
+    return gst_publish_bin_stop_recorder(self, DEFAULT_RECORDER_ID);
+}
+
+static GstStructure *gst_publish_bin_get_recorders(GstPublishBin *self)
+{
+  GstStructure *recorders = gst_structure_new_empty("publishbin-recorders");
+  GPtrArray *proxies = g_ptr_array_new_with_free_func(gst_object_unref);
+  GPtrArray *ids = g_ptr_array_new_with_free_func(g_free);
+  GHashTableIter iter;
+  gpointer key, value;
+
+  GST_OBJECT_LOCK(self);
+  g_hash_table_iter_init(&iter, self->recorders);
+  while (g_hash_table_iter_next(&iter, &key, &value)){
+    g_ptr_array_add(ids, g_strdup(key));
+    g_ptr_array_add(proxies, gst_object_ref(value));
+  }
+  GST_OBJECT_UNLOCK(self);
+
+  for (guint i = 0; i < ids->len; i++){
+    GstElement *recorder = NULL;
+    GstStructure *stats = NULL;
+
+    g_object_get(g_ptr_array_index(proxies, i), "child", &recorder, NULL);
+    if (!recorder)
+      continue;
+    g_object_get(recorder, "stats", &stats, NULL);
+    gst_structure_set(recorders, g_ptr_array_index(ids, i), GST_TYPE_STRUCTURE, stats, NULL);
+    gst_structure_free(stats);
+    gst_object_unref(recorder);
+  }
+
+  g_ptr_array_unref(ids);
+  g_ptr_array_unref(proxies);
+
+  return recorders;
+}
+
 static gboolean gst_publish_bin_start_stream(GstPublishBin *self, gchar* location, gchar* username, gchar* password){
 
     gboolean ret = FALSE;
@@ -142,7 +286,8 @@ static gboolean gst_publish_bin_start_stream(GstPublishBin *self, gchar* locatio
       if (! g_strcmp0(password, "")){
         g_object_set(streamer, "password", password, NULL);
       }      
-      g_object_set(self->streamer, "child", streamer, NULL);
+      g_object_set(self->streamer, "child", streamer, "thread-policy", self->thread_policy,
+          "shared-pool", self->shared_pool, NULL);
       g_signal_emit_by_name(self->dtee, "start", self->streamer, &ret);
       ret = TRUE;
     }
@@ -161,15 +306,232 @@ static gboolean gst_publish_bin_stop_stream(GstPublishBin *self){
   return FALSE;
 }
 
+/* Starts child in a proxybin on tee, kept in slot. Each start gets a new
+ * name, a stopped branch may still be tearing down under its old one. The
+ * slot holds a reference until stop, or until the tee tore the branch down
+ * after it failed. */
+static gboolean gst_publish_bin_start_branch(GstPublishBin *self, GstElement *tee, GstElement **slot,
+    const gchar *prefix, GstElement *child){
+    gboolean ret = FALSE;
+    GstElement *proxy;
+    gchar *name;
+    guint count;
+
+    if (!child)
+      return FALSE;
+    gst_object_ref_sink(child);
+
+    GST_OBJECT_LOCK(self);
+    count = self->branch_count++;
+    GST_OBJECT_UNLOCK(self);
+
+    name = g_strdup_printf("%s-%u", prefix, count);
+    proxy = gst_object_ref_sink(gst_element_factory_make("proxybin", name));
+    g_free(name);
+    g_object_set(proxy, "child", child, "thread-policy", self->thread_policy,
+        "shared-pool", self->shared_pool, NULL);
+    gst_object_unref(child);
+
+    GST_OBJECT_LOCK(self);
+    if (*slot){
+      GST_OBJECT_UNLOCK(self);
+      gst_object_unref(proxy);
+      return FALSE;
+    }
+    *slot = gst_object_ref(proxy);
+    GST_OBJECT_UNLOCK(self);
+
+    g_signal_emit_by_name(tee, "start", proxy, &ret);
+    if (!ret){
+      GST_OBJECT_LOCK(self);
+      if (*slot == proxy){
+        gst_object_unref(*slot);
+        *slot = NULL;
+      }
+      GST_OBJECT_UNLOCK(self);
+    }
+    gst_object_unref(proxy);
+
+    return ret;
+}
+
+static gboolean gst_publish_bin_stop_branch(GstPublishBin *self, GstElement *tee, GstElement **slot){
+    gboolean ret = FALSE;
+    GstElement *proxy;
+
+    GST_OBJECT_LOCK(self);
+    proxy = *slot;
+    *slot = NULL;
+    GST_OBJECT_UNLOCK(self);
+
+    if (proxy){
+      g_signal_emit_by_name(tee, "stop", proxy, &ret);
+      gst_object_unref(proxy);
+    }
+
+    return ret;
+}
+
+/* Called with the object lock, the caller drops the returned reference */
+static GstElement *gst_publish_bin_take_torn_down(GstElement **slot, const gchar *name){
+    GstElement *proxy = NULL;
+
+    if (*slot && g_strcmp0(GST_OBJECT_NAME(*slot), name) == 0){
+      proxy = *slot;
+      *slot = NULL;
+    }
+    return proxy;
+}
+
+/* A branch that failed is torn down by its tee: its slot is freed so it
+ * can be started again */
+static void gst_publish_bin_handle_message(GstBin *bin, GstMessage *message){
+    GstPublishBin *self = GST_PUBLISH_BIN(bin);
+
+    if (GST_MESSAGE_TYPE(message) == GST_MESSAGE_ELEMENT &&
+        gst_message_has_name(message, "dynamictee-teardown")){
+      const gchar *name = gst_structure_get_string(gst_message_get_structure(message), "element");
+      GstElement *proxy;
+
+      GST_OBJECT_LOCK(self);
+      proxy = gst_publish_bin_take_torn_down(&self->hls, name);
+      if (!proxy)
+        proxy = gst_publish_bin_take_torn_down(&self->srt, name);
+      if (!proxy)
+        proxy = gst_publish_bin_take_torn_down(&self->clips, name);
+      if (!proxy){
+        GHashTableIter iter;
+        gpointer key, value;
+
+        g_hash_table_iter_init(&iter, self->recorders);
+        while (!proxy && g_hash_table_iter_next(&iter, &key, &value)){
+          if (g_strcmp0(GST_OBJECT_NAME(value), name) == 0){
+            proxy = value;
+            g_hash_table_iter_steal(&iter);
+            g_free(key);
+          }
+        }
+      }
+      GST_OBJECT_UNLOCK(self);
+      if (proxy){
+        GST_INFO_OBJECT(self, "Branch %s is gone", name);
+        gst_object_unref(proxy);
+      }
+    }
+
+    GST_BIN_CLASS(gst_publish_bin_parent_class)->handle_message(bin, message);
+}
+
+static gboolean gst_publish_bin_start_hls(GstPublishBin *self, gchar* location){
+    GstElement *hls = gst_element_factory_make("cmafsink", "hls");
 
+    if (hls)
+      g_object_set(hls, "location", location, NULL);
+
+    return gst_publish_bin_start_branch(self, self->dtee, &self->hls, "phls", hls);
+}
+
+static gboolean gst_publish_bin_stop_hls(GstPublishBin *self){
+    return gst_publish_bin_stop_branch(self, self->dtee, &self->hls);
+}
+
+static gboolean gst_publish_bin_start_srt(GstPublishBin *self, gchar* location, gchar* passphrase, gchar* streamid){
+    GstElement *srt = gst_element_factory_make("srtstreamsink", "srt");
+
+    if (srt){
+      g_object_set(srt, "location", location, NULL);
+      if (g_strcmp0(passphrase, "")){
+        g_object_set(srt, "passphrase", passphrase, NULL);
+      }
+      if (g_strcmp0(streamid, "")){
+        g_object_set(srt, "streamid", streamid, NULL);
+      }
+    }
+
+    return gst_publish_bin_start_branch(self, self->dtee, &self->srt, "psrt", srt);
+}
+
+static gboolean gst_publish_bin_stop_srt(GstPublishBin *self){
+    return gst_publish_bin_stop_branch(self, self->dtee, &self->srt);
+}
+
+/* The clip buffer sits on the recorder tee, it keeps the parsed streams */
+static gboolean gst_publish_bin_start_clip_buffer(GstPublishBin *self, gchar* location){
+    GstElement *clips = gst_element_factory_make("clipbuffer", "clips");
+
+    if (clips)
+      g_object_set(clips, "location", location, NULL);
+
+    return gst_publish_bin_start_branch(self, self->rtee, &self->clips, "pclips", clips);
+}
+
+static gboolean gst_publish_bin_stop_clip_buffer(GstPublishBin *self){
+    return gst_publish_bin_stop_branch(self, self->rtee, &self->clips);
+}
+
+static gboolean gst_publish_bin_save_clip(GstPublishBin *self, gchar* location, gint64 start, gint64 stop){
+    gboolean ret = FALSE;
+    GstElement *proxy = NULL, *clips = NULL;
+
+    GST_OBJECT_LOCK(self);
+    if (self->clips)
+      proxy = gst_object_ref(self->clips);
+    GST_OBJECT_UNLOCK(self);
+
+    if (proxy){
+      g_object_get(proxy, "child", &clips, NULL);
+      gst_object_unref(proxy);
+    }
+    if (clips){
+      g_signal_emit_by_name(clips, "save-clip", location, start, stop, &ret);
+      gst_object_unref(clips);
+    }
+
+    return ret;
+}
+
+static void gst_publish_bin_finalize(GObject *object)
+{
+  GstPublishBin *self = GST_PUBLISH_BIN(object);
+
+  g_free(self->thread_policy);
+  g_hash_table_unref(self->recorders);
+  gst_clear_object(&self->hls);
+  gst_clear_object(&self->srt);
+  gst_clear_object(&self->clips);
+
+  G_OBJECT_CLASS(gst_publish_bin_parent_class)->finalize(object);
+}
 
 static void gst_publish_bin_class_init(GstPublishBinClass *klass)
 {
   GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+  GstBinClass *bin_class = GST_BIN_CLASS(klass);
 
   GObjectClass *object_class = G_OBJECT_CLASS(klass);
+  bin_class->handle_message = gst_publish_bin_handle_message;
   object_class->set_property = gst_publish_bin_set_property;
   object_class->get_property = gst_publish_bin_get_property;
+  object_class->finalize = gst_publish_bin_finalize;
+
+  g_object_class_install_property(object_class, PROP_THREAD_POLICY,
+      g_param_spec_string("thread-policy", "Thread policy",
+          "Placement applied to the streaming threads of each record and stream branch",
+          NULL,
+          G_PARAM_READWRITE));
+
+  g_object_class_install_property(object_class, PROP_SHARED_POOL,
+      g_param_spec_boolean("shared-pool", "Shared pool",
+          "Run the ingress queues of each record and stream branch on the process-wide work pool",
+          FALSE,
+          G_PARAM_READWRITE));
+
+
+  g_object_class_install_property(object_class, PROP_RECORDERS,
+      g_param_spec_boxed("recorders", "Recorders",
+          "Statistics of each active recorder, by id",
+          GST_TYPE_STRUCTURE,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 
 
   GType record_params[1] = {G_TYPE_STRING};
@@ -187,6 +549,22 @@ static void gst_publish_bin_class_init(GstPublishBinClass *klass)
                     NULL, NULL, NULL, G_TYPE_BOOLEAN,
                     0, NULL); 
 
+  GType recorder_params[2] = {G_TYPE_STRING, G_TYPE_STRING};
+  gst_publish_bin_signals[SIGNAL_START_RECORDER] =
+      g_signal_newv("start-recorder", G_TYPE_FROM_CLASS(klass),
+                    G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+                    g_cclosure_new(G_CALLBACK(gst_publish_bin_start_recorder), NULL, NULL),
+                    NULL, NULL, NULL, G_TYPE_BOOLEAN,
+                    2, recorder_params);
+
+  GType recorder_id_params[1] = {G_TYPE_STRING};
+  gst_publish_bin_signals[SIGNAL_STOP_RECORDER] =
+      g_signal_newv("stop-recorder", G_TYPE_FROM_CLASS(klass),
+                    G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+                    g_cclosure_new(G_CALLBACK(gst_publish_bin_stop_recorder), NULL, NULL),
+                    NULL, NULL, NULL, G_TYPE_BOOLEAN,
+                    1, recorder_id_params);
+
 
   GType streamer_params[3] = {G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING};
   gst_publish_bin_signals[SIGNAL_START_STREAM] =
@@ -203,6 +581,60 @@ static void gst_publish_bin_class_init(GstPublishBinClass *klass)
                     NULL, NULL, NULL, G_TYPE_BOOLEAN,
                     0, NULL);      
 
+  GType hls_params[1] = {G_TYPE_STRING};
+  gst_publish_bin_signals[SIGNAL_START_HLS] =
+      g_signal_newv("start-hls", G_TYPE_FROM_CLASS(klass),
+                    G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+                    g_cclosure_new(G_CALLBACK(gst_publish_bin_start_hls), NULL, NULL),
+                    NULL, NULL, NULL, G_TYPE_BOOLEAN,
+                    1, hls_params);
+
+  gst_publish_bin_signals[SIGNAL_STOP_HLS] =
+      g_signal_newv("stop-hls", G_TYPE_FROM_CLASS(klass),
+                    G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+                    g_cclosure_new(G_CALLBACK(gst_publish_bin_stop_hls), NULL, NULL),
+                    NULL, NULL, NULL, G_TYPE_BOOLEAN,
+                    0, NULL);
+
+  GType srt_params[3] = {G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING};
+  gst_publish_bin_signals[SIGNAL_START_SRT] =
+      g_signal_newv("start-srt", G_TYPE_FROM_CLASS(klass),
+                    G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+                    g_cclosure_new(G_CALLBACK(gst_publish_bin_start_srt), NULL, NULL),
+                    NULL, NULL, NULL, G_TYPE_BOOLEAN,
+                    3, srt_params);
+
+  gst_publish_bin_signals[SIGNAL_STOP_SRT] =
+      g_signal_newv("stop-srt", G_TYPE_FROM_CLASS(klass),
+                    G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+                    g_cclosure_new(G_CALLBACK(gst_publish_bin_stop_srt), NULL, NULL),
+                    NULL, NULL, NULL, G_TYPE_BOOLEAN,
+                    0, NULL);
+
+  GType clip_buffer_params[1] = {G_TYPE_STRING};
+  gst_publish_bin_signals[SIGNAL_START_CLIP_BUFFER] =
+      g_signal_newv("start-clip-buffer", G_TYPE_FROM_CLASS(klass),
+                    G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+                    g_cclosure_new(G_CALLBACK(gst_publish_bin_start_clip_buffer), NULL, NULL),
+                    NULL, NULL, NULL, G_TYPE_BOOLEAN,
+                    1, clip_buffer_params);
+
+  gst_publish_bin_signals[SIGNAL_STOP_CLIP_BUFFER] =
+      g_signal_newv("stop-clip-buffer", G_TYPE_FROM_CLASS(klass),
+                    G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+                    g_cclosure_new(G_CALLBACK(gst_publish_bin_stop_clip_buffer), NULL, NULL),
+                    NULL, NULL, NULL, G_TYPE_BOOLEAN,
+                    0, NULL);
+
+  /* location, then start and stop in ms, counted back from live when <= 0 */
+  GType save_clip_params[3] = {G_TYPE_STRING, G_TYPE_INT64, G_TYPE_INT64};
+  gst_publish_bin_signals[SIGNAL_SAVE_CLIP] =
+      g_signal_newv("save-clip", G_TYPE_FROM_CLASS(klass),
+                    G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+                    g_cclosure_new(G_CALLBACK(gst_publish_bin_save_clip), NULL, NULL),
+                    NULL, NULL, NULL, G_TYPE_BOOLEAN,
+                    3, save_clip_params);
+
 
   gst_element_class_set_static_metadata(element_class,
                                         "Publish Bin",
@@ -4,10 +4,45 @@
 #include <config.h>
 #endif
 
+#include <string.h>
+#include <sys/statvfs.h>
+
+#include <glib/gstdio.h>
+
+#include <common/gstrecordindex.h>
+
 GST_DEBUG_CATEGORY_STATIC (gst_record_sink_debug); 
 #define GST_CAT_DEFAULT gst_record_sink_debug
 
 #define DEFAULT_LOCATION "record.mp4"
+#define DEFAULT_EXPECTED_DURATION 0
+#define DEFAULT_EXPECTED_BITRATE 0
+#define DEFAULT_MAX_RESERVE (16 * 1024 * 1024)
+#define DEFAULT_PARSE TRUE
+#define DEFAULT_DISK_POLICY GST_RECORD_SINK_DISK_POLICY_STOP
+#define DEFAULT_DISK_WARNING 600
+#define DEFAULT_DISK_RESERVE 60
+#define DEFAULT_FALLBACK_LOCATION NULL
+#define DEFAULT_INDEX TRUE
+#define DEFAULT_FRAGMENTED FALSE
+
+/* marks the video keyframes on their way through the muxer, with their
+ * timestamp, for the index */
+static GstStaticCaps keyframe_caps = GST_STATIC_CAPS("timestamp/x-record-keyframe");
+
+/* free space is checked once per second of wall time */
+#define DISK_CHECK_INTERVAL G_USEC_PER_SEC
+/* left to finalize the file whatever the policy */
+#define DISK_CRITICAL 10
+
+/* moov bytes per second of H.264 at 30 fps with AAC, the mp4mux estimate,
+ * and the extra for 64-bit chunk offsets past 4 GiB */
+#define MOOV_BYTES_PER_SEC 550
+#define MOOV_CO64_BYTES_PER_SEC 32
+/* reserve for a quarter more than announced */
+#define RESERVE_MARGIN 4
+#define MOOV_UPDATE_PERIOD (10 * GST_SECOND)
+#define FRAGMENT_DURATION 2000
 
 #define gst_record_sink_parent_class parent_class
 
@@ -15,9 +50,45 @@ GST_DEBUG_CATEGORY_STATIC (gst_record_sink_debug);
 enum
 {
   PROP_0,
-  PROP_LOCATION
+  PROP_LOCATION,
+  PROP_EXPECTED_DURATION,
+  PROP_EXPECTED_BITRATE,
+  PROP_MAX_RESERVE,
+  PROP_PARSE,
+  PROP_DISK_POLICY,
+  PROP_DISK_WARNING,
+  PROP_DISK_RESERVE,
+  PROP_FALLBACK_LOCATION,
+  PROP_INDEX,
+  PROP_FRAGMENTED,
+  PROP_STATS,
 };
 
+typedef enum
+{
+  GST_RECORD_SINK_DISK_POLICY_STOP,
+  GST_RECORD_SINK_DISK_POLICY_ROTATE,
+  GST_RECORD_SINK_DISK_POLICY_SWITCH,
+  GST_RECORD_SINK_DISK_POLICY_LOWER_BITRATE,
+} GstRecordSinkDiskPolicy;
+
+#define GST_TYPE_RECORD_SINK_DISK_POLICY (gst_record_sink_disk_policy_get_type())
+static GType gst_record_sink_disk_policy_get_type(void)
+{
+  static GType type = 0;
+  static const GEnumValue values[] = {
+    {GST_RECORD_SINK_DISK_POLICY_STOP, "Finalize the file and stop", "stop"},
+    {GST_RECORD_SINK_DISK_POLICY_ROTATE, "Continue in a new file, deleting the oldest one", "rotate"},
+    {GST_RECORD_SINK_DISK_POLICY_SWITCH, "Continue in a new file in fallback-location", "switch"},
+    {GST_RECORD_SINK_DISK_POLICY_LOWER_BITRATE, "Ask for a lower bitrate on the bus, applied by enginebin", "lower-bitrate"},
+    {0, NULL, NULL},
+  };
+
+  if (g_once_init_enter(&type))
+    g_once_init_leave(&type, g_enum_register_static("GstRecordSinkDiskPolicy", values));
+  return type;
+}
+
 enum
 {
   LAST_SIGNAL
@@ -36,12 +107,403 @@ struct _GstRecordSink
   GstElement* aacparse;
 
   GstElement* mp4mux;
-  GstElement* filesink;
+  GstElement* writer;
+  GstElement* splitmux;
+
+  guint expected_duration;
+  guint expected_bitrate;
+  guint64 max_reserve;
+  gboolean parse;
+  gchar *location;
+  GstRecordSinkDiskPolicy disk_policy;
+  guint disk_warning;
+  guint disk_reserve;
+  gchar *fallback_location;
+  gboolean index;
+  gboolean fragmented;
+
+  /* under the object lock */
+  GstClockTime first_pts;
+  GstClockTime last_pts;
+  guint64 bytes_in;
+  gchar *current_location;
+  gchar *next_location;
+  /* files finished by a rotation, oldest first */
+  GQueue finished;
+  guint fragments;
+  gint64 last_check;
+  guint64 last_bytes;
+  guint64 byte_rate;
+  guint64 disk_free;
+  guint64 time_left;
+  gboolean warned;
+  gboolean applied;
+  gboolean stopping;
+  gboolean eos_sent[2];
+  /* a split was asked for before the moov reserve runs out */
+  gboolean reserve_split;
+  guint indexed;
+
+  /* moov reserve of each file, 0 when fragmented */
+  GstClockTime reserved_duration;
+
+  GstCaps *keyframe_caps;
+
+  /* from the writer streaming thread */
+  GstRecordIndexWriter *index_writer;
+  GstClockTime index_start;
 };
 
 G_DEFINE_TYPE(GstRecordSink, gst_record_sink, GST_TYPE_BIN);
 
 
+static gchar *gst_record_sink_rotated_location(GstRecordSink *self, const gchar *directory)
+{
+  gchar *basename = g_path_get_basename(self->location);
+  gchar *extension = strrchr(basename, '.');
+  gchar *name, *path;
+
+  if (extension && extension != basename){
+    *extension = '\0';
+    name = g_strdup_printf("%s-%u.%s", basename, self->fragments, extension + 1);
+  } else {
+    name = g_strdup_printf("%s-%u", basename, self->fragments);
+  }
+  path = g_build_filename(directory, name, NULL);
+
+  g_free(name);
+  g_free(basename);
+  return path;
+}
+
+/* Called by splitmuxsink for each new file */
+static gchar *gst_record_sink_format_location(GstElement *splitmux, guint fragment_id, gpointer user_data)
+{
+  GstRecordSink *self = GST_RECORD_SINK(user_data);
+  gchar *path;
+
+  GST_OBJECT_LOCK(self);
+  if (self->next_location){
+    path = self->next_location;
+    self->next_location = NULL;
+  } else if (fragment_id == 0 || self->current_location == NULL){
+    path = g_strdup(self->location);
+  } else {
+    gchar *directory = g_path_get_dirname(self->current_location);
+    path = gst_record_sink_rotated_location(self, directory);
+    g_free(directory);
+  }
+  if (self->current_location)
+    g_queue_push_tail(&self->finished, self->current_location);
+  self->current_location = g_strdup(path);
+  self->fragments++;
+  /* the new file gets its own warning and policy */
+  self->warned = FALSE;
+  self->applied = FALSE;
+  self->reserve_split = FALSE;
+  GST_OBJECT_UNLOCK(self);
+
+  GST_INFO_OBJECT(self, "Recording to %s", path);
+  return path;
+}
+
+static const gchar *gst_record_sink_disk_policy_nick(GstRecordSinkDiskPolicy policy)
+{
+  GEnumValue *value = g_enum_get_value(g_type_class_peek(GST_TYPE_RECORD_SINK_DISK_POLICY), policy);
+
+  return value ? value->value_nick : "none";
+}
+
+/* Called with the object lock, returns the action taken. A file to delete
+ * for room is returned in @oldest, to unlink out of the lock. */
+static GstRecordSinkDiskPolicy gst_record_sink_apply_disk_policy(GstRecordSink *self, gboolean critical, gchar **oldest)
+{
+  GstRecordSinkDiskPolicy policy = critical ? GST_RECORD_SINK_DISK_POLICY_STOP : self->disk_policy;
+  gchar *directory;
+
+  switch (policy){
+    case GST_RECORD_SINK_DISK_POLICY_ROTATE:
+      /* the previous files make room for the new one */
+      *oldest = g_queue_pop_head(&self->finished);
+      directory = g_path_get_dirname(self->current_location ? self->current_location : self->location);
+      g_free(self->next_location);
+      self->next_location = gst_record_sink_rotated_location(self, directory);
+      g_free(directory);
+      break;
+    case GST_RECORD_SINK_DISK_POLICY_SWITCH:
+      directory = self->current_location ? g_path_get_dirname(self->current_location) : NULL;
+      if (self->fallback_location && g_strcmp0(directory, self->fallback_location)){
+        g_free(self->next_location);
+        self->next_location = gst_record_sink_rotated_location(self, self->fallback_location);
+      } else {
+        policy = GST_RECORD_SINK_DISK_POLICY_STOP;
+      }
+      g_free(directory);
+      break;
+    default:
+      break;
+  }
+
+  if (policy == GST_RECORD_SINK_DISK_POLICY_STOP)
+    self->stopping = TRUE;
+  self->applied = TRUE;
+
+  return policy;
+}
+
+/* Predicts when the disk is full from the free space and the byte rate
+ * coming in, warns ahead and acts before the writes fail */
+static void gst_record_sink_check_disk(GstRecordSink *self, gint64 now)
+{
+  GstRecordSinkDiskPolicy action = GST_RECORD_SINK_DISK_POLICY_STOP;
+  gboolean warn = FALSE, acted = FALSE, critical;
+  struct statvfs st;
+  gchar *directory, *oldest = NULL;
+  guint64 rate, free_bytes, time_left;
+
+  GST_OBJECT_LOCK(self);
+  directory = g_path_get_dirname(self->current_location ? self->current_location : self->location);
+  GST_OBJECT_UNLOCK(self);
+
+  if (statvfs(directory, &st) < 0){
+    GST_DEBUG_OBJECT(self, "Cannot check the free space of %s", directory);
+    g_free(directory);
+    return;
+  }
+  g_free(directory);
+  free_bytes = (guint64) st.f_bavail * st.f_frsize;
+
+  GST_OBJECT_LOCK(self);
+  rate = gst_util_uint64_scale(self->bytes_in - self->last_bytes, G_USEC_PER_SEC, now - self->last_check);
+  rate = self->byte_rate == 0 ? rate : (self->byte_rate * 3 + rate) / 4;
+  self->byte_rate = rate;
+  self->last_bytes = self->bytes_in;
+  self->last_check = now;
+  self->disk_free = free_bytes;
+  time_left = rate > 0 ? free_bytes / rate : G_MAXUINT64;
+  self->time_left = time_left;
+
+  critical = time_left <= DISK_CRITICAL;
+  if (time_left < self->disk_warning && !self->warned){
+    self->warned = TRUE;
+    warn = TRUE;
+  }
+  if (!self->stopping && ((time_left < self->disk_reserve && !self->applied) || critical)){
+    action = gst_record_sink_apply_disk_policy(self, critical, &oldest);
+    acted = TRUE;
+  }
+  GST_OBJECT_UNLOCK(self);
+
+  if (oldest){
+    gchar *index = g_strconcat(oldest, GST_RECORD_INDEX_SUFFIX, NULL);
+
+    GST_INFO_OBJECT(self, "Deleting %s to make room", oldest);
+    g_unlink(oldest);
+    /* the index goes with its file, if it was written */
+    g_unlink(index);
+    g_free(index);
+    g_free(oldest);
+  }
+
+  if (warn){
+    GST_ELEMENT_WARNING(self, RESOURCE, NO_SPACE_LEFT,
+        ("Disk full in %" G_GUINT64_FORMAT " s", time_left),
+        ("%" G_GUINT64_FORMAT " bytes free at %" G_GUINT64_FORMAT " bytes/s", free_bytes, rate));
+  }
+  if (warn || acted){
+    gst_element_post_message(GST_ELEMENT(self),
+        gst_message_new_element(GST_OBJECT(self),
+            gst_structure_new("recordsink-disk",
+                "free", G_TYPE_UINT64, free_bytes,
+                "byte-rate", G_TYPE_UINT64, rate,
+                "time-left", G_TYPE_UINT64, time_left,
+                /* what would last until the warning delay */
+                "target-byte-rate", G_TYPE_UINT64, self->disk_warning > 0 ? free_bytes / self->disk_warning : rate,
+                "action", G_TYPE_STRING, acted ? gst_record_sink_disk_policy_nick(action) : "none",
+                NULL)));
+  }
+
+  if (acted && (action == GST_RECORD_SINK_DISK_POLICY_ROTATE || action == GST_RECORD_SINK_DISK_POLICY_SWITCH))
+    g_signal_emit_by_name(self->splitmux, "split-now");
+}
+
+/* The moov only fits in its reserve for the expected duration and the
+ * margin. A recording going on past the expected duration continues in a
+ * new file, while the margin still covers the wait for the next keyframe. */
+static void gst_record_sink_check_reserve(GstRecordSink *self)
+{
+  GstClockTime remaining = GST_CLOCK_TIME_NONE;
+  gboolean split;
+
+  if (self->reserved_duration == 0)
+    return;
+
+  g_object_get(self->mp4mux, "reserved-duration-remaining", &remaining, NULL);
+  if (!GST_CLOCK_TIME_IS_VALID(remaining) || remaining > self->reserved_duration / (RESERVE_MARGIN + 1))
+    return;
+
+  GST_OBJECT_LOCK(self);
+  split = !self->stopping && !self->reserve_split;
+  self->reserve_split = TRUE;
+  GST_OBJECT_UNLOCK(self);
+
+  if (!split)
+    return;
+
+  GST_ELEMENT_WARNING(self, STREAM, MUX, ("Recording longer than expected-duration"),
+      ("%" GST_TIME_FORMAT " of moov reserve left, continuing in a new file", GST_TIME_ARGS(remaining)));
+  g_signal_emit_by_name(self->splitmux, "split-now");
+}
+
+/* Counts the bytes coming in, and ends each stream once the disk policy
+ * stopped the recording, so the muxer finalizes the file */
+static GstPadProbeReturn gst_record_sink_probe(GstRecordSink *self, GstPad *pad, GstBuffer *buffer, guint stream)
+{
+  gboolean stopping, send_eos = FALSE;
+
+  GST_OBJECT_LOCK(self);
+  self->bytes_in += gst_buffer_get_size(buffer);
+  stopping = self->stopping;
+  if (stopping){
+    send_eos = !self->eos_sent[stream];
+    self->eos_sent[stream] = TRUE;
+  }
+  GST_OBJECT_UNLOCK(self);
+
+  if (stopping){
+    if (send_eos){
+      GST_INFO_OBJECT(self, "Stopping the recording before the disk is full");
+      gst_pad_send_event(pad, gst_event_new_eos());
+    }
+    return GST_PAD_PROBE_DROP;
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn gst_record_sink_audio_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+  return gst_record_sink_probe(GST_RECORD_SINK(user_data), pad, GST_PAD_PROBE_INFO_BUFFER(info), 1);
+}
+
+/* Recorded duration, from the video timestamps */
+static GstPadProbeReturn gst_record_sink_video_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+  GstRecordSink *self = GST_RECORD_SINK(user_data);
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+  GstClockTime pts = GST_BUFFER_PTS(buffer);
+  gint64 now = g_get_monotonic_time();
+  gboolean check;
+
+  GST_OBJECT_LOCK(self);
+  if (GST_CLOCK_TIME_IS_VALID(pts)){
+    if (!GST_CLOCK_TIME_IS_VALID(self->first_pts))
+      self->first_pts = pts;
+    if (!GST_CLOCK_TIME_IS_VALID(self->last_pts) || pts > self->last_pts)
+      self->last_pts = pts;
+  }
+  if (self->last_check == 0)
+    self->last_check = now;
+  check = now - self->last_check >= DISK_CHECK_INTERVAL;
+  GST_OBJECT_UNLOCK(self);
+
+  if (check){
+    gst_record_sink_check_reserve(self);
+    gst_record_sink_check_disk(self, now);
+  }
+
+  return gst_record_sink_probe(self, pad, buffer, 0);
+}
+
+/* A new file starts with a new index next to it */
+static void gst_record_sink_open_index(GstRecordSink *self)
+{
+  GError *error = NULL;
+  gchar *location = NULL, *path;
+
+  g_clear_pointer(&self->index_writer, gst_record_index_writer_free);
+  self->index_start = GST_CLOCK_TIME_NONE;
+
+  g_object_get(self->writer, "location", &location, NULL);
+  if (location == NULL)
+    return;
+
+  path = g_strconcat(location, GST_RECORD_INDEX_SUFFIX, NULL);
+  self->index_writer = gst_record_index_writer_new(path, &error);
+  if (self->index_writer == NULL){
+    GST_WARNING_OBJECT(self, "No index for %s: %s", location, error->message);
+    g_clear_error(&error);
+  } else {
+    GST_DEBUG_OBJECT(self, "Indexing %s to %s", location, path);
+  }
+
+  g_free(path);
+  g_free(location);
+}
+
+/* Tags the parsed video keyframes going to the muxer, the meta stays on
+ * the sample buffer down to the writer */
+static GstPadProbeReturn gst_record_sink_keyframe_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+  GstRecordSink *self = GST_RECORD_SINK(user_data);
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+
+  if (!self->index || GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT) ||
+      !GST_BUFFER_PTS_IS_VALID(buffer))
+    return GST_PAD_PROBE_OK;
+
+  buffer = gst_buffer_make_writable(buffer);
+  gst_buffer_add_reference_timestamp_meta(buffer, self->keyframe_caps, GST_BUFFER_PTS(buffer), GST_CLOCK_TIME_NONE);
+  GST_PAD_PROBE_INFO_DATA(info) = buffer;
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* Keyframe samples reach the writer with their meta, the file offset is
+ * where the writer is about to write them. The muxer interleaves the
+ * samples in time order, the first one starts the file timeline. */
+static GstPadProbeReturn gst_record_sink_writer_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+  GstRecordSink *self = GST_RECORD_SINK(user_data);
+  GstReferenceTimestampMeta *meta;
+  GstRecordIndexEntry entry = {0};
+  GstBuffer *buffer;
+  gint64 offset;
+
+  if (info->type & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM){
+    if (GST_EVENT_TYPE(GST_PAD_PROBE_INFO_EVENT(info)) == GST_EVENT_STREAM_START && self->index)
+      gst_record_sink_open_index(self);
+    return GST_PAD_PROBE_OK;
+  }
+
+  if (self->index_writer == NULL)
+    return GST_PAD_PROBE_OK;
+
+  buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+  if (!GST_CLOCK_TIME_IS_VALID(self->index_start) && GST_BUFFER_PTS_IS_VALID(buffer))
+    self->index_start = GST_BUFFER_PTS(buffer);
+
+  meta = gst_buffer_get_reference_timestamp_meta(buffer, self->keyframe_caps);
+  if (meta == NULL || !gst_pad_query_position(pad, GST_FORMAT_BYTES, &offset))
+    return GST_PAD_PROBE_OK;
+
+  /* from the start of the file, as the file plays */
+  entry.pts = GST_CLOCK_TIME_IS_VALID(self->index_start) && meta->timestamp > self->index_start ?
+      meta->timestamp - self->index_start : 0;
+  entry.offset = offset;
+  entry.size = gst_buffer_get_size(buffer);
+  if (gst_record_index_writer_append(self->index_writer, &entry)){
+    GST_OBJECT_LOCK(self);
+    self->indexed++;
+    GST_OBJECT_UNLOCK(self);
+  } else {
+    GST_WARNING_OBJECT(self, "Cannot write the index, stopping it");
+    g_clear_pointer(&self->index_writer, gst_record_index_writer_free);
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
 static void gst_record_sink_init(GstRecordSink *self)
 {
   GstBin *bin = GST_BIN(self);
@@ -54,23 +516,207 @@ static void gst_record_sink_init(GstRecordSink *self)
   self->aacparse = gst_element_factory_make("aacparse", "aparse");
 
   self->mp4mux = gst_element_factory_make("mp4mux", "mux");
-  self->filesink = gst_element_factory_make("filesink", "sink");
-
-  gst_bin_add_many(GST_BIN(bin), self->vqueue, self->h264parse, self->aqueue, self->aacparse, self->mp4mux, self->filesink, NULL);
-  gst_element_link_many(self->aqueue, self->aacparse, self->mp4mux, self->filesink, NULL);
-  gst_element_link_many(self->vqueue, self->h264parse, self->mp4mux, NULL);
+  self->writer = gst_element_factory_make("recordwriter", "sink");
+  self->splitmux = gst_element_factory_make("splitmuxsink", "split");
+
+  /* files only change when the disk policy asks for it */
+  g_object_set(self->splitmux, "muxer", self->mp4mux, "sink", self->writer,
+      "max-size-time", (guint64) 0, "max-size-bytes", (guint64) 0, NULL);
+  g_signal_connect(self->splitmux, "format-location", G_CALLBACK(gst_record_sink_format_location), self);
+
+  self->expected_duration = DEFAULT_EXPECTED_DURATION;
+  self->expected_bitrate = DEFAULT_EXPECTED_BITRATE;
+  self->max_reserve = DEFAULT_MAX_RESERVE;
+  self->parse = DEFAULT_PARSE;
+  self->location = g_strdup(DEFAULT_LOCATION);
+  self->disk_policy = DEFAULT_DISK_POLICY;
+  self->disk_warning = DEFAULT_DISK_WARNING;
+  self->disk_reserve = DEFAULT_DISK_RESERVE;
+  self->fallback_location = DEFAULT_FALLBACK_LOCATION;
+  self->first_pts = GST_CLOCK_TIME_NONE;
+  self->last_pts = GST_CLOCK_TIME_NONE;
+  self->time_left = G_MAXUINT64;
+  self->index = DEFAULT_INDEX;
+  self->fragmented = DEFAULT_FRAGMENTED;
+  self->index_start = GST_CLOCK_TIME_NONE;
+  self->keyframe_caps = gst_static_caps_get(&keyframe_caps);
+  g_queue_init(&self->finished);
+
+  gst_bin_add_many(GST_BIN(bin), self->vqueue, self->h264parse, self->aqueue, self->aacparse, self->splitmux, NULL);
+  gst_element_link(self->aqueue, self->aacparse);
+  gst_element_link_pads(self->aacparse, "src", self->splitmux, "audio_%u");
+  gst_element_link(self->vqueue, self->h264parse);
+  gst_element_link_pads(self->h264parse, "src", self->splitmux, "video");
+
+  GstPad *pad = gst_element_get_static_pad(self->h264parse, "src");
+  gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, gst_record_sink_keyframe_probe, self, NULL);
+  gst_object_unref(GST_OBJECT(pad));
 
-  GstPad *pad = gst_element_get_static_pad(self->aqueue, "sink");
+  pad = gst_element_get_static_pad(self->aqueue, "sink");
+  gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, gst_record_sink_audio_probe, self, NULL);
   gst_element_add_pad(element, gst_ghost_pad_new("audio_sink", pad));
   gst_object_unref(GST_OBJECT(pad));
 
   pad = gst_element_get_static_pad(self->vqueue, "sink");
+  gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, gst_record_sink_video_probe, self, NULL);
   gst_element_add_pad(element, gst_ghost_pad_new("video_sink", pad));
   gst_object_unref(GST_OBJECT(pad));
 
+  pad = gst_element_get_static_pad(self->writer, "sink");
+  gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+      gst_record_sink_writer_probe, self, NULL);
+  gst_object_unref(GST_OBJECT(pad));
 }
 
 
+/* Picks how the file is finalized before the muxer starts. With a known
+ * duration, the moov is written into space reserved after ftyp and
+ * patched in place at EOS, so the file is fast-start without rewriting
+ * the samples. Without one, or when the reserve would be too large, the
+ * moov is appended at EOS as before, or the file is fragmented when asked
+ * for. A recording outlasting its reserve is split before the moov
+ * overflows it. */
+static void gst_record_sink_configure_mux(GstRecordSink *self)
+{
+  guint64 expected_size = (guint64) self->expected_bitrate / 8 * self->expected_duration;
+  guint64 bytes_per_sec = MOOV_BYTES_PER_SEC;
+  guint64 duration, reserve;
+
+  if (expected_size > G_MAXUINT32)
+    bytes_per_sec += MOOV_CO64_BYTES_PER_SEC;
+  duration = (guint64) self->expected_duration * (RESERVE_MARGIN + 1) / RESERVE_MARGIN;
+  reserve = duration * bytes_per_sec;
+
+  if (duration > 0 && reserve <= self->max_reserve){
+    GST_DEBUG_OBJECT(self, "Reserving %" G_GUINT64_FORMAT " bytes for %" G_GUINT64_FORMAT " s", reserve, duration);
+    self->reserved_duration = duration * GST_SECOND;
+    g_object_set(self->mp4mux, "fragment-duration", 0,
+        "reserved-bytes-per-sec", (guint) bytes_per_sec,
+        "reserved-max-duration", duration * GST_SECOND,
+        "reserved-moov-update-period", MOOV_UPDATE_PERIOD, NULL);
+  } else if (self->fragmented) {
+    GST_DEBUG_OBJECT(self, "No moov reserve for %u s, writing fragments", self->expected_duration);
+    self->reserved_duration = 0;
+    g_object_set(self->mp4mux, "fragment-duration", FRAGMENT_DURATION,
+        "reserved-max-duration", GST_CLOCK_TIME_NONE,
+        "reserved-moov-update-period", GST_CLOCK_TIME_NONE, NULL);
+  } else {
+    GST_DEBUG_OBJECT(self, "No moov reserve for %u s, moov written at EOS", self->expected_duration);
+    self->reserved_duration = 0;
+    g_object_set(self->mp4mux, "fragment-duration", 0,
+        "reserved-max-duration", GST_CLOCK_TIME_NONE,
+        "reserved-moov-update-period", GST_CLOCK_TIME_NONE, NULL);
+  }
+
+  /* the whole file can be reserved at once when its size is known */
+  if (expected_size > 0)
+    g_object_set(self->writer, "preallocate", expected_size + expected_size / RESERVE_MARGIN, NULL);
+}
+
+/* The input is already parsed upstream, shared with other recorders */
+static void gst_record_sink_remove_parsers(GstRecordSink *self)
+{
+  GstPad *pad;
+
+  gst_element_unlink_many(self->aqueue, self->aacparse, self->splitmux, NULL);
+  gst_element_unlink_many(self->vqueue, self->h264parse, self->splitmux, NULL);
+  gst_bin_remove_many(GST_BIN(self), self->aacparse, self->h264parse, NULL);
+  self->aacparse = NULL;
+  self->h264parse = NULL;
+
+  gst_element_link_pads(self->aqueue, "src", self->splitmux, "audio_%u");
+  gst_element_link_pads(self->vqueue, "src", self->splitmux, "video");
+
+  pad = gst_element_get_static_pad(self->vqueue, "src");
+  gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, gst_record_sink_keyframe_probe, self, NULL);
+  gst_object_unref(GST_OBJECT(pad));
+}
+
+static GstStructure *gst_record_sink_get_stats(GstRecordSink *self)
+{
+  GstStructure *writer_stats = NULL, *stats;
+  GstClockTime duration = 0;
+  guint64 bytes = 0, disk_usage = 0, disk_free, time_left;
+  gchar *location = NULL;
+  guint files, keyframes;
+  GStatBuf st;
+
+  g_object_get(self->writer, "stats", &writer_stats, "location", &location, NULL);
+  gst_structure_get_uint64(writer_stats, "bytes", &bytes);
+
+  GST_OBJECT_LOCK(self);
+  if (GST_CLOCK_TIME_IS_VALID(self->first_pts))
+    duration = self->last_pts - self->first_pts;
+  disk_free = self->disk_free;
+  time_left = self->time_left;
+  files = self->fragments;
+  keyframes = self->indexed;
+  GST_OBJECT_UNLOCK(self);
+
+  /* blocks held on disk, preallocation included */
+  if (location && g_stat(location, &st) == 0)
+    disk_usage = (guint64) st.st_blocks * 512;
+
+  stats = gst_structure_new("recordsink-stats",
+      "location", G_TYPE_STRING, location,
+      "duration", G_TYPE_UINT64, duration,
+      "bytes", G_TYPE_UINT64, bytes,
+      "byte-rate", G_TYPE_UINT64,
+          duration > 0 ? gst_util_uint64_scale(bytes, GST_SECOND, duration) : (guint64) 0,
+      "disk-usage", G_TYPE_UINT64, disk_usage,
+      "disk-free", G_TYPE_UINT64, disk_free,
+      "time-left", G_TYPE_UINT64, time_left,
+      "files", G_TYPE_UINT, files,
+      "keyframes", G_TYPE_UINT, keyframes,
+      "writer", GST_TYPE_STRUCTURE, writer_stats,
+      NULL);
+
+  gst_structure_free(writer_stats);
+  g_free(location);
+
+  return stats;
+}
+
+static GstStateChangeReturn gst_record_sink_change_state(GstElement *element, GstStateChange transition)
+{
+  GstRecordSink *self = GST_RECORD_SINK(element);
+  GstStateChangeReturn ret;
+
+  if (transition == GST_STATE_CHANGE_NULL_TO_READY && !self->parse && self->h264parse)
+    gst_record_sink_remove_parsers(self);
+
+  if (transition == GST_STATE_CHANGE_READY_TO_PAUSED){
+    GST_OBJECT_LOCK(self);
+    self->first_pts = GST_CLOCK_TIME_NONE;
+    self->last_pts = GST_CLOCK_TIME_NONE;
+    self->bytes_in = 0;
+    self->last_bytes = 0;
+    self->last_check = 0;
+    self->byte_rate = 0;
+    self->disk_free = 0;
+    self->time_left = G_MAXUINT64;
+    self->fragments = 0;
+    self->stopping = FALSE;
+    self->eos_sent[0] = self->eos_sent[1] = FALSE;
+    self->reserve_split = FALSE;
+    g_clear_pointer(&self->current_location, g_free);
+    g_clear_pointer(&self->next_location, g_free);
+    g_queue_clear_full(&self->finished, g_free);
+    self->indexed = 0;
+    GST_OBJECT_UNLOCK(self);
+    gst_record_sink_configure_mux(self);
+  }
+
+  ret = GST_ELEMENT_CLASS(parent_class)->change_state(element, transition);
+
+  /* the writer streaming thread is stopped */
+  if (transition == GST_STATE_CHANGE_PAUSED_TO_READY){
+    g_clear_pointer(&self->index_writer, gst_record_index_writer_free);
+  }
+
+  return ret;
+}
+
 static void gst_video_recorder_set_property(GObject *object,
                                                 guint prop_id,
                                                 const GValue *value,
@@ -88,7 +734,43 @@ static void gst_record_sink_set_property(GObject *object,
 
     switch (prop_id) {
         case PROP_LOCATION:
-            g_object_set_property(G_OBJECT(self->filesink), "location", value);
+            GST_OBJECT_LOCK(self);
+            g_free(self->location);
+            self->location = g_value_dup_string(value);
+            GST_OBJECT_UNLOCK(self);
+            break;
+        case PROP_EXPECTED_DURATION:
+            self->expected_duration = g_value_get_uint(value);
+            break;
+        case PROP_EXPECTED_BITRATE:
+            self->expected_bitrate = g_value_get_uint(value);
+            break;
+        case PROP_MAX_RESERVE:
+            self->max_reserve = g_value_get_uint64(value);
+            break;
+        case PROP_PARSE:
+            self->parse = g_value_get_boolean(value);
+            break;
+        case PROP_DISK_POLICY:
+            self->disk_policy = g_value_get_enum(value);
+            break;
+        case PROP_DISK_WARNING:
+            self->disk_warning = g_value_get_uint(value);
+            break;
+        case PROP_DISK_RESERVE:
+            self->disk_reserve = g_value_get_uint(value);
+            break;
+        case PROP_FALLBACK_LOCATION:
+            GST_OBJECT_LOCK(self);
+            g_free(self->fallback_location);
+            self->fallback_location = g_value_dup_string(value);
+            GST_OBJECT_UNLOCK(self);
+            break;
+        case PROP_INDEX:
+            self->index = g_value_get_boolean(value);
+            break;
+        case PROP_FRAGMENTED:
+            self->fragmented = g_value_get_boolean(value);
             break;
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
@@ -105,6 +787,46 @@ static void gst_record_sink_get_property(GObject *object,
     GstRecordSink *self = GST_RECORD_SINK(object);
 
     switch (prop_id) {
+        case PROP_LOCATION:
+            GST_OBJECT_LOCK(self);
+            g_value_set_string(value, self->location);
+            GST_OBJECT_UNLOCK(self);
+            break;
+        case PROP_EXPECTED_DURATION:
+            g_value_set_uint(value, self->expected_duration);
+            break;
+        case PROP_EXPECTED_BITRATE:
+            g_value_set_uint(value, self->expected_bitrate);
+            break;
+        case PROP_MAX_RESERVE:
+            g_value_set_uint64(value, self->max_reserve);
+            break;
+        case PROP_PARSE:
+            g_value_set_boolean(value, self->parse);
+            break;
+        case PROP_DISK_POLICY:
+            g_value_set_enum(value, self->disk_policy);
+            break;
+        case PROP_DISK_WARNING:
+            g_value_set_uint(value, self->disk_warning);
+            break;
+        case PROP_DISK_RESERVE:
+            g_value_set_uint(value, self->disk_reserve);
+            break;
+        case PROP_FALLBACK_LOCATION:
+            GST_OBJECT_LOCK(self);
+            g_value_set_string(value, self->fallback_location);
+            GST_OBJECT_UNLOCK(self);
+            break;
+        case PROP_INDEX:
+            g_value_set_boolean(value, self->index);
+            break;
+        case PROP_FRAGMENTED:
+            g_value_set_boolean(value, self->fragmented);
+            break;
+        case PROP_STATS:
+            g_value_take_boxed(value, gst_record_sink_get_stats(self));
+            break;
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
             break;
@@ -112,6 +834,20 @@ static void gst_record_sink_get_property(GObject *object,
 }
 
 
+static void gst_record_sink_finalize(GObject *object)
+{
+  GstRecordSink *self = GST_RECORD_SINK(object);
+
+  g_free(self->location);
+  g_free(self->fallback_location);
+  g_free(self->current_location);
+  g_free(self->next_location);
+  g_queue_clear_full(&self->finished, g_free);
+  gst_record_index_writer_free(self->index_writer);
+  gst_caps_unref(self->keyframe_caps);
+
+  G_OBJECT_CLASS(parent_class)->finalize(object);
+}
 
 static void gst_record_sink_class_init(GstRecordSinkClass *klass)
 {
@@ -121,12 +857,83 @@ static void gst_record_sink_class_init(GstRecordSinkClass *klass)
   GObjectClass *object_class = G_OBJECT_CLASS(klass);
   object_class->set_property = gst_record_sink_set_property;
   object_class->get_property = gst_record_sink_get_property;
+  object_class->finalize = gst_record_sink_finalize;
+
+  element_class->change_state = gst_record_sink_change_state;
 
   g_object_class_install_property(object_class, PROP_LOCATION,
                                   g_param_spec_string("location", "Location",
                                                    "File location", DEFAULT_LOCATION,
                                                    G_PARAM_READWRITE));
 
+  g_object_class_install_property(object_class, PROP_EXPECTED_DURATION,
+                                  g_param_spec_uint("expected-duration", "Expected duration",
+                                                   "Expected recording length in seconds, to reserve the moov at the start, 0 if unknown. Longer recordings continue in a new file",
+                                                   0, G_MAXUINT, DEFAULT_EXPECTED_DURATION,
+                                                   G_PARAM_READWRITE));
+
+  g_object_class_install_property(object_class, PROP_EXPECTED_BITRATE,
+                                  g_param_spec_uint("expected-bitrate", "Expected bitrate",
+                                                   "Expected total bitrate in bits per second, 0 if unknown",
+                                                   0, G_MAXUINT, DEFAULT_EXPECTED_BITRATE,
+                                                   G_PARAM_READWRITE));
+
+  g_object_class_install_property(object_class, PROP_MAX_RESERVE,
+                                  g_param_spec_uint64("max-reserve", "Maximum reserve",
+                                                   "Largest moov reserve in bytes, larger ones are not reserved",
+                                                   0, G_MAXUINT64, DEFAULT_MAX_RESERVE,
+                                                   G_PARAM_READWRITE));
+
+  g_object_class_install_property(object_class, PROP_PARSE,
+                                  g_param_spec_boolean("parse", "Parse",
+                                                   "Parse the input, FALSE when it is parsed upstream for several recorders",
+                                                   DEFAULT_PARSE,
+                                                   G_PARAM_READWRITE));
+
+  g_object_class_install_property(object_class, PROP_DISK_POLICY,
+                                  g_param_spec_enum("disk-policy", "Disk policy",
+                                                   "What to do when the disk is about to be full",
+                                                   GST_TYPE_RECORD_SINK_DISK_POLICY, DEFAULT_DISK_POLICY,
+                                                   G_PARAM_READWRITE));
+
+  g_object_class_install_property(object_class, PROP_DISK_WARNING,
+                                  g_param_spec_uint("disk-warning", "Disk warning",
+                                                   "Seconds of recording left on the disk when a warning is posted",
+                                                   0, G_MAXUINT, DEFAULT_DISK_WARNING,
+                                                   G_PARAM_READWRITE));
+
+  g_object_class_install_property(object_class, PROP_DISK_RESERVE,
+                                  g_param_spec_uint("disk-reserve", "Disk reserve",
+                                                   "Seconds of recording left on the disk when the disk policy applies",
+                                                   DISK_CRITICAL, G_MAXUINT, DEFAULT_DISK_RESERVE,
+                                                   G_PARAM_READWRITE));
+
+  g_object_class_install_property(object_class, PROP_FALLBACK_LOCATION,
+                                  g_param_spec_string("fallback-location", "Fallback location",
+                                                   "Directory the recording switches to with the switch policy", DEFAULT_FALLBACK_LOCATION,
+                                                   G_PARAM_READWRITE));
+
+  g_object_class_install_property(object_class, PROP_INDEX,
+                                  g_param_spec_boolean("index", "Index",
+                                                   "Write the keyframes offsets and times to <file>" GST_RECORD_INDEX_SUFFIX " for seeking without parsing the file",
+                                                   DEFAULT_INDEX,
+                                                   G_PARAM_READWRITE));
+
+  g_object_class_install_property(object_class, PROP_FRAGMENTED,
+                                  g_param_spec_boolean("fragmented", "Fragmented",
+                                                   "Write a fragmented file when no moov is reserved, instead of the moov at EOS",
+                                                   DEFAULT_FRAGMENTED,
+                                                   G_PARAM_READWRITE));
+
+  g_object_class_install_property(object_class, PROP_STATS,
+                                  g_param_spec_boxed("stats", "Statistics",
+                                                   "Duration, byte rate and disk usage of the recording",
+                                                   GST_TYPE_STRUCTURE,
+                                                   G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  GST_DEBUG_CATEGORY_INIT (gst_record_sink_debug, "recordsink", 0,
+      "Record Sink Debug");
+
   gst_element_class_set_static_metadata(element_class,
                                         "RecordSink",
                                         "RecordSink",
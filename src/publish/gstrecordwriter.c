@@ -0,0 +1,660 @@
+/* fallocate(), sync_file_range() */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "gstrecordwriter.h"
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib/gstdio.h>
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+GST_DEBUG_CATEGORY_STATIC (gst_record_writer_debug);
+#define GST_CAT_DEFAULT gst_record_writer_debug
+
+#define gst_record_writer_parent_class parent_class
+
+#define DEFAULT_LOCATION "record.mp4"
+#define DEFAULT_BUFFER_SIZE (4 * 1024 * 1024)
+#define DEFAULT_PREALLOCATE (64 * 1024 * 1024)
+#define DEFAULT_WRITE_BEHIND (8 * 1024 * 1024)
+#define DEFAULT_SYNC_INTERVAL 0
+#define DEFAULT_IO_URING FALSE
+
+/* page and block size every write is aligned on */
+#define WRITE_ALIGNMENT 4096
+
+/* properties */
+enum
+{
+  PROP_0,
+  PROP_LOCATION,
+  PROP_BUFFER_SIZE,
+  PROP_PREALLOCATE,
+  PROP_WRITE_BEHIND,
+  PROP_SYNC_INTERVAL,
+  PROP_IO_URING,
+  PROP_STATS,
+};
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS_ANY);
+
+/* File sink for long recordings. The muxer output is gathered into
+ * buffer-size chunks written at aligned offsets, so a recording costs a
+ * few large writes per second instead of one per buffer. The file grows
+ * into blocks reserved ahead with fallocate, and the written pages are
+ * pushed to disk and dropped from the page cache behind the writer, so
+ * many recordings on one host do not fill the memory with dirty pages.
+ * With io-uring, a full chunk is written while the next one fills. */
+struct _GstRecordWriter
+{
+  GstBaseSink parent_instance;
+
+  gchar *location;
+  guint buffer_size;
+  guint64 preallocate;
+  guint64 write_behind;
+  guint sync_interval;
+  gboolean io_uring;
+
+  /* streaming thread only */
+  gint fd;
+  guint8 *chunks[2];
+  /* buffer-size when the chunks were allocated */
+  gsize chunk_size;
+  guint chunk;
+  gsize fill;
+  /* file offset of the first byte of the current chunk */
+  guint64 offset;
+  guint64 end;
+  guint64 allocated;
+  /* start of the pages not handed to writeback yet, and of the ones being
+   * written back */
+  guint64 flushed;
+  guint64 flushing;
+  gint64 last_sync;
+
+#ifdef HAVE_LIBURING
+  struct io_uring ring;
+  gboolean ring_ready;
+  gboolean inflight;
+  gsize inflight_size;
+  guint64 inflight_offset;
+  gint64 inflight_started;
+#endif
+
+  GMutex lock;
+  gint64 started;
+  guint64 bytes_written;
+  guint64 writes;
+  GstClockTime write_latency;
+  GstClockTime write_latency_max;
+  guint64 syncs;
+  GstClockTime sync_latency;
+  GstClockTime sync_latency_max;
+};
+
+G_DEFINE_TYPE(GstRecordWriter, gst_record_writer, GST_TYPE_BASE_SINK);
+
+
+static void gst_record_writer_account_write(GstRecordWriter *self, gsize size, gint64 started)
+{
+  GstClockTime latency = (g_get_monotonic_time() - started) * GST_USECOND;
+
+  g_mutex_lock(&self->lock);
+  self->writes++;
+  self->bytes_written += size;
+  /* moving average over the last ~16 writes */
+  self->write_latency = self->write_latency == 0 ? latency :
+      (self->write_latency * 15 + latency) / 16;
+  self->write_latency_max = MAX(self->write_latency_max, latency);
+  g_mutex_unlock(&self->lock);
+}
+
+static gboolean gst_record_writer_sync(GstRecordWriter *self)
+{
+  gint64 started = g_get_monotonic_time();
+  GstClockTime latency;
+  gint ret = fdatasync(self->fd);
+
+  latency = (g_get_monotonic_time() - started) * GST_USECOND;
+  self->last_sync = g_get_monotonic_time();
+
+  g_mutex_lock(&self->lock);
+  self->syncs++;
+  self->sync_latency = latency;
+  self->sync_latency_max = MAX(self->sync_latency_max, latency);
+  g_mutex_unlock(&self->lock);
+
+  if (ret < 0){
+    GST_ELEMENT_ERROR(self, RESOURCE, SYNC, ("Cannot sync %s", self->location), ("%s", g_strerror(errno)));
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/* Called once the bytes up to self->end are in the page cache */
+static void gst_record_writer_written(GstRecordWriter *self)
+{
+#ifdef __linux__
+  if (self->write_behind > 0 && self->end >= self->flushed + self->write_behind){
+    /* start the writeback of the new window, then wait for the previous
+     * one and drop its pages: the dirty pages stay bounded to two windows
+     * and the recording does not evict the rest of the page cache */
+    sync_file_range(self->fd, self->flushed, self->end - self->flushed, SYNC_FILE_RANGE_WRITE);
+    if (self->flushed > self->flushing){
+      sync_file_range(self->fd, self->flushing, self->flushed - self->flushing,
+          SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+      posix_fadvise(self->fd, self->flushing, self->flushed - self->flushing, POSIX_FADV_DONTNEED);
+    }
+    self->flushing = self->flushed;
+    self->flushed = self->end;
+  }
+#endif
+
+  if (self->sync_interval > 0 &&
+      g_get_monotonic_time() - self->last_sync >= (gint64) self->sync_interval * 1000)
+    gst_record_writer_sync(self);
+}
+
+static void gst_record_writer_preallocate(GstRecordWriter *self, guint64 end)
+{
+#if defined(__linux__) && defined(FALLOC_FL_KEEP_SIZE)
+  if (self->preallocate == 0 || end <= self->allocated)
+    return;
+
+  /* reserve the next blocks without changing the visible size */
+  if (fallocate(self->fd, FALLOC_FL_KEEP_SIZE, self->allocated, self->preallocate) < 0){
+    GST_DEBUG_OBJECT(self, "No preallocation: %s", g_strerror(errno));
+    self->preallocate = 0;
+    return;
+  }
+  self->allocated += self->preallocate;
+#endif
+}
+
+static gboolean gst_record_writer_pwrite(GstRecordWriter *self, const guint8 *data, gsize size, guint64 offset)
+{
+  gint64 started = g_get_monotonic_time();
+  gsize done = 0;
+
+  while (done < size){
+    ssize_t written = pwrite(self->fd, data + done, size - done, offset + done);
+
+    if (written < 0){
+      if (errno == EINTR)
+        continue;
+      GST_ELEMENT_ERROR(self, RESOURCE, WRITE, ("Cannot write to %s", self->location), ("%s", g_strerror(errno)));
+      return FALSE;
+    }
+    done += written;
+  }
+
+  gst_record_writer_account_write(self, size, started);
+  return TRUE;
+}
+
+#ifdef HAVE_LIBURING
+static gboolean gst_record_writer_wait(GstRecordWriter *self)
+{
+  struct io_uring_cqe *cqe;
+  gint res, ret;
+
+  if (!self->inflight)
+    return TRUE;
+  self->inflight = FALSE;
+
+  do {
+    ret = io_uring_wait_cqe(&self->ring, &cqe);
+  } while (ret == -EINTR);
+  if (ret < 0){
+    GST_ELEMENT_ERROR(self, RESOURCE, WRITE, ("Cannot write to %s", self->location), ("%s", g_strerror(-ret)));
+    return FALSE;
+  }
+  res = cqe->res;
+  io_uring_cqe_seen(&self->ring, cqe);
+
+  if (res < 0){
+    GST_ELEMENT_ERROR(self, RESOURCE, WRITE, ("Cannot write to %s", self->location), ("%s", g_strerror(-res)));
+    return FALSE;
+  }
+  gst_record_writer_account_write(self, res, self->inflight_started);
+
+  /* a short write is finished synchronously from the chunk, untouched
+   * until this returns */
+  if ((gsize) res < self->inflight_size &&
+      !gst_record_writer_pwrite(self, self->chunks[self->chunk ^ 1] + res,
+          self->inflight_size - res, self->inflight_offset + res))
+    return FALSE;
+
+  gst_record_writer_written(self);
+  return TRUE;
+}
+#endif
+
+/* Hands the current chunk to the kernel and starts filling the other one */
+static gboolean gst_record_writer_submit(GstRecordWriter *self)
+{
+  guint8 *data = self->chunks[self->chunk];
+  gsize size = self->fill;
+  guint64 offset = self->offset;
+
+  if (size == 0)
+    return TRUE;
+
+  self->offset += size;
+  self->fill = 0;
+  gst_record_writer_preallocate(self, self->offset);
+
+#ifdef HAVE_LIBURING
+  if (self->ring_ready){
+    struct io_uring_sqe *sqe;
+
+    /* at most one chunk in flight, the other one is being filled */
+    if (!gst_record_writer_wait(self))
+      return FALSE;
+
+    sqe = io_uring_get_sqe(&self->ring);
+    io_uring_prep_write(sqe, self->fd, data, size, offset);
+    self->inflight_started = g_get_monotonic_time();
+    self->inflight_size = size;
+    self->inflight_offset = offset;
+    if (io_uring_submit(&self->ring) < 1){
+      GST_ELEMENT_ERROR(self, RESOURCE, WRITE, ("Cannot write to %s", self->location), ("io_uring submission failed"));
+      return FALSE;
+    }
+    self->inflight = TRUE;
+    self->end = MAX(self->end, offset + size);
+    self->chunk ^= 1;
+    return TRUE;
+  }
+#endif
+
+  if (!gst_record_writer_pwrite(self, data, size, offset))
+    return FALSE;
+  self->end = MAX(self->end, offset + size);
+  gst_record_writer_written(self);
+  return TRUE;
+}
+
+/* Writes everything out, before a seek or at the end */
+static gboolean gst_record_writer_drain(GstRecordWriter *self)
+{
+  if (!gst_record_writer_submit(self))
+    return FALSE;
+#ifdef HAVE_LIBURING
+  if (!gst_record_writer_wait(self))
+    return FALSE;
+#endif
+  return TRUE;
+}
+
+static GstFlowReturn gst_record_writer_render(GstBaseSink *sink, GstBuffer *buffer)
+{
+  GstRecordWriter *self = GST_RECORD_WRITER(sink);
+  GstMapInfo map;
+  gsize done = 0;
+
+  if (!gst_buffer_map(buffer, &map, GST_MAP_READ))
+    return GST_FLOW_ERROR;
+
+  /* chunks are filled to buffer-size exactly, so each write covers whole
+   * blocks at an aligned offset unless the muxer seeked */
+  while (done < map.size){
+    gsize size = MIN(map.size - done, self->chunk_size - self->fill);
+
+    memcpy(self->chunks[self->chunk] + self->fill, map.data + done, size);
+    self->fill += size;
+    done += size;
+
+    if (self->fill == self->chunk_size && !gst_record_writer_submit(self)){
+      gst_buffer_unmap(buffer, &map);
+      return GST_FLOW_ERROR;
+    }
+  }
+
+  gst_buffer_unmap(buffer, &map);
+  return GST_FLOW_OK;
+}
+
+static gboolean gst_record_writer_event(GstBaseSink *sink, GstEvent *event)
+{
+  GstRecordWriter *self = GST_RECORD_WRITER(sink);
+
+  switch (GST_EVENT_TYPE(event)){
+    case GST_EVENT_SEGMENT:{
+      const GstSegment *segment;
+
+      /* the muxer seeks back to rewrite its headers */
+      gst_event_parse_segment(event, &segment);
+      if (segment->format == GST_FORMAT_BYTES &&
+          segment->start != self->offset + self->fill){
+        if (!gst_record_writer_drain(self)){
+          gst_event_unref(event);
+          return FALSE;
+        }
+        self->offset = segment->start;
+      }
+      break;
+    }
+    case GST_EVENT_EOS:
+      if (!gst_record_writer_drain(self) || !gst_record_writer_sync(self)){
+        gst_event_unref(event);
+        return FALSE;
+      }
+      break;
+    default:
+      break;
+  }
+
+  return GST_BASE_SINK_CLASS(parent_class)->event(sink, event);
+}
+
+static gboolean gst_record_writer_query(GstBaseSink *sink, GstQuery *query)
+{
+  GstRecordWriter *self = GST_RECORD_WRITER(sink);
+  GstFormat format;
+
+  switch (GST_QUERY_TYPE(query)){
+    case GST_QUERY_POSITION:
+      gst_query_parse_position(query, &format, NULL);
+      if (format != GST_FORMAT_BYTES && format != GST_FORMAT_DEFAULT)
+        break;
+      gst_query_set_position(query, GST_FORMAT_BYTES, self->offset + self->fill);
+      return TRUE;
+    case GST_QUERY_SEEKING:
+      gst_query_parse_seeking(query, &format, NULL, NULL, NULL);
+      if (format != GST_FORMAT_BYTES && format != GST_FORMAT_DEFAULT)
+        break;
+      gst_query_set_seeking(query, GST_FORMAT_BYTES, TRUE, 0, -1);
+      return TRUE;
+    case GST_QUERY_FORMATS:
+      gst_query_set_formats(query, 2, GST_FORMAT_DEFAULT, GST_FORMAT_BYTES);
+      return TRUE;
+    default:
+      break;
+  }
+
+  return GST_BASE_SINK_CLASS(parent_class)->query(sink, query);
+}
+
+static gboolean gst_record_writer_start(GstBaseSink *sink)
+{
+  GstRecordWriter *self = GST_RECORD_WRITER(sink);
+
+  self->fd = g_open(self->location, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (self->fd < 0){
+    GST_ELEMENT_ERROR(self, RESOURCE, OPEN_WRITE, ("Cannot open %s", self->location), ("%s", g_strerror(errno)));
+    return FALSE;
+  }
+
+  self->chunk_size = self->buffer_size;
+  for (guint i = 0; i < 2; i++){
+    if (posix_memalign((void **) &self->chunks[i], WRITE_ALIGNMENT, self->chunk_size) != 0){
+      GST_ELEMENT_ERROR(self, RESOURCE, NO_SPACE_LEFT, ("Cannot allocate the write buffers"), (NULL));
+      /* stop is not called after a failed start */
+      self->chunks[i] = NULL;
+      g_clear_pointer(&self->chunks[0], free);
+      close(self->fd);
+      self->fd = -1;
+      return FALSE;
+    }
+  }
+  self->chunk = 0;
+  self->fill = 0;
+  self->offset = 0;
+  self->end = 0;
+  self->allocated = 0;
+  self->flushed = 0;
+  self->flushing = 0;
+  self->last_sync = g_get_monotonic_time();
+
+#ifdef HAVE_LIBURING
+  self->inflight = FALSE;
+  self->ring_ready = self->io_uring && io_uring_queue_init(4, &self->ring, 0) == 0;
+  if (self->io_uring && !self->ring_ready)
+    GST_WARNING_OBJECT(self, "io_uring unavailable, using pwrite");
+#else
+  if (self->io_uring)
+    GST_WARNING_OBJECT(self, "Built without io_uring, using pwrite");
+#endif
+
+  g_mutex_lock(&self->lock);
+  self->started = g_get_monotonic_time();
+  self->bytes_written = 0;
+  self->writes = 0;
+  self->write_latency = 0;
+  self->write_latency_max = 0;
+  self->syncs = 0;
+  self->sync_latency = 0;
+  self->sync_latency_max = 0;
+  g_mutex_unlock(&self->lock);
+
+  return TRUE;
+}
+
+static gboolean gst_record_writer_stop(GstBaseSink *sink)
+{
+  GstRecordWriter *self = GST_RECORD_WRITER(sink);
+
+  if (self->fd >= 0){
+    gst_record_writer_drain(self);
+    /* give back the preallocated blocks past the end */
+    if (self->allocated > self->end && ftruncate(self->fd, self->end) < 0)
+      GST_WARNING_OBJECT(self, "Cannot trim %s: %s", self->location, g_strerror(errno));
+    close(self->fd);
+    self->fd = -1;
+  }
+
+#ifdef HAVE_LIBURING
+  if (self->ring_ready){
+    io_uring_queue_exit(&self->ring);
+    self->ring_ready = FALSE;
+  }
+#endif
+
+  for (guint i = 0; i < 2; i++)
+    g_clear_pointer(&self->chunks[i], free);
+
+  return TRUE;
+}
+
+static GstStructure *gst_record_writer_get_stats(GstRecordWriter *self)
+{
+  GstStructure *stats;
+  gint64 elapsed;
+
+  g_mutex_lock(&self->lock);
+  elapsed = self->started > 0 ? g_get_monotonic_time() - self->started : 0;
+  stats = gst_structure_new("recordwriter-stats",
+      "bytes", G_TYPE_UINT64, self->bytes_written,
+      "writes", G_TYPE_UINT64, self->writes,
+      "throughput", G_TYPE_UINT64,
+          elapsed > 0 ? gst_util_uint64_scale(self->bytes_written, G_USEC_PER_SEC, elapsed) : (guint64) 0,
+      "write-latency", G_TYPE_UINT64, self->write_latency,
+      "max-write-latency", G_TYPE_UINT64, self->write_latency_max,
+      "syncs", G_TYPE_UINT64, self->syncs,
+      "sync-latency", G_TYPE_UINT64, self->sync_latency,
+      "max-sync-latency", G_TYPE_UINT64, self->sync_latency_max,
+      NULL);
+  g_mutex_unlock(&self->lock);
+
+  return stats;
+}
+
+static void gst_record_writer_init(GstRecordWriter *self)
+{
+  g_mutex_init(&self->lock);
+  self->location = g_strdup(DEFAULT_LOCATION);
+  self->buffer_size = DEFAULT_BUFFER_SIZE;
+  self->preallocate = DEFAULT_PREALLOCATE;
+  self->write_behind = DEFAULT_WRITE_BEHIND;
+  self->sync_interval = DEFAULT_SYNC_INTERVAL;
+  self->io_uring = DEFAULT_IO_URING;
+  self->fd = -1;
+
+  gst_base_sink_set_sync(GST_BASE_SINK(self), FALSE);
+}
+
+static void gst_record_writer_set_property(GObject *object,
+                                                guint prop_id,
+                                                const GValue *value,
+                                                GParamSpec *pspec){
+    GstRecordWriter *self = GST_RECORD_WRITER(object);
+
+    switch (prop_id) {
+        case PROP_LOCATION:
+            g_free(self->location);
+            self->location = g_value_dup_string(value);
+            break;
+        case PROP_BUFFER_SIZE:
+            self->buffer_size = GST_ROUND_UP_N(g_value_get_uint(value), WRITE_ALIGNMENT);
+            break;
+        case PROP_PREALLOCATE:
+            self->preallocate = g_value_get_uint64(value);
+            break;
+        case PROP_WRITE_BEHIND:
+            self->write_behind = g_value_get_uint64(value);
+            break;
+        case PROP_SYNC_INTERVAL:
+            self->sync_interval = g_value_get_uint(value);
+            break;
+        case PROP_IO_URING:
+            self->io_uring = g_value_get_boolean(value);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+
+}
+
+static void gst_record_writer_get_property(GObject *object,
+                                                guint prop_id,
+                                                GValue *value,
+                                                GParamSpec *pspec){
+
+    GstRecordWriter *self = GST_RECORD_WRITER(object);
+
+    switch (prop_id) {
+        case PROP_LOCATION:
+            g_value_set_string(value, self->location);
+            break;
+        case PROP_BUFFER_SIZE:
+            g_value_set_uint(value, self->buffer_size);
+            break;
+        case PROP_PREALLOCATE:
+            g_value_set_uint64(value, self->preallocate);
+            break;
+        case PROP_WRITE_BEHIND:
+            g_value_set_uint64(value, self->write_behind);
+            break;
+        case PROP_SYNC_INTERVAL:
+            g_value_set_uint(value, self->sync_interval);
+            break;
+        case PROP_IO_URING:
+            g_value_set_boolean(value, self->io_uring);
+            break;
+        case PROP_STATS:
+            g_value_take_boxed(value, gst_record_writer_get_stats(self));
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+
+}
+
+static void gst_record_writer_finalize(GObject *object)
+{
+  GstRecordWriter *self = GST_RECORD_WRITER(object);
+
+  g_free(self->location);
+  g_mutex_clear(&self->lock);
+
+  G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
+static void gst_record_writer_class_init(GstRecordWriterClass *klass)
+{
+  GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+  GstBaseSinkClass *base_sink_class = GST_BASE_SINK_CLASS(klass);
+
+  GObjectClass *object_class = G_OBJECT_CLASS(klass);
+  object_class->set_property = gst_record_writer_set_property;
+  object_class->get_property = gst_record_writer_get_property;
+  object_class->finalize = gst_record_writer_finalize;
+
+  base_sink_class->start = gst_record_writer_start;
+  base_sink_class->stop = gst_record_writer_stop;
+  base_sink_class->render = gst_record_writer_render;
+  base_sink_class->event = gst_record_writer_event;
+  base_sink_class->query = gst_record_writer_query;
+
+  g_object_class_install_property(object_class, PROP_LOCATION,
+                                  g_param_spec_string("location", "Location",
+                                                   "File location", DEFAULT_LOCATION,
+                                                   G_PARAM_READWRITE));
+
+  g_object_class_install_property(object_class, PROP_BUFFER_SIZE,
+                                  g_param_spec_uint("buffer-size", "Buffer size",
+                                                   "Size of each write in bytes, rounded up to 4 KiB",
+                                                   WRITE_ALIGNMENT, 256 * 1024 * 1024, DEFAULT_BUFFER_SIZE,
+                                                   G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property(object_class, PROP_PREALLOCATE,
+                                  g_param_spec_uint64("preallocate", "Preallocate",
+                                                   "Bytes reserved ahead of the writes with fallocate, 0 to disable",
+                                                   0, G_MAXUINT64, DEFAULT_PREALLOCATE,
+                                                   G_PARAM_READWRITE));
+
+  g_object_class_install_property(object_class, PROP_WRITE_BEHIND,
+                                  g_param_spec_uint64("write-behind", "Write behind",
+                                                   "Bytes written before they are flushed and dropped from the page cache, 0 to disable",
+                                                   0, G_MAXUINT64, DEFAULT_WRITE_BEHIND,
+                                                   G_PARAM_READWRITE));
+
+  g_object_class_install_property(object_class, PROP_SYNC_INTERVAL,
+                                  g_param_spec_uint("sync-interval", "Sync interval",
+                                                   "Milliseconds between two fdatasync, 0 to sync at the end only",
+                                                   0, G_MAXUINT, DEFAULT_SYNC_INTERVAL,
+                                                   G_PARAM_READWRITE));
+
+  g_object_class_install_property(object_class, PROP_IO_URING,
+                                  g_param_spec_boolean("io-uring", "io_uring",
+                                                   "Submit the writes with io_uring when available",
+                                                   DEFAULT_IO_URING,
+                                                   G_PARAM_READWRITE));
+
+  g_object_class_install_property(object_class, PROP_STATS,
+                                  g_param_spec_boxed("stats", "Statistics",
+                                                   "Write throughput and write and sync latencies",
+                                                   GST_TYPE_STRUCTURE,
+                                                   G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  gst_element_class_add_static_pad_template(element_class, &sink_template);
+
+  GST_DEBUG_CATEGORY_INIT (gst_record_writer_debug, "recordwriter", 0,
+      "Record Writer Debug");
+
+  gst_element_class_set_static_metadata(element_class,
+                                        "Record Writer",
+                                        "Sink/File",
+                                        "Writes a recording with large aligned writes and bounded page cache use",
+                                        "Ludovic Bouguerra <ludovic.bouguerra@stream.studio>");
+}
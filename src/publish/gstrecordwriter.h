@@ -0,0 +1,18 @@
+#ifndef __GST_RECORD_WRITER_H__
+#define __GST_RECORD_WRITER_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstbasesink.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_RECORD_WRITER gst_record_writer_get_type ()
+G_DECLARE_FINAL_TYPE (GstRecordWriter, gst_record_writer, GST, RECORD_WRITER, GstBaseSink)
+
+struct GstRecordWriterClass {
+  GstBaseSinkClass parent_class;
+};
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,363 @@
+#include "gstsrtstreamsink.h"
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define DEFAULT_LOCATION "srt://localhost:8888"
+#define DEFAULT_LATENCY 120
+#define DEFAULT_OVERHEAD 25
+#define DEFAULT_EXPECTED_BITRATE 0
+#define DEFAULT_PASSPHRASE NULL
+#define DEFAULT_STREAMID NULL
+
+/* 7 TS packets, the payload of one SRT packet */
+#define TS_ALIGNMENT 7
+
+GST_DEBUG_CATEGORY_STATIC (gst_srt_stream_sink_debug);
+#define GST_CAT_DEFAULT gst_srt_stream_sink_debug
+
+/* properties */
+enum
+{
+  PROP_0,
+  PROP_LOCATION,
+  PROP_LATENCY,
+  PROP_OVERHEAD,
+  PROP_EXPECTED_BITRATE,
+  PROP_PASSPHRASE,
+  PROP_STREAMID,
+  PROP_STATS,
+};
+
+/* Same branch as streamsink, over SRT: the stream is muxed once into
+ * MPEG-TS and sent by srtsink, whose ARQ recovers the losses within the
+ * latency window instead of stalling like TCP. */
+struct _GstSrtStreamSink
+{
+  GstBin parent_instance;
+
+  GstElement* aqueue;
+  GstElement* vqueue;
+
+  GstElement* h264parse;
+  GstElement* aacparse;
+
+  GstElement* tsmux;
+  GstElement* srtsink;
+
+  gchar* location;
+  guint overhead;
+  guint expected_bitrate;
+};
+
+#define gst_srt_stream_sink_parent_class parent_class
+G_DEFINE_TYPE(GstSrtStreamSink, gst_srt_stream_sink, GST_TYPE_BIN);
+
+
+/* The retransmission bandwidth is a libsrt socket option srtsink only takes
+ * from the URI query. libsrt only applies the overhead to the input rate
+ * when maxbw is 0, the input rate is measured unless the bitrate is known. */
+static void gst_srt_stream_sink_update_uri(GstSrtStreamSink *self)
+{
+  GstUri *uri;
+  gchar *overhead, *location;
+
+  if (!self->srtsink)
+    return;
+  uri = gst_uri_from_string(self->location);
+  if (!uri){
+    GST_WARNING_OBJECT(self, "Invalid SRT location %s", self->location);
+    return;
+  }
+
+  overhead = g_strdup_printf("%u", self->overhead);
+  gst_uri_set_query_value(uri, "maxbw", "0");
+  gst_uri_set_query_value(uri, "oheadbw", overhead);
+  if (self->expected_bitrate > 0){
+    gchar *input = g_strdup_printf("%u", self->expected_bitrate / 8);
+
+    gst_uri_set_query_value(uri, "inputbw", input);
+    g_free(input);
+  }
+  location = gst_uri_to_string(uri);
+  g_object_set(self->srtsink, "uri", location, NULL);
+
+  g_free(location);
+  g_free(overhead);
+  gst_uri_unref(uri);
+}
+
+static void gst_srt_stream_sink_init(GstSrtStreamSink *self)
+{
+  GstBin *bin = GST_BIN(self);
+  GstElement *element = GST_ELEMENT(self);
+
+  self->location = g_strdup(DEFAULT_LOCATION);
+  self->overhead = DEFAULT_OVERHEAD;
+  self->expected_bitrate = DEFAULT_EXPECTED_BITRATE;
+
+  self->aqueue = gst_element_factory_make("queue", "aqueue");
+  self->vqueue = gst_element_factory_make("queue", "vqueue");
+  g_object_set(self->aqueue, "leaky", 2, NULL);
+  g_object_set(self->vqueue, "leaky", 2, NULL);
+
+  self->h264parse = gst_element_factory_make("h264parse", "vparse");
+  self->aacparse = gst_element_factory_make("aacparse", "aparse");
+
+  self->tsmux = gst_element_factory_make("mpegtsmux", "mux");
+  self->srtsink = gst_element_factory_make("srtsink", "sink");
+  if (!self->tsmux || !self->srtsink){
+    GST_ERROR("Failed to create SRT stream elements");
+    return;
+  }
+  g_object_set(self->tsmux, "alignment", TS_ALIGNMENT, NULL);
+  g_object_set(self->srtsink, "sync", FALSE, "latency", DEFAULT_LATENCY, NULL);
+  gst_srt_stream_sink_update_uri(self);
+
+  gst_bin_add_many(GST_BIN(bin), self->vqueue, self->h264parse, self->aqueue, self->aacparse, self->tsmux, self->srtsink, NULL);
+  gst_element_link_many(self->aqueue, self->aacparse, self->tsmux, self->srtsink, NULL);
+  gst_element_link_many(self->vqueue, self->h264parse, self->tsmux, NULL);
+
+  GstPad *pad = gst_element_get_static_pad(self->aqueue, "sink");
+  gst_element_add_pad(element, gst_ghost_pad_new("audio_sink", pad));
+  gst_object_unref(GST_OBJECT(pad));
+
+  pad = gst_element_get_static_pad(self->vqueue, "sink");
+  gst_element_add_pad(element, gst_ghost_pad_new("video_sink", pad));
+  gst_object_unref(GST_OBJECT(pad));
+
+}
+
+static guint64 get_stat_uint64(const GstStructure *stats, const gchar *field)
+{
+  guint64 value = 0;
+  gint64 signed_value = 0;
+  gint int_value = 0;
+
+  /* libsrt counters come as signed or unsigned depending on the field */
+  if (gst_structure_get_uint64(stats, field, &value))
+    return value;
+  if (gst_structure_get_int64(stats, field, &signed_value))
+    return MAX(signed_value, 0);
+  if (gst_structure_get_int(stats, field, &int_value))
+    return MAX(int_value, 0);
+  return 0;
+}
+
+static gdouble get_stat_double(const GstStructure *stats, const gchar *field)
+{
+  gdouble value = 0;
+
+  gst_structure_get_double(stats, field, &value);
+  return value;
+}
+
+static GstStructure *gst_srt_stream_sink_get_stats(GstSrtStreamSink *self)
+{
+  GstStructure *link = NULL, *stats;
+  const GValue *callers;
+  guint64 bytes_sent, bytes_retransmitted;
+
+  if (self->srtsink)
+    g_object_get(self->srtsink, "stats", &link, NULL);
+  if (link == NULL)
+    link = gst_structure_new_empty("application/x-srt-statistics");
+
+  /* a listener reports one structure per caller, the first one is the peer */
+  callers = gst_structure_get_value(link, "callers");
+  if (callers && G_VALUE_HOLDS(callers, G_TYPE_VALUE_ARRAY)){
+    G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+    GValueArray *array = g_value_get_boxed(callers);
+    if (array && array->n_values > 0){
+      GstStructure *first = gst_structure_copy(g_value_get_boxed(g_value_array_get_nth(array, 0)));
+      gst_structure_free(link);
+      link = first;
+    }
+    G_GNUC_END_IGNORE_DEPRECATIONS
+  }
+
+  bytes_sent = get_stat_uint64(link, "bytes-sent");
+  bytes_retransmitted = get_stat_uint64(link, "bytes-retransmitted");
+
+  stats = gst_structure_new("srtstreamsink-stats",
+      "rtt-ms", G_TYPE_DOUBLE, get_stat_double(link, "rtt-ms"),
+      "send-rate-mbps", G_TYPE_DOUBLE, get_stat_double(link, "send-rate-mbps"),
+      "bandwidth-mbps", G_TYPE_DOUBLE, get_stat_double(link, "bandwidth-mbps"),
+      "negotiated-latency-ms", G_TYPE_UINT64, get_stat_uint64(link, "negotiated-latency-ms"),
+      "packets-sent", G_TYPE_UINT64, get_stat_uint64(link, "packets-sent"),
+      "packets-lost", G_TYPE_UINT64, get_stat_uint64(link, "packets-sent-lost"),
+      "packets-retransmitted", G_TYPE_UINT64, get_stat_uint64(link, "packets-retransmitted"),
+      "packets-dropped", G_TYPE_UINT64, get_stat_uint64(link, "packets-sent-dropped"),
+      "nack-received", G_TYPE_UINT64, get_stat_uint64(link, "packet-nack-received"),
+      "bytes-sent", G_TYPE_UINT64, bytes_sent,
+      "bytes-retransmitted", G_TYPE_UINT64, bytes_retransmitted,
+      "retransmit-overhead", G_TYPE_DOUBLE,
+          bytes_sent > 0 ? (gdouble) bytes_retransmitted / bytes_sent : 0.0,
+      NULL);
+  gst_structure_free(link);
+
+  return stats;
+}
+
+static void gst_srt_stream_sink_set_property(GObject *object,
+                                                guint prop_id,
+                                                const GValue *value,
+                                                GParamSpec *pspec){
+    GstSrtStreamSink *self = GST_SRT_STREAM_SINK(object);
+
+    switch (prop_id) {
+        case PROP_LOCATION:
+            g_free(self->location);
+            self->location = g_value_dup_string(value);
+            gst_srt_stream_sink_update_uri(self);
+            break;
+        case PROP_LATENCY:
+            if (self->srtsink)
+                g_object_set_property(G_OBJECT(self->srtsink), "latency", value);
+            break;
+        case PROP_OVERHEAD:
+            self->overhead = g_value_get_uint(value);
+            gst_srt_stream_sink_update_uri(self);
+            break;
+        case PROP_EXPECTED_BITRATE:
+            self->expected_bitrate = g_value_get_uint(value);
+            gst_srt_stream_sink_update_uri(self);
+            break;
+        case PROP_PASSPHRASE:
+            if (self->srtsink)
+                g_object_set_property(G_OBJECT(self->srtsink), "passphrase", value);
+            break;
+        case PROP_STREAMID:
+            if (self->srtsink)
+                g_object_set_property(G_OBJECT(self->srtsink), "streamid", value);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+
+}
+
+static void gst_srt_stream_sink_get_property(GObject *object,
+                                                guint prop_id,
+                                                GValue *value,
+                                                GParamSpec *pspec){
+
+    GstSrtStreamSink *self = GST_SRT_STREAM_SINK(object);
+
+    switch (prop_id) {
+        case PROP_LOCATION:
+            g_value_set_string(value, self->location);
+            break;
+        case PROP_LATENCY:
+            if (self->srtsink)
+                g_object_get_property(G_OBJECT(self->srtsink), "latency", value);
+            else
+                g_param_value_set_default(pspec, value);
+            break;
+        case PROP_OVERHEAD:
+            g_value_set_uint(value, self->overhead);
+            break;
+        case PROP_EXPECTED_BITRATE:
+            g_value_set_uint(value, self->expected_bitrate);
+            break;
+        case PROP_PASSPHRASE:
+            if (self->srtsink)
+                g_object_get_property(G_OBJECT(self->srtsink), "passphrase", value);
+            break;
+        case PROP_STREAMID:
+            if (self->srtsink)
+                g_object_get_property(G_OBJECT(self->srtsink), "streamid", value);
+            break;
+        case PROP_STATS:
+            g_value_take_boxed(value, gst_srt_stream_sink_get_stats(self));
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+
+}
+
+static GstStateChangeReturn gst_srt_stream_sink_change_state(GstElement *element, GstStateChange transition)
+{
+  GstSrtStreamSink *self = GST_SRT_STREAM_SINK(element);
+
+  if (transition == GST_STATE_CHANGE_NULL_TO_READY && (!self->tsmux || !self->srtsink)){
+    GST_ELEMENT_ERROR(self, CORE, MISSING_PLUGIN,
+        ("%s is missing", !self->srtsink ? "srtsink" : "mpegtsmux"),
+        ("Install the SRT and MPEG-TS elements of gst-plugins-bad"));
+    return GST_STATE_CHANGE_FAILURE;
+  }
+
+  return GST_ELEMENT_CLASS(parent_class)->change_state(element, transition);
+}
+
+static void gst_srt_stream_sink_finalize(GObject *object)
+{
+  GstSrtStreamSink *self = GST_SRT_STREAM_SINK(object);
+
+  g_free(self->location);
+
+  G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
+static void gst_srt_stream_sink_class_init(GstSrtStreamSinkClass *klass)
+{
+  GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+
+  GObjectClass *object_class = G_OBJECT_CLASS(klass);
+  object_class->set_property = gst_srt_stream_sink_set_property;
+  object_class->get_property = gst_srt_stream_sink_get_property;
+  object_class->finalize = gst_srt_stream_sink_finalize;
+  element_class->change_state = gst_srt_stream_sink_change_state;
+
+  g_object_class_install_property(object_class, PROP_LOCATION,
+                                  g_param_spec_string("location", "Location",
+                                                   "SRT URI, e.g. srt://host:port or srt://:port?mode=listener", DEFAULT_LOCATION,
+                                                   G_PARAM_READWRITE));
+
+  g_object_class_install_property(object_class, PROP_LATENCY,
+                                  g_param_spec_int("latency", "Latency",
+                                                   "Retransmission window in ms, about 4 times the RTT on lossy links",
+                                                   0, G_MAXINT32, DEFAULT_LATENCY,
+                                                   G_PARAM_READWRITE));
+
+  g_object_class_install_property(object_class, PROP_OVERHEAD,
+                                  g_param_spec_uint("overhead", "Overhead",
+                                                   "Bandwidth allowed for retransmissions, in percent of the stream rate",
+                                                   5, 100, DEFAULT_OVERHEAD,
+                                                   G_PARAM_READWRITE));
+
+  g_object_class_install_property(object_class, PROP_EXPECTED_BITRATE,
+                                  g_param_spec_uint("expected-bitrate", "Expected bitrate",
+                                                   "Stream bitrate in bits per second the overhead applies to, 0 to let SRT measure it",
+                                                   0, G_MAXUINT, DEFAULT_EXPECTED_BITRATE,
+                                                   G_PARAM_READWRITE));
+
+  g_object_class_install_property(object_class, PROP_PASSPHRASE,
+                                  g_param_spec_string("passphrase", "Passphrase",
+                                                   "Encryption passphrase", DEFAULT_PASSPHRASE,
+                                                   G_PARAM_READWRITE));
+
+  g_object_class_install_property(object_class, PROP_STREAMID,
+                                  g_param_spec_string("streamid", "Stream ID",
+                                                   "Stream ID sent to the listener", DEFAULT_STREAMID,
+                                                   G_PARAM_READWRITE));
+
+  g_object_class_install_property(object_class, PROP_STATS,
+                                  g_param_spec_boxed("stats", "Statistics",
+                                                   "Link statistics: RTT, loss, retransmissions and their overhead",
+                                                   GST_TYPE_STRUCTURE,
+                                                   G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  GST_DEBUG_CATEGORY_INIT (gst_srt_stream_sink_debug, "srtstreamsink", 0,
+      "SRT Stream Sink Debug");
+
+  gst_element_class_set_static_metadata(element_class,
+                                        "SRT Stream Sink",
+                                        "Stream Bin",
+                                        "MPEG-TS over SRT Stream Sink",
+                                        "Ludovic Bouguerra <ludovic.bouguerra@stream.studio>");
+}
@@ -0,0 +1,17 @@
+#ifndef __GST_SRT_STREAM_SINK_H__
+#define __GST_SRT_STREAM_SINK_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_SRT_STREAM_SINK gst_srt_stream_sink_get_type ()
+G_DECLARE_FINAL_TYPE (GstSrtStreamSink, gst_srt_stream_sink, GST, SRT_STREAM_SINK, GstBin)
+
+struct GstSrtStreamSinkClass {
+  GstBinClass parent_class;
+};
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,102 @@
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+
+#include <gst/gst.h>
+
+#define FRAMES 300
+
+typedef struct
+{
+  const gchar *format;
+  gint width;
+  gint height;
+  gint out_width;
+  gint out_height;
+} BenchCase;
+
+static const BenchCase cases[] = {
+  {"NV12", 1920, 1080, 1920, 1080},
+  {"YUY2", 1920, 1080, 1920, 1080},
+  {"BGRA", 1920, 1080, 1920, 1080},
+  {"NV12", 1920, 1080, 640, 360},
+  {"BGRA", 1920, 1080, 1280, 720},
+  {"I420", 1920, 1080, 960, 540},
+  {"I420", 1920, 1080, 1280, 720},
+};
+
+/* Time per frame of @converter on one frozen frame, so only the
+ * conversion is measured */
+static gdouble
+run (const BenchCase * c, const gchar * converter)
+{
+  GstElement *pipeline;
+  GstMessage *message;
+  GError *error = NULL;
+  gchar *description;
+  gint64 started, elapsed;
+
+  description = g_strdup_printf ("videotestsrc num-buffers=1 pattern=smpte ! "
+      "video/x-raw,format=%s,width=%d,height=%d,framerate=30/1 ! "
+      "imagefreeze num-buffers=%d ! %s ! "
+      "video/x-raw,format=I420,width=%d,height=%d ! fakesink sync=false",
+      c->format, c->width, c->height, FRAMES, converter, c->out_width,
+      c->out_height);
+  pipeline = gst_parse_launch (description, &error);
+  g_free (description);
+  if (pipeline == NULL) {
+    g_printerr ("%s: %s\n", converter, error->message);
+    g_clear_error (&error);
+    return -1;
+  }
+
+  started = g_get_monotonic_time ();
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+  message = gst_bus_timed_pop_filtered (GST_ELEMENT_BUS (pipeline),
+      GST_CLOCK_TIME_NONE, GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  elapsed = g_get_monotonic_time () - started;
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+
+  if (GST_MESSAGE_TYPE (message) == GST_MESSAGE_ERROR) {
+    gst_message_parse_error (message, &error, NULL);
+    g_printerr ("%s: %s\n", converter, error->message);
+    g_clear_error (&error);
+    elapsed = -1;
+  }
+  gst_message_unref (message);
+  gst_object_unref (pipeline);
+
+  return elapsed < 0 ? -1 : elapsed / 1000.0 / FRAMES;
+}
+
+/* convertscale against videoconvert and videoscale, with as many threads */
+int
+main (int argc, char *argv[])
+{
+  guint threads;
+  gchar *stock;
+
+  gst_init (&argc, &argv);
+
+  threads = g_get_num_processors ();
+  stock = g_strdup_printf ("videoconvert n-threads=%u ! videoscale n-threads=%u",
+      threads, threads);
+
+  printf ("%-32s %14s %14s %8s\n", "case", "convertscale", "stock", "speedup");
+  for (guint i = 0; i < G_N_ELEMENTS (cases); i++) {
+    const BenchCase *c = &cases[i];
+    gchar *name = g_strdup_printf ("%s %dx%d > I420 %dx%d", c->format,
+        c->width, c->height, c->out_width, c->out_height);
+    gdouble ours = run (c, "convertscale");
+    gdouble theirs = run (c, stock);
+
+    printf ("%-32s %11.3f ms %11.3f ms %7.2fx\n", name, ours, theirs,
+        ours > 0 ? theirs / ours : 0);
+    g_free (name);
+  }
+
+  g_free (stock);
+  return 0;
+}
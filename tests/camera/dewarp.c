@@ -0,0 +1,157 @@
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#ifdef HAVE_VALGRIND
+# include <valgrind/valgrind.h>
+#endif
+
+#include <gst/check/gstcheck.h>
+#include <gst/check/gstharness.h>
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+#include <glib/gstdio.h>
+
+/* A flat frame of each plane set to its value, 4 bytes per pixel for
+ * packed formats */
+static GstBuffer *
+make_frame (GstVideoInfo * info, const guint8 * values)
+{
+  GstVideoFrame frame;
+  GstBuffer *buffer;
+
+  buffer = gst_buffer_new_allocate (NULL, GST_VIDEO_INFO_SIZE (info), NULL);
+  fail_unless (gst_video_frame_map (&frame, info, buffer, GST_MAP_WRITE));
+  for (guint p = 0; p < GST_VIDEO_FRAME_N_PLANES (&frame); p++) {
+    guint8 *data = GST_VIDEO_FRAME_PLANE_DATA (&frame, p);
+    gint stride = GST_VIDEO_FRAME_PLANE_STRIDE (&frame, p);
+    gint rows = GST_VIDEO_FRAME_COMP_HEIGHT (&frame, p);
+
+    for (gint row = 0; row < rows; row++)
+      for (gint i = 0; i < stride; i++)
+        data[row * stride + i] = GST_VIDEO_FRAME_N_PLANES (&frame) == 1 ?
+            values[i % 4] : values[p];
+  }
+  gst_video_frame_unmap (&frame);
+
+  return buffer;
+}
+
+/* The optical center sees itself whatever the distortion, so a flat frame
+ * keeps its value there, and zoomed out the corners fall outside the
+ * fisheye circle and are filled. */
+static void
+check_dewarp (const gchar * caps_str, const guint8 * values,
+    const guint8 * fill)
+{
+  GstHarness *h = gst_harness_new ("dewarp");
+  GstCaps *caps = gst_caps_from_string (caps_str);
+  GstStructure *stats;
+  GstVideoInfo info;
+  GstVideoFrame frame;
+  GstBuffer *buffer;
+  guint64 frames = 0;
+  guint n_planes;
+
+  fail_unless (gst_video_info_from_caps (&info, caps));
+  gst_caps_unref (caps);
+  g_object_set (h->element, "scale", 0.3, NULL);
+  gst_harness_set_src_caps_str (h, caps_str);
+
+  buffer = gst_harness_push_and_pull (h, make_frame (&info, values));
+  fail_unless (buffer != NULL);
+
+  fail_unless (gst_video_frame_map (&frame, &info, buffer, GST_MAP_READ));
+  n_planes = GST_VIDEO_FRAME_N_PLANES (&frame);
+  for (guint p = 0; p < n_planes; p++) {
+    const guint8 *data = GST_VIDEO_FRAME_PLANE_DATA (&frame, p);
+    gint stride = GST_VIDEO_FRAME_PLANE_STRIDE (&frame, p);
+    gint pstride = GST_VIDEO_FRAME_COMP_PSTRIDE (&frame, p);
+    gint cx = GST_VIDEO_FRAME_COMP_WIDTH (&frame, p) / 2;
+    gint cy = GST_VIDEO_FRAME_COMP_HEIGHT (&frame, p) / 2;
+
+    for (gint c = 0; c < pstride; c++) {
+      fail_unless_equals_int (data[cy * stride + cx * pstride + c],
+          n_planes == 1 ? values[c] : values[p]);
+      fail_unless_equals_int (data[c], n_planes == 1 ? fill[c] : fill[p]);
+    }
+  }
+  gst_video_frame_unmap (&frame);
+  gst_buffer_unref (buffer);
+
+  g_object_get (h->element, "stats", &stats, NULL);
+  fail_unless (gst_structure_get_uint64 (stats, "frames", &frames));
+  fail_unless_equals_uint64 (frames, 1);
+  gst_structure_free (stats);
+
+  gst_harness_teardown (h);
+}
+
+GST_START_TEST (test_dewarp_i420)
+{
+  check_dewarp ("video/x-raw,format=I420,width=640,height=360,framerate=30/1",
+      (guint8[]) {120, 90, 160, 0}, (guint8[]) {16, 128, 128, 0});
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_dewarp_nv12)
+{
+  check_dewarp ("video/x-raw,format=NV12,width=640,height=360,framerate=30/1",
+      (guint8[]) {120, 90, 0, 0}, (guint8[]) {16, 128, 0, 0});
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_dewarp_bgra)
+{
+  check_dewarp ("video/x-raw,format=BGRA,width=640,height=360,framerate=30/1",
+      (guint8[]) {40, 80, 200, 255}, (guint8[]) {0, 0, 0, 255});
+}
+
+GST_END_TEST;
+
+/* The key file written by calibration.py replaces the properties */
+GST_START_TEST (test_dewarp_calibration_file)
+{
+  GstElement *dewarp = gst_element_factory_make ("dewarp", NULL);
+  gchar *path = g_build_filename (g_get_tmp_dir (), "dewarp-test.ini", NULL);
+  gdouble fx, cy, k4;
+  gint width;
+
+  fail_unless (g_file_set_contents (path,
+          "[calibration]\nwidth=1280\nheight=720\n"
+          "K=700.5;0;640.0;0;701.0;360.5;0;0;1\nD=0.1;0.2;0.3;0.4\n", -1,
+          NULL));
+  g_object_set (dewarp, "calibration-file", path, NULL);
+  g_object_get (dewarp, "fx", &fx, "cy", &cy, "k4", &k4,
+      "calibration-width", &width, NULL);
+
+  fail_unless (fx == 700.5);
+  fail_unless (cy == 360.5);
+  fail_unless (k4 == 0.4);
+  fail_unless_equals_int (width, 1280);
+
+  gst_object_unref (dewarp);
+  g_unlink (path);
+  g_free (path);
+}
+
+GST_END_TEST;
+
+
+static Suite * dewarp_suite(){
+    Suite *s = suite_create ("dewarp");
+    TCase *tc_chain = tcase_create ("general");
+    suite_add_tcase (s, tc_chain);
+    tcase_add_test (tc_chain, test_dewarp_i420);
+    tcase_add_test (tc_chain, test_dewarp_nv12);
+    tcase_add_test (tc_chain, test_dewarp_bgra);
+    tcase_add_test (tc_chain, test_dewarp_calibration_file);
+
+    return s;
+}
+
+GST_CHECK_MAIN (dewarp);
@@ -0,0 +1,124 @@
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#ifdef HAVE_VALGRIND
+# include <valgrind/valgrind.h>
+#endif
+
+#include <gst/check/gstcheck.h>
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+#define N_FRAMES 5
+
+/* luma at the center of the panorama, across the seam */
+static void
+on_handoff (GstElement * sink, GstBuffer * buffer, GstPad * pad, gpointer data)
+{
+  gint *center = data;
+  GstCaps *caps = gst_pad_get_current_caps (pad);
+  GstVideoInfo info;
+  GstVideoFrame frame;
+
+  fail_unless (gst_video_info_from_caps (&info, caps));
+  gst_caps_unref (caps);
+
+  fail_unless (gst_video_frame_map (&frame, &info, buffer, GST_MAP_READ));
+  *center = ((guint8 *) GST_VIDEO_FRAME_PLANE_DATA (&frame, 0))
+      [GST_VIDEO_INFO_HEIGHT (&info) / 2 * GST_VIDEO_FRAME_PLANE_STRIDE (&frame, 0)
+      + GST_VIDEO_INFO_WIDTH (&info) / 2];
+  gst_video_frame_unmap (&frame);
+}
+
+/* Two flat cameras give one flat panorama per pair of frames */
+GST_START_TEST (test_stitch_pairs)
+{
+  GstElement *pipeline, *stitch, *sink;
+  GstStructure *stats;
+  GstMessage *msg;
+  GstBus *bus;
+  guint64 frames = 0, missing = 0;
+  gint center = -1;
+
+  pipeline = gst_parse_launch ("stitch name=stitch ! "
+      "video/x-raw,format=I420,width=640,height=180 ! "
+      "fakesink name=sink signal-handoffs=true "
+      "videotestsrc num-buffers=" G_STRINGIFY (N_FRAMES) " pattern=white ! "
+      "video/x-raw,format=I420,width=640,height=360,framerate=30/1 ! stitch.sink_0 "
+      "videotestsrc num-buffers=" G_STRINGIFY (N_FRAMES) " pattern=white ! "
+      "video/x-raw,format=I420,width=640,height=360,framerate=30/1 ! stitch.sink_1",
+      NULL);
+  fail_unless (pipeline != NULL);
+
+  sink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+  g_signal_connect (sink, "handoff", G_CALLBACK (on_handoff), &center);
+  gst_object_unref (sink);
+
+  fail_unless (gst_element_set_state (pipeline,
+          GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE);
+
+  bus = gst_element_get_bus (pipeline);
+  msg = gst_bus_timed_pop_filtered (bus, 10 * GST_SECOND,
+      GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  fail_unless (msg != NULL);
+  fail_unless_equals_int (GST_MESSAGE_TYPE (msg), GST_MESSAGE_EOS);
+  gst_message_unref (msg);
+  gst_object_unref (bus);
+
+  stitch = gst_bin_get_by_name (GST_BIN (pipeline), "stitch");
+  g_object_get (stitch, "stats", &stats, NULL);
+  gst_structure_get_uint64 (stats, "frames", &frames);
+  gst_structure_get_uint64 (stats, "missing", &missing);
+  gst_structure_free (stats);
+  gst_object_unref (stitch);
+
+  fail_unless_equals_uint64 (frames, N_FRAMES);
+  fail_unless_equals_uint64 (missing, 0);
+  fail_unless_equals_int (center, 235);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_stitch_two_cameras)
+{
+  GstElement *stitch = gst_element_factory_make ("stitch", NULL);
+  GstPad *first, *second;
+  gdouble yaw = 0;
+
+  first = gst_element_request_pad_simple (stitch, "sink_%u");
+  second = gst_element_request_pad_simple (stitch, "sink_%u");
+  fail_unless (first != NULL && second != NULL);
+  fail_unless (gst_element_request_pad_simple (stitch, "sink_%u") == NULL);
+
+  /* the cameras look away from each other by default */
+  g_object_get (first, "yaw", &yaw, NULL);
+  fail_unless (yaw < 0);
+  g_object_get (second, "yaw", &yaw, NULL);
+  fail_unless (yaw > 0);
+
+  gst_element_release_request_pad (stitch, first);
+  gst_element_release_request_pad (stitch, second);
+  gst_object_unref (first);
+  gst_object_unref (second);
+  gst_object_unref (stitch);
+}
+
+GST_END_TEST;
+
+
+static Suite * stitch_suite(){
+    Suite *s = suite_create ("stitch");
+    TCase *tc_chain = tcase_create ("general");
+    suite_add_tcase (s, tc_chain);
+    tcase_add_test (tc_chain, test_stitch_pairs);
+    tcase_add_test (tc_chain, test_stitch_two_cameras);
+
+    return s;
+}
+
+GST_CHECK_MAIN (stitch);
@@ -0,0 +1,178 @@
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#ifdef HAVE_VALGRIND
+# include <valgrind/valgrind.h>
+#endif
+
+#include <gst/check/gstcheck.h>
+
+#include <gst/gst.h>
+#include <gst/audio/audio.h>
+
+#define N_BUFFERS 10
+#define SAMPLES_PER_BUFFER 1024
+
+#define SOURCE "audiotestsrc num-buffers=" G_STRINGIFY (N_BUFFERS) \
+    " samplesperbuffer=" G_STRINGIFY (SAMPLES_PER_BUFFER) " ! " \
+    "audio/x-raw,format=S16LE,rate=44100,channels=2 ! "
+
+typedef struct
+{
+  guint64 samples;
+  GstClockTime next;
+  gboolean gap;
+} Output;
+
+/* samples out, and whether the timestamps follow each other */
+static void
+on_handoff (GstElement * sink, GstBuffer * buffer, GstPad * pad, gpointer data)
+{
+  Output *output = data;
+  GstCaps *caps = gst_pad_get_current_caps (pad);
+  GstAudioInfo info;
+
+  fail_unless (gst_audio_info_from_caps (&info, caps));
+  gst_caps_unref (caps);
+
+  output->samples += gst_buffer_get_size (buffer) / GST_AUDIO_INFO_BPF (&info);
+  if (GST_CLOCK_TIME_IS_VALID (output->next) &&
+      GST_BUFFER_PTS (buffer) != output->next)
+    output->gap = TRUE;
+  output->next = GST_BUFFER_PTS (buffer) + GST_BUFFER_DURATION (buffer);
+}
+
+static GstStructure *
+run_outputs (const gchar * description, Output * outputs, guint n_outputs)
+{
+  GstElement *pipeline, *frontend;
+  GstStructure *stats;
+  GstMessage *msg;
+  GstBus *bus;
+
+  pipeline = gst_parse_launch (description, NULL);
+  fail_unless (pipeline != NULL);
+
+  for (guint i = 0; i < n_outputs; i++) {
+    gchar *name = g_strdup_printf ("sink%u", i);
+    GstElement *sink = gst_bin_get_by_name (GST_BIN (pipeline), name);
+
+    outputs[i].next = GST_CLOCK_TIME_NONE;
+    g_signal_connect (sink, "handoff", G_CALLBACK (on_handoff), &outputs[i]);
+    gst_object_unref (sink);
+    g_free (name);
+  }
+
+  fail_unless (gst_element_set_state (pipeline,
+          GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE);
+
+  bus = gst_element_get_bus (pipeline);
+  msg = gst_bus_timed_pop_filtered (bus, 10 * GST_SECOND,
+      GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  fail_unless (msg != NULL);
+  fail_unless_equals_int (GST_MESSAGE_TYPE (msg), GST_MESSAGE_EOS);
+  gst_message_unref (msg);
+  gst_object_unref (bus);
+
+  frontend = gst_bin_get_by_name (GST_BIN (pipeline), "frontend");
+  g_object_get (frontend, "stats", &stats, NULL);
+  gst_object_unref (frontend);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+
+  return stats;
+}
+
+static const GstStructure *
+get_stage (const GstStructure * stats, guint index)
+{
+  const GValue *stages = gst_structure_get_value (stats, "stages");
+
+  fail_unless (stages != NULL);
+  fail_unless (index < gst_value_array_get_size (stages));
+  return gst_value_get_structure (gst_value_array_get_value (stages, index));
+}
+
+/* Opus at 48 kHz and AAC at the input rate, one conversion each */
+GST_START_TEST (test_audiofrontend_rates)
+{
+  Output outputs[2] = { {0}, {0} };
+  GstStructure *stats;
+  guint64 buffers = 0, expected;
+  gint rate = 0;
+
+  stats = run_outputs (SOURCE "audiofrontend name=frontend "
+      "frontend. ! audio/x-raw,format=F32LE,rate={48000,24000},layout=interleaved ! "
+      "fakesink name=sink0 signal-handoffs=true sync=false "
+      "frontend. ! audio/x-raw,format=F32LE,layout=non-interleaved ! "
+      "fakesink name=sink1 signal-handoffs=true sync=false", outputs, 2);
+
+  gst_structure_get_uint64 (stats, "buffers", &buffers);
+  fail_unless_equals_uint64 (buffers, N_BUFFERS);
+  fail_unless_equals_int (gst_value_array_get_size (gst_structure_get_value
+          (stats, "stages")), 2);
+
+  gst_structure_get_int (get_stage (stats, 0), "rate", &rate);
+  fail_unless_equals_int (rate, 48000);
+  gst_structure_get_int (get_stage (stats, 1), "rate", &rate);
+  fail_unless_equals_int (rate, 44100);
+  gst_structure_free (stats);
+
+  /* less the latency of the resampler */
+  expected = gst_util_uint64_scale_int (N_BUFFERS * SAMPLES_PER_BUFFER,
+      48000, 44100);
+  fail_unless (outputs[0].samples <= expected + 1);
+  fail_unless (outputs[0].samples > expected * 9 / 10);
+  fail_unless_equals_uint64 (outputs[1].samples,
+      N_BUFFERS * SAMPLES_PER_BUFFER);
+  fail_if (outputs[0].gap);
+  fail_if (outputs[1].gap);
+}
+
+GST_END_TEST;
+
+/* Two outputs of the same format share a single conversion */
+GST_START_TEST (test_audiofrontend_shared)
+{
+  Output outputs[2] = { {0}, {0} };
+  GstStructure *stats;
+  const GstStructure *stage;
+  guint64 buffers = 0;
+  guint n_outputs = 0;
+
+  stats = run_outputs (SOURCE "audiofrontend name=frontend "
+      "frontend. ! audio/x-raw,format=F32LE,rate=48000 ! "
+      "fakesink name=sink0 signal-handoffs=true sync=false "
+      "frontend. ! audio/x-raw,format=F32LE,rate=48000 ! "
+      "fakesink name=sink1 signal-handoffs=true sync=false", outputs, 2);
+
+  fail_unless_equals_int (gst_value_array_get_size (gst_structure_get_value
+          (stats, "stages")), 1);
+  stage = get_stage (stats, 0);
+  gst_structure_get_uint (stage, "outputs", &n_outputs);
+  gst_structure_get_uint64 (stage, "buffers", &buffers);
+  fail_unless_equals_int (n_outputs, 2);
+  fail_unless (buffers > 0);
+  fail_unless (gst_structure_has_field (stage, "cpu-time"));
+  gst_structure_free (stats);
+
+  fail_unless (outputs[0].samples > 0);
+  fail_unless_equals_uint64 (outputs[0].samples, outputs[1].samples);
+}
+
+GST_END_TEST;
+
+
+static Suite * audiofrontend_suite(){
+    Suite *s = suite_create ("audiofrontend");
+    TCase *tc_chain = tcase_create ("general");
+    suite_add_tcase (s, tc_chain);
+    tcase_add_test (tc_chain, test_audiofrontend_rates);
+    tcase_add_test (tc_chain, test_audiofrontend_shared);
+
+    return s;
+}
+
+GST_CHECK_MAIN (audiofrontend);
@@ -0,0 +1,151 @@
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#ifdef HAVE_VALGRIND
+# include <valgrind/valgrind.h>
+#endif
+
+#include <gst/check/gstcheck.h>
+#include <gst/check/gstharness.h>
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+/* A flat frame of each plane set to its value, 4 bytes per pixel for
+ * packed formats */
+static GstBuffer *
+make_frame (const gchar * caps_str, const guint8 * values)
+{
+  GstCaps *caps = gst_caps_from_string (caps_str);
+  GstVideoInfo info;
+  GstVideoFrame frame;
+  GstBuffer *buffer;
+
+  fail_unless (gst_video_info_from_caps (&info, caps));
+  gst_caps_unref (caps);
+
+  buffer = gst_buffer_new_allocate (NULL, GST_VIDEO_INFO_SIZE (&info), NULL);
+  fail_unless (gst_video_frame_map (&frame, &info, buffer, GST_MAP_WRITE));
+  for (guint p = 0; p < GST_VIDEO_FRAME_N_PLANES (&frame); p++) {
+    guint8 *data = GST_VIDEO_FRAME_PLANE_DATA (&frame, p);
+    gint stride = GST_VIDEO_FRAME_PLANE_STRIDE (&frame, p);
+    gint rows = GST_VIDEO_FRAME_COMP_HEIGHT (&frame, p);
+
+    for (gint row = 0; row < rows; row++)
+      for (gint i = 0; i < stride; i++)
+        data[row * stride + i] = GST_VIDEO_FRAME_N_PLANES (&frame) == 1 ?
+            values[i % 4] : values[p];
+  }
+  gst_video_frame_unmap (&frame);
+
+  return buffer;
+}
+
+static void
+check_convert (const gchar * in_caps, const guint8 * values,
+    const gchar * out_caps, guint8 y, guint8 u, guint8 v)
+{
+  GstHarness *h = gst_harness_new ("convertscale");
+  GstCaps *caps;
+  GstVideoInfo info;
+  GstVideoFrame frame;
+  GstBuffer *buffer;
+  guint8 expected[3] = { y, u, v };
+
+  gst_harness_set_src_caps_str (h, in_caps);
+  gst_harness_set_sink_caps_str (h, out_caps);
+
+  buffer = gst_harness_push_and_pull (h, make_frame (in_caps, values));
+  fail_unless (buffer != NULL);
+
+  caps = gst_caps_from_string (out_caps);
+  fail_unless (gst_video_info_from_caps (&info, caps));
+  gst_caps_unref (caps);
+
+  fail_unless (gst_video_frame_map (&frame, &info, buffer, GST_MAP_READ));
+  for (guint p = 0; p < 3; p++) {
+    const guint8 *data = GST_VIDEO_FRAME_PLANE_DATA (&frame, p);
+    gint stride = GST_VIDEO_FRAME_PLANE_STRIDE (&frame, p);
+
+    for (gint row = 0; row < GST_VIDEO_FRAME_COMP_HEIGHT (&frame, p); row++)
+      for (gint i = 0; i < GST_VIDEO_FRAME_COMP_WIDTH (&frame, p); i++)
+        fail_unless_equals_int (data[row * stride + i], expected[p]);
+  }
+  gst_video_frame_unmap (&frame);
+
+  gst_buffer_unref (buffer);
+  gst_harness_teardown (h);
+}
+
+/* BT.601 red, kept by the conversion at any size */
+GST_START_TEST (test_convert_bgra)
+{
+  const guint8 red[4] = { 0, 0, 255, 255 };
+
+  check_convert ("video/x-raw,format=BGRA,width=64,height=36,framerate=30/1",
+      red, "video/x-raw,format=I420,width=64,height=36,framerate=30/1",
+      82, 90, 240);
+  check_convert ("video/x-raw,format=BGRA,width=64,height=36,framerate=30/1",
+      red, "video/x-raw,format=I420,width=40,height=30,framerate=30/1",
+      82, 90, 240);
+}
+
+GST_END_TEST;
+
+/* Flat planes stay flat through the halving, area and bilinear paths */
+GST_START_TEST (test_scale_yuv)
+{
+  const guint8 nv12[3] = { 100, 50, 50 };
+  const guint8 yuy2[4] = { 100, 60, 100, 200 };
+
+  check_convert ("video/x-raw,format=NV12,width=128,height=72,framerate=30/1",
+      nv12, "video/x-raw,format=I420,width=64,height=36,framerate=30/1",
+      100, 50, 50);
+  check_convert ("video/x-raw,format=NV12,width=128,height=72,framerate=30/1",
+      nv12, "video/x-raw,format=I420,width=30,height=20,framerate=30/1",
+      100, 50, 50);
+  check_convert ("video/x-raw,format=YUY2,width=128,height=72,framerate=30/1",
+      yuy2, "video/x-raw,format=I420,width=96,height=54,framerate=30/1",
+      100, 60, 200);
+}
+
+GST_END_TEST;
+
+/* Formats the encoder takes are not touched */
+GST_START_TEST (test_passthrough)
+{
+  GstHarness *h = gst_harness_new ("convertscale");
+  const gchar *caps =
+      "video/x-raw,format=NV12,width=64,height=36,framerate=30/1";
+  const guint8 values[3] = { 16, 128, 128 };
+  GstBuffer *in, *out;
+
+  gst_harness_set_src_caps_str (h, caps);
+  gst_harness_set_sink_caps_str (h,
+      "video/x-raw,format={NV12,I420},width=64,height=36,framerate=30/1");
+
+  in = make_frame (caps, values);
+  out = gst_harness_push_and_pull (h, gst_buffer_ref (in));
+  fail_unless (out == in);
+
+  gst_buffer_unref (out);
+  gst_buffer_unref (in);
+  gst_harness_teardown (h);
+}
+
+GST_END_TEST;
+
+
+static Suite * convert_suite(){
+    Suite *s = suite_create ("convertscale");
+    TCase *tc_chain = tcase_create ("general");
+    suite_add_tcase (s, tc_chain);
+    tcase_add_test (tc_chain, test_convert_bgra);
+    tcase_add_test (tc_chain, test_scale_yuv);
+    tcase_add_test (tc_chain, test_passthrough);
+
+    return s;
+}
+
+GST_CHECK_MAIN (convert);
@@ -0,0 +1,254 @@
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#ifdef HAVE_VALGRIND
+# include <valgrind/valgrind.h>
+#endif
+
+#include <gst/check/gstcheck.h>
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+#define N_FRAMES 10
+
+static GstStructure *
+get_stats (GstElement * engine)
+{
+  GstStructure *stats = NULL;
+
+  g_object_get (engine, "stats", &stats, NULL);
+  fail_unless (stats != NULL);
+  return stats;
+}
+
+/*
+ * Frames pushed with push-video-sample are counted once at the converter,
+ * and one the encoder takes without conversion is not counted as a copy.
+ */
+GST_START_TEST (test_enginebin_push_video_sample)
+{
+  GstElement *pipeline, *engine;
+  GstStructure *stats;
+  GstVideoInfo info;
+  GstCaps *caps;
+  GstClock *clock;
+  guint64 frames = 0, fd_frames = 1, copies = 0;
+
+  if (!gst_registry_check_feature_version (gst_registry_get (), "x264enc", 1, 0, 0)
+      || !gst_registry_check_feature_version (gst_registry_get (), "avenc_aac", 1, 0, 0)
+      || !gst_registry_check_feature_version (gst_registry_get (), "opusenc", 1, 0, 0)) {
+    GST_INFO ("x264enc, avenc_aac or opusenc missing, skipping");
+    return;
+  }
+
+  pipeline = gst_pipeline_new (NULL);
+  engine = gst_element_factory_make ("enginebin", NULL);
+  fail_unless (engine != NULL);
+  g_object_set (engine, "use-test-sources", FALSE, NULL);
+  gst_bin_add (GST_BIN (pipeline), engine);
+
+  fail_unless (gst_element_set_state (pipeline,
+          GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE);
+  fail_unless (gst_element_get_state (pipeline, NULL, NULL,
+          5 * GST_SECOND) == GST_STATE_CHANGE_SUCCESS);
+
+  gst_video_info_set_format (&info, GST_VIDEO_FORMAT_I420, 320, 240);
+  info.fps_n = 30;
+  info.fps_d = 1;
+  caps = gst_video_info_to_caps (&info);
+  clock = gst_element_get_clock (pipeline);
+
+  for (guint i = 0; i < N_FRAMES; i++) {
+    GstBuffer *buffer = gst_buffer_new_allocate (NULL, info.size, NULL);
+    GstSample *sample;
+    GstFlowReturn ret = GST_FLOW_ERROR;
+
+    gst_buffer_memset (buffer, 0, 0x80, info.size);
+    /* live input, stamped with the running time */
+    GST_BUFFER_PTS (buffer) = gst_clock_get_time (clock) -
+        gst_element_get_base_time (pipeline);
+    GST_BUFFER_DURATION (buffer) = GST_SECOND / 30;
+    sample = gst_sample_new (buffer, caps, NULL, NULL);
+    g_signal_emit_by_name (engine, "push-video-sample", sample, &ret);
+    fail_unless_equals_int (ret, GST_FLOW_OK);
+    gst_sample_unref (sample);
+    gst_buffer_unref (buffer);
+    g_usleep (G_USEC_PER_SEC / 30);
+  }
+  gst_object_unref (clock);
+  gst_caps_unref (caps);
+
+  for (gint i = 0; i < 50 && frames < N_FRAMES; i++) {
+    g_usleep (100 * G_USEC_PER_SEC / 1000);
+    stats = get_stats (engine);
+    gst_structure_get_uint64 (stats, "frames", &frames);
+    gst_structure_free (stats);
+  }
+
+  stats = get_stats (engine);
+  gst_structure_get_uint64 (stats, "frames", &frames);
+  gst_structure_get_uint64 (stats, "fd-frames", &fd_frames);
+  gst_structure_get_uint64 (stats, "copies", &copies);
+  gst_structure_free (stats);
+
+  fail_unless_equals_uint64 (frames, N_FRAMES);
+  /* system memory frames the encoder takes as they are */
+  fail_unless_equals_uint64 (fd_frames, 0);
+  fail_unless_equals_uint64 (copies, 0);
+
+  /* cleanup */
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+}
+
+GST_END_TEST;
+
+/*
+ * A recorder asking for a lower bitrate for the disk scales the video
+ * encoder bitrate down by the ratio of its target to its byte rate.
+ */
+GST_START_TEST (test_enginebin_lower_bitrate)
+{
+  GstElement *engine, *encoder;
+  guint bitrate = 0;
+
+  if (!gst_registry_check_feature_version (gst_registry_get (), "x264enc", 1, 0, 0)) {
+    GST_INFO ("x264enc missing, skipping");
+    return;
+  }
+
+  engine = gst_element_factory_make ("enginebin", NULL);
+  fail_unless (engine != NULL);
+  encoder = gst_bin_get_by_name (GST_BIN (engine), "vencoder");
+  fail_unless (encoder != NULL);
+  g_object_get (encoder, "bitrate", &bitrate, NULL);
+  fail_unless_equals_int (bitrate, 1000);
+
+  /* only the lower-bitrate action is applied */
+  gst_element_post_message (encoder, gst_message_new_element (GST_OBJECT (encoder),
+          gst_structure_new ("recordsink-disk", "byte-rate", G_TYPE_UINT64,
+              (guint64) 200000, "target-byte-rate", G_TYPE_UINT64,
+              (guint64) 50000, "action", G_TYPE_STRING, "none", NULL)));
+  g_object_get (encoder, "bitrate", &bitrate, NULL);
+  fail_unless_equals_int (bitrate, 1000);
+
+  gst_element_post_message (encoder, gst_message_new_element (GST_OBJECT (encoder),
+          gst_structure_new ("recordsink-disk", "byte-rate", G_TYPE_UINT64,
+              (guint64) 200000, "target-byte-rate", G_TYPE_UINT64,
+              (guint64) 50000, "action", G_TYPE_STRING, "lower-bitrate", NULL)));
+  g_object_get (encoder, "bitrate", &bitrate, NULL);
+  fail_unless_equals_int (bitrate, 250);
+
+  /* cleanup */
+  gst_object_unref (encoder);
+  gst_object_unref (engine);
+}
+
+GST_END_TEST;
+
+/*
+ * An overlay makes the mixer compose each frame in a buffer of its own,
+ * which the encoder sees as a copy of the ingested frame.
+ */
+GST_START_TEST (test_enginebin_compose_copies)
+{
+  GstElement *pipeline, *engine, *overlay_src;
+  GstPad *overlay, *target, *srcpad;
+  GstStructure *stats;
+  GstVideoInfo info;
+  GstCaps *caps;
+  GstClock *clock;
+  guint64 frames = 0, copies = 0;
+
+  if (!gst_registry_check_feature_version (gst_registry_get (), "x264enc", 1, 0, 0)
+      || !gst_registry_check_feature_version (gst_registry_get (), "avenc_aac", 1, 0, 0)
+      || !gst_registry_check_feature_version (gst_registry_get (), "opusenc", 1, 0, 0)) {
+    GST_INFO ("x264enc, avenc_aac or opusenc missing, skipping");
+    return;
+  }
+
+  pipeline = gst_pipeline_new (NULL);
+  engine = gst_element_factory_make ("enginebin", NULL);
+  fail_unless (engine != NULL);
+  g_object_set (engine, "use-test-sources", FALSE, NULL);
+  overlay_src = gst_element_factory_make ("videotestsrc", NULL);
+  g_object_set (overlay_src, "is-live", TRUE, NULL);
+  gst_bin_add_many (GST_BIN (pipeline), engine, overlay_src, NULL);
+
+  /* a half transparent quarter of the picture */
+  overlay = gst_element_request_pad_simple (engine, "video_sink_%u");
+  fail_unless (overlay != NULL);
+  target = gst_ghost_pad_get_target (GST_GHOST_PAD (overlay));
+  g_object_set (target, "alpha", 0.5, "width", 160, "height", 120, NULL);
+  gst_object_unref (target);
+  srcpad = gst_element_get_static_pad (overlay_src, "src");
+  fail_unless_equals_int (gst_pad_link (srcpad, overlay), GST_PAD_LINK_OK);
+  gst_object_unref (srcpad);
+
+  fail_unless (gst_element_set_state (pipeline,
+          GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE);
+  fail_unless (gst_element_get_state (pipeline, NULL, NULL,
+          5 * GST_SECOND) == GST_STATE_CHANGE_SUCCESS);
+
+  gst_video_info_set_format (&info, GST_VIDEO_FORMAT_I420, 320, 240);
+  info.fps_n = 30;
+  info.fps_d = 1;
+  caps = gst_video_info_to_caps (&info);
+  clock = gst_element_get_clock (pipeline);
+
+  for (guint i = 0; i < N_FRAMES; i++) {
+    GstBuffer *buffer = gst_buffer_new_allocate (NULL, info.size, NULL);
+    GstSample *sample;
+    GstFlowReturn ret = GST_FLOW_ERROR;
+
+    gst_buffer_memset (buffer, 0, 0x80, info.size);
+    GST_BUFFER_PTS (buffer) = gst_clock_get_time (clock) -
+        gst_element_get_base_time (pipeline);
+    GST_BUFFER_DURATION (buffer) = GST_SECOND / 30;
+    sample = gst_sample_new (buffer, caps, NULL, NULL);
+    g_signal_emit_by_name (engine, "push-video-sample", sample, &ret);
+    fail_unless_equals_int (ret, GST_FLOW_OK);
+    gst_sample_unref (sample);
+    gst_buffer_unref (buffer);
+    g_usleep (G_USEC_PER_SEC / 30);
+  }
+  gst_object_unref (clock);
+  gst_caps_unref (caps);
+
+  for (gint i = 0; i < 50 && copies == 0; i++) {
+    g_usleep (100 * G_USEC_PER_SEC / 1000);
+    stats = get_stats (engine);
+    gst_structure_get_uint64 (stats, "frames", &frames);
+    gst_structure_get_uint64 (stats, "copies", &copies);
+    gst_structure_free (stats);
+  }
+
+  fail_unless_equals_uint64 (frames, N_FRAMES);
+  /* composed frames are not the ingested memory */
+  fail_unless (copies > 0);
+
+  /* cleanup */
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_element_release_request_pad (engine, overlay);
+  gst_object_unref (overlay);
+  gst_object_unref (pipeline);
+}
+
+GST_END_TEST;
+
+
+static Suite * enginebin_suite(){
+    Suite *s = suite_create ("enginebin");
+    TCase *tc_chain = tcase_create ("general");
+    suite_add_tcase (s, tc_chain);
+    tcase_set_timeout (tc_chain, 20);
+    tcase_add_test (tc_chain, test_enginebin_push_video_sample);
+    tcase_add_test (tc_chain, test_enginebin_lower_bitrate);
+    tcase_add_test (tc_chain, test_enginebin_compose_copies);
+
+    return s;
+}
+
+GST_CHECK_MAIN (enginebin);
@@ -0,0 +1,210 @@
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#ifdef HAVE_VALGRIND
+# include <valgrind/valgrind.h>
+#endif
+
+#include <gst/check/gstcheck.h>
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+#define N_FRAMES 5
+
+#define MAIN_SOURCE "videotestsrc num-buffers=" G_STRINGIFY (N_FRAMES) \
+    " pattern=white ! video/x-raw,format=I420,width=320,height=240,framerate=30/1 ! "
+
+#define OVERLAY_SOURCE "videotestsrc num-buffers=" G_STRINGIFY (N_FRAMES) \
+    " pattern=black ! video/x-raw,format=I420,width=160,height=120,framerate=30/1 ! "
+
+typedef struct
+{
+  gint inside;
+  gint outside;
+} Luma;
+
+/* luma in the top right quarter, where the overlay goes, and bottom left */
+static void
+on_handoff (GstElement * sink, GstBuffer * buffer, GstPad * pad, gpointer data)
+{
+  Luma *luma = data;
+  GstCaps *caps = gst_pad_get_current_caps (pad);
+  GstVideoInfo info;
+  GstVideoFrame frame;
+  const guint8 *y;
+  gint stride;
+
+  fail_unless (gst_video_info_from_caps (&info, caps));
+  gst_caps_unref (caps);
+
+  fail_unless (gst_video_frame_map (&frame, &info, buffer, GST_MAP_READ));
+  y = GST_VIDEO_FRAME_PLANE_DATA (&frame, 0);
+  stride = GST_VIDEO_FRAME_PLANE_STRIDE (&frame, 0);
+  luma->inside = y[60 * stride + 240];
+  luma->outside = y[180 * stride + 80];
+  gst_video_frame_unmap (&frame);
+}
+
+static void
+run_scene (const gchar * description, Luma * luma, GstStructure ** stats)
+{
+  GstElement *pipeline, *mixer, *sink;
+  GstMessage *msg;
+  GstBus *bus;
+
+  pipeline = gst_parse_launch (description, NULL);
+  fail_unless (pipeline != NULL);
+
+  sink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+  g_signal_connect (sink, "handoff", G_CALLBACK (on_handoff), luma);
+  gst_object_unref (sink);
+
+  fail_unless (gst_element_set_state (pipeline,
+          GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE);
+
+  bus = gst_element_get_bus (pipeline);
+  msg = gst_bus_timed_pop_filtered (bus, 10 * GST_SECOND,
+      GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  fail_unless (msg != NULL);
+  fail_unless_equals_int (GST_MESSAGE_TYPE (msg), GST_MESSAGE_EOS);
+  gst_message_unref (msg);
+  gst_object_unref (bus);
+
+  mixer = gst_bin_get_by_name (GST_BIN (pipeline), "mixer");
+  g_object_get (mixer, "stats", stats, NULL);
+  gst_object_unref (mixer);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+}
+
+/* A single full frame input goes through as it is */
+GST_START_TEST (test_scenemixer_passthrough)
+{
+  GstStructure *stats;
+  guint64 frames = 0, passthrough = 0, composed = 0;
+  Luma luma = { -1, -1 };
+
+  run_scene (MAIN_SOURCE "scenemixer name=mixer ! "
+      "fakesink name=sink signal-handoffs=true", &luma, &stats);
+
+  gst_structure_get_uint64 (stats, "frames", &frames);
+  gst_structure_get_uint64 (stats, "passthrough", &passthrough);
+  gst_structure_get_uint64 (stats, "composed", &composed);
+  gst_structure_free (stats);
+
+  fail_unless_equals_uint64 (frames, N_FRAMES);
+  fail_unless_equals_uint64 (passthrough, N_FRAMES);
+  fail_unless_equals_uint64 (composed, 0);
+  fail_unless_equals_int (luma.inside, 235);
+  fail_unless_equals_int (luma.outside, 235);
+}
+
+GST_END_TEST;
+
+/* An opaque overlay replaces the main video where it is placed */
+GST_START_TEST (test_scenemixer_overlay)
+{
+  GstStructure *stats;
+  guint64 frames = 0, composed = 0, hidden = 0;
+  Luma luma = { -1, -1 };
+
+  run_scene ("scenemixer name=mixer sink_1::xpos=160 ! "
+      "fakesink name=sink signal-handoffs=true "
+      MAIN_SOURCE "mixer.sink_0 " OVERLAY_SOURCE "mixer.sink_1", &luma,
+      &stats);
+
+  gst_structure_get_uint64 (stats, "frames", &frames);
+  gst_structure_get_uint64 (stats, "composed", &composed);
+  gst_structure_get_uint64 (stats, "hidden-tiles", &hidden);
+  gst_structure_free (stats);
+
+  fail_unless_equals_uint64 (frames, N_FRAMES);
+  fail_unless_equals_uint64 (composed, N_FRAMES);
+  /* the tiles under the overlay are not drawn from the main video */
+  fail_unless (hidden > 0);
+  fail_unless_equals_int (luma.inside, 16);
+  fail_unless_equals_int (luma.outside, 235);
+}
+
+GST_END_TEST;
+
+/* Half transparent, the overlay is blended with the main video */
+GST_START_TEST (test_scenemixer_alpha)
+{
+  GstStructure *stats;
+  guint64 hidden = 1;
+  Luma luma = { -1, -1 };
+
+  run_scene ("scenemixer name=mixer sink_1::xpos=160 sink_1::alpha=0.5 ! "
+      "fakesink name=sink signal-handoffs=true "
+      MAIN_SOURCE "mixer.sink_0 " OVERLAY_SOURCE "mixer.sink_1", &luma,
+      &stats);
+
+  gst_structure_get_uint64 (stats, "hidden-tiles", &hidden);
+  gst_structure_free (stats);
+
+  fail_unless_equals_uint64 (hidden, 0);
+  fail_unless_equals_int (luma.inside, (235 * 128 + 16 * 128 + 128) >> 8);
+  fail_unless_equals_int (luma.outside, 235);
+}
+
+GST_END_TEST;
+
+/* A scene naming an unknown input changes nothing */
+GST_START_TEST (test_scenemixer_set_scene)
+{
+  GstElement *mixer = gst_element_factory_make ("scenemixer", NULL);
+  GstStructure *scene;
+  GstPad *main_pad, *overlay;
+  gboolean result = FALSE;
+  gint xpos = -1;
+  gdouble alpha = -1;
+
+  main_pad = gst_element_request_pad_simple (mixer, "sink_%u");
+  overlay = gst_element_request_pad_simple (mixer, "sink_%u");
+  fail_unless (main_pad != NULL && overlay != NULL);
+
+  scene = gst_structure_from_string ("scene, "
+      "sink_1=(structure)\"s, xpos=(int)100, alpha=(double)0.25;\", "
+      "sink_7=(structure)\"s, xpos=(int)10;\"", NULL);
+  g_signal_emit_by_name (mixer, "set-scene", scene, &result);
+  gst_structure_free (scene);
+  fail_if (result);
+  g_object_get (overlay, "xpos", &xpos, NULL);
+  fail_unless_equals_int (xpos, 0);
+
+  scene = gst_structure_from_string ("scene, "
+      "sink_1=(structure)\"s, xpos=(int)100, alpha=(double)0.25;\"", NULL);
+  g_signal_emit_by_name (mixer, "set-scene", scene, &result);
+  gst_structure_free (scene);
+  fail_unless (result);
+  g_object_get (overlay, "xpos", &xpos, "alpha", &alpha, NULL);
+  fail_unless_equals_int (xpos, 100);
+  fail_unless (alpha == 0.25);
+
+  gst_element_release_request_pad (mixer, main_pad);
+  gst_element_release_request_pad (mixer, overlay);
+  gst_object_unref (main_pad);
+  gst_object_unref (overlay);
+  gst_object_unref (mixer);
+}
+
+GST_END_TEST;
+
+
+static Suite * scenemixer_suite(){
+    Suite *s = suite_create ("scenemixer");
+    TCase *tc_chain = tcase_create ("general");
+    suite_add_tcase (s, tc_chain);
+    tcase_add_test (tc_chain, test_scenemixer_passthrough);
+    tcase_add_test (tc_chain, test_scenemixer_overlay);
+    tcase_add_test (tc_chain, test_scenemixer_alpha);
+    tcase_add_test (tc_chain, test_scenemixer_set_scene);
+
+    return s;
+}
+
+GST_CHECK_MAIN (scenemixer);
@@ -0,0 +1,181 @@
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#ifdef HAVE_VALGRIND
+# include <valgrind/valgrind.h>
+#endif
+
+#include <gst/check/gstcheck.h>
+#include <gst/check/gstconsistencychecker.h>
+#include <gst/check/gstharness.h>
+
+#include <gst/gst.h>
+
+#include <glib/gstdio.h>
+#include <string.h>
+
+#define RING_SIZE (1024 * 1024)
+#define SAMPLE_SIZE 200000
+
+/* The ring keeps the newest samples within both its size and its
+ * duration, wrapping around the file as they come in. */
+GST_START_TEST (test_clip_buffer_ring)
+{
+  GstElement *clipbuffer;
+  GstHarness *h;
+  GstStructure *stats = NULL;
+  gchar *path;
+  guint samples = 0;
+  guint64 bytes = 0, available = G_MAXUINT64;
+
+  path = g_build_filename (g_get_tmp_dir (), "clipbuffer-test.bin", NULL);
+
+  clipbuffer = gst_element_factory_make ("clipbuffer", NULL);
+  fail_unless (clipbuffer != NULL);
+  g_object_set (clipbuffer, "location", path, "max-size", (guint64) RING_SIZE,
+      "max-duration", 1000, NULL);
+
+  h = gst_harness_new_with_element (clipbuffer, "video_sink", NULL);
+  gst_harness_set_src_caps_str (h,
+      "video/x-h264,stream-format=avc,alignment=au");
+
+  for (guint i = 0; i < 30; i++) {
+    GstBuffer *buffer = gst_buffer_new_allocate (NULL, SAMPLE_SIZE, NULL);
+
+    GST_BUFFER_PTS (buffer) = GST_BUFFER_DTS (buffer) = i * 100 * GST_MSECOND;
+    GST_BUFFER_DURATION (buffer) = 100 * GST_MSECOND;
+    if (i % 10)
+      GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+    fail_unless_equals_int (gst_harness_push (h, buffer), GST_FLOW_OK);
+  }
+
+  g_object_get (clipbuffer, "stats", &stats, NULL);
+  fail_unless (gst_structure_get_uint (stats, "samples", &samples));
+  fail_unless (gst_structure_get_uint64 (stats, "bytes", &bytes));
+  fail_unless (gst_structure_get_uint64 (stats, "available", &available));
+  gst_structure_free (stats);
+
+  fail_unless (samples > 0);
+  fail_unless_equals_uint64 (bytes, (guint64) samples * SAMPLE_SIZE);
+  fail_unless (bytes <= RING_SIZE);
+  fail_unless (available <= GST_SECOND);
+
+  gst_harness_teardown (h);
+  gst_object_unref (clipbuffer);
+
+  g_unlink (path);
+  g_free (path);
+}
+
+GST_END_TEST;
+
+/* A saved clip is remuxed from the ring into a playable file. */
+GST_START_TEST (test_clip_buffer_save)
+{
+  GstElement *pipeline, *clipbuffer;
+  GstStructure *stats = NULL;
+  const GstStructure *result;
+  GstMessage *msg;
+  GstBus *bus;
+  gchar *ring, *clip, *description, *contents = NULL;
+  gsize length = 0;
+  guint samples = 0;
+  guint64 saved = 0;
+  gboolean queued = FALSE, success = FALSE;
+  gboolean has_moov = FALSE, has_mdat = FALSE;
+
+  if (!gst_registry_check_feature_version (gst_registry_get (), "x264enc", 1, 0, 0)) {
+    GST_INFO ("x264enc missing, skipping");
+    return;
+  }
+
+  ring = g_build_filename (g_get_tmp_dir (), "clipbuffer-save.bin", NULL);
+  clip = g_build_filename (g_get_tmp_dir (), "clipbuffer-save.mp4", NULL);
+  g_unlink (clip);
+
+  description = g_strdup_printf ("videotestsrc num-buffers=90 "
+      "! video/x-raw,width=320,height=240,framerate=30/1 "
+      "! x264enc tune=zerolatency key-int-max=30 ! h264parse "
+      "! video/x-h264,stream-format=avc,alignment=au ! clip.video_sink "
+      "clipbuffer name=clip location=%s max-size=%u", ring, 4 * RING_SIZE);
+  pipeline = gst_parse_launch (description, NULL);
+  g_free (description);
+  fail_unless (pipeline != NULL);
+  clipbuffer = gst_bin_get_by_name (GST_BIN (pipeline), "clip");
+
+  fail_unless (gst_element_set_state (pipeline,
+          GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE);
+
+  /* the audio sink never ends, wait for the video in the ring */
+  for (gint i = 0; i < 100 && samples < 90; i++) {
+    g_usleep (100 * G_USEC_PER_SEC / 1000);
+    g_object_get (clipbuffer, "stats", &stats, NULL);
+    gst_structure_get_uint (stats, "samples", &samples);
+    gst_structure_free (stats);
+  }
+  fail_unless_equals_int (samples, 90);
+
+  g_signal_emit_by_name (clipbuffer, "save-clip", clip, (gint64) -2000,
+      (gint64) 0, &queued);
+  fail_unless (queued);
+
+  bus = gst_element_get_bus (pipeline);
+  msg = gst_bus_timed_pop_filtered (bus, 10 * GST_SECOND, GST_MESSAGE_ELEMENT);
+  fail_unless (msg != NULL);
+  result = gst_message_get_structure (msg);
+  fail_unless (gst_structure_has_name (result, "clipbuffer-clip"));
+  fail_unless (gst_structure_get_boolean (result, "success", &success));
+  fail_unless (success);
+  gst_message_unref (msg);
+  gst_object_unref (bus);
+
+  g_object_get (clipbuffer, "stats", &stats, NULL);
+  gst_structure_get_uint64 (stats, "clips-saved", &saved);
+  gst_structure_free (stats);
+  fail_unless_equals_uint64 (saved, 1);
+
+  /* an mp4 with its ftyp first, a moov and the samples */
+  fail_unless (g_file_get_contents (clip, &contents, &length, NULL));
+  fail_unless (length > 16);
+  fail_unless (memcmp (contents + 4, "ftyp", 4) == 0);
+  for (gsize offset = 0; offset + 8 <= length;) {
+    guint32 size = GST_READ_UINT32_BE (contents + offset);
+
+    if (memcmp (contents + offset + 4, "moov", 4) == 0)
+      has_moov = TRUE;
+    if (memcmp (contents + offset + 4, "mdat", 4) == 0)
+      has_mdat = TRUE;
+    if (size < 8)
+      break;
+    offset += size;
+  }
+  fail_unless (has_moov);
+  fail_unless (has_mdat);
+  g_free (contents);
+
+  /* cleanup */
+  gst_object_unref (clipbuffer);
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+  g_unlink (clip);
+  g_unlink (ring);
+  g_free (clip);
+  g_free (ring);
+}
+
+GST_END_TEST;
+
+
+static Suite * clip_suite(){
+    Suite *s = suite_create ("clipbuffer");
+    TCase *tc_chain = tcase_create ("general");
+    suite_add_tcase (s, tc_chain);
+    tcase_set_timeout (tc_chain, 30);
+    tcase_add_test (tc_chain, test_clip_buffer_ring);
+    tcase_add_test (tc_chain, test_clip_buffer_save);
+
+    return s;
+}
+
+GST_CHECK_MAIN (clip);
@@ -0,0 +1,166 @@
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#ifdef HAVE_VALGRIND
+# include <valgrind/valgrind.h>
+#endif
+
+#include <gst/check/gstcheck.h>
+#include <gst/check/gstconsistencychecker.h>
+#include <gst/check/gstharness.h>
+
+#include <gst/gst.h>
+#include <glib/gstdio.h>
+#include <string.h>
+
+GST_START_TEST (test_cmaf)
+{
+  GstElement *cmafsink;
+  GstStructure *stats = NULL;
+  guint64 segments = 1;
+  guint part_duration = 0;
+
+  GST_INFO ("preparing test");
+  cmafsink = gst_element_factory_make ("cmafsink", NULL);
+  fail_unless (cmafsink != NULL);
+
+  g_object_set (cmafsink, "location", "/tmp/cmafsink-test", "part-duration", 200, NULL);
+  g_object_get (cmafsink, "part-duration", &part_duration, "stats", &stats, NULL);
+  fail_unless_equals_int (part_duration, 200);
+
+  /* nothing written before the first keyframe */
+  fail_unless (stats != NULL);
+  fail_unless (gst_structure_get_uint64 (stats, "segments", &segments));
+  fail_unless_equals_uint64 (segments, 0);
+  gst_structure_free (stats);
+
+  /* cleanup */
+  gst_object_unref (cmafsink);
+}
+
+GST_END_TEST;
+
+static guint
+count_segments (const gchar * location)
+{
+  GDir *dir = g_dir_open (location, 0, NULL);
+  const gchar *name;
+  guint count = 0;
+
+  fail_unless (dir != NULL);
+  while ((name = g_dir_read_name (dir)) != NULL) {
+    if (g_str_has_suffix (name, ".m4s"))
+      count++;
+  }
+  g_dir_close (dir);
+
+  return count;
+}
+
+static void
+run_to_eos (GstElement * pipeline)
+{
+  GstBus *bus;
+  GstMessage *msg;
+
+  fail_unless (gst_element_set_state (pipeline,
+          GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE);
+
+  bus = gst_element_get_bus (pipeline);
+  msg = gst_bus_timed_pop_filtered (bus, 20 * GST_SECOND,
+      GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  fail_unless (msg != NULL);
+  fail_unless_equals_int (GST_MESSAGE_TYPE (msg), GST_MESSAGE_EOS);
+  gst_message_unref (msg);
+  gst_object_unref (bus);
+
+  /* the last segment is listed on the way down */
+  gst_element_set_state (pipeline, GST_STATE_READY);
+}
+
+/*
+ * Every segment of the playlist is on disk, and a restart keeps deleting
+ * the segments of the previous run as they expire.
+ */
+GST_START_TEST (test_cmaf_segments)
+{
+  GstElement *pipeline;
+  gchar *location, *description, *path, *playlist = NULL;
+  gchar **lines;
+  guint listed = 0;
+
+  if (!gst_registry_check_feature_version (gst_registry_get (), "x264enc", 1, 0, 0)
+      || !gst_registry_check_feature_version (gst_registry_get (), "avenc_aac", 1, 0, 0)) {
+    GST_INFO ("x264enc or avenc_aac missing, skipping");
+    return;
+  }
+
+  location = g_dir_make_tmp ("cmafsink-XXXXXX", NULL);
+  fail_unless (location != NULL);
+
+  description = g_strdup_printf ("videotestsrc num-buffers=150 "
+      "! video/x-raw,width=320,height=240,framerate=30/1 "
+      "! x264enc tune=zerolatency key-int-max=15 ! sink.video_sink "
+      "audiotestsrc num-buffers=235 ! avenc_aac ! sink.audio_sink "
+      "cmafsink name=sink location=%s target-duration=1 playlist-length=2",
+      location);
+  pipeline = gst_parse_launch (description, NULL);
+  g_free (description);
+  fail_unless (pipeline != NULL);
+
+  run_to_eos (pipeline);
+  run_to_eos (pipeline);
+
+  path = g_build_filename (location, "index.m3u8", NULL);
+  fail_unless (g_file_get_contents (path, &playlist, NULL, NULL));
+  g_free (path);
+
+  fail_unless (strstr (playlist, "#EXT-X-DISCONTINUITY") != NULL);
+  lines = g_strsplit (playlist, "\n", -1);
+  for (guint i = 0; lines[i] != NULL; i++) {
+    if (!g_str_has_suffix (lines[i], ".m4s"))
+      continue;
+    path = g_build_filename (location, lines[i], NULL);
+    fail_unless (g_file_test (path, G_FILE_TEST_IS_REGULAR), "%s missing", lines[i]);
+    g_free (path);
+    listed++;
+  }
+  g_strfreev (lines);
+  g_free (playlist);
+  fail_unless_equals_int (listed, 2);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+
+  /* the listed segments stay, the expired ones are gone */
+  fail_unless_equals_int (count_segments (location), listed);
+
+  /* cleanup */
+  GDir *dir = g_dir_open (location, 0, NULL);
+  const gchar *name;
+  while ((name = g_dir_read_name (dir)) != NULL) {
+    path = g_build_filename (location, name, NULL);
+    g_unlink (path);
+    g_free (path);
+  }
+  g_dir_close (dir);
+  g_rmdir (location);
+  g_free (location);
+}
+
+GST_END_TEST;
+
+
+static Suite * cmaf_suite(){
+    Suite *s = suite_create ("cmafsink");
+    TCase *tc_chain = tcase_create ("general");
+    suite_add_tcase (s, tc_chain);
+    tcase_set_timeout (tc_chain, 60);
+    tcase_add_test (tc_chain, test_cmaf);
+    tcase_add_test (tc_chain, test_cmaf_segments);
+
+    return s;
+}
+
+GST_CHECK_MAIN (cmaf);
@@ -0,0 +1,216 @@
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#ifdef HAVE_VALGRIND
+# include <valgrind/valgrind.h>
+#endif
+
+#include <gst/check/gstcheck.h>
+#include <gst/check/gstconsistencychecker.h>
+#include <gst/check/gstharness.h>
+
+#include <gst/gst.h>
+
+#define CHURN_OPERATIONS 100
+#define CHURN_INTERVAL_US (G_USEC_PER_SEC / CHURN_OPERATIONS)
+
+static GstElement *
+make_branch (void)
+{
+  GstElement *bin = gst_bin_new (NULL);
+  GstElement *vsink = gst_element_factory_make ("fakesink", NULL);
+  GstElement *asink = gst_element_factory_make ("fakesink", NULL);
+  GstPad *pad;
+
+  g_object_set (vsink, "sync", FALSE, "async", FALSE, NULL);
+  g_object_set (asink, "sync", FALSE, "async", FALSE, NULL);
+  gst_bin_add_many (GST_BIN (bin), vsink, asink, NULL);
+
+  pad = gst_element_get_static_pad (vsink, "sink");
+  gst_element_add_pad (bin, gst_ghost_pad_new ("video_sink", pad));
+  gst_object_unref (pad);
+
+  pad = gst_element_get_static_pad (asink, "sink");
+  gst_element_add_pad (bin, gst_ghost_pad_new ("audio_sink", pad));
+  gst_object_unref (pad);
+
+  return bin;
+}
+
+static guint64
+get_video_buffers (GstElement * tee)
+{
+  GstStructure *stats;
+  guint64 buffers = 0;
+
+  g_object_get (tee, "stats", &stats, NULL);
+  gst_structure_get_uint64 (stats, "video-buffers", &buffers);
+  gst_structure_free (stats);
+
+  return buffers;
+}
+
+/*
+ * Attach and detach a branch every 10ms while buffers are flowing, the
+ * streaming threads must keep pushing and every old branch list must be
+ * released once the readers moved on.
+ */
+GST_START_TEST (test_churn)
+{
+  GstElement *pipeline, *tee, *previous = NULL;
+  GstStructure *stats;
+  guint64 attached = 0, detached = 0, before, after;
+  gint64 start, elapsed;
+  gboolean ret;
+
+  pipeline = gst_parse_launch ("dynamictee name=t "
+      "fakesrc sizetype=2 sizemax=4096 ! t.video_sink "
+      "fakesrc sizetype=2 sizemax=512 ! t.audio_sink", NULL);
+  fail_unless (pipeline != NULL);
+  tee = gst_bin_get_by_name (GST_BIN (pipeline), "t");
+
+  fail_unless (gst_element_set_state (pipeline, GST_STATE_PLAYING) !=
+      GST_STATE_CHANGE_FAILURE);
+  gst_element_get_state (pipeline, NULL, NULL, GST_CLOCK_TIME_NONE);
+
+  before = get_video_buffers (tee);
+  start = g_get_monotonic_time ();
+
+  for (guint i = 0; i < CHURN_OPERATIONS; i++) {
+    GstElement *branch = make_branch ();
+
+    g_signal_emit_by_name (tee, "start", branch, &ret);
+    fail_unless (ret);
+
+    if (previous != NULL) {
+      g_signal_emit_by_name (tee, "stop", previous, &ret);
+      fail_unless (ret);
+    }
+    previous = branch;
+
+    g_usleep (CHURN_INTERVAL_US);
+  }
+
+  elapsed = g_get_monotonic_time () - start;
+  after = get_video_buffers (tee);
+
+  GST_INFO ("%d attach/detach in %" G_GINT64_FORMAT " us, %" G_GUINT64_FORMAT
+      " video buffers pushed (%.0f buffers/s)", CHURN_OPERATIONS, elapsed,
+      after - before, (after - before) * (gdouble) G_USEC_PER_SEC / elapsed);
+
+  fail_unless (after > before);
+
+  g_object_get (tee, "stats", &stats, NULL);
+  gst_structure_get_uint64 (stats, "attached", &attached);
+  gst_structure_get_uint64 (stats, "detached", &detached);
+  gst_structure_free (stats);
+
+  fail_unless_equals_uint64 (attached, CHURN_OPERATIONS);
+  fail_unless_equals_uint64 (detached, CHURN_OPERATIONS - 1);
+
+  /* cleanup */
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (tee);
+  gst_object_unref (pipeline);
+}
+
+GST_END_TEST;
+
+static GstPadProbeReturn
+drop_eos (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  if (GST_EVENT_TYPE (GST_PAD_PROBE_INFO_EVENT (info)) == GST_EVENT_EOS)
+    return GST_PAD_PROBE_DROP;
+
+  return GST_PAD_PROBE_OK;
+}
+
+static guint64
+wait_for_teardowns (GstElement * tee, guint64 expected)
+{
+  guint64 teardowns = 0;
+
+  for (guint i = 0; i < 100 && teardowns < expected; i++) {
+    GstStructure *stats;
+
+    g_object_get (tee, "stats", &stats, NULL);
+    gst_structure_get_uint64 (stats, "teardowns", &teardowns);
+    gst_structure_free (stats);
+
+    if (teardowns < expected)
+      g_usleep (50 * 1000);
+  }
+
+  return teardowns;
+}
+
+/*
+ * Stopped branches are removed by the reaper thread without any main loop,
+ * including a branch that never lets its EOS through.
+ */
+GST_START_TEST (test_teardown)
+{
+  GstElement *pipeline, *tee, *branches[10];
+  GstStructure *stats;
+  guint64 timeouts = 0;
+  gboolean ret;
+  GstPad *pad;
+
+  pipeline = gst_parse_launch ("dynamictee name=t teardown-timeout=200000000 "
+      "fakesrc sizetype=2 sizemax=4096 ! t.video_sink "
+      "fakesrc sizetype=2 sizemax=512 ! t.audio_sink", NULL);
+  fail_unless (pipeline != NULL);
+  tee = gst_bin_get_by_name (GST_BIN (pipeline), "t");
+
+  fail_unless (gst_element_set_state (pipeline, GST_STATE_PLAYING) !=
+      GST_STATE_CHANGE_FAILURE);
+  gst_element_get_state (pipeline, NULL, NULL, GST_CLOCK_TIME_NONE);
+
+  for (guint i = 0; i < G_N_ELEMENTS (branches); i++) {
+    branches[i] = make_branch ();
+    g_signal_emit_by_name (tee, "start", branches[i], &ret);
+    fail_unless (ret);
+  }
+
+  pad = gst_element_get_static_pad (branches[0], "video_sink");
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, drop_eos, NULL,
+      NULL);
+  gst_object_unref (pad);
+
+  g_usleep (50 * 1000);
+
+  for (guint i = 0; i < G_N_ELEMENTS (branches); i++) {
+    g_signal_emit_by_name (tee, "stop", branches[i], &ret);
+    fail_unless (ret);
+  }
+
+  fail_unless_equals_uint64 (wait_for_teardowns (tee, G_N_ELEMENTS (branches)),
+      G_N_ELEMENTS (branches));
+  fail_unless_equals_int (GST_BIN_NUMCHILDREN (tee), 0);
+
+  g_object_get (tee, "stats", &stats, NULL);
+  gst_structure_get_uint64 (stats, "teardown-timeouts", &timeouts);
+  gst_structure_free (stats);
+  fail_unless_equals_uint64 (timeouts, 1);
+
+  /* cleanup */
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (tee);
+  gst_object_unref (pipeline);
+}
+
+GST_END_TEST;
+
+
+static Suite * dynamictee_suite(){
+    Suite *s = suite_create ("dynamictee");
+    TCase *tc_chain = tcase_create ("general");
+    suite_add_tcase (s, tc_chain);
+    tcase_add_test (tc_chain, test_churn);
+    tcase_add_test (tc_chain, test_teardown);
+
+    return s;
+}
+
+GST_CHECK_MAIN (dynamictee);
@@ -0,0 +1,218 @@
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#ifdef HAVE_VALGRIND
+# include <valgrind/valgrind.h>
+#endif
+
+#include <gst/check/gstcheck.h>
+#include <gst/check/gstconsistencychecker.h>
+#include <gst/check/gstharness.h>
+
+#include <gst/gst.h>
+
+#define N_PIPELINES 64
+#define N_BUFFERS 500
+
+static void
+on_handoff (GstElement * sink, GstBuffer * buffer, GstPad * pad,
+    gpointer user_data)
+{
+  g_atomic_int_inc ((gint *) user_data);
+}
+
+/*
+ * Many non leaky poolqueues share the pool: every buffer and the EOS must
+ * get through, in order, on no more threads than there are cores.
+ */
+GST_START_TEST (test_many_queues)
+{
+  GstElement *pipelines[N_PIPELINES];
+  gint received[N_PIPELINES] = { 0 };
+  guint64 runs = 0, steals = 0;
+  guint threads = 0;
+
+  for (guint i = 0; i < N_PIPELINES; i++) {
+    GstElement *sink;
+
+    pipelines[i] = gst_parse_launch ("fakesrc num-buffers=500 sizetype=2 "
+        "sizemax=1024 ! poolqueue name=q leaky=false max-size-buffers=8 ! "
+        "fakesink name=sink sync=false signal-handoffs=true", NULL);
+    fail_unless (pipelines[i] != NULL);
+
+    sink = gst_bin_get_by_name (GST_BIN (pipelines[i]), "sink");
+    g_signal_connect (sink, "handoff", G_CALLBACK (on_handoff), &received[i]);
+    gst_object_unref (sink);
+  }
+
+  for (guint i = 0; i < N_PIPELINES; i++) {
+    fail_unless (gst_element_set_state (pipelines[i],
+            GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE);
+  }
+
+  for (guint i = 0; i < N_PIPELINES; i++) {
+    GstBus *bus = gst_element_get_bus (pipelines[i]);
+    GstMessage *msg = gst_bus_timed_pop_filtered (bus, 10 * GST_SECOND,
+        GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+
+    fail_unless (msg != NULL);
+    fail_unless_equals_int (GST_MESSAGE_TYPE (msg), GST_MESSAGE_EOS);
+    gst_message_unref (msg);
+    gst_object_unref (bus);
+
+    fail_unless_equals_int (g_atomic_int_get (&received[i]), N_BUFFERS);
+  }
+
+  for (guint i = 0; i < N_PIPELINES; i++) {
+    GstElement *queue = gst_bin_get_by_name (GST_BIN (pipelines[i]), "q");
+    GstStructure *stats;
+    guint64 queue_runs = 0, queue_steals = 0, dropped = 0;
+
+    g_object_get (queue, "stats", &stats, NULL);
+    gst_structure_get_uint64 (stats, "runs", &queue_runs);
+    gst_structure_get_uint64 (stats, "steals", &queue_steals);
+    gst_structure_get_uint64 (stats, "dropped", &dropped);
+    gst_structure_get_uint (stats, "pool-threads", &threads);
+    gst_structure_free (stats);
+    gst_object_unref (queue);
+
+    fail_unless_equals_uint64 (dropped, 0);
+    fail_unless (queue_runs > 0);
+    runs += queue_runs;
+    steals += queue_steals;
+  }
+
+  fail_unless (threads > 0 && threads <= g_get_num_processors ());
+  GST_INFO ("%d queues drained in %" G_GUINT64_FORMAT " runs on %u threads, "
+      "%" G_GUINT64_FORMAT " stolen", N_PIPELINES, runs, threads, steals);
+
+  /* cleanup */
+  for (guint i = 0; i < N_PIPELINES; i++) {
+    gst_element_set_state (pipelines[i], GST_STATE_NULL);
+    gst_object_unref (pipelines[i]);
+  }
+}
+
+GST_END_TEST;
+
+/*
+ * A leaky poolqueue never blocks upstream and counts what it dropped.
+ */
+GST_START_TEST (test_leaky)
+{
+  GstElement *pipeline;
+  GstElement *queue;
+  GstStructure *stats;
+  GstBus *bus;
+  GstMessage *msg;
+  gint received = 0;
+  guint64 dropped = 0;
+
+  pipeline = gst_parse_launch ("fakesrc num-buffers=200 ! "
+      "poolqueue name=q max-size-buffers=1 ! identity sleep-time=1000 ! "
+      "fakesink name=sink sync=false signal-handoffs=true",
+      NULL);
+  fail_unless (pipeline != NULL);
+
+  GstElement *sink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+  g_signal_connect (sink, "handoff", G_CALLBACK (on_handoff), &received);
+  gst_object_unref (sink);
+
+  fail_unless (gst_element_set_state (pipeline,
+          GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE);
+
+  bus = gst_element_get_bus (pipeline);
+  msg = gst_bus_timed_pop_filtered (bus, 10 * GST_SECOND,
+      GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  fail_unless (msg != NULL);
+  fail_unless_equals_int (GST_MESSAGE_TYPE (msg), GST_MESSAGE_EOS);
+  gst_message_unref (msg);
+  gst_object_unref (bus);
+
+  queue = gst_bin_get_by_name (GST_BIN (pipeline), "q");
+  g_object_get (queue, "stats", &stats, NULL);
+  gst_structure_get_uint64 (stats, "dropped", &dropped);
+  gst_structure_free (stats);
+  gst_object_unref (queue);
+
+  fail_unless_equals_uint64 (dropped + received, 200);
+
+  /* cleanup */
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+}
+
+GST_END_TEST;
+
+/*
+ * A downstream slow enough to block a pool thread moves the queue to a
+ * task of its own, and every buffer still gets through.
+ */
+GST_START_TEST (test_blocking_downstream)
+{
+  GstElement *pipeline;
+  GstElement *queue;
+  GstStructure *stats;
+  GstBus *bus;
+  GstMessage *msg;
+  gint received = 0;
+  guint64 blocking = 0, fallbacks = 0;
+  gboolean dedicated = FALSE;
+
+  pipeline = gst_parse_launch ("fakesrc num-buffers=20 ! "
+      "poolqueue name=q leaky=false max-size-buffers=4 ! "
+      "identity sleep-time=50000 ! "
+      "fakesink name=sink sync=false signal-handoffs=true", NULL);
+  fail_unless (pipeline != NULL);
+
+  GstElement *sink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+  g_signal_connect (sink, "handoff", G_CALLBACK (on_handoff), &received);
+  gst_object_unref (sink);
+
+  fail_unless (gst_element_set_state (pipeline,
+          GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE);
+
+  bus = gst_element_get_bus (pipeline);
+  msg = gst_bus_timed_pop_filtered (bus, 10 * GST_SECOND,
+      GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  fail_unless (msg != NULL);
+  fail_unless_equals_int (GST_MESSAGE_TYPE (msg), GST_MESSAGE_EOS);
+  gst_message_unref (msg);
+  gst_object_unref (bus);
+
+  fail_unless_equals_int (g_atomic_int_get (&received), 20);
+
+  queue = gst_bin_get_by_name (GST_BIN (pipeline), "q");
+  g_object_get (queue, "stats", &stats, NULL);
+  gst_structure_get_uint64 (stats, "blocking-pushes", &blocking);
+  gst_structure_get_boolean (stats, "dedicated", &dedicated);
+  gst_structure_get_uint64 (stats, "fallbacks", &fallbacks);
+  gst_structure_free (stats);
+  gst_object_unref (queue);
+
+  fail_unless (blocking > 0);
+  fail_unless (dedicated);
+  /* moved to its task once, and stayed there while downstream was slow */
+  fail_unless_equals_uint64 (fallbacks, 1);
+
+  /* cleanup */
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+}
+
+GST_END_TEST;
+
+
+static Suite * poolqueue_suite(){
+    Suite *s = suite_create ("poolqueue");
+    TCase *tc_chain = tcase_create ("general");
+    suite_add_tcase (s, tc_chain);
+    tcase_add_test (tc_chain, test_many_queues);
+    tcase_add_test (tc_chain, test_leaky);
+    tcase_add_test (tc_chain, test_blocking_downstream);
+
+    return s;
+}
+
+GST_CHECK_MAIN (poolqueue);
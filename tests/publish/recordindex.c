@@ -0,0 +1,73 @@
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#ifdef HAVE_VALGRIND
+# include <valgrind/valgrind.h>
+#endif
+
+#include <gst/check/gstcheck.h>
+
+#include <gst/gst.h>
+
+#include <glib/gstdio.h>
+
+#include <common/gstrecordindex.h>
+
+/* Entries are read back from the mapped file as written, and a lookup
+ * lands on the keyframe at or before the requested time. */
+GST_START_TEST (test_record_index)
+{
+  GstRecordIndexWriter *writer;
+  GstRecordIndex *index;
+  GstRecordIndexEntry entry;
+  GError *error = NULL;
+  gchar *path;
+
+  path = g_build_filename (g_get_tmp_dir (), "recordindex-test.mp4.idx", NULL);
+
+  writer = gst_record_index_writer_new (path, &error);
+  fail_unless (writer != NULL);
+  for (guint i = 0; i < 10; i++) {
+    entry.pts = i * 2 * GST_SECOND;
+    entry.offset = 48 + i * 100000;
+    entry.size = 20000 + i;
+    entry.flags = 0;
+    fail_unless (gst_record_index_writer_append (writer, &entry));
+  }
+  gst_record_index_writer_free (writer);
+
+  index = gst_record_index_open (path, &error);
+  fail_unless (index != NULL);
+  fail_unless_equals_int (gst_record_index_get_n_entries (index), 10);
+
+  fail_unless (gst_record_index_get_entry (index, 3, &entry));
+  fail_unless_equals_uint64 (entry.pts, 6 * GST_SECOND);
+  fail_unless_equals_uint64 (entry.offset, 300048);
+  fail_unless_equals_int (entry.size, 20003);
+  fail_if (gst_record_index_get_entry (index, 10, &entry));
+
+  fail_unless_equals_int (gst_record_index_lookup (index, 0), 0);
+  fail_unless_equals_int (gst_record_index_lookup (index, 7 * GST_SECOND), 3);
+  fail_unless_equals_int (gst_record_index_lookup (index, 8 * GST_SECOND), 4);
+  fail_unless_equals_int (gst_record_index_lookup (index, 60 * GST_SECOND), 9);
+
+  gst_record_index_close (index);
+
+  g_unlink (path);
+  g_free (path);
+}
+
+GST_END_TEST;
+
+
+static Suite * index_suite(){
+    Suite *s = suite_create ("recordindex");
+    TCase *tc_chain = tcase_create ("general");
+    suite_add_tcase (s, tc_chain);
+    tcase_add_test (tc_chain, test_record_index);
+
+    return s;
+}
+
+GST_CHECK_MAIN (index);
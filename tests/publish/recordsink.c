@@ -21,8 +21,35 @@
 GST_START_TEST (test_record)
 {
   GstElement *recordsink;
+  GstStructure *stats = NULL;
+  guint duration = 0;
+  guint64 recorded = 1;
+  gboolean fragmented = TRUE;
+
   GST_INFO ("preparing test");
   recordsink = gst_element_factory_make ("recordsink", NULL);
+  fail_unless (recordsink != NULL);
+
+  g_object_set (recordsink, "expected-duration", 3600, NULL);
+  g_object_get (recordsink, "expected-duration", &duration, NULL);
+  fail_unless_equals_int (duration, 3600);
+
+  /* the moov goes at EOS unless fragments are asked for */
+  g_object_get (recordsink, "fragmented", &fragmented, NULL);
+  fail_unless (!fragmented);
+
+  g_object_set (recordsink, "disk-reserve", 30, NULL);
+  g_object_get (recordsink, "disk-reserve", &duration, NULL);
+  fail_unless_equals_int (duration, 30);
+  gst_util_set_object_arg (G_OBJECT (recordsink), "disk-policy", "rotate");
+
+  /* nothing recorded yet */
+  g_object_set (recordsink, "parse", FALSE, NULL);
+  g_object_get (recordsink, "stats", &stats, NULL);
+  fail_unless (stats != NULL);
+  fail_unless (gst_structure_get_uint64 (stats, "duration", &recorded));
+  fail_unless_equals_uint64 (recorded, 0);
+  gst_structure_free (stats);
 
   /* cleanup */
   gst_object_unref (recordsink);
@@ -0,0 +1,95 @@
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#ifdef HAVE_VALGRIND
+# include <valgrind/valgrind.h>
+#endif
+
+#include <gst/check/gstcheck.h>
+#include <gst/check/gstconsistencychecker.h>
+#include <gst/check/gstharness.h>
+
+#include <gst/gst.h>
+
+#include <glib/gstdio.h>
+
+#define CHUNK_SIZE 4096
+
+static GstBuffer *
+make_buffer (gsize size, guint8 value)
+{
+  GstBuffer *buffer = gst_buffer_new_allocate (NULL, size, NULL);
+
+  gst_buffer_memset (buffer, 0, value, size);
+  return buffer;
+}
+
+/* Buffers are regrouped across the chunk boundaries, a bytes segment
+ * rewrites earlier data like the muxer does for its headers, and the file
+ * ends up with exactly the bytes pushed. */
+GST_START_TEST (test_record_writer)
+{
+  GstHarness *h;
+  GstStructure *stats = NULL;
+  GstSegment segment;
+  gchar *path, *contents = NULL;
+  gsize length = 0;
+  guint64 bytes = 0, syncs = 0;
+
+  path = g_build_filename (g_get_tmp_dir (), "recordwriter-test.bin", NULL);
+
+  h = gst_harness_new ("recordwriter");
+  g_object_set (h->element, "location", path, "buffer-size", CHUNK_SIZE,
+      "preallocate", (guint64) 65536, "write-behind", (guint64) 8192, NULL);
+  gst_harness_set_src_caps_str (h, "application/octet-stream");
+
+  fail_unless_equals_int (gst_harness_push (h, make_buffer (3000, 'a')), GST_FLOW_OK);
+  fail_unless_equals_int (gst_harness_push (h, make_buffer (3000, 'b')), GST_FLOW_OK);
+  fail_unless_equals_int (gst_harness_push (h, make_buffer (10000, 'c')), GST_FLOW_OK);
+
+  gst_segment_init (&segment, GST_FORMAT_BYTES);
+  segment.start = 0;
+  fail_unless (gst_harness_push_event (h, gst_event_new_segment (&segment)));
+  fail_unless_equals_int (gst_harness_push (h, make_buffer (8, 'h')), GST_FLOW_OK);
+
+  fail_unless (gst_harness_push_event (h, gst_event_new_eos ()));
+
+  g_object_get (h->element, "stats", &stats, NULL);
+  fail_unless (gst_structure_get_uint64 (stats, "bytes", &bytes));
+  fail_unless (gst_structure_get_uint64 (stats, "syncs", &syncs));
+  fail_unless_equals_uint64 (bytes, 16008);
+  fail_unless_equals_uint64 (syncs, 1);
+  gst_structure_free (stats);
+
+  gst_harness_teardown (h);
+
+  /* the preallocated blocks are not part of the file */
+  fail_unless (g_file_get_contents (path, &contents, &length, NULL));
+  fail_unless_equals_int (length, 16000);
+  fail_unless_equals_int (contents[0], 'h');
+  fail_unless_equals_int (contents[7], 'h');
+  fail_unless_equals_int (contents[8], 'a');
+  fail_unless_equals_int (contents[2999], 'a');
+  fail_unless_equals_int (contents[3000], 'b');
+  fail_unless_equals_int (contents[6000], 'c');
+  fail_unless_equals_int (contents[15999], 'c');
+
+  g_free (contents);
+  g_unlink (path);
+  g_free (path);
+}
+
+GST_END_TEST;
+
+
+static Suite * writer_suite(){
+    Suite *s = suite_create ("recordwriter");
+    TCase *tc_chain = tcase_create ("general");
+    suite_add_tcase (s, tc_chain);
+    tcase_add_test (tc_chain, test_record_writer);
+
+    return s;
+}
+
+GST_CHECK_MAIN (writer);
@@ -0,0 +1,164 @@
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#ifdef HAVE_VALGRIND
+# include <valgrind/valgrind.h>
+#endif
+
+#include <gst/check/gstcheck.h>
+#include <gst/check/gstconsistencychecker.h>
+#include <gst/check/gstharness.h>
+
+#include <gst/gst.h>
+
+#define LOOPBACK_PORT 18888
+
+GST_START_TEST (test_srt_properties)
+{
+  GstElement *srtsink;
+  GstStructure *stats = NULL;
+  guint overhead = 0;
+  gint latency = 0;
+  guint64 bytes = 1;
+
+  GST_INFO ("preparing test");
+  srtsink = gst_element_factory_make ("srtstreamsink", NULL);
+  fail_unless (srtsink != NULL);
+
+  g_object_set (srtsink, "location", "srt://127.0.0.1:9999", "latency", 200,
+      "overhead", 50, NULL);
+  g_object_get (srtsink, "latency", &latency, "overhead", &overhead,
+      "stats", &stats, NULL);
+  fail_unless_equals_int (latency, 200);
+  fail_unless_equals_int (overhead, 50);
+
+  /* not connected yet */
+  fail_unless (stats != NULL);
+  fail_unless (gst_structure_get_uint64 (stats, "bytes-sent", &bytes));
+  fail_unless_equals_uint64 (bytes, 0);
+  gst_structure_free (stats);
+
+  /* cleanup */
+  gst_object_unref (srtsink);
+}
+
+GST_END_TEST;
+
+/* srtsink sets the socket options from its URI query */
+GST_START_TEST (test_srt_bandwidth_options)
+{
+  GstElement *srtsink, *sink;
+  gchar *location = NULL;
+  GstUri *uri;
+
+  srtsink = gst_element_factory_make ("srtstreamsink", NULL);
+  fail_unless (srtsink != NULL);
+  g_object_set (srtsink, "location", "srt://127.0.0.1:9999?maxbw=1000000",
+      "overhead", 40, NULL);
+
+  sink = gst_bin_get_by_name (GST_BIN (srtsink), "sink");
+  fail_unless (sink != NULL);
+  g_object_get (sink, "uri", &location, NULL);
+  uri = gst_uri_from_string (location);
+  fail_unless (uri != NULL);
+  /* the overhead only applies without a fixed maximum */
+  fail_unless_equals_string (gst_uri_get_query_value (uri, "maxbw"), "0");
+  fail_unless_equals_string (gst_uri_get_query_value (uri, "oheadbw"), "40");
+  fail_if (gst_uri_has_query_key (uri, "inputbw"));
+  gst_uri_unref (uri);
+  g_free (location);
+
+  g_object_set (srtsink, "expected-bitrate", 4000000, NULL);
+  g_object_get (sink, "uri", &location, NULL);
+  uri = gst_uri_from_string (location);
+  fail_unless_equals_string (gst_uri_get_query_value (uri, "inputbw"), "500000");
+  gst_uri_unref (uri);
+  g_free (location);
+
+  /* cleanup */
+  gst_object_unref (sink);
+  gst_object_unref (srtsink);
+}
+
+GST_END_TEST;
+
+static void
+handoff_cb (GstElement * fakesink, GstBuffer * buffer, GstPad * pad,
+    gpointer user_data)
+{
+  g_atomic_int_inc ((gint *) user_data);
+}
+
+GST_START_TEST (test_srt_loopback)
+{
+  GstElement *listener, *sender, *fakesink, *srtsink;
+  GstStructure *stats = NULL;
+  gint received = 0;
+  guint64 bytes = 0;
+  gchar *description;
+
+  if (!gst_registry_check_feature_version (gst_registry_get (), "srtsrc", 1, 0, 0)
+      || !gst_registry_check_feature_version (gst_registry_get (), "x264enc", 1, 0, 0)
+      || !gst_registry_check_feature_version (gst_registry_get (), "avenc_aac", 1, 0, 0)) {
+    GST_INFO ("srtsrc, x264enc or avenc_aac missing, skipping");
+    return;
+  }
+
+  description = g_strdup_printf ("srtsrc uri=srt://:%d?mode=listener latency=120 "
+      "! fakesink name=out signal-handoffs=true", LOOPBACK_PORT);
+  listener = gst_parse_launch (description, NULL);
+  g_free (description);
+  fail_unless (listener != NULL);
+  fakesink = gst_bin_get_by_name (GST_BIN (listener), "out");
+  g_signal_connect (fakesink, "handoff", G_CALLBACK (handoff_cb), &received);
+  gst_object_unref (fakesink);
+
+  description = g_strdup_printf ("videotestsrc is-live=true "
+      "! x264enc tune=zerolatency key-int-max=30 ! sink.video_sink "
+      "audiotestsrc is-live=true ! avenc_aac ! sink.audio_sink "
+      "srtstreamsink name=sink location=srt://127.0.0.1:%d", LOOPBACK_PORT);
+  sender = gst_parse_launch (description, NULL);
+  g_free (description);
+  fail_unless (sender != NULL);
+
+  fail_if (gst_element_set_state (listener, GST_STATE_PLAYING) ==
+      GST_STATE_CHANGE_FAILURE);
+  fail_if (gst_element_set_state (sender, GST_STATE_PLAYING) ==
+      GST_STATE_CHANGE_FAILURE);
+
+  srtsink = gst_bin_get_by_name (GST_BIN (sender), "sink");
+  for (gint i = 0; i < 50 && (g_atomic_int_get (&received) == 0 || bytes == 0); i++) {
+    g_usleep (100 * G_USEC_PER_SEC / 1000);
+    g_object_get (srtsink, "stats", &stats, NULL);
+    gst_structure_get_uint64 (stats, "bytes-sent", &bytes);
+    gst_structure_free (stats);
+  }
+  gst_object_unref (srtsink);
+
+  fail_unless (g_atomic_int_get (&received) > 0);
+  fail_unless (bytes > 0);
+
+  /* cleanup */
+  gst_element_set_state (sender, GST_STATE_NULL);
+  gst_element_set_state (listener, GST_STATE_NULL);
+  gst_object_unref (sender);
+  gst_object_unref (listener);
+}
+
+GST_END_TEST;
+
+
+static Suite * srt_suite(){
+    Suite *s = suite_create ("srtstreamsink");
+    TCase *tc_chain = tcase_create ("general");
+    suite_add_tcase (s, tc_chain);
+    tcase_set_timeout (tc_chain, 20);
+    tcase_add_test (tc_chain, test_srt_properties);
+    tcase_add_test (tc_chain, test_srt_bandwidth_options);
+    tcase_add_test (tc_chain, test_srt_loopback);
+
+    return s;
+}
+
+GST_CHECK_MAIN (srt);
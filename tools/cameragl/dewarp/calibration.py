@@ -3,11 +3,12 @@ import cv2
 import glob
 import argparse
 
-def calibrate(path, validation_image, validation_image_dewarped):
+def calibrate(path, validation_image, validation_image_dewarped, output=None):
     """
         :path : jpeg files path
         :validation_image : validation image to test dewarping
         :validation_image_dewarped : path to dewarped image
+        :output : calibration file for the dewarp element
     """
     # Define the chess board rows and columns
     CHECKERBOARD = (6,9)
@@ -63,12 +64,23 @@ def calibrate(path, validation_image, validation_image_dewarped):
     print(D)
     print(map1)
     print(map2)
+
+    if output:
+        height, width = gray.shape
+        with open(output, "w") as f:
+            f.write("[calibration]\n")
+            f.write("width={}\n".format(width))
+            f.write("height={}\n".format(height))
+            f.write("K={}\n".format(";".join(repr(float(v)) for v in K.flatten())))
+            f.write("D={}\n".format(";".join(repr(float(v)) for v in D.flatten())))
+
 if __name__ == "__main__":
     parser = argparse.ArgumentParser(prog='calibration.py',
                     description='Stream Studio Dewarper Calibration')
     parser.add_argument('path')
     parser.add_argument('validation_image')
     parser.add_argument('validation_image_dewarped')
+    parser.add_argument('--output', help='calibration file for the dewarp element')
 
     args = parser.parse_args()
-    calibrate(args.path, args.validation_image, args.validation_image_dewarped)
\ No newline at end of file
+    calibrate(args.path, args.validation_image, args.validation_image_dewarped, args.output)
\ No newline at end of file